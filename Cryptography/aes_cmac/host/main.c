@@ -5,16 +5,25 @@
 #include <tee_client_api.h>
 
 #include "../ta/include/aes_cmac.h"
+#include "shm_pool.h"
 
 const char *message = "hello world\n";
 
 #define BUFFER_LEN 256
 #define MAC_LEN (16)
 
+// 会话期间重复使用的共享内存, 不再每次调用临时申请
+static const struct shm_pool_class shm_classes[] = {
+	{ BUFFER_LEN, 3 },
+};
+
 struct aes_cmac_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
-	uint8_t mac[MAC_LEN];
+	struct shm_pool *pool;
+	struct shm_buf *in;
+	struct shm_buf *mac;
+	struct shm_buf *out;
 };
 
 static void generate_key(struct aes_cmac_ctx *ctx)
@@ -23,20 +32,19 @@ static void generate_key(struct aes_cmac_ctx *ctx)
 	TEEC_Operation op;
 	uint32_t err_origin;
 	uint32_t key_len;
-	uint8_t key[BUFFER_LEN] = {0};
+	uint8_t *key = ctx->out->data;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE,
 									TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = key;
-	op.params[0].tmpref.size = BUFFER_LEN;
+	shm_buf_param(&op.params[0], ctx->out, BUFFER_LEN);
 
 	res = TEEC_InvokeCommand(&ctx->sess, AES_CMAC_GEN_KEY, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "generate key failed\n");
 	}
 
-	key_len = op.params[0].tmpref.size;
+	key_len = op.params[0].memref.size;
 
 	printf("key is :\n");
 	for(uint16_t i = 0; i < key_len; i++) {
@@ -50,24 +58,25 @@ static void do_mac(struct aes_cmac_ctx *ctx)
 	TEEC_Result res;
 	TEEC_Operation op;
 	uint32_t err_origin;
+	uint8_t *mac = ctx->mac->data;
+
+	memcpy(ctx->in->data, message, strlen(message));
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
 									TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = (void *)message;
-	op.params[0].tmpref.size = strlen(message);
-	op.params[1].tmpref.buffer = ctx->mac;
-	op.params[1].tmpref.size = MAC_LEN;
+	shm_buf_param(&op.params[0], ctx->in, strlen(message));
+	shm_buf_param(&op.params[1], ctx->mac, MAC_LEN);
 
 	res = TEEC_InvokeCommand(&ctx->sess, AES_CMAC_GEN_MAC, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "do mac failed\n");
 	}
 
-	uint32_t mac_len = op.params[1].tmpref.size;
+	uint32_t mac_len = op.params[1].memref.size;
 	printf("MAC is :\n");
 	for(uint16_t i = 0; i < mac_len; i++) {
-		printf("%02x", ctx->mac[i]);;
+		printf("%02x", mac[i]);;
 	}
 	printf("\n\n");
 }
@@ -78,13 +87,12 @@ static void verify(struct aes_cmac_ctx *ctx)
 	TEEC_Operation op;
 	uint32_t err_origin;
 
+	// in 和 mac 中仍是 do_mac 时的内容
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
 									TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = (void *)message;
-	op.params[0].tmpref.size = strlen(message);
-	op.params[1].tmpref.buffer = ctx->mac;
-	op.params[1].tmpref.size = MAC_LEN;
+	shm_buf_param(&op.params[0], ctx->in, strlen(message));
+	shm_buf_param(&op.params[1], ctx->mac, MAC_LEN);
 
 	res = TEEC_InvokeCommand(&ctx->sess, AES_CMAC_VERIFY, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
@@ -104,6 +112,15 @@ static void prepare_tee_session(struct aes_cmac_ctx *ctx)
 	    exit(0);
 	}
 
+	ctx->pool = shm_pool_create(&ctx->ctx, shm_classes, sizeof(shm_classes) / sizeof(shm_classes[0]));
+	if (!ctx->pool)
+		errx(1, "shm_pool_create failed");
+	ctx->in = shm_pool_get(ctx->pool, BUFFER_LEN);
+	ctx->mac = shm_pool_get(ctx->pool, MAC_LEN);
+	ctx->out = shm_pool_get(ctx->pool, BUFFER_LEN);
+	if(!ctx->in || !ctx->mac || !ctx->out)
+		errx(1, "shm_pool_get failed");
+
 	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
 			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
 	if (res != TEEC_SUCCESS) {
@@ -122,6 +139,10 @@ static void example(struct aes_cmac_ctx *ctx)
 static void terminate_tee_session(struct aes_cmac_ctx *ctx)
 {
 	TEEC_CloseSession(&ctx->sess);
+	shm_pool_put(ctx->pool, ctx->in);
+	shm_pool_put(ctx->pool, ctx->mac);
+	shm_pool_put(ctx->pool, ctx->out);
+	shm_pool_destroy(ctx->pool);
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
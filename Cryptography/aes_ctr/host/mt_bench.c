@@ -0,0 +1,227 @@
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <tee_client_api.h>
+
+#include "../ta/include/aes_ctr.h"
+#include "session_pool.h"
+#include "shm_pool.h"
+
+/*
+ * 多线程 AES-CTR 吞吐测试, 线程通过会话池借用会话, 每次加密借出一次, 加密完立即归还
+ *
+ * TA 为 TA_FLAG_SINGLE_INSTANCE | TA_FLAG_MULTI_SESSION, 所有会话共用一个 TA 实例,
+ * OP-TEE 同一时刻只允许一个调用进入该实例, 其余调用在安全侧排队.
+ * 因此多线程只能重叠 REE 侧的开销(参数准备, 系统调用, 共享内存映射), TA 内的加密是串行的,
+ * 吞吐随线程数增长到一定程度后趋于平缓; 线程数超过会话数时, 多出的线程在会话池中排队
+ *
+ * aes_ctr_mt [最大线程数] [会话数] [块大小] [每线程加密次数]
+ */
+
+#define DEFAULT_MAX_THREADS		(8)
+#define DEFAULT_SESSIONS		(4)
+#define DEFAULT_BLOCK_SIZE		(4096)
+#define DEFAULT_OPS				(2000)
+
+#define KEY_SIZE				(32)
+#define IV_SIZE					(16)
+
+struct mt_bench {
+	struct session_pool *sessions;
+	struct shm_pool *shm;
+	TEEC_UUID uuid;
+	uint32_t block_size;
+	uint32_t ops;
+};
+
+struct worker {
+	struct mt_bench *bench;
+	pthread_t tid;
+	struct shm_buf *in;
+	struct shm_buf *out;
+	struct shm_buf *iv;
+	uint32_t dead;			// 遇到 TEEC_ERROR_TARGET_DEAD 后重试的次数
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 每个会话(包括 TA 崩溃后重新打开的)都需要先在 TA 中生成密钥
+static TEEC_Result setup_session(TEEC_Session *sess, void *arg)
+{
+	TEEC_Operation op;
+	uint32_t err_origin;
+	uint8_t key[KEY_SIZE];
+
+	(void)arg;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = key;
+	op.params[0].tmpref.size = sizeof(key);
+
+	return TEEC_InvokeCommand(sess, TA_AES_CTR_GEN_KEY, &op, &err_origin);
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct mt_bench *bench = w->bench;
+	struct pooled_session *ps;
+	TEEC_Operation op;
+	TEEC_Result res;
+	uint32_t err_origin;
+
+	for(uint32_t i = 0; i < bench->ops; i++) {
+		ps = session_pool_acquire(bench->sessions, &bench->uuid, -1);
+		if(!ps)
+			errx(1, "session_pool_acquire failed");
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+										TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE);
+		shm_buf_param(&op.params[0], w->in, bench->block_size);
+		shm_buf_param(&op.params[1], w->iv, IV_SIZE);
+		shm_buf_param(&op.params[2], w->out, bench->block_size);
+
+		res = session_pool_invoke(ps, TA_AES_CTR_ENCRYPT, &op, &err_origin);
+		session_pool_release(bench->sessions, ps);
+
+		// TA 崩溃后会话池会重开会话并重新生成密钥, 重试这一块
+		if(res == TEEC_ERROR_TARGET_DEAD) {
+			w->dead++;
+			i--;
+			continue;
+		}
+		if(res != TEEC_SUCCESS)
+			errx(1, "encrypt failed with code 0x%x origin 0x%x", res, err_origin);
+	}
+
+	return NULL;
+}
+
+static void run(struct mt_bench *bench, struct worker *workers, uint32_t threads, double *base)
+{
+	struct session_pool_stats stats;
+	uint64_t start, ns;
+	uint32_t dead = 0;
+	double mbps;
+
+	session_pool_reset_stats(bench->sessions, &bench->uuid);
+
+	start = now_ns();
+	for(uint32_t i = 0; i < threads; i++) {
+		workers[i].dead = 0;
+		if(pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]))
+			errx(1, "pthread_create failed");
+	}
+	for(uint32_t i = 0; i < threads; i++) {
+		pthread_join(workers[i].tid, NULL);
+		dead += workers[i].dead;
+	}
+	ns = now_ns() - start;
+
+	session_pool_stats(bench->sessions, &bench->uuid, &stats);
+
+	// 字节/us 即 MB/s
+	mbps = (double)bench->block_size * bench->ops * threads * 1000 / ns;
+	if(threads == 1)
+		*base = mbps;
+
+	printf("%u,%u,%u,%.1f,%.2f,%.1f,%.1f,%u,%llu,%u\n", threads, stats.sessions, bench->block_size, mbps,
+		*base > 0 ? mbps / *base : 0,
+		stats.acquires ? (double)stats.wait_ns / stats.acquires / 1000 : 0,
+		(double)stats.max_wait_ns / 1000, stats.max_queue_depth,
+		(unsigned long long)stats.reopens, dead);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	struct mt_bench bench;
+	struct worker *workers;
+	uint32_t max_threads = DEFAULT_MAX_THREADS;
+	uint32_t nr_sessions = DEFAULT_SESSIONS;
+	TEEC_UUID uuid = TA_AES_CTR_UUID;
+	struct shm_pool_class classes[2];
+	double base = 0;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.uuid = uuid;
+	bench.block_size = DEFAULT_BLOCK_SIZE;
+	bench.ops = DEFAULT_OPS;
+
+	if(argc > 1)
+		max_threads = strtoul(argv[1], NULL, 0);
+	if(argc > 2)
+		nr_sessions = strtoul(argv[2], NULL, 0);
+	if(argc > 3)
+		bench.block_size = strtoul(argv[3], NULL, 0);
+	if(argc > 4)
+		bench.ops = strtoul(argv[4], NULL, 0);
+	if(!max_threads || !nr_sessions || !bench.block_size || !bench.ops)
+		errx(1, "usage: %s [max threads] [sessions] [block size] [ops per thread]", argv[0]);
+
+	bench.sessions = session_pool_create();
+	if(!bench.sessions)
+		errx(1, "session_pool_create failed");
+
+	if(session_pool_add(bench.sessions, &bench.uuid, nr_sessions, setup_session, NULL))
+		errx(1, "open %u sessions failed", nr_sessions);
+
+	// 共享内存属于会话池的 context, 每个线程独占自己的输入/输出/IV
+	classes[0].size = IV_SIZE;
+	classes[0].count = max_threads;
+	classes[1].size = bench.block_size;
+	classes[1].count = max_threads * 2;
+	bench.shm = shm_pool_create(session_pool_context(bench.sessions), classes, 2);
+	if(!bench.shm)
+		errx(1, "shm_pool_create failed");
+
+	workers = calloc(max_threads, sizeof(*workers));
+	if(!workers)
+		errx(1, "out of memory");
+
+	for(uint32_t i = 0; i < max_threads; i++) {
+		workers[i].bench = &bench;
+		workers[i].iv = shm_pool_get(bench.shm, IV_SIZE);
+		workers[i].in = shm_pool_get(bench.shm, bench.block_size);
+		workers[i].out = shm_pool_get(bench.shm, bench.block_size);
+		if(!workers[i].iv || !workers[i].in || !workers[i].out)
+			errx(1, "shm_pool_get failed");
+
+		memset(workers[i].iv->data, (int)i, IV_SIZE);
+		memset(workers[i].in->data, 0x5a, bench.block_size);
+	}
+
+	printf("threads,sessions,block_size,mb_per_s,scaling,avg_wait_us,max_wait_us,max_queue_depth,reopens,retries\n");
+	for(uint32_t threads = 1; threads <= max_threads; threads *= 2)
+		run(&bench, workers, threads, &base);
+
+	for(uint32_t i = 0; i < max_threads; i++) {
+		shm_pool_put(bench.shm, workers[i].iv);
+		shm_pool_put(bench.shm, workers[i].in);
+		shm_pool_put(bench.shm, workers[i].out);
+	}
+	free(workers);
+	shm_pool_destroy(bench.shm);
+	session_pool_destroy(bench.sessions);
+
+	return 0;
+}
+
+/**
+ * @brief 配置到开发板指令
+
+ * scp aes_ctr/ta/e2366aab-1c0a-412a-9b81-53f9d3821fc1.ta wenshuyu@192.168.1.6:/lib/optee_armtz
+ * scp aes_ctr/host/aes_ctr_mt wenshuyu@192.168.1.6:/usr/bin
+ * aes_ctr_mt 8 4 4096 2000
+ */
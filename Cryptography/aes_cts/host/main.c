@@ -5,6 +5,7 @@
 #include <tee_client_api.h>
 
 #include "../ta/include/aes_cts.h"
+#include "shm_pool.h"
 
 const char *plain_src = "hello world hello world\n"; // plain text size must > 16(a block)
 
@@ -14,10 +15,18 @@ const char *plain_src = "hello world hello world\n"; // plain text size must > 1
 uint8_t cipher_buf[BUFFER_LEN] = {0};
 uint16_t cipher_len;
 
+// 会话期间重复使用的共享内存, 不再每次调用临时申请
+static const struct shm_pool_class shm_classes[] = {
+	{ BUFFER_LEN, 3 },
+};
+
 struct aes_cts_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
-	uint8_t iv[IV_SIZE];
+	struct shm_pool *pool;
+	struct shm_buf *iv;
+	struct shm_buf *in;
+	struct shm_buf *out;
 };
 
 static void generate_key(struct aes_cts_ctx *ctx)
@@ -26,20 +35,19 @@ static void generate_key(struct aes_cts_ctx *ctx)
 	TEEC_Operation op;
 	uint32_t err_origin;
 	uint32_t key_len;
-	uint8_t key[BUFFER_LEN] = {0};
+	uint8_t *key = ctx->out->data;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE,
 									TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = key;
-	op.params[0].tmpref.size = BUFFER_LEN;
+	shm_buf_param(&op.params[0], ctx->out, BUFFER_LEN);
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CTS_GEN_KEY, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "generate key failed\n");
 	}
 
-	key_len = op.params[0].tmpref.size;
+	key_len = op.params[0].memref.size;
 
 	printf("key is :\n");
 	for(uint16_t i = 0; i < key_len; i++) {
@@ -53,12 +61,12 @@ static void generate_iv(struct aes_cts_ctx *ctx)
 	TEEC_Result res;
 	TEEC_Operation op;
 	uint32_t err_origin;
+	uint8_t *iv = ctx->iv->data;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE,
 									TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = ctx->iv;
-	op.params[0].tmpref.size = IV_SIZE;
+	shm_buf_param(&op.params[0], ctx->iv, IV_SIZE);
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CTS_GEN_IV, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
@@ -67,7 +75,7 @@ static void generate_iv(struct aes_cts_ctx *ctx)
 
 	printf("IV is :\n");
 	for(uint16_t i = 0; i < IV_SIZE; i++) {
-		printf("%02x", ctx->iv[i]);
+		printf("%02x", iv[i]);
 	}
 	printf("\n\n");
 }
@@ -78,22 +86,22 @@ static void encrypt(struct aes_cts_ctx *ctx)
 	TEEC_Operation op;
 	uint32_t err_origin;
 
+	memcpy(ctx->in->data, plain_src, strlen(plain_src));
+
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
-									TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE);
-	op.params[0].tmpref.buffer = (void *)plain_src;
-	op.params[0].tmpref.size = strlen(plain_src);
-	op.params[1].tmpref.buffer = ctx->iv;
-	op.params[1].tmpref.size = IV_SIZE;
-	op.params[2].tmpref.buffer = (void *)cipher_buf;
-	op.params[2].tmpref.size = BUFFER_LEN;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+									TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE);
+	shm_buf_param(&op.params[0], ctx->in, strlen(plain_src));
+	shm_buf_param(&op.params[1], ctx->iv, IV_SIZE);
+	shm_buf_param(&op.params[2], ctx->out, BUFFER_LEN);
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CTS_ENCRYPT, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "encrypt failed\n");
 	}
 
-	cipher_len = op.params[2].tmpref.size;
+	cipher_len = op.params[2].memref.size;
+	memcpy(cipher_buf, ctx->out->data, cipher_len);
 	printf("cipher text is :\n");
 	for(uint16_t i = 0; i < cipher_len; i++) {
 		printf("%02x", cipher_buf[i]);;
@@ -107,24 +115,23 @@ static void decrypt(struct aes_cts_ctx *ctx)
 	TEEC_Operation op;
 	uint32_t err_origin;
 	uint32_t plain_len;
-	uint8_t plain_buf[BUFFER_LEN];
+	uint8_t *plain_buf = ctx->out->data;
+
+	memcpy(ctx->in->data, cipher_buf, cipher_len);
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
-									TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE);
-	op.params[0].tmpref.buffer = cipher_buf;
-	op.params[0].tmpref.size = cipher_len;
-	op.params[1].tmpref.buffer = ctx->iv;
-	op.params[1].tmpref.size = IV_SIZE;
-	op.params[2].tmpref.buffer = plain_buf;
-	op.params[2].tmpref.size = BUFFER_LEN;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+									TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE);
+	shm_buf_param(&op.params[0], ctx->in, cipher_len);
+	shm_buf_param(&op.params[1], ctx->iv, IV_SIZE);
+	shm_buf_param(&op.params[2], ctx->out, BUFFER_LEN);
 
 	res = TEEC_InvokeCommand(&ctx->sess, TA_AES_CTS_DECRYPT, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "decrypt failed\n");
 	}
 
-	plain_len = op.params[2].tmpref.size;
+	plain_len = op.params[2].memref.size;
 	printf("plain text is :\n");
 	for(uint16_t i = 0; i < plain_len; i++) {
 		printf("%c", plain_buf[i]);;
@@ -144,6 +151,15 @@ static void prepare_tee_session(struct aes_cts_ctx *ctx)
 	    exit(0);
 	}
 
+	ctx->pool = shm_pool_create(&ctx->ctx, shm_classes, sizeof(shm_classes) / sizeof(shm_classes[0]));
+	if (!ctx->pool)
+		errx(1, "shm_pool_create failed");
+	ctx->iv = shm_pool_get(ctx->pool, IV_SIZE);
+	ctx->in = shm_pool_get(ctx->pool, BUFFER_LEN);
+	ctx->out = shm_pool_get(ctx->pool, BUFFER_LEN);
+	if(!ctx->iv || !ctx->in || !ctx->out)
+		errx(1, "shm_pool_get failed");
+
 	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
 			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
 	if (res != TEEC_SUCCESS) {
@@ -163,6 +179,10 @@ static void example(struct aes_cts_ctx *ctx)
 static void terminate_tee_session(struct aes_cts_ctx *ctx)
 {
 	TEEC_CloseSession(&ctx->sess);
+	shm_pool_put(ctx->pool, ctx->iv);
+	shm_pool_put(ctx->pool, ctx->in);
+	shm_pool_put(ctx->pool, ctx->out);
+	shm_pool_destroy(ctx->pool);
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
@@ -5,6 +5,7 @@
 #include <tee_client_api.h>
 
 #include "../ta/include/aes_gcm.h"
+#include "shm_pool.h"
 
 const char *plain_text = "hello world\n";
 
@@ -15,11 +16,19 @@ const char *plain_text = "hello world\n";
 uint8_t cipher_len;
 uint8_t cipher_buf[BUFFER_SZIE];
 
+// 会话期间重复使用的共享内存, 不再每次调用临时申请
+static const struct shm_pool_class shm_classes[] = {
+	{ BUFFER_SZIE, 4 },
+};
+
 struct aes_gcm_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
-	uint8_t iv[IV_SIZE];
-	uint8_t tag[TAG_SIZE];
+	struct shm_pool *pool;
+	struct shm_buf *iv;
+	struct shm_buf *tag;
+	struct shm_buf *in;
+	struct shm_buf *out;
 };
 
 static void generate_key(struct aes_gcm_ctx *ctx)
@@ -29,32 +38,31 @@ static void generate_key(struct aes_gcm_ctx *ctx)
 	uint32_t err_origin;
 	uint32_t key_len;
 	uint32_t iv_len;
-	uint8_t key[BUFFER_SZIE] = {0};
+	uint8_t *key = ctx->out->data;
+	uint8_t *iv = ctx->iv->data;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_MEMREF_TEMP_OUTPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
 									TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = key;
-	op.params[0].tmpref.size = BUFFER_SZIE;
-	op.params[1].tmpref.buffer = ctx->iv;
-	op.params[1].tmpref.size = IV_SIZE;
+	shm_buf_param(&op.params[0], ctx->out, BUFFER_SZIE);
+	shm_buf_param(&op.params[1], ctx->iv, IV_SIZE);
 
 	res = TEEC_InvokeCommand(&ctx->sess, AES_GCM_GEN_KEY, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "generate key failed\n");
 	}
 
-	key_len = op.params[0].tmpref.size;
+	key_len = op.params[0].memref.size;
 	printf("key is :\n");
 	for(uint16_t i = 0; i < key_len; i++) {
 		printf("%02x", key[i]);
 	}
 	printf("\n\n");
 
-	iv_len = op.params[1].tmpref.size;
+	iv_len = op.params[1].memref.size;
 	printf("iv is :\n");
 	for(uint16_t i = 0; i < iv_len; i++) {
-		printf("%02x", ctx->iv[i]);
+		printf("%02x", iv[i]);
 	}
 	printf("\n\n");
 }
@@ -64,35 +72,35 @@ static void encrypt(struct aes_gcm_ctx *ctx)
 	TEEC_Result res;
 	TEEC_Operation op;
 	uint32_t err_origin;
+	uint8_t *tag = ctx->tag->data;
+
+	memcpy(ctx->in->data, plain_text, strlen(plain_text));
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
-									TEEC_MEMREF_TEMP_OUTPUT, TEEC_MEMREF_TEMP_OUTPUT);
-	op.params[0].tmpref.buffer = (void *)plain_text;
-	op.params[0].tmpref.size = strlen(plain_text);
-	op.params[1].tmpref.buffer = ctx->iv;
-	op.params[1].tmpref.size = IV_SIZE;
-	op.params[2].tmpref.buffer = cipher_buf;
-	op.params[2].tmpref.size = BUFFER_SZIE;
-	op.params[3].tmpref.buffer = ctx->tag;
-	op.params[3].tmpref.size = TAG_SIZE;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+									TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_MEMREF_PARTIAL_OUTPUT);
+	shm_buf_param(&op.params[0], ctx->in, strlen(plain_text));
+	shm_buf_param(&op.params[1], ctx->iv, IV_SIZE);
+	shm_buf_param(&op.params[2], ctx->out, BUFFER_SZIE);
+	shm_buf_param(&op.params[3], ctx->tag, TAG_SIZE);
 
 	res = TEEC_InvokeCommand(&ctx->sess, AES_GCM_AE_ENCRYPR, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "encryptfailed\n");
 	}
 
-	cipher_len = op.params[2].tmpref.size;
+	cipher_len = op.params[2].memref.size;
+	memcpy(cipher_buf, ctx->out->data, cipher_len);
 	printf("cipher text is :\n");
 	for(uint16_t i = 0; i < cipher_len; i++) {
 		printf("%02x", cipher_buf[i]);;
 	}
 	printf("\n\n");
 
-	uint32_t tag_len = op.params[3].tmpref.size;
+	uint32_t tag_len = op.params[3].memref.size;
 	printf("tag is :\n");
 	for(uint16_t i = 0; i < tag_len; i++) {
-		printf("%02x", ctx->tag[i]);;
+		printf("%02x", tag[i]);;
 	}
 	printf("\n\n");
 }
@@ -103,26 +111,24 @@ static void decrypt(struct aes_gcm_ctx *ctx)
 	TEEC_Operation op;
 	uint32_t err_origin;
 	uint32_t plain_len = 0;
-	uint8_t plain_buf[BUFFER_SZIE];
+	uint8_t *plain_buf = ctx->out->data;
+
+	memcpy(ctx->in->data, cipher_buf, cipher_len);
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
-									TEEC_MEMREF_TEMP_OUTPUT, TEEC_MEMREF_TEMP_OUTPUT);
-	op.params[0].tmpref.buffer = cipher_buf;
-	op.params[0].tmpref.size = cipher_len;
-	op.params[1].tmpref.buffer = ctx->iv;
-	op.params[1].tmpref.size = IV_SIZE;
-	op.params[2].tmpref.buffer = plain_buf;
-	op.params[2].tmpref.size = BUFFER_SZIE;
-	op.params[3].tmpref.buffer = ctx->tag;
-	op.params[3].tmpref.size = TAG_SIZE;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
+									TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_MEMREF_PARTIAL_OUTPUT);
+	shm_buf_param(&op.params[0], ctx->in, cipher_len);
+	shm_buf_param(&op.params[1], ctx->iv, IV_SIZE);
+	shm_buf_param(&op.params[2], ctx->out, BUFFER_SZIE);
+	shm_buf_param(&op.params[3], ctx->tag, TAG_SIZE);
 
 	res = TEEC_InvokeCommand(&ctx->sess, AES_GCM_AE_ENCRYPR, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "encryptfailed\n");
 	}
 
-	plain_len = op.params[2].tmpref.size;
+	plain_len = op.params[2].memref.size;
 	printf("plain text is :\n");
 	for(uint16_t i = 0; i < plain_len; i++) {
 		printf("%c", plain_buf[i]);;
@@ -142,6 +148,16 @@ static void prepare_tee_session(struct aes_gcm_ctx *ctx)
 	    exit(0);
 	}
 
+	ctx->pool = shm_pool_create(&ctx->ctx, shm_classes, sizeof(shm_classes) / sizeof(shm_classes[0]));
+	if (!ctx->pool)
+		errx(1, "shm_pool_create failed");
+	ctx->iv = shm_pool_get(ctx->pool, IV_SIZE);
+	ctx->tag = shm_pool_get(ctx->pool, TAG_SIZE);
+	ctx->in = shm_pool_get(ctx->pool, BUFFER_SZIE);
+	ctx->out = shm_pool_get(ctx->pool, BUFFER_SZIE);
+	if(!ctx->iv || !ctx->tag || !ctx->in || !ctx->out)
+		errx(1, "shm_pool_get failed");
+
 	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
 			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
 	if (res != TEEC_SUCCESS) {
@@ -160,6 +176,11 @@ static void example(struct aes_gcm_ctx *ctx)
 static void terminate_tee_session(struct aes_gcm_ctx *ctx)
 {
 	TEEC_CloseSession(&ctx->sess);
+	shm_pool_put(ctx->pool, ctx->iv);
+	shm_pool_put(ctx->pool, ctx->tag);
+	shm_pool_put(ctx->pool, ctx->in);
+	shm_pool_put(ctx->pool, ctx->out);
+	shm_pool_destroy(ctx->pool);
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
@@ -1,5 +1,6 @@
 #include <tee_internal_api.h>
 #include <tee_internal_api_extensions.h>
+#include <string.h>
 
 #include "include/dh_basic.h"
 
@@ -11,194 +12,1343 @@ static int align_to_8(int num) {
         return (num + 8 - (num % 8));
 }
 
+// 多对端密钥环中的一项, last_used 为0表示空闲
+struct peer_key {
+    uint32_t peer_id;
+    uint32_t last_used;
+    TEE_OperationHandle ctr_op;         // 密钥只保存在操作中
+};
+
+// HKDF密钥调度安装的通信密钥, epoch 为0表示尚未调度
+struct channel_keys {
+    TEE_OperationHandle tx_cipher;
+    TEE_OperationHandle tx_mac;
+    TEE_OperationHandle rx_cipher;
+    TEE_OperationHandle rx_mac;
+    TEE_OperationHandle gcm[2];             // AES-GCM, 按 TEE_MODE_ENCRYPT(发送) / TEE_MODE_DECRYPT(接收) 索引
+    uint8_t rekey_secret[HKDF_HASH_SIZE];
+    uint32_t role;
+    uint32_t epoch;
+    uint64_t tx_seq;                        // 下一条发送记录的序号
+    uint64_t rx_seq;                        // 可以接受的最小接收序号
+    uint64_t gcm_tx_seq;                    // 下一个GCM发送 nonce 的计数
+    uint64_t gcm_rx_seq;                    // 可以接受的最小GCM接收计数
+    uint64_t gcm_rx_pending;                // 正在解密的流式记录的计数, 标签通过后才被接受
+    uint32_t gcm_streaming[2];              // 该方向是否有未结束的流式记录
+};
+
 struct dh_basic_ctx {
     TEE_OperationHandle operation;
     TEE_ObjectHandle keypair;
     TEE_ObjectHandle shared_key;
     TEE_ObjectHandle aes_key; 
+    struct peer_key *keyring;
+    uint32_t keyring_size;
+    uint32_t keyring_tick;
+    struct channel_keys channel;
 };
 
-static TEE_Result generate_keypair(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+/*
+ * 预生成的临时密钥对池, TA为单实例, 所有会话共享
+ * 池中的密钥对都属于同一组DH参数(prime/base), 每个密钥对只会被取出一次, 派生完成后立即释放
+ */
+struct keypair_pool {
+    TEE_ObjectHandle keypairs[KEYPAIR_POOL_MAX_DEPTH];
+    uint32_t depth;
+    uint8_t prime[KEYPAIR_BYTES];
+    uint32_t prime_len;
+    uint8_t base[KEYPAIR_BYTES];
+    uint32_t base_len;
+};
+
+static struct keypair_pool pool;
+
+static TEE_Result alloc_keypair(TEE_ObjectHandle *keypair, void *dh_prime, uint32_t dh_prime_len,
+                                void *dh_base, uint32_t dh_base_len) {
+    TEE_Result res;
+    TEE_Attribute attrs[2];
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_DH_KEYPAIR, KEYPAIR_BITS, keypair);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate transient object, res = 0x%x\n", res);
+        return res;
+    }
+
+    TEE_InitRefAttribute(&attrs[0], TEE_ATTR_DH_PRIME, dh_prime, dh_prime_len);
+    TEE_InitRefAttribute(&attrs[1], TEE_ATTR_DH_BASE, dh_base, dh_base_len);
+
+    res = TEE_GenerateKey(*keypair, KEYPAIR_BITS, attrs, 2);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to generate keypair, res = 0x%x\n", res);
+        TEE_FreeTransientObject(*keypair);
+        *keypair = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
+static bool pool_domain_match(void *dh_prime, uint32_t dh_prime_len, void *dh_base, uint32_t dh_base_len) {
+    return pool.prime_len == dh_prime_len && pool.base_len == dh_base_len &&
+           TEE_MemCompare(pool.prime, dh_prime, dh_prime_len) == 0 &&
+           TEE_MemCompare(pool.base, dh_base, dh_base_len) == 0;
+}
+
+static TEE_ObjectHandle pool_take(void *dh_prime, uint32_t dh_prime_len, void *dh_base, uint32_t dh_base_len) {
+    TEE_ObjectHandle keypair;
+
+    if (pool.depth == 0 || !pool_domain_match(dh_prime, dh_prime_len, dh_base, dh_base_len))
+        return TEE_HANDLE_NULL;
+
+    pool.depth--;
+    keypair = pool.keypairs[pool.depth];
+    pool.keypairs[pool.depth] = TEE_HANDLE_NULL;
+
+    return keypair;
+}
+
+static void pool_trim(uint32_t depth) {
+    while (pool.depth > depth) {
+        pool.depth--;
+        TEE_FreeTransientObject(pool.keypairs[pool.depth]);
+        pool.keypairs[pool.depth] = TEE_HANDLE_NULL;
+    }
+}
+
+static TEE_Result refill_keypair_pool(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+    TEE_Result res;
+    (void)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INOUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT,  
+        TEE_PARAM_TYPE_MEMREF_INPUT,  
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t target = params[0].value.a;
+    if (target > KEYPAIR_POOL_MAX_DEPTH) {
+        EMSG("Pool depth %u exceeds the limit %u\n", target, KEYPAIR_POOL_MAX_DEPTH);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    void *dh_prime = params[1].memref.buffer;
+    uint32_t dh_prime_len = params[1].memref.size;
+
+    void *dh_base = params[2].memref.buffer;
+    uint32_t dh_base_len = params[2].memref.size;
+
+    if (dh_prime_len > KEYPAIR_BYTES || dh_base_len > KEYPAIR_BYTES) {
+        EMSG("DH parameters are too large\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // DH参数改变后, 旧参数生成的密钥对全部作废
+    if (!pool_domain_match(dh_prime, dh_prime_len, dh_base, dh_base_len)) {
+        pool_trim(0);
+        TEE_MemMove(pool.prime, dh_prime, dh_prime_len);
+        pool.prime_len = dh_prime_len;
+        TEE_MemMove(pool.base, dh_base, dh_base_len);
+        pool.base_len = dh_base_len;
+    }
+
+    pool_trim(target);
+
+    while (pool.depth < target) {
+        res = alloc_keypair(&pool.keypairs[pool.depth], pool.prime, pool.prime_len, pool.base, pool.base_len);
+        if (res != TEE_SUCCESS)
+            return res;
+        pool.depth++;
+    }
+
+    params[0].value.a = pool.depth;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result generate_keypair(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+    TEE_Result res;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT,  
+        TEE_PARAM_TYPE_MEMREF_INPUT,  
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    void *dh_prime = params[1].memref.buffer;
+    size_t dh_prime_len = params[1].memref.size;
+
+    void *dh_base = params[2].memref.buffer;
+    size_t dh_base_len = params[2].memref.size;
+
+    uint32_t out_size = params[0].memref.size;
+    if (out_size < KEYPAIR_BYTES) {
+        EMSG("Public key buffer is too small\n");
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+ 
+    if (ctx->keypair != TEE_HANDLE_NULL) {
+        TEE_FreeTransientObject(ctx->keypair);
+        ctx->keypair = TEE_HANDLE_NULL;
+    }
+
+    ctx->keypair = pool_take(dh_prime, dh_prime_len, dh_base, dh_base_len);
+    if (ctx->keypair == TEE_HANDLE_NULL) {
+        res = alloc_keypair(&ctx->keypair, dh_prime, dh_prime_len, dh_base, dh_base_len);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    res = TEE_GetObjectBufferAttribute(ctx->keypair, TEE_ATTR_DH_PUBLIC_VALUE, params[0].memref.buffer, &out_size);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to get public value, res = 0x%x\n", res);
+        goto err_free_keypair;
+    }
+
+    params[0].memref.size = out_size;
+
+    IMSG("\nKey pair generated successfully\n\n");
+
+    return TEE_SUCCESS;
+
+err_free_keypair:
+    if (ctx->keypair) {
+        TEE_FreeTransientObject(ctx->keypair);
+        ctx->keypair = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
+static void free_peer_key(struct peer_key *entry) {
+    if (entry->ctr_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(entry->ctr_op);
+        entry->ctr_op = TEE_HANDLE_NULL;
+    }
+
+    entry->last_used = 0;
+}
+
+static struct peer_key *keyring_find(struct dh_basic_ctx *ctx, uint32_t peer_id) {
+    for (uint32_t i = 0; i < ctx->keyring_size; i++) {
+        struct peer_key *entry = &ctx->keyring[i];
+
+        if (entry->last_used && entry->peer_id == peer_id) {
+            entry->last_used = ++ctx->keyring_tick;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * 查找对端已有的表项, 否则取一个空闲表项
+ * 密钥环按需扩容到 KEYRING_MAX_PEERS, 满了之后淘汰最久未使用的对端
+ */
+static struct peer_key *keyring_slot(struct dh_basic_ctx *ctx, uint32_t peer_id) {
+    struct peer_key *victim = NULL;
+
+    for (uint32_t i = 0; i < ctx->keyring_size; i++) {
+        struct peer_key *entry = &ctx->keyring[i];
+
+        if (entry->last_used && entry->peer_id == peer_id)
+            return entry;
+
+        if (!victim || entry->last_used < victim->last_used)
+            victim = entry;
+    }
+
+    if (victim && victim->last_used == 0)
+        return victim;
+
+    if (ctx->keyring_size < KEYRING_MAX_PEERS) {
+        uint32_t new_size = ctx->keyring_size ? ctx->keyring_size * 2 : 8;
+        if (new_size > KEYRING_MAX_PEERS)
+            new_size = KEYRING_MAX_PEERS;
+
+        struct peer_key *new_keyring = TEE_Realloc(ctx->keyring, new_size * sizeof(struct peer_key));
+        if (new_keyring) {
+            TEE_MemFill(&new_keyring[ctx->keyring_size], 0,
+                        (new_size - ctx->keyring_size) * sizeof(struct peer_key));
+            ctx->keyring = new_keyring;
+            victim = &ctx->keyring[ctx->keyring_size];
+            ctx->keyring_size = new_size;
+            return victim;
+        }
+
+        if (!victim) {
+            EMSG("Out of memory for keyring\n");
+            return NULL;
+        }
+    }
+
+    IMSG("Keyring is full, evict peer %u\n", victim->peer_id);
+    free_peer_key(victim);
+
+    return victim;
+}
+
+// 为对端保存AES密钥并预先设置好AES-CTR操作, CTR模式加解密相同, 共用一个操作
+static TEE_Result keyring_store(struct dh_basic_ctx *ctx, uint32_t peer_id, uint8_t *aes_key, uint32_t aes_key_len) {
+    TEE_Result res;
+    TEE_Attribute attr;
+    TEE_ObjectHandle key;
+
+    struct peer_key *entry = keyring_slot(ctx, peer_id);
+    if (!entry)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    free_peer_key(entry);
+
+    // 密钥对象只用来设置操作, TEE_SetOperationKey 会拷贝密钥, 之后即可释放
+    res = TEE_AllocateTransientObject(TEE_TYPE_AES, AES_SECRET_BITS, &key);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate AES key object, res = 0x%x\n", res);
+        return res;
+    }
+
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, aes_key, aes_key_len);
+    res = TEE_PopulateTransientObject(key, &attr, 1);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to populate AES key object, res = 0x%x\n", res);
+        goto err_free_key;
+    }
+
+    res = TEE_AllocateOperation(&entry->ctr_op, TEE_ALG_AES_CTR, TEE_MODE_ENCRYPT, AES_SECRET_BITS);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate operation, res = 0x%x\n", res);
+        goto err_free_key;
+    }
+
+    res = TEE_SetOperationKey(entry->ctr_op, key);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to set operation key, res = 0x%x\n", res);
+        goto err_free_entry;
+    }
+
+    TEE_FreeTransientObject(key);
+
+    entry->peer_id = peer_id;
+    entry->last_used = ++ctx->keyring_tick;
+
+    return TEE_SUCCESS;
+
+err_free_entry:
+    free_peer_key(entry);
+err_free_key:
+    TEE_FreeTransientObject(key);
+
+    return res;
+}
+
+static void free_keyring(struct dh_basic_ctx *ctx) {
+    for (uint32_t i = 0; i < ctx->keyring_size; i++)
+        free_peer_key(&ctx->keyring[i]);
+
+    TEE_Free(ctx->keyring);
+    ctx->keyring = NULL;
+    ctx->keyring_size = 0;
+}
+
+// 记录头: epoch(4) | 序号(8), 都是大端
+static void channel_header(uint8_t hdr[CHANNEL_HEADER_SIZE], uint32_t epoch, uint64_t seq) {
+    for (uint32_t i = 0; i < 4; i++)
+        hdr[i] = epoch >> (24 - 8 * i);
+    for (uint32_t i = 0; i < 8; i++)
+        hdr[4 + i] = seq >> (56 - 8 * i);
+}
+
+static void channel_parse_header(const uint8_t hdr[CHANNEL_HEADER_SIZE], uint32_t *epoch, uint64_t *seq) {
+    *epoch = 0;
+    for (uint32_t i = 0; i < 4; i++)
+        *epoch = (*epoch << 8) | hdr[i];
+    *seq = 0;
+    for (uint32_t i = 0; i < 8; i++)
+        *seq = (*seq << 8) | hdr[4 + i];
+}
+
+/*
+ * GCM 使用密钥调度安装的每个方向独立的密钥, 操作在调度时就已建好
+ * 流式记录可能被放弃或在中途失败, 操作停在 ACTIVE 状态, 每条记录开始前先复位(密钥保留)
+ */
+static TEE_Result get_gcm_op(struct dh_basic_ctx *ctx, uint32_t mode, TEE_OperationHandle *op) {
+    if (ctx->channel.epoch == 0) {
+        EMSG("Channel keys are not scheduled\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    *op = ctx->channel.gcm[mode];
+
+    return TEE_SUCCESS;
+}
+
+// nonce 与记录头格式相同: epoch(4) | 发送计数(8), 由TA生成, 计数用完之前必须 rekey, 不能回绕
+static TEE_Result gcm_next_nonce(struct channel_keys *channel, uint8_t nonce[GCM_IV_SIZE]) {
+    if (channel->gcm_tx_seq == UINT64_MAX) {
+        EMSG("GCM nonces of epoch %u are exhausted\n", channel->epoch);
+        return TEE_ERROR_OVERFLOW;
+    }
+
+    channel_header(nonce, channel->epoch, channel->gcm_tx_seq++);
+
+    return TEE_SUCCESS;
+}
+
+// 只接受当前 epoch 且计数不小于 gcm_rx_seq 的 nonce, 重放和乱序的旧记录被拒绝
+static TEE_Result gcm_check_nonce(struct channel_keys *channel, const uint8_t nonce[GCM_IV_SIZE], uint64_t *seq) {
+    uint32_t epoch;
+
+    channel_parse_header(nonce, &epoch, seq);
+    if (epoch != channel->epoch || *seq < channel->gcm_rx_seq) {
+        EMSG("Nonce of epoch %u seq %llu rejected\n", epoch, (unsigned long long)*seq);
+        return TEE_ERROR_SECURITY;
+    }
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result gcm_init(TEE_OperationHandle op, const uint8_t *iv, const uint8_t *aad, uint32_t aad_len) {
+    TEE_Result res;
+
+    // 对 ACTIVE 状态的操作调用 TEE_AEInit 会使TA panic
+    TEE_ResetOperation(op);
+
+    // GCM 不需要预先知道 AAD 和明文长度
+    res = TEE_AEInit(op, iv, GCM_IV_SIZE, GCM_TAG_SIZE * 8, 0, 0);
+    if (res != TEE_SUCCESS) {
+        EMSG("AE init failed, res = 0x%x\n", res);
+        return res;
+    }
+
+    if (aad_len)
+        TEE_AEUpdateAAD(op, aad, aad_len);
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * 处理一段数据, last 为真时结束本条记录
+ * 加密的最后一段在密文后追加标签, 解密的最后一段输入以标签结尾
+ * 调用者保证 *out_len >= in_len + GCM_TAG_SIZE
+ */
+static TEE_Result gcm_process(TEE_OperationHandle op, uint32_t mode, int last,
+                              uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t *out_len) {
+    TEE_Result res;
+
+    if (!last) {
+        res = TEE_AEUpdate(op, in, in_len, out, out_len);
+        if (res != TEE_SUCCESS)
+            EMSG("AE update failed, res = 0x%x\n", res);
+        return res;
+    }
+
+    if (mode == TEE_MODE_ENCRYPT) {
+        uint8_t tag[GCM_TAG_SIZE];
+        uint32_t tag_len = sizeof(tag);
+        uint32_t cipher_len = *out_len - GCM_TAG_SIZE;
+
+        res = TEE_AEEncryptFinal(op, in, in_len, out, &cipher_len, tag, &tag_len);
+        if (res != TEE_SUCCESS) {
+            EMSG("AE encrypt failed, res = 0x%x\n", res);
+            return res;
+        }
+
+        TEE_MemMove(out + cipher_len, tag, tag_len);
+        *out_len = cipher_len + tag_len;
+
+        return TEE_SUCCESS;
+    }
+
+    if (in_len < GCM_TAG_SIZE) {
+        EMSG("The tag is missing\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    in_len -= GCM_TAG_SIZE;
+    res = TEE_AEDecryptFinal(op, in, in_len, out, out_len, in + in_len, GCM_TAG_SIZE);
+    if (res != TEE_SUCCESS)
+        EMSG("AE decrypt failed, res = 0x%x\n", res);
+
+    return res;
+}
+
+/*
+ * 第一段加密输出和第一段解密输入的前面是 nonce (GCM_IV_SIZE 字节), 之后都只有数据
+ * 加密在第一段消耗一个发送计数, 解密在最后一段标签通过后才推进接收计数
+ */
+static TEE_Result gcm_stream(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4], uint32_t mode) {
+    TEE_Result res;
+    TEE_OperationHandle op;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t flags = params[0].value.a;
+    uint8_t *in = params[2].memref.buffer;
+    uint32_t in_len = params[2].memref.size;
+    uint8_t *out = params[3].memref.buffer;
+    uint32_t out_len = params[3].memref.size;
+    uint32_t nonce_len = (flags & GCM_CHUNK_FIRST) ? GCM_IV_SIZE : 0;
+
+    if (mode == TEE_MODE_DECRYPT) {
+        if (in_len < nonce_len) {
+            EMSG("The nonce is missing\n");
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+        in_len -= nonce_len;
+    }
+
+    uint32_t need = in_len + GCM_TAG_SIZE + (mode == TEE_MODE_ENCRYPT ? nonce_len : 0);
+    if (out_len < need) {
+        EMSG("Output buffer is too small\n");
+        params[3].memref.size = need;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    res = get_gcm_op(ctx, mode, &op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 新的第一段会丢弃同方向上未结束的记录
+    if (flags & GCM_CHUNK_FIRST) {
+        uint8_t nonce[GCM_IV_SIZE];
+
+        if (mode == TEE_MODE_ENCRYPT) {
+            res = gcm_next_nonce(&ctx->channel, nonce);
+            if (res != TEE_SUCCESS)
+                return res;
+
+            TEE_MemMove(out, nonce, sizeof(nonce));
+            out += sizeof(nonce);
+            out_len -= sizeof(nonce);
+        } else {
+            // nonce 在共享内存中, 拷贝到栈上, 检查和初始化都只用这一份
+            TEE_MemMove(nonce, in, sizeof(nonce));
+            in += sizeof(nonce);
+
+            res = gcm_check_nonce(&ctx->channel, nonce, &ctx->channel.gcm_rx_pending);
+            if (res != TEE_SUCCESS)
+                return res;
+        }
+
+        ctx->channel.gcm_streaming[mode] = 0;
+        res = gcm_init(op, nonce, params[1].memref.buffer, params[1].memref.size);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        ctx->channel.gcm_streaming[mode] = 1;
+    } else if (!ctx->channel.gcm_streaming[mode]) {
+        EMSG("No record is in progress\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    int last = (flags & GCM_CHUNK_LAST) != 0;
+    res = gcm_process(op, mode, last, in, in_len, out, &out_len);
+    if (res != TEE_SUCCESS || last)
+        ctx->channel.gcm_streaming[mode] = 0;
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (last && mode == TEE_MODE_DECRYPT)
+        ctx->channel.gcm_rx_seq = ctx->channel.gcm_rx_pending + 1;
+
+    params[3].memref.size = out_len + (mode == TEE_MODE_ENCRYPT ? nonce_len : 0);
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * 一次调用处理多条记录, 输入输出都是 struct gcm_record 头加数据依次排列
+ * 先检查全部记录并计算输出长度, 再逐条处理, 记录头可能不对齐, 拷贝到栈上再读
+ * 加密时输入记录头中的 nonce 被忽略, 由TA按发送计数生成后写入输出记录头
+ */
+static TEE_Result gcm_batch(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4], uint32_t mode) {
+    TEE_Result res;
+    TEE_OperationHandle op;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    struct gcm_record hdr;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, 
+        TEE_PARAM_TYPE_VALUE_OUTPUT,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint8_t *in = params[0].memref.buffer;
+    uint8_t *out = params[1].memref.buffer;
+    uint32_t in_size = params[0].memref.size;
+    uint32_t need = 0;
+    uint32_t off = 0;
+
+    while (off < in_size) {
+        if (in_size - off < sizeof(hdr)) {
+            EMSG("Truncated record header\n");
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        TEE_MemMove(&hdr, in + off, sizeof(hdr));
+        off += sizeof(hdr);
+
+        if (hdr.len > in_size - off || (mode == TEE_MODE_DECRYPT && hdr.len < GCM_TAG_SIZE)) {
+            EMSG("Invalid record length %u\n", hdr.len);
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        off += hdr.len;
+        need += sizeof(hdr) + hdr.len + GCM_TAG_SIZE;
+    }
+
+    if (params[1].memref.size < need) {
+        EMSG("Output buffer is too small\n");
+        params[1].memref.size = need;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    res = get_gcm_op(ctx, mode, &op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 批处理与流式共用同一个操作, 未结束的流式记录作废
+    ctx->channel.gcm_streaming[mode] = 0;
+
+    uint32_t out_off = 0;
+    uint32_t count = 0;
+
+    off = 0;
+    while (off < in_size) {
+        TEE_MemMove(&hdr, in + off, sizeof(hdr));
+        off += sizeof(hdr);
+
+        // 记录头在共享内存中, 第一遍检查后 CA 仍可能修改, 重新检查
+        if (hdr.len > in_size - off || (mode == TEE_MODE_DECRYPT && hdr.len < GCM_TAG_SIZE) ||
+            (uint64_t)out_off + sizeof(hdr) + hdr.len + GCM_TAG_SIZE > params[1].memref.size) {
+            EMSG("Record %u changed\n", count);
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+
+        uint64_t seq = 0;
+        if (mode == TEE_MODE_ENCRYPT)
+            res = gcm_next_nonce(&ctx->channel, hdr.nonce);
+        else
+            res = gcm_check_nonce(&ctx->channel, hdr.nonce, &seq);
+        if (res != TEE_SUCCESS) {
+            EMSG("Record %u failed\n", count);
+            return res;
+        }
+
+        res = gcm_init(op, hdr.nonce, NULL, 0);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        uint32_t out_len = hdr.len + GCM_TAG_SIZE;
+        res = gcm_process(op, mode, 1, in + off, hdr.len, out + out_off + sizeof(hdr), &out_len);
+        if (res != TEE_SUCCESS) {
+            EMSG("Record %u failed\n", count);
+            return res;
+        }
+
+        if (mode == TEE_MODE_DECRYPT)
+            ctx->channel.gcm_rx_seq = seq + 1;
+
+        off += hdr.len;
+        hdr.len = out_len;
+        TEE_MemMove(out + out_off, &hdr, sizeof(hdr));
+        out_off += sizeof(hdr) + out_len;
+        count++;
+    }
+
+    params[1].memref.size = out_off;
+    params[2].value.a = count;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result generate_shared_key(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+    TEE_Result res;
+    TEE_Attribute attr;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+    uint32_t exp_param_type_peer = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_type != exp_param_type && param_type != exp_param_type_peer) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (ctx->keypair == TEE_HANDLE_NULL) {
+        EMSG("Key pair is not generated\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    if (ctx->operation != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->operation);
+        ctx->operation = TEE_HANDLE_NULL;
+    }
+
+    
+    res = TEE_AllocateOperation(&ctx->operation, TEE_ALG_DH_DERIVE_SHARED_SECRET, TEE_MODE_DERIVE, KEYPAIR_BITS);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate operation, res = 0x%x\n", res);
+        return res;
+    }
+
+    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to set operation key, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    if (ctx->shared_key != TEE_HANDLE_NULL) {
+        TEE_FreeTransientObject(ctx->shared_key);
+        ctx->shared_key = TEE_HANDLE_NULL;
+    }
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_GENERIC_SECRET, align_to_8(KEYPAIR_BITS), &ctx->shared_key);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate shared key object, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    TEE_InitRefAttribute(&attr, TEE_ATTR_DH_PUBLIC_VALUE, params[0].memref.buffer, params[0].memref.size);
+
+    TEE_DeriveKey(ctx->operation, &attr, 1, ctx->shared_key);
+
+    // 临时私钥只使用一次
+    TEE_FreeTransientObject(ctx->keypair);
+    ctx->keypair = TEE_HANDLE_NULL;
+    
+    uint8_t shared_secret[KEYPAIR_BYTES];
+    size_t shared_secret_len = sizeof(shared_secret);
+    res = TEE_GetObjectBufferAttribute(ctx->shared_key, TEE_ATTR_SECRET_VALUE, shared_secret, &shared_secret_len);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to get shared secret, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    TEE_OperationHandle hash_op = TEE_HANDLE_NULL;
+    uint8_t aes_key[AES_SECRET_BITS / 8]; 
+    uint32_t aes_key_len = sizeof(aes_key);
+
+    res = TEE_AllocateOperation(&hash_op, USE_ALG_AES_HASH, TEE_MODE_DIGEST, 0);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate hash operation, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    res = TEE_DigestDoFinal(hash_op, shared_secret, shared_secret_len, aes_key, &aes_key_len);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to compute hash, res = 0x%x\n", res);
+        TEE_FreeOperation(hash_op);
+        goto err_free_operation;
+    }
+
+    TEE_FreeOperation(hash_op);
+
+    if (param_type == exp_param_type_peer) {
+        res = keyring_store(ctx, params[1].value.a, aes_key, aes_key_len);
+        if (res != TEE_SUCCESS)
+            goto err_free_operation;
+
+        IMSG("\nAES key of peer %u derived successfully\n\n", params[1].value.a);
+
+        TEE_FreeOperation(ctx->operation);
+        ctx->operation = TEE_HANDLE_NULL;
+        return TEE_SUCCESS;
+    }
+
+    if (ctx->aes_key != TEE_HANDLE_NULL) {
+        TEE_FreeTransientObject(ctx->aes_key);
+        ctx->aes_key = TEE_HANDLE_NULL;
+    }
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_AES, AES_SECRET_BITS, &ctx->aes_key);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate AES key object, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, aes_key, aes_key_len);
+    res = TEE_PopulateTransientObject(ctx->aes_key, &attr, 1);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to populate AES key object, res = 0x%x\n", res);
+        TEE_FreeTransientObject(ctx->aes_key);
+        ctx->aes_key = TEE_HANDLE_NULL;
+        goto err_free_operation;
+    }
+
+    IMSG("\nAES key derived successfully\n\n");
+
+    return TEE_SUCCESS;
+
+err_free_operation:
+    if (ctx->operation) {
+        TEE_FreeOperation(ctx->operation);
+        ctx->operation = TEE_HANDLE_NULL;
+    }
+    return res;
+}
+
+static TEE_Result decrypt(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+    TEE_Result res;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (ctx->operation != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->operation);
+        ctx->operation = TEE_HANDLE_NULL;
+    }
+
+    res = TEE_AllocateOperation(&ctx->operation, TEE_ALG_AES_CTR, TEE_MODE_DECRYPT, 256);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate operation, res = 0x%x\n", res);
+        return res;
+    }
+
+    res = TEE_SetOperationKey(ctx->operation, ctx->aes_key);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to set operation key, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    TEE_CipherInit(ctx->operation, params[1].memref.buffer, params[1].memref.size);
+
+    uint8_t plain_buf[256];
+    uint32_t plain_len = sizeof(plain_buf);
+    res = TEE_CipherUpdate(ctx->operation, params[0].memref.buffer, params[0].memref.size,
+                           plain_buf, &plain_len);
+    if (res != TEE_SUCCESS) {
+        EMSG("Cipher update failed, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    printf("\nthe Bob's message is:\n");
+    for (uint32_t i = 0; i < plain_len; i++) {
+        printf("%c", plain_buf[i]);
+    }
+    printf("\n\n");
+
+    return TEE_SUCCESS;
+
+err_free_operation:
+    if (ctx->operation != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->operation);
+        ctx->operation = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
+static TEE_Result peer_cipher(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+    TEE_Result res;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    struct peer_key *entry = keyring_find(ctx, params[0].value.a);
+    if (!entry) {
+        EMSG("No key for peer %u\n", params[0].value.a);
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    uint32_t out_size = params[3].memref.size;
+    if (out_size < params[2].memref.size) {
+        EMSG("Output buffer is too small\n");
+        params[3].memref.size = params[2].memref.size;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    // IV 长度不对时 TEE_CipherInit 会使TA panic
+    if (params[1].memref.size != CTR_IV_SIZE) {
+        EMSG("IV must be %u bytes\n", CTR_IV_SIZE);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    TEE_CipherInit(entry->ctr_op, params[1].memref.buffer, params[1].memref.size);
+
+    res = TEE_CipherUpdate(entry->ctr_op, params[2].memref.buffer, params[2].memref.size,
+                           params[3].memref.buffer, &out_size);
+    if (res != TEE_SUCCESS) {
+        EMSG("Cipher update failed, res = 0x%x\n", res);
+        return res;
+    }
+
+    params[3].memref.size = out_size;
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * HKDF-SHA256 (RFC 5869), 用 HMAC-SHA256 实现, 不依赖平台是否支持 TEE_ALG_HKDF
+ * 根据GP规范 HMAC-SHA256 密钥长度为 192 ~ 1024 位
+ */
+static TEE_Result alloc_hmac(const uint8_t *key, uint32_t key_len, TEE_OperationHandle *op) {
+    TEE_Result res;
+    TEE_Attribute attr;
+    TEE_ObjectHandle key_obj = TEE_HANDLE_NULL;
+
+    res = TEE_AllocateOperation(op, TEE_ALG_HMAC_SHA256, TEE_MODE_MAC, key_len * 8);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate HMAC operation, res = 0x%x\n", res);
+        return res;
+    }
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_HMAC_SHA256, key_len * 8, &key_obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to allocate HMAC key object, res = 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_len);
+    res = TEE_PopulateTransientObject(key_obj, &attr, 1);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to populate HMAC key object, res = 0x%x\n", res);
+        goto err_free_key;
+    }
+
+    // 设置密钥时操作会拷贝一份, 密钥对象可以立即释放
+    res = TEE_SetOperationKey(*op, key_obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to set HMAC key, res = 0x%x\n", res);
+        goto err_free_key;
+    }
+
+    TEE_FreeTransientObject(key_obj);
+
+    return TEE_SUCCESS;
+
+err_free_key:
+    TEE_FreeTransientObject(key_obj);
+err_free_operation:
+    TEE_FreeOperation(*op);
+    *op = TEE_HANDLE_NULL;
+
+    return res;
+}
+
+// PRK = HMAC(salt, IKM), 没有盐时使用 HashLen 个0
+static TEE_Result hkdf_extract(const uint8_t *salt, uint32_t salt_len, const uint8_t *ikm, uint32_t ikm_len,
+                               uint8_t prk[HKDF_HASH_SIZE]) {
     TEE_Result res;
-    TEE_Attribute attrs[2];
-    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
-    uint32_t exp_param_type = TEE_PARAM_TYPES(
-        TEE_PARAM_TYPE_MEMREF_OUTPUT, 
-        TEE_PARAM_TYPE_MEMREF_INPUT,  
-        TEE_PARAM_TYPE_MEMREF_INPUT,  
-        TEE_PARAM_TYPE_NONE);
+    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    uint8_t zero_salt[HKDF_HASH_SIZE];
+    uint32_t prk_len = HKDF_HASH_SIZE;
+
+    if (salt_len == 0) {
+        TEE_MemFill(zero_salt, 0, sizeof(zero_salt));
+        salt = zero_salt;
+        salt_len = sizeof(zero_salt);
+    }
 
-    if (param_type != exp_param_type) {
-        EMSG("Parameter types mismatch\n");
+    res = alloc_hmac(salt, salt_len, &op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    TEE_MACInit(op, NULL, 0);
+    res = TEE_MACComputeFinal(op, ikm, ikm_len, prk, &prk_len);
+    if (res != TEE_SUCCESS)
+        EMSG("HKDF extract failed, res = 0x%x\n", res);
+
+    TEE_FreeOperation(op);
+
+    return res;
+}
+
+/*
+ * T(i) = HMAC(PRK, T(i-1) | label | context | i), OKM 取 T(1) | T(2) ... 的前 okm_len 字节
+ * info 由标签和上下文拼接而成, 分段送入 HMAC, 不需要额外的拼接缓冲区
+ */
+static TEE_Result hkdf_expand(const uint8_t prk[HKDF_HASH_SIZE], const char *label,
+                              const uint8_t *context, uint32_t context_len, uint8_t *okm, uint32_t okm_len) {
+    TEE_Result res;
+    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    uint8_t t[HKDF_HASH_SIZE];
+    uint32_t t_len = 0;
+    uint8_t counter = 0;
+
+    if (okm_len > 255 * HKDF_HASH_SIZE)
         return TEE_ERROR_BAD_PARAMETERS;
+
+    res = alloc_hmac(prk, HKDF_HASH_SIZE, &op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    while (okm_len) {
+        TEE_MACInit(op, NULL, 0);
+        if (t_len)
+            TEE_MACUpdate(op, t, t_len);
+        TEE_MACUpdate(op, label, strlen(label));
+        if (context_len)
+            TEE_MACUpdate(op, context, context_len);
+
+        counter++;
+        t_len = sizeof(t);
+        res = TEE_MACComputeFinal(op, &counter, 1, t, &t_len);
+        if (res != TEE_SUCCESS) {
+            EMSG("HKDF expand failed, res = 0x%x\n", res);
+            break;
+        }
+
+        uint32_t n = okm_len < t_len ? okm_len : t_len;
+        TEE_MemMove(okm, t, n);
+        okm += n;
+        okm_len -= n;
     }
 
-    void *dh_prime = params[1].memref.buffer;
-    size_t dh_prime_len = params[1].memref.size;
+    TEE_MemFill(t, 0, sizeof(t));
+    TEE_FreeOperation(op);
 
-    void *dh_base = params[2].memref.buffer;
-    size_t dh_base_len = params[2].memref.size;
+    return res;
+}
 
-    uint32_t out_size = params[0].memref.size;
-    if (out_size < KEYPAIR_BYTES) {
-        EMSG("Public key buffer is too small\n");
-        return TEE_ERROR_SHORT_BUFFER;
-    }
- 
-    if (ctx->keypair != TEE_HANDLE_NULL) {
-        TEE_FreeTransientObject(ctx->keypair);
-        ctx->keypair = TEE_HANDLE_NULL;
-    }
+static TEE_Result alloc_aes(uint32_t algo, uint32_t mode, const uint8_t *key, uint32_t key_len,
+                            TEE_OperationHandle *op) {
+    TEE_Result res;
+    TEE_Attribute attr;
+    TEE_ObjectHandle key_obj = TEE_HANDLE_NULL;
 
-    res = TEE_AllocateTransientObject(TEE_TYPE_DH_KEYPAIR, KEYPAIR_BITS, &ctx->keypair);
+    res = TEE_AllocateOperation(op, algo, mode, AES_SECRET_BITS);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate transient object, res = 0x%x\n", res);
+        EMSG("Failed to allocate operation, res = 0x%x\n", res);
         return res;
     }
-    
-    TEE_InitRefAttribute(&attrs[0], TEE_ATTR_DH_PRIME, dh_prime, dh_prime_len);
-    TEE_InitRefAttribute(&attrs[1], TEE_ATTR_DH_BASE, dh_base, dh_base_len);
 
-    res = TEE_GenerateKey(ctx->keypair, KEYPAIR_BITS, attrs, 2);
+    res = TEE_AllocateTransientObject(TEE_TYPE_AES, AES_SECRET_BITS, &key_obj);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to generate keypair, res = 0x%x\n", res);
-        goto err_free_keypair;
+        EMSG("Failed to allocate AES key object, res = 0x%x\n", res);
+        goto err_free_operation;
     }
 
-    res = TEE_GetObjectBufferAttribute(ctx->keypair, TEE_ATTR_DH_PUBLIC_VALUE, params[0].memref.buffer, &out_size);
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_len);
+    res = TEE_PopulateTransientObject(key_obj, &attr, 1);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to get public value, res = 0x%x\n", res);
-        goto err_free_keypair;
+        EMSG("Failed to populate AES key object, res = 0x%x\n", res);
+        goto err_free_key;
     }
 
-    params[0].memref.size = out_size;
+    res = TEE_SetOperationKey(*op, key_obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to set operation key, res = 0x%x\n", res);
+        goto err_free_key;
+    }
 
-    IMSG("\nKey pair generated successfully\n\n");
+    TEE_FreeTransientObject(key_obj);
 
     return TEE_SUCCESS;
 
-err_free_keypair:
-    if (ctx->keypair) {
-        TEE_FreeTransientObject(ctx->keypair);
-        ctx->keypair = TEE_HANDLE_NULL;
+err_free_key:
+    TEE_FreeTransientObject(key_obj);
+err_free_operation:
+    TEE_FreeOperation(*op);
+    *op = TEE_HANDLE_NULL;
+
+    return res;
+}
+
+static void free_channel(struct channel_keys *channel) {
+    TEE_OperationHandle *ops[] = {
+        &channel->tx_cipher, &channel->tx_mac, &channel->rx_cipher, &channel->rx_mac,
+        &channel->gcm[TEE_MODE_ENCRYPT], &channel->gcm[TEE_MODE_DECRYPT],
+    };
+
+    for (uint32_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        if (*ops[i] != TEE_HANDLE_NULL) {
+            TEE_FreeOperation(*ops[i]);
+            *ops[i] = TEE_HANDLE_NULL;
+        }
+    }
+
+    TEE_MemFill(channel->rekey_secret, 0, sizeof(channel->rekey_secret));
+}
+
+// 通信密钥的标签, 下标为发送方角色
+static const char * const channel_labels[2][3] = {
+    { "c2s key", "c2s mac", "c2s gcm" },
+    { "s2c key", "s2c mac", "s2c gcm" },
+};
+
+/*
+ * 从 PRK 展开出两个方向的加密/MAC/GCM密钥和下一轮的 rekey secret, 并全部安装成可直接使用的操作
+ * 发起方发送用 c2s, 接收用 s2c, 响应方相反, 先全部建好再替换旧的密钥, 失败时旧密钥保持不变
+ * 新密钥的收发序号和GCM计数都从0开始, 未结束的GCM流式记录作废
+ */
+static TEE_Result install_channel(struct channel_keys *channel, const uint8_t prk[HKDF_HASH_SIZE], uint32_t role,
+                                  uint32_t epoch, const uint8_t *context, uint32_t context_len) {
+    TEE_Result res;
+    struct channel_keys next;
+    uint8_t key[HKDF_HASH_SIZE];
+    const struct {
+        const char *label;
+        TEE_OperationHandle *op;
+        uint32_t algo;              // 0 表示 HMAC
+        uint32_t mode;
+    } keys[] = {
+        { channel_labels[role][0], &next.tx_cipher, TEE_ALG_AES_CTR, TEE_MODE_ENCRYPT },
+        { channel_labels[role][1], &next.tx_mac, 0, 0 },
+        { channel_labels[role][2], &next.gcm[TEE_MODE_ENCRYPT], TEE_ALG_AES_GCM, TEE_MODE_ENCRYPT },
+        { channel_labels[1 - role][0], &next.rx_cipher, TEE_ALG_AES_CTR, TEE_MODE_ENCRYPT },
+        { channel_labels[1 - role][1], &next.rx_mac, 0, 0 },
+        { channel_labels[1 - role][2], &next.gcm[TEE_MODE_DECRYPT], TEE_ALG_AES_GCM, TEE_MODE_DECRYPT },
+    };
+
+    TEE_MemFill(&next, 0, sizeof(next));
+
+    for (uint32_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        res = hkdf_expand(prk, keys[i].label, context, context_len, key, sizeof(key));
+        if (res != TEE_SUCCESS)
+            goto err_free_next;
+
+        if (keys[i].algo == 0)
+            res = alloc_hmac(key, sizeof(key), keys[i].op);
+        else
+            res = alloc_aes(keys[i].algo, keys[i].mode, key, AES_SECRET_BITS / 8, keys[i].op);
+        if (res != TEE_SUCCESS)
+            goto err_free_next;
     }
 
+    res = hkdf_expand(prk, "rekey", context, context_len, next.rekey_secret, sizeof(next.rekey_secret));
+    if (res != TEE_SUCCESS)
+        goto err_free_next;
+
+    TEE_MemFill(key, 0, sizeof(key));
+
+    next.role = role;
+    next.epoch = epoch;
+    free_channel(channel);
+    *channel = next;
+
+    return TEE_SUCCESS;
+
+err_free_next:
+    TEE_MemFill(key, 0, sizeof(key));
+    free_channel(&next);
+
     return res;
 }
 
-static TEE_Result generate_shared_key(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+static TEE_Result key_schedule(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
     TEE_Result res;
-    TEE_Attribute attr;
     struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
     uint32_t exp_param_type = TEE_PARAM_TYPES(
         TEE_PARAM_TYPE_MEMREF_INPUT, 
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE);
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_VALUE_INPUT,
+        TEE_PARAM_TYPE_VALUE_OUTPUT);
 
     if (param_type != exp_param_type) {
         EMSG("Parameter types mismatch\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if (ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation);
-        ctx->operation = TEE_HANDLE_NULL;
+    uint32_t role = params[2].value.a;
+    if (role != CHANNEL_ROLE_INITIATOR && role != CHANNEL_ROLE_RESPONDER) {
+        EMSG("Invalid channel role %u\n", role);
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    
-    res = TEE_AllocateOperation(&ctx->operation, TEE_ALG_DH_DERIVE_SHARED_SECRET, TEE_MODE_DERIVE, KEYPAIR_BITS);
+    uint32_t salt_len = params[0].memref.size;
+    if (salt_len != 0 && (salt_len < 24 || salt_len > 128)) {
+        EMSG("Salt must be empty or 24 ~ 128 bytes\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (ctx->shared_key == TEE_HANDLE_NULL) {
+        EMSG("Shared key is not derived\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    uint8_t shared_secret[KEYPAIR_BYTES];
+    uint32_t shared_secret_len = sizeof(shared_secret);
+    res = TEE_GetObjectBufferAttribute(ctx->shared_key, TEE_ATTR_SECRET_VALUE, shared_secret, &shared_secret_len);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate operation, res = 0x%x\n", res);
+        EMSG("Failed to get shared secret, res = 0x%x\n", res);
+        TEE_MemFill(shared_secret, 0, sizeof(shared_secret));
         return res;
     }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to set operation key, res = 0x%x\n", res);
-        goto err_free_operation;
+    uint8_t prk[HKDF_HASH_SIZE];
+    res = hkdf_extract(params[0].memref.buffer, salt_len, shared_secret, shared_secret_len, prk);
+    TEE_MemFill(shared_secret, 0, sizeof(shared_secret));
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = install_channel(&ctx->channel, prk, role, 1, params[1].memref.buffer, params[1].memref.size);
+    TEE_MemFill(prk, 0, sizeof(prk));
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 共享秘密只用于这一次调度, 之后的密钥都从 rekey secret 派生
+    TEE_FreeTransientObject(ctx->shared_key);
+    ctx->shared_key = TEE_HANDLE_NULL;
+
+    params[3].value.a = ctx->channel.epoch;
+
+    IMSG("\nChannel keys installed, epoch %u\n\n", ctx->channel.epoch);
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result rekey(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+    TEE_Result res;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_OUTPUT, 
+        TEE_PARAM_TYPE_NONE, 
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if (ctx->shared_key != TEE_HANDLE_NULL) {
-        TEE_FreeTransientObject(ctx->shared_key);
-        ctx->shared_key = TEE_HANDLE_NULL;
+    if (ctx->channel.epoch == 0) {
+        EMSG("Channel keys are not scheduled\n");
+        return TEE_ERROR_BAD_STATE;
     }
 
-    res = TEE_AllocateTransientObject(TEE_TYPE_GENERIC_SECRET, align_to_8(KEYPAIR_BITS), &ctx->shared_key);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate shared key object, res = 0x%x\n", res);
-        goto err_free_operation;
+    // epoch 为0表示尚未调度, 不能回绕
+    if (ctx->channel.epoch == UINT32_MAX) {
+        EMSG("Key epochs are exhausted\n");
+        return TEE_ERROR_OVERFLOW;
     }
 
-    TEE_InitRefAttribute(&attr, TEE_ATTR_DH_PUBLIC_VALUE, params[0].memref.buffer, params[0].memref.size);
+    // rekey secret 本身就是均匀随机的 PRK, 直接展开即可, 不需要再做 extract
+    uint8_t prk[HKDF_HASH_SIZE];
+    TEE_MemMove(prk, ctx->channel.rekey_secret, sizeof(prk));
 
-    TEE_DeriveKey(ctx->operation, &attr, 1, ctx->shared_key);
-    
-    uint8_t shared_secret[KEYPAIR_BYTES];
-    size_t shared_secret_len = sizeof(shared_secret);
-    res = TEE_GetObjectBufferAttribute(ctx->shared_key, TEE_ATTR_SECRET_VALUE, shared_secret, &shared_secret_len);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to get shared secret, res = 0x%x\n", res);
-        goto err_free_operation;
-    }
+    res = install_channel(&ctx->channel, prk, ctx->channel.role, ctx->channel.epoch + 1, NULL, 0);
+    TEE_MemFill(prk, 0, sizeof(prk));
+    if (res != TEE_SUCCESS)
+        return res;
 
-    TEE_OperationHandle hash_op = TEE_HANDLE_NULL;
-    uint8_t aes_key[AES_SECRET_BITS / 8]; 
-    uint32_t aes_key_len = sizeof(aes_key);
+    params[0].value.a = ctx->channel.epoch;
 
-    res = TEE_AllocateOperation(&hash_op, USE_ALG_AES_HASH, TEE_MODE_DIGEST, 0);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate hash operation, res = 0x%x\n", res);
-        goto err_free_operation;
+    return TEE_SUCCESS;
+}
+
+/*
+ * 先加密后MAC: 输出 记录头 | 密文 | HMAC(记录头 | 密文)
+ * CTR 的 IV 为 记录头 | 4个0, 由TA按发送序号生成, 同一密钥下不会重复, 低32位留给块计数
+ */
+static TEE_Result channel_seal(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+    TEE_Result res;
+    struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, 
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE);
+
+    if (param_type != exp_param_type) {
+        EMSG("Parameter types mismatch\n");
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    res = TEE_DigestDoFinal(hash_op, shared_secret, shared_secret_len, aes_key, &aes_key_len);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to compute hash, res = 0x%x\n", res);
-        TEE_FreeOperation(hash_op);
-        goto err_free_operation;
+    if (ctx->channel.epoch == 0) {
+        EMSG("Channel keys are not scheduled\n");
+        return TEE_ERROR_BAD_STATE;
     }
 
-    TEE_FreeOperation(hash_op);
+    uint32_t plain_len = params[0].memref.size;
+    if (plain_len > params[1].memref.size ||
+        params[1].memref.size - plain_len < CHANNEL_HEADER_SIZE + CHANNEL_TAG_SIZE) {
+        EMSG("Output buffer is too small\n");
+        params[1].memref.size = CHANNEL_HEADER_SIZE + plain_len + CHANNEL_TAG_SIZE;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
 
-    if (ctx->aes_key != TEE_HANDLE_NULL) {
-        TEE_FreeTransientObject(ctx->aes_key);
-        ctx->aes_key = TEE_HANDLE_NULL;
+    // 序号用完之前必须 rekey, 不能回绕到已经用过的 IV
+    if (ctx->channel.tx_seq == UINT64_MAX) {
+        EMSG("Sequence numbers of epoch %u are exhausted\n", ctx->channel.epoch);
+        return TEE_ERROR_OVERFLOW;
     }
 
-    res = TEE_AllocateTransientObject(TEE_TYPE_AES, AES_SECRET_BITS, &ctx->aes_key);
+    uint8_t iv[CTR_IV_SIZE];
+    uint8_t *out = params[1].memref.buffer;
+    uint8_t *cipher = out + CHANNEL_HEADER_SIZE;
+    uint32_t cipher_len = plain_len;
+
+    // 序号先消耗, 后面失败也不回退, 接收方允许序号有空缺
+    TEE_MemFill(iv, 0, sizeof(iv));
+    channel_header(iv, ctx->channel.epoch, ctx->channel.tx_seq++);
+    TEE_MemMove(out, iv, CHANNEL_HEADER_SIZE);
+
+    TEE_CipherInit(ctx->channel.tx_cipher, iv, sizeof(iv));
+    res = TEE_CipherUpdate(ctx->channel.tx_cipher, params[0].memref.buffer, plain_len, cipher, &cipher_len);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate AES key object, res = 0x%x\n", res);
-        goto err_free_operation;
+        EMSG("Cipher update failed, res = 0x%x\n", res);
+        return res;
     }
 
-    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, aes_key, aes_key_len);
-    res = TEE_PopulateTransientObject(ctx->aes_key, &attr, 1);
+    uint32_t tag_len = CHANNEL_TAG_SIZE;
+    TEE_MACInit(ctx->channel.tx_mac, NULL, 0);
+    TEE_MACUpdate(ctx->channel.tx_mac, iv, CHANNEL_HEADER_SIZE);
+    res = TEE_MACComputeFinal(ctx->channel.tx_mac, cipher, cipher_len, cipher + cipher_len, &tag_len);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to populate AES key object, res = 0x%x\n", res);
-        TEE_FreeTransientObject(ctx->aes_key);
-        ctx->aes_key = TEE_HANDLE_NULL;
-        goto err_free_operation;
+        EMSG("MAC compute failed, res = 0x%x\n", res);
+        return res;
     }
 
-    IMSG("\nAES key derived successfully\n\n");
+    params[1].memref.size = CHANNEL_HEADER_SIZE + cipher_len + tag_len;
 
     return TEE_SUCCESS;
-
-err_free_operation:
-    if (ctx->operation) {
-        TEE_FreeOperation(ctx->operation);
-        ctx->operation = TEE_HANDLE_NULL;
-    }
-    return res;
 }
 
-static TEE_Result decrypt(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
+/*
+ * 先检查记录头和MAC, 通过之后才解密
+ * 只接受当前 epoch 且序号不小于 rx_seq 的记录, 重放和乱序的旧记录被拒绝
+ */
+static TEE_Result channel_open(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TEE_Param params[4]) {
     TEE_Result res;
     struct dh_basic_ctx *ctx = (struct dh_basic_ctx *)sess_ctx;
     uint32_t exp_param_type = TEE_PARAM_TYPES(
         TEE_PARAM_TYPE_MEMREF_INPUT, 
-        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_OUTPUT, 
         TEE_PARAM_TYPE_NONE,
         TEE_PARAM_TYPE_NONE);
 
@@ -207,49 +1357,61 @@ static TEE_Result decrypt(struct dh_basic_ctx* sess_ctx, uint32_t param_type, TE
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if (ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation);
-        ctx->operation = TEE_HANDLE_NULL;
+    if (ctx->channel.epoch == 0) {
+        EMSG("Channel keys are not scheduled\n");
+        return TEE_ERROR_BAD_STATE;
     }
 
-    res = TEE_AllocateOperation(&ctx->operation, TEE_ALG_AES_CTR, TEE_MODE_DECRYPT, 256);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate operation, res = 0x%x\n", res);
-        return res;
+    uint32_t in_len = params[0].memref.size;
+    if (in_len < CHANNEL_HEADER_SIZE + CHANNEL_TAG_SIZE) {
+        EMSG("Record is too short\n");
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->aes_key);
+    uint8_t *in = params[0].memref.buffer;
+    uint8_t *cipher = in + CHANNEL_HEADER_SIZE;
+    uint32_t cipher_len = in_len - CHANNEL_HEADER_SIZE - CHANNEL_TAG_SIZE;
+    if (params[1].memref.size < cipher_len) {
+        EMSG("Output buffer is too small\n");
+        params[1].memref.size = cipher_len;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    // 记录头在共享内存中, 拷贝到栈上, 检查、MAC和IV都只用这一份
+    uint8_t iv[CTR_IV_SIZE];
+    uint32_t epoch;
+    uint64_t seq;
+
+    TEE_MemFill(iv, 0, sizeof(iv));
+    TEE_MemMove(iv, in, CHANNEL_HEADER_SIZE);
+    channel_parse_header(iv, &epoch, &seq);
+    if (epoch != ctx->channel.epoch || seq < ctx->channel.rx_seq) {
+        EMSG("Record of epoch %u seq %llu rejected\n", epoch, (unsigned long long)seq);
+        return TEE_ERROR_SECURITY;
+    }
+
+    TEE_MACInit(ctx->channel.rx_mac, NULL, 0);
+    TEE_MACUpdate(ctx->channel.rx_mac, iv, CHANNEL_HEADER_SIZE);
+    res = TEE_MACCompareFinal(ctx->channel.rx_mac, cipher, cipher_len, cipher + cipher_len, CHANNEL_TAG_SIZE);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to set operation key, res = 0x%x\n", res);
-        goto err_free_operation;
+        EMSG("MAC check failed, res = 0x%x\n", res);
+        return res;
     }
 
-    TEE_CipherInit(ctx->operation, params[1].memref.buffer, params[1].memref.size);
+    // MAC 通过后这个序号就被接受了, 不能再打开第二次
+    ctx->channel.rx_seq = seq + 1;
 
-    uint8_t plain_buf[256];
-    uint32_t plain_len = sizeof(plain_buf);
-    res = TEE_CipherUpdate(ctx->operation, params[0].memref.buffer, params[0].memref.size,
-                           plain_buf, &plain_len);
+    uint32_t plain_len = params[1].memref.size;
+    TEE_CipherInit(ctx->channel.rx_cipher, iv, sizeof(iv));
+    res = TEE_CipherUpdate(ctx->channel.rx_cipher, cipher, cipher_len, params[1].memref.buffer, &plain_len);
     if (res != TEE_SUCCESS) {
         EMSG("Cipher update failed, res = 0x%x\n", res);
-        goto err_free_operation;
+        return res;
     }
 
-    printf("\nthe Bob's message is:\n");
-    for (uint32_t i = 0; i < plain_len; i++) {
-        printf("%c", plain_buf[i]);
-    }
-    printf("\n\n");
+    params[1].memref.size = plain_len;
 
     return TEE_SUCCESS;
-
-err_free_operation:
-    if (ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation);
-        ctx->operation = TEE_HANDLE_NULL;
-    }
-
-    return res;
 }
 
 /*******************************************************************************
@@ -261,7 +1423,7 @@ TEE_Result TA_CreateEntryPoint(void) {
 }
 
 void TA_DestroyEntryPoint(void) {
-    
+    pool_trim(0);
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t param_type, TEE_Param params[4], void **sess_ctx) {
@@ -302,6 +1464,9 @@ void TA_CloseSessionEntryPoint(void *sess_ctx) {
         ctx->aes_key = TEE_HANDLE_NULL;
     }
 
+    free_keyring(ctx);
+    free_channel(&ctx->channel);
+
     TEE_Free(ctx);
 }
 
@@ -316,6 +1481,37 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
         case DH_BASIC_DECRYPT:
             return decrypt(sess_ctx, param_type, params);
 
+        case DH_BASIC_REFILL_KEYPAIR_POOL:
+            return refill_keypair_pool(sess_ctx, param_type, params);
+
+        case DH_BASIC_PEER_ENCRYPT:
+        case DH_BASIC_PEER_DECRYPT:
+            return peer_cipher(sess_ctx, param_type, params);
+
+        case DH_BASIC_KEY_SCHEDULE:
+            return key_schedule(sess_ctx, param_type, params);
+
+        case DH_BASIC_REKEY:
+            return rekey(sess_ctx, param_type, params);
+
+        case DH_BASIC_CHANNEL_SEAL:
+            return channel_seal(sess_ctx, param_type, params);
+
+        case DH_BASIC_CHANNEL_OPEN:
+            return channel_open(sess_ctx, param_type, params);
+
+        case DH_BASIC_GCM_ENCRYPT:
+            return gcm_stream(sess_ctx, param_type, params, TEE_MODE_ENCRYPT);
+
+        case DH_BASIC_GCM_DECRYPT:
+            return gcm_stream(sess_ctx, param_type, params, TEE_MODE_DECRYPT);
+
+        case DH_BASIC_GCM_ENCRYPT_BATCH:
+            return gcm_batch(sess_ctx, param_type, params, TEE_MODE_ENCRYPT);
+
+        case DH_BASIC_GCM_DECRYPT_BATCH:
+            return gcm_batch(sess_ctx, param_type, params, TEE_MODE_DECRYPT);
+
         default:
             return TEE_ERROR_BAD_PARAMETERS;
     }
@@ -15,6 +15,7 @@ struct dsa_sha256_ctx {
 	TEEC_Session sess;
 	uint8_t digest[DIGEST_BITS / 8];
 	uint8_t signature[SIGNATURE_SIZE];
+	uint32_t domain;
 };
 
 unsigned char tee_attr_dsa_prime[] = {
@@ -84,7 +85,10 @@ unsigned char tee_attr_dsa_public_value[] = {
     0xE0, 0x8D, 0x80, 0xA0, 0x40, 0xDA, 0xE0, 0xD4, 0x9B, 0xE6, 0xCD, 0x6F, 0xC9, 0xEA, 0x7B, 0xFC
 };
 
-static void set_key0(struct dsa_sha256_ctx *ctx)
+/*
+ * 域参数只注册一次, TA返回句柄, 之后的密钥设置和生成只需要传句柄
+ */
+static void register_domain(struct dsa_sha256_ctx *ctx)
 {
 	TEEC_Operation op;
 	uint32_t error_origin;
@@ -92,7 +96,7 @@ static void set_key0(struct dsa_sha256_ctx *ctx)
 
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
-										TEEC_MEMREF_TEMP_INPUT, TEEC_NONE);
+										TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_OUTPUT);
 	op.params[0].tmpref.buffer = tee_attr_dsa_prime;
 	op.params[0].tmpref.size = sizeof(tee_attr_dsa_prime);
 	op.params[1].tmpref.buffer = tee_attr_dsa_subprime;
@@ -100,39 +104,75 @@ static void set_key0(struct dsa_sha256_ctx *ctx)
 	op.params[2].tmpref.buffer = tee_attr_dsa_base;
 	op.params[2].tmpref.size = sizeof(tee_attr_dsa_base);
 
-	res = TEEC_InvokeCommand(&ctx->sess, DSA_SHA256_SET_KEY_0, &op, &error_origin);
+	res = TEEC_InvokeCommand(&ctx->sess, DSA_SHA256_REGISTER_DOMAIN, &op, &error_origin);
 	if(res != TEEC_SUCCESS) 
-		errx(1, "set key pair failed\n");
-	
-	printf("set key0 successful\n\n");
+		errx(1, "register domain failed\n");
+
+	ctx->domain = op.params[3].value.a;
+	printf("domain handle is 0x%x\n\n", ctx->domain);
 }
 
-static void set_key1(struct dsa_sha256_ctx *ctx)
+static void release_domain(struct dsa_sha256_ctx *ctx)
 {
 	TEEC_Operation op;
 	uint32_t error_origin;
 	TEEC_Result res;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
-										TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = tee_attr_dsa_public_value;
-	op.params[0].tmpref.size = sizeof(tee_attr_dsa_public_value);
-	op.params[1].tmpref.buffer = tee_attr_dsa_private_value;
-	op.params[1].tmpref.size = sizeof(tee_attr_dsa_private_value);
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = ctx->domain;
+
+	res = TEEC_InvokeCommand(&ctx->sess, DSA_SHA256_RELEASE_DOMAIN, &op, &error_origin);
+	if(res != TEEC_SUCCESS) 
+		errx(1, "release domain failed\n");
+}
+
+static void set_key(struct dsa_sha256_ctx *ctx)
+{
+	TEEC_Operation op;
+	uint32_t error_origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT,
+										TEEC_MEMREF_TEMP_INPUT, TEEC_NONE);
+	op.params[0].value.a = ctx->domain;
+	op.params[1].tmpref.buffer = tee_attr_dsa_public_value;
+	op.params[1].tmpref.size = sizeof(tee_attr_dsa_public_value);
+	op.params[2].tmpref.buffer = tee_attr_dsa_private_value;
+	op.params[2].tmpref.size = sizeof(tee_attr_dsa_private_value);
 
-	res = TEEC_InvokeCommand(&ctx->sess, DSA_SHA256_SET_KEY_1, &op, &error_origin);
+	res = TEEC_InvokeCommand(&ctx->sess, DSA_SHA256_SET_KEY, &op, &error_origin);
 	if(res != TEEC_SUCCESS) 
 		errx(1, "set key pair failed\n");
 	
-	printf("set key1 successful\n\n");
 	printf("set keypair successful\n\n");
 }
 
-static void set_key(struct dsa_sha256_ctx *ctx)
+static void generate_key(struct dsa_sha256_ctx *ctx)
 {
-	set_key0(ctx);
-	set_key1(ctx);
+	TEEC_Operation op;
+	uint32_t error_origin;
+	TEEC_Result res;
+	uint8_t pub[DSA_PUB_VALUE_SIZE];
+	uint32_t i;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+										TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = ctx->domain;
+	op.params[1].tmpref.buffer = pub;
+	op.params[1].tmpref.size = sizeof(pub);
+
+	res = TEEC_InvokeCommand(&ctx->sess, DSA_SHA256_GEN_KEY, &op, &error_origin);
+	if(res != TEEC_SUCCESS) 
+		errx(1, "generate key pair failed\n");
+
+	printf("public key :\n");
+	for(i = 0; i < op.params[1].tmpref.size; i++) {
+		printf("%02x", pub[i]);
+	}
+	printf("\n\n");
 }
 
 static void digest(struct dsa_sha256_ctx *ctx)
@@ -210,10 +250,25 @@ static void verify(struct dsa_sha256_ctx *ctx)
 
 static void example(struct dsa_sha256_ctx *ctx)
 {
+	register_domain(ctx);
 	set_key(ctx);
 	digest(ctx);
 	sign(ctx);
 	verify(ctx);
+	release_domain(ctx);
+}
+
+// 同一组域参数生成多个新密钥对, 每次只传句柄
+static void generate_example(struct dsa_sha256_ctx *ctx)
+{
+	register_domain(ctx);
+	for (int i = 0; i < 3; i++) {
+		generate_key(ctx);
+		digest(ctx);
+		sign(ctx);
+		verify(ctx);
+	}
+	release_domain(ctx);
 }
 
 static void prepare_tee_session(struct dsa_sha256_ctx *ctx)
@@ -242,13 +297,17 @@ static void terminate_tee_session(struct dsa_sha256_ctx *ctx)
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     struct dsa_sha256_ctx ctx;
 
     prepare_tee_session(&ctx);
 
-    example(&ctx);
+    // dsa_sha256 gen : 在注册的域参数上生成新的密钥对
+    if (argc > 1 && strcmp(argv[1], "gen") == 0)
+        generate_example(&ctx);
+    else
+        example(&ctx);
 
     terminate_tee_session(&ctx);
 
@@ -12,8 +12,50 @@ struct dsa_sha256_ctx {
     uint8_t tee_attr_dsa_base[DSA_BASE_SIZE];
     uint8_t tee_attr_dsa_public_value[DSA_PUB_VALUE_SIZE];
     uint8_t tee_attr_dsa_private_value[DSA_PRIV_VALUE_SIZE];
+
+    uint32_t domain_refs[DSA_DOMAIN_MAX];   // 本会话对每个域参数表项持有的引用数, 关闭会话时归还
+};
+
+/*
+ * 注册过的域参数, 放在TA全局状态中由所有会话共享, TA为单实例, 入口函数串行执行
+ * 句柄的低8位为表项下标加1, 高位为表项的代数, 释放后旧句柄失效
+ * 每次注册引用数加一, 引用数为0时表项空闲
+ */
+struct dsa_domain {
+    uint32_t generation;
+    uint32_t refs;
+    uint8_t prime[DSA_PRIME_SIZE];
+    uint8_t subprime[DSA_SUBPRIME_SIZE];
+    uint8_t base[DSA_BASE_SIZE];
 };
 
+static struct dsa_domain domains[DSA_DOMAIN_MAX];
+
+static uint32_t domain_handle(uint32_t index)
+{
+    return (domains[index].generation << 8) | (index + 1);
+}
+
+static struct dsa_domain *domain_lookup(uint32_t handle)
+{
+    uint32_t index = (handle & 0xFF) - 1;
+
+    if (index >= DSA_DOMAIN_MAX || !domains[index].refs ||
+        domains[index].generation != (handle >> 8)) {
+        EMSG("invalid domain handle 0x%x\n", handle);
+        return NULL;
+    }
+
+    return &domains[index];
+}
+
+static void domain_attrs(struct dsa_domain *domain, TEE_Attribute attrs[DSA_COMPONENTS_MAX])
+{
+    TEE_InitRefAttribute(&attrs[DSA_PRIME], TEE_ATTR_DSA_PRIME, domain->prime, DSA_PRIME_SIZE);
+    TEE_InitRefAttribute(&attrs[DSA_SUBPRIME], TEE_ATTR_DSA_SUBPRIME, domain->subprime, DSA_SUBPRIME_SIZE);
+    TEE_InitRefAttribute(&attrs[DSA_BASE], TEE_ATTR_DSA_BASE, domain->base, DSA_BASE_SIZE);
+}
+
 static TEE_Result set_key0(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
     struct dsa_sha256_ctx *ctx = (struct dsa_sha256_ctx *)sess_ctx;
@@ -104,6 +146,229 @@ static TEE_Result set_key1(void **sess_ctx, uint32_t param_type, TEE_Param param
 }
 
 
+static TEE_Result register_domain(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct dsa_sha256_ctx *ctx = (struct dsa_sha256_ctx *)sess_ctx;
+    struct dsa_domain *free_slot = NULL;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_VALUE_OUTPUT
+    );
+
+    if (param_type != exp_param_type) {
+        EMSG("bad parameters\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (params[0].memref.size != DSA_PRIME_SIZE ||
+        params[1].memref.size != DSA_SUBPRIME_SIZE ||
+        params[2].memref.size != DSA_BASE_SIZE) {
+        EMSG("incorrect DSA parameter sizes\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 相同的域参数只保存一份, 直接返回已有的句柄
+    for (uint32_t i = 0; i < DSA_DOMAIN_MAX; i++) {
+        struct dsa_domain *domain = &domains[i];
+
+        if (!domain->refs) {
+            if (!free_slot)
+                free_slot = domain;
+            continue;
+        }
+
+        if (!TEE_MemCompare(domain->prime, params[0].memref.buffer, DSA_PRIME_SIZE) &&
+            !TEE_MemCompare(domain->subprime, params[1].memref.buffer, DSA_SUBPRIME_SIZE) &&
+            !TEE_MemCompare(domain->base, params[2].memref.buffer, DSA_BASE_SIZE)) {
+            domain->refs++;
+            ctx->domain_refs[i]++;
+            params[3].value.a = domain_handle(i);
+            return TEE_SUCCESS;
+        }
+    }
+
+    if (!free_slot) {
+        EMSG("domain table is full\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    TEE_MemMove(free_slot->prime, params[0].memref.buffer, DSA_PRIME_SIZE);
+    TEE_MemMove(free_slot->subprime, params[1].memref.buffer, DSA_SUBPRIME_SIZE);
+    TEE_MemMove(free_slot->base, params[2].memref.buffer, DSA_BASE_SIZE);
+    free_slot->refs = 1;
+    free_slot->generation = (free_slot->generation + 1) & 0xFFFFFF;
+    ctx->domain_refs[free_slot - domains]++;
+
+    params[3].value.a = domain_handle(free_slot - domains);
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result release_domain(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct dsa_sha256_ctx *ctx = (struct dsa_sha256_ctx *)sess_ctx;
+    struct dsa_domain *domain;
+    uint32_t index;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, 
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE, 
+        TEE_PARAM_TYPE_NONE
+    );
+
+    if (param_type != exp_param_type) {
+        EMSG("bad parameters\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    domain = domain_lookup(params[0].value.a);
+    if (!domain)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+
+    // 只能释放本会话注册过的引用, 其他会话仍可继续使用同一个句柄
+    index = domain - domains;
+    if (!ctx->domain_refs[index]) {
+        EMSG("domain handle 0x%x is not held by this session\n", params[0].value.a);
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    }
+
+    // 已经用这组参数建好的密钥对不受影响, 密钥对象里有自己的一份
+    ctx->domain_refs[index]--;
+    domain->refs--;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result alloc_keypair(struct dsa_sha256_ctx *ctx)
+{
+    TEE_Result res;
+
+    if (ctx->keypair != TEE_HANDLE_NULL) {
+        TEE_FreeTransientObject(ctx->keypair);
+        ctx->keypair = TEE_HANDLE_NULL;
+    }
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_DSA_KEYPAIR, KEYPAIR_BITS, &ctx->keypair);
+    if (res != TEE_SUCCESS)
+        EMSG("alloc key pair failed\n");
+
+    return res;
+}
+
+static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct dsa_sha256_ctx *ctx = (struct dsa_sha256_ctx *)sess_ctx;
+    TEE_Attribute dsa_attrs[DSA_COMPONENTS_MAX];
+    struct dsa_domain *domain;
+    TEE_Result res;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_NONE, 
+        TEE_PARAM_TYPE_NONE
+    );
+
+    if (param_type != exp_param_type) {
+        EMSG("bad parameters\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (params[1].memref.size < DSA_PUB_VALUE_SIZE) {
+        EMSG("public key buffer is too short\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    domain = domain_lookup(params[0].value.a);
+    if (!domain)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+
+    res = alloc_keypair(ctx);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 属性直接引用全局表中的域参数, 不再拷贝到会话
+    domain_attrs(domain, dsa_attrs);
+
+    res = TEE_GenerateKey(ctx->keypair, KEYPAIR_BITS, dsa_attrs, DSA_BASE + 1);
+    if (res != TEE_SUCCESS) {
+        EMSG("generate key pair failed, res is 0x%x\n", res);
+        goto err_free_keypair;
+    }
+
+    uint32_t pub_size = params[1].memref.size;
+    res = TEE_GetObjectBufferAttribute(ctx->keypair, TEE_ATTR_DSA_PUBLIC_VALUE,
+                                       params[1].memref.buffer, &pub_size);
+    if (res != TEE_SUCCESS) {
+        EMSG("get public key failed, res is 0x%x\n", res);
+        goto err_free_keypair;
+    }
+    params[1].memref.size = pub_size;
+
+    return TEE_SUCCESS;
+
+err_free_keypair:
+    TEE_FreeTransientObject(ctx->keypair);
+    ctx->keypair = TEE_HANDLE_NULL;
+
+    return res;
+}
+
+static TEE_Result set_key(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct dsa_sha256_ctx *ctx = (struct dsa_sha256_ctx *)sess_ctx;
+    TEE_Attribute dsa_attrs[DSA_COMPONENTS_MAX];
+    struct dsa_domain *domain;
+    TEE_Result res;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_VALUE_INPUT, 
+        TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_INPUT, 
+        TEE_PARAM_TYPE_NONE
+    );
+
+    if (param_type != exp_param_type) {
+        EMSG("bad parameters\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (params[1].memref.size != DSA_PUB_VALUE_SIZE ||
+        params[2].memref.size != DSA_PRIV_VALUE_SIZE) {
+        EMSG("incorrect public/private key sizes\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    domain = domain_lookup(params[0].value.a);
+    if (!domain)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+
+    res = alloc_keypair(ctx);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 填充时密钥对象会自己拷贝一份, 公私钥直接引用参数缓冲区
+    domain_attrs(domain, dsa_attrs);
+    TEE_InitRefAttribute(&dsa_attrs[DSA_PUB_VALUE], TEE_ATTR_DSA_PUBLIC_VALUE,
+                         params[1].memref.buffer, DSA_PUB_VALUE_SIZE);
+    TEE_InitRefAttribute(&dsa_attrs[DSA_PRIV_VALUE], TEE_ATTR_DSA_PRIVATE_VALUE,
+                         params[2].memref.buffer, DSA_PRIV_VALUE_SIZE);
+
+    res = TEE_PopulateTransientObject(ctx->keypair, dsa_attrs, DSA_COMPONENTS_MAX);
+    if (res != TEE_SUCCESS) {
+        EMSG("set key pair failed\n");
+        TEE_FreeTransientObject(ctx->keypair);
+        ctx->keypair = TEE_HANDLE_NULL;
+        return res;
+    }
+
+    return TEE_SUCCESS;
+}
+
 static TEE_Result digest(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
     struct dsa_sha256_ctx *ctx = (struct dsa_sha256_ctx *)sess_ctx;
@@ -284,6 +549,10 @@ void TA_CloseSessionEntryPoint(void *sess_ctx)
     if(ctx->keypair != TEE_HANDLE_NULL)
         TEE_FreeTransientObject(ctx->keypair);
 
+    // CA 没有释放(或已崩溃)的域参数引用在这里归还
+    for (uint32_t i = 0; i < DSA_DOMAIN_MAX; i++)
+        domains[i].refs -= ctx->domain_refs[i];
+
     TEE_Free(ctx);
 }
 
@@ -305,6 +574,18 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
         case DSA_SHA256_VERIFY:
             return verify(sess_ctx, param_type, params);
 
+        case DSA_SHA256_REGISTER_DOMAIN:
+            return register_domain(sess_ctx, param_type, params);
+
+        case DSA_SHA256_RELEASE_DOMAIN:
+            return release_domain(sess_ctx, param_type, params);
+
+        case DSA_SHA256_GEN_KEY:
+            return generate_key(sess_ctx, param_type, params);
+
+        case DSA_SHA256_SET_KEY:
+            return set_key(sess_ctx, param_type, params);
+
         default:
             return TEE_ERROR_BAD_PARAMETERS;
     }
@@ -16,6 +16,8 @@
 #define DSA_PUB_VALUE_SIZE        256
 #define DSA_PRIV_VALUE_SIZE       32
 
+#define DSA_DOMAIN_MAX            (4)  // 同时注册的域参数组数
+
 
 /***************************************************************** */
 
@@ -83,4 +85,48 @@ enum dsa_components {
  */
 #define DSA_SHA256_VERIFY         4
 
+/* 
+ * @brief : register a domain parameter set shared by all sessions,
+ *          the same set registered twice returns the same handle and takes another reference,
+ *          references still held when the session closes are dropped
+ *
+ * param[0] (memref-input)     : dsa prime
+ * param[1] (memref-input)     : dsa subprime
+ * param[2] (memref-input)     : dsa base
+ * param[3] (value-output)     : a : domain handle
+ */
+#define DSA_SHA256_REGISTER_DOMAIN    5
+
+/* 
+ * @brief : drop one reference this session holds on a domain, the set is freed with the last reference,
+ *          key pairs already built from it are kept
+ *
+ * param[0] (value-input)      : a : domain handle
+ * param[1] (unused)
+ * param[2] (unused)
+ * param[3] (unused)
+ */
+#define DSA_SHA256_RELEASE_DOMAIN     6
+
+/* 
+ * @brief : generate a key pair over a registered domain
+ *
+ * param[0] (value-input)      : a : domain handle
+ * param[1] (memref-output)    : public key
+ * param[2] (unused)
+ * param[3] (unused)
+ */
+#define DSA_SHA256_GEN_KEY            7
+
+/* 
+ * @brief : set key pair over a registered domain in one call,
+ *          replaces DSA_SHA256_SET_KEY_0 + DSA_SHA256_SET_KEY_1
+ *
+ * param[0] (value-input)      : a : domain handle
+ * param[1] (memref-input)     : public key
+ * param[2] (memref-input)     : private key
+ * param[3] (unused)
+ */
+#define DSA_SHA256_SET_KEY            8
+
 #endif /* _DSA_SHAX_H */
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <time.h>
 #include <tee_client_api.h>
 
 #include "../ta/include/ecdh_x25519.h"
@@ -13,6 +14,10 @@ struct ecdh_x25519_ctx {
     uint8_t peer_pub_key[KEYPAIR_SIZE * 3];
 };
 
+#define BENCH_ROUNDS        (200)
+#define DEMO_PEERS          (4)
+#define DEMO_RECORDS        (4)
+
 
 static uint8_t hex_char_to_byte(char c) {
     if (c >= '0' && c <= '9') return c - '0';
@@ -170,6 +175,475 @@ static void dh_example(struct ecdh_x25519_ctx *ctx) {
     send_cipher_text(ctx);
 }
 
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void refill_keypair_pool(TEEC_Session *sess, uint32_t depth) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    op.params[0].value.a = depth;
+
+    res = TEEC_InvokeCommand(sess, ECDH_X25519_REFILL_KEYPAIR_POOL, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Failed to refill keypair pool, code 0x%x\n", res);
+    }
+}
+
+static void bench_keypair(TEEC_Session *sess, uint8_t *pub_key, size_t size) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    op.params[0].tmpref.buffer = pub_key;
+    op.params[0].tmpref.size = size;
+
+    res = TEEC_InvokeCommand(sess, ECDH_X25519_GEN_DH_KEYPAIR, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Failed to generate keypair, code 0x%x\n", res);
+    }
+}
+
+static void bench_derive(TEEC_Session *sess, uint8_t *peer_pub_key, size_t size) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+    op.params[0].tmpref.buffer = peer_pub_key;
+    op.params[0].tmpref.size = size;
+
+    res = TEEC_InvokeCommand(sess, ECDH_X25519_DERIVE_KEY, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Failed to derive shared key, code 0x%x\n", res);
+    }
+}
+
+/*
+ * Alice 与 Bob 各开一个会话, 一次握手 = 双方各生成一次密钥对并各派生一次
+ * 启用密钥池时, 在每次握手前(不计时)把池补满, 模拟空闲时补充
+ */
+static void bench_handshake(struct ecdh_x25519_ctx *ctx, int use_pool) {
+    TEEC_Session bob;
+    TEEC_UUID uuid = TA_ECDH_X25519_UUID;
+    uint32_t origin;
+    TEEC_Result res;
+    uint8_t alice_pub[KEYPAIR_SIZE];
+    uint8_t bob_pub[KEYPAIR_SIZE];
+    uint64_t lat[BENCH_ROUNDS];
+
+    res = TEEC_OpenSession(&ctx->ctx, &bob, &uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x\n", res, origin);
+    }
+
+    refill_keypair_pool(&ctx->sess, use_pool ? KEYPAIR_POOL_MAX_DEPTH : 0);
+
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        if (use_pool)
+            refill_keypair_pool(&ctx->sess, KEYPAIR_POOL_MAX_DEPTH);
+
+        uint64_t start = now_ns();
+        bench_keypair(&ctx->sess, alice_pub, sizeof(alice_pub));
+        bench_keypair(&bob, bob_pub, sizeof(bob_pub));
+        bench_derive(&ctx->sess, bob_pub, sizeof(bob_pub));
+        bench_derive(&bob, alice_pub, sizeof(alice_pub));
+        lat[i] = now_ns() - start;
+    }
+
+    refill_keypair_pool(&ctx->sess, 0);
+    TEEC_CloseSession(&bob);
+
+    qsort(lat, BENCH_ROUNDS, sizeof(lat[0]), cmp_u64);
+    printf("pool %-3s : p50 = %8.3f ms, p99 = %8.3f ms (%d handshakes)\n",
+           use_pool ? "on" : "off",
+           lat[BENCH_ROUNDS / 2] / 1e6, lat[BENCH_ROUNDS * 99 / 100] / 1e6, BENCH_ROUNDS);
+}
+
+static void bench_example(struct ecdh_x25519_ctx *ctx) {
+    bench_handshake(ctx, 0);
+    bench_handshake(ctx, 1);
+}
+
+static void derive_peer_key(TEEC_Session *sess, uint8_t *peer_pub_key, size_t size, uint32_t peer_id) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
+    op.params[0].tmpref.buffer = peer_pub_key;
+    op.params[0].tmpref.size = size;
+    op.params[1].value.a = peer_id;
+
+    res = TEEC_InvokeCommand(sess, ECDH_X25519_DERIVE_KEY, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Failed to derive key of peer %u, code 0x%x\n", peer_id, res);
+    }
+}
+
+static size_t peer_cipher(TEEC_Session *sess, uint32_t cmd, uint32_t peer_id, uint8_t *iv,
+                          const void *in, size_t in_len, void *out, size_t out_len) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT,
+                                     TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT);
+    op.params[0].value.a = peer_id;
+    op.params[1].tmpref.buffer = iv;
+    op.params[1].tmpref.size = 16;
+    op.params[2].tmpref.buffer = (void *)in;
+    op.params[2].tmpref.size = in_len;
+    op.params[3].tmpref.buffer = out;
+    op.params[3].tmpref.size = out_len;
+
+    res = TEEC_InvokeCommand(sess, cmd, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Peer %u cipher failed, code 0x%x\n", peer_id, res);
+    }
+
+    return op.params[3].tmpref.size;
+}
+
+/*
+ * Alice 一个会话通过密钥环同时与多个 Bob 通信, 每个 Bob 使用独立的会话
+ */
+static void peers_example(struct ecdh_x25519_ctx *ctx) {
+    TEEC_Session bob[DEMO_PEERS];
+    TEEC_UUID uuid = TA_ECDH_X25519_UUID;
+    uint32_t origin;
+    TEEC_Result res;
+    uint8_t alice_pub[KEYPAIR_SIZE];
+    uint8_t bob_pub[KEYPAIR_SIZE];
+    uint8_t iv[16];
+    char msg[64];
+    uint8_t cipher[64];
+    char plain[64];
+
+    memset(iv, 0x5A, sizeof(iv));
+
+    for (uint32_t i = 0; i < DEMO_PEERS; i++) {
+        res = TEEC_OpenSession(&ctx->ctx, &bob[i], &uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+        if (res != TEEC_SUCCESS) {
+            errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x\n", res, origin);
+        }
+
+        bench_keypair(&ctx->sess, alice_pub, sizeof(alice_pub));
+        bench_keypair(&bob[i], bob_pub, sizeof(bob_pub));
+        derive_peer_key(&ctx->sess, bob_pub, sizeof(bob_pub), i);
+        derive_peer_key(&bob[i], alice_pub, sizeof(alice_pub), 0);
+    }
+
+    for (uint32_t i = 0; i < DEMO_PEERS; i++) {
+        snprintf(msg, sizeof(msg), "hello from Bob %u", i);
+        size_t cipher_len = peer_cipher(&bob[i], ECDH_X25519_PEER_ENCRYPT, 0, iv, msg, strlen(msg),
+                                        cipher, sizeof(cipher));
+        size_t plain_len = peer_cipher(&ctx->sess, ECDH_X25519_PEER_DECRYPT, i, iv, cipher, cipher_len,
+                                       plain, sizeof(plain) - 1);
+        plain[plain_len] = '\0';
+        printf("peer %u : %s\n", i, plain);
+    }
+
+    for (uint32_t i = 0; i < DEMO_PEERS; i++)
+        TEEC_CloseSession(&bob[i]);
+}
+
+static uint32_t key_schedule(TEEC_Session *sess, uint32_t role, const void *context, size_t context_len) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
+                                     TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT);
+    op.params[0].tmpref.buffer = NULL;
+    op.params[0].tmpref.size = 0;
+    op.params[1].tmpref.buffer = (void *)context;
+    op.params[1].tmpref.size = context_len;
+    op.params[2].value.a = role;
+
+    res = TEEC_InvokeCommand(sess, ECDH_X25519_KEY_SCHEDULE, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Failed to run key schedule, code 0x%x\n", res);
+    }
+
+    return op.params[3].value.a;
+}
+
+static uint32_t rekey(TEEC_Session *sess) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+
+    res = TEEC_InvokeCommand(sess, ECDH_X25519_REKEY, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Failed to rekey, code 0x%x\n", res);
+    }
+
+    return op.params[0].value.a;
+}
+
+static TEEC_Result channel_invoke(TEEC_Session *sess, uint32_t cmd, const void *in, size_t in_len,
+                                  void *out, size_t *out_len) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_NONE, TEEC_NONE);
+    op.params[0].tmpref.buffer = (void *)in;
+    op.params[0].tmpref.size = in_len;
+    op.params[1].tmpref.buffer = out;
+    op.params[1].tmpref.size = *out_len;
+
+    res = TEEC_InvokeCommand(sess, cmd, &op, &error_origin);
+    *out_len = op.params[1].tmpref.size;
+
+    return res;
+}
+
+// IV 和序号都由TA生成, 记录为 头 | 密文 | 标签
+static size_t channel_record(TEEC_Session *sess, uint32_t cmd,
+                             const void *in, size_t in_len, void *out, size_t out_len) {
+    TEEC_Result res;
+
+    res = channel_invoke(sess, cmd, in, in_len, out, &out_len);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "Channel record failed, code 0x%x\n", res);
+    }
+
+    return out_len;
+}
+
+/*
+ * 一次密钥协商之后用 HKDF 派生双向的通信密钥, Alice 为发起方, Bob 为响应方
+ * 双方各发一条消息, 重放的记录被拒绝, 然后同时 rekey 再发一条
+ */
+static void channel_example(struct ecdh_x25519_ctx *ctx) {
+    TEEC_Session bob;
+    TEEC_UUID uuid = TA_ECDH_X25519_UUID;
+    uint32_t origin;
+    TEEC_Result res;
+    uint8_t alice_pub[KEYPAIR_SIZE];
+    uint8_t bob_pub[KEYPAIR_SIZE];
+    uint8_t context[(KEYPAIR_SIZE) * 2];
+    char msg[64];
+    uint8_t record[CHANNEL_HEADER_SIZE + 64 + CHANNEL_TAG_SIZE];
+    char plain[64];
+
+    res = TEEC_OpenSession(&ctx->ctx, &bob, &uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x\n", res, origin);
+    }
+
+    size_t alice_len = sizeof(alice_pub);
+    size_t bob_len = sizeof(bob_pub);
+    bench_keypair(&ctx->sess, alice_pub, alice_len);
+    bench_keypair(&bob, bob_pub, bob_len);
+    bench_derive(&ctx->sess, bob_pub, bob_len);
+    bench_derive(&bob, alice_pub, alice_len);
+
+    // 双方使用相同的上下文: 发起方公钥 | 响应方公钥
+    memcpy(context, alice_pub, alice_len);
+    memcpy(context + alice_len, bob_pub, bob_len);
+    key_schedule(&ctx->sess, CHANNEL_ROLE_INITIATOR, context, alice_len + bob_len);
+    key_schedule(&bob, CHANNEL_ROLE_RESPONDER, context, alice_len + bob_len);
+
+    for (uint32_t epoch = 1; epoch <= 2; epoch++) {
+        snprintf(msg, sizeof(msg), "hello from Alice, epoch %u", epoch);
+        size_t record_len = channel_record(&ctx->sess, ECDH_X25519_CHANNEL_SEAL, msg, strlen(msg),
+                                           record, sizeof(record));
+        size_t plain_len = channel_record(&bob, ECDH_X25519_CHANNEL_OPEN, record, record_len,
+                                          plain, sizeof(plain) - 1);
+        plain[plain_len] = '\0';
+        printf("Bob received   : %s\n", plain);
+
+        plain_len = sizeof(plain) - 1;
+        res = channel_invoke(&bob, ECDH_X25519_CHANNEL_OPEN, record, record_len, plain, &plain_len);
+        if (res != TEEC_ERROR_SECURITY)
+            errx(1, "Replayed record was not rejected, code 0x%x\n", res);
+        printf("Bob rejected the replayed record\n");
+
+        snprintf(msg, sizeof(msg), "hello from Bob, epoch %u", epoch);
+        record_len = channel_record(&bob, ECDH_X25519_CHANNEL_SEAL, msg, strlen(msg),
+                                    record, sizeof(record));
+        plain_len = channel_record(&ctx->sess, ECDH_X25519_CHANNEL_OPEN, record, record_len,
+                                   plain, sizeof(plain) - 1);
+        plain[plain_len] = '\0';
+        printf("Alice received : %s\n", plain);
+
+        if (rekey(&ctx->sess) != rekey(&bob))
+            errx(1, "Key epoch mismatch\n");
+    }
+
+    TEEC_CloseSession(&bob);
+}
+
+static size_t gcm_chunk(TEEC_Session *sess, uint32_t cmd, uint32_t flags, const void *aad, size_t aad_len,
+                        const void *in, size_t in_len, void *out, size_t out_len) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT,
+                                     TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT);
+    op.params[0].value.a = flags;
+    op.params[1].tmpref.buffer = (void *)aad;
+    op.params[1].tmpref.size = aad_len;
+    op.params[2].tmpref.buffer = (void *)in;
+    op.params[2].tmpref.size = in_len;
+    op.params[3].tmpref.buffer = out;
+    op.params[3].tmpref.size = out_len;
+
+    res = TEEC_InvokeCommand(sess, cmd, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "AES-GCM chunk failed, code 0x%x\n", res);
+    }
+
+    return op.params[3].tmpref.size;
+}
+
+static size_t gcm_batch(TEEC_Session *sess, uint32_t cmd, const void *in, size_t in_len, void *out, size_t out_len) {
+    TEEC_Operation op;
+    TEEC_Result res;
+    uint32_t error_origin;
+
+    memset(&op, 0, sizeof(op));
+    op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+                                     TEEC_VALUE_OUTPUT, TEEC_NONE);
+    op.params[0].tmpref.buffer = (void *)in;
+    op.params[0].tmpref.size = in_len;
+    op.params[1].tmpref.buffer = out;
+    op.params[1].tmpref.size = out_len;
+
+    res = TEEC_InvokeCommand(sess, cmd, &op, &error_origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "AES-GCM batch failed, code 0x%x\n", res);
+    }
+
+    printf("%u records processed\n", op.params[2].value.a);
+
+    return op.params[1].tmpref.size;
+}
+
+/*
+ * 共享密钥不离开TA, 密钥调度后 Alice 加密 Bob 解密: 单条记录, 分段流式记录, 批量记录
+ * nonce 由TA生成, 放在加密输出的最前面, 解密时原样送回
+ */
+static void gcm_example(struct ecdh_x25519_ctx *ctx) {
+    TEEC_Session bob;
+    TEEC_UUID uuid = TA_ECDH_X25519_UUID;
+    uint32_t origin;
+    TEEC_Result res;
+    uint8_t alice_pub[KEYPAIR_SIZE];
+    uint8_t bob_pub[KEYPAIR_SIZE];
+    uint8_t context[(KEYPAIR_SIZE) * 2];
+    const char *aad = "record#1";
+    const char *msg = "the whole secure channel runs inside the TA";
+    size_t msg_len = strlen(msg);
+    uint8_t cipher[128];
+    char plain[128];
+    size_t cipher_len, plain_len;
+
+    res = TEEC_OpenSession(&ctx->ctx, &bob, &uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+    if (res != TEEC_SUCCESS) {
+        errx(1, "TEEC_OpenSession failed with code 0x%x origin 0x%x\n", res, origin);
+    }
+
+    size_t alice_len = sizeof(alice_pub);
+    size_t bob_len = sizeof(bob_pub);
+    bench_keypair(&ctx->sess, alice_pub, alice_len);
+    bench_keypair(&bob, bob_pub, bob_len);
+    bench_derive(&ctx->sess, bob_pub, bob_len);
+    bench_derive(&bob, alice_pub, alice_len);
+
+    // 双方使用相同的上下文: 发起方公钥 | 响应方公钥
+    memcpy(context, alice_pub, alice_len);
+    memcpy(context + alice_len, bob_pub, bob_len);
+    key_schedule(&ctx->sess, CHANNEL_ROLE_INITIATOR, context, alice_len + bob_len);
+    key_schedule(&bob, CHANNEL_ROLE_RESPONDER, context, alice_len + bob_len);
+
+    // 记录为 nonce | 密文 | 标签
+    cipher_len = gcm_chunk(&ctx->sess, ECDH_X25519_GCM_ENCRYPT, GCM_CHUNK_FIRST | GCM_CHUNK_LAST,
+                           aad, strlen(aad), msg, msg_len, cipher, sizeof(cipher));
+    plain_len = gcm_chunk(&bob, ECDH_X25519_GCM_DECRYPT, GCM_CHUNK_FIRST | GCM_CHUNK_LAST,
+                          aad, strlen(aad), cipher, cipher_len, plain, sizeof(plain) - 1);
+    plain[plain_len] = '\0';
+    printf("single record   : %s\n", plain);
+
+    // 加密分三段, 解密分两段, nonce 在第一段里, 标签完整地在最后一段里
+    size_t third = msg_len / 3;
+    cipher_len = gcm_chunk(&ctx->sess, ECDH_X25519_GCM_ENCRYPT, GCM_CHUNK_FIRST, aad, strlen(aad),
+                           msg, third, cipher, sizeof(cipher));
+    cipher_len += gcm_chunk(&ctx->sess, ECDH_X25519_GCM_ENCRYPT, 0, NULL, 0,
+                            msg + third, third, cipher + cipher_len, sizeof(cipher) - cipher_len);
+    cipher_len += gcm_chunk(&ctx->sess, ECDH_X25519_GCM_ENCRYPT, GCM_CHUNK_LAST, NULL, 0,
+                            msg + 2 * third, msg_len - 2 * third, cipher + cipher_len, sizeof(cipher) - cipher_len);
+
+    size_t half = cipher_len / 2;
+    plain_len = gcm_chunk(&bob, ECDH_X25519_GCM_DECRYPT, GCM_CHUNK_FIRST, aad, strlen(aad),
+                          cipher, half, plain, sizeof(plain) - 1);
+    plain_len += gcm_chunk(&bob, ECDH_X25519_GCM_DECRYPT, GCM_CHUNK_LAST, NULL, 0,
+                           cipher + half, cipher_len - half, plain + plain_len, sizeof(plain) - 1 - plain_len);
+    plain[plain_len] = '\0';
+    printf("streamed record : %s\n", plain);
+
+    // 放弃未结束的流式记录: 直接开始新记录, 或转去批量处理, TA 会复位操作, 用掉的 nonce 不会再用
+    gcm_chunk(&ctx->sess, ECDH_X25519_GCM_ENCRYPT, GCM_CHUNK_FIRST, aad, strlen(aad),
+              msg, third, cipher, sizeof(cipher));
+    gcm_chunk(&ctx->sess, ECDH_X25519_GCM_ENCRYPT, GCM_CHUNK_FIRST, aad, strlen(aad),
+              msg, third, cipher, sizeof(cipher));
+    printf("abandoned record: 2 records left unfinished\n");
+
+    // 批量: 每条记录 struct gcm_record | 数据, 加密时 nonce 由TA填入输出
+    uint8_t batch_in[DEMO_RECORDS * (sizeof(struct gcm_record) + 32 + GCM_TAG_SIZE)];
+    uint8_t batch_out[sizeof(batch_in)];
+    struct gcm_record hdr;
+    size_t off = 0;
+
+    for (uint32_t i = 0; i < DEMO_RECORDS; i++) {
+        char text[32];
+
+        memset(hdr.nonce, 0, GCM_IV_SIZE);
+        hdr.len = snprintf(text, sizeof(text), "batched record %u", i);
+        memcpy(batch_in + off, &hdr, sizeof(hdr));
+        memcpy(batch_in + off + sizeof(hdr), text, hdr.len);
+        off += sizeof(hdr) + hdr.len;
+    }
+
+    size_t batch_len = gcm_batch(&ctx->sess, ECDH_X25519_GCM_ENCRYPT_BATCH, batch_in, off, batch_out, sizeof(batch_out));
+    batch_len = gcm_batch(&bob, ECDH_X25519_GCM_DECRYPT_BATCH, batch_out, batch_len, batch_in, sizeof(batch_in));
+
+    for (off = 0; off < batch_len; off += sizeof(hdr) + hdr.len) {
+        memcpy(&hdr, batch_in + off, sizeof(hdr));
+        printf("batch           : %.*s\n", (int)hdr.len, (char *)batch_in + off + sizeof(hdr));
+    }
+
+    TEEC_CloseSession(&bob);
+}
+
 static void prepare_tee_session(struct ecdh_x25519_ctx *ctx) {
     TEEC_UUID uuid = TA_ECDH_X25519_UUID;
     uint32_t origin;
@@ -192,12 +666,25 @@ static void terminate_tee_session(struct ecdh_x25519_ctx *ctx) {
     TEEC_FinalizeContext(&ctx->ctx);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     struct ecdh_x25519_ctx ctx;
 
     prepare_tee_session(&ctx);
 
-    dh_example(&ctx);
+    // ecdh_x25519 bench : 测试握手延迟(密钥池关闭/开启)
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        bench_example(&ctx);
+    // ecdh_x25519 peers : 一个会话通过密钥环与多个对端通信
+    else if (argc > 1 && strcmp(argv[1], "peers") == 0)
+        peers_example(&ctx);
+    // ecdh_x25519 channel : HKDF派生双向通信密钥并rekey
+    else if (argc > 1 && strcmp(argv[1], "channel") == 0)
+        channel_example(&ctx);
+    // ecdh_x25519 gcm : 共享密钥留在TA内, 用AES-GCM加解密(单条/流式/批量)
+    else if (argc > 1 && strcmp(argv[1], "gcm") == 0)
+        gcm_example(&ctx);
+    else
+        dh_example(&ctx);
 
     terminate_tee_session(&ctx);
 
@@ -37,6 +37,21 @@
 #define USE_ALG_AES_HASH		TEE_ALG_SHA256
 #define AES_SECRET_BITS (256)
 
+#define KEYPAIR_POOL_MAX_DEPTH		(8)
+#define KEYRING_MAX_PEERS			(256)
+
+#define HKDF_HASH_SIZE				(32)
+#define CHANNEL_TAG_SIZE			(32)
+#define CHANNEL_HEADER_SIZE			(12)
+#define CHANNEL_ROLE_INITIATOR		(0)
+#define CHANNEL_ROLE_RESPONDER		(1)
+
+#define CTR_IV_SIZE					(16)
+#define GCM_IV_SIZE					(12)
+#define GCM_TAG_SIZE				(16)
+#define GCM_CHUNK_FIRST				(1 << 0)
+#define GCM_CHUNK_LAST				(1 << 1)
+
 /* 
  * @brief : generate key pair by ECDH
  *
@@ -52,7 +67,9 @@
  *
  * param[0] (memref-input) : the peer public key x
  * param[1] (memref-input) : the peer public key y
- * param[2] (unsued)
+ * param[2] (unsued or value-input) : a : peer id, optional, if present the key is stored
+ * 							  in the session keyring for ECDH_PEER_ENCRYPT/ECDH_PEER_DECRYPT instead
+ * 							  (at most KEYRING_MAX_PEERS peers, the least recently used one is evicted)
  * param[3] (unsued)
  */
 #define ECDH_DERIVE_KEY				1
@@ -67,4 +84,147 @@
  */
 #define ECDH_DECRYPT				2
 
+/* 
+ * @brief : refill the ephemeral key pair pool to the target depth,
+ *          call it when idle, ECDH_GEN_DH_KEYPAIR will take a key pair from the pool
+ *          and generate it synchronously only if the pool is empty
+ *
+ * param[0] (value-inout) 	: a : target depth (input, 0 ~ KEYPAIR_POOL_MAX_DEPTH, 0 disables the pool)
+ * 							  a : pool depth (output)
+ * param[1] (unsued)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define ECDH_REFILL_KEYPAIR_POOL	3
+
+/* 
+ * @brief : encrypt message by AES-CTR with the key of the peer in the keyring
+ *
+ * param[0] (value-input) 	: a : peer id
+ * param[1] (memref-input) 	: IV (CTR_IV_SIZE bytes)
+ * param[2] (memref-input) 	: the plain text
+ * param[3] (memref-output) : the cipher text
+ */
+#define ECDH_PEER_ENCRYPT			4
+
+/* 
+ * @brief : decrypt message by AES-CTR with the key of the peer in the keyring
+ *
+ * param[0] (value-input) 	: a : peer id
+ * param[1] (memref-input) 	: IV (CTR_IV_SIZE bytes)
+ * param[2] (memref-input) 	: the cipher text
+ * param[3] (memref-output) : the plain text
+ */
+#define ECDH_PEER_DECRYPT			5
+
+/* 
+ * @brief : run the HKDF-SHA256 key schedule over the last shared secret (derived by ECDH_DERIVE_KEY)
+ *          and install the channel keys, the shared secret is wiped afterwards
+ *          labels "c2s key" / "c2s mac" / "c2s gcm" / "s2c key" / "s2c mac" / "s2c gcm" / "rekey",
+ *          the initiator sends with c2s
+ *
+ * param[0] (memref-input) 	: HKDF salt, empty or 24 ~ 128 bytes
+ * param[1] (memref-input) 	: context appended to every label (e.g. both public keys), may be empty
+ * param[2] (value-input) 	: a : CHANNEL_ROLE_INITIATOR or CHANNEL_ROLE_RESPONDER
+ * param[3] (value-output) 	: a : key epoch (1)
+ */
+#define ECDH_KEY_SCHEDULE			6
+
+/* 
+ * @brief : replace the channel keys by the ones expanded from the rekey secret,
+ *          both sides must rekey at the same point of the stream, sequence numbers restart from 0
+ *
+ * param[0] (value-output) 	: a : new key epoch
+ * param[1] (unsued)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define ECDH_REKEY				7
+
+/* 
+ * @brief : encrypt a record by AES-CTR and append HMAC-SHA256(header | cipher text) with the send keys,
+ *          the header is the key epoch (4 bytes) | the send sequence number (8 bytes), both big endian,
+ *          the CTR IV is header | 4 zero bytes, built by the TA so it never repeats under one key,
+ *          TEE_ERROR_OVERFLOW once the sequence numbers of the epoch are used up, rekey first
+ *
+ * param[0] (memref-input) 	: the plain text
+ * param[1] (memref-output) : header (CHANNEL_HEADER_SIZE bytes) | cipher text | tag (CHANNEL_TAG_SIZE bytes)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define ECDH_CHANNEL_SEAL			8
+
+/* 
+ * @brief : check the header and the tag and decrypt a record with the receive keys,
+ *          TEE_ERROR_MAC_INVALID if the tag mismatches, TEE_ERROR_SECURITY if the record is not of the current
+ *          epoch or its sequence number is below the next expected one (replayed or reordered),
+ *          gaps are allowed since a failed seal still uses up its sequence number
+ *
+ * param[0] (memref-input) 	: header (CHANNEL_HEADER_SIZE bytes) | cipher text | tag (CHANNEL_TAG_SIZE bytes)
+ * param[1] (memref-output) : the plain text
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define ECDH_CHANNEL_OPEN			9
+
+/*
+ * 批量AES-GCM的记录头, 后面紧跟 len 字节数据, 多条记录依次排列
+ * 加密输出的数据为 密文 | 标签, 解密输入的数据为 密文 | 标签
+ * nonce 由TA生成: 加密输入中的 nonce 被忽略, 输出中为TA写入的 nonce
+ */
+struct gcm_record {
+	uint8_t nonce[GCM_IV_SIZE];
+	uint32_t len;
+};
+
+/* 
+ * @brief : AES-GCM encrypt with the send GCM key of the key schedule, a record may be split into chunks
+ *          over several calls, TEE_ERROR_BAD_STATE before the key schedule,
+ *          the nonce is the key epoch (4 bytes) | the send nonce counter (8 bytes), both big endian,
+ *          built by the TA and returned at the head of the first chunk, TEE_ERROR_OVERFLOW once
+ *          the counter is used up, rekey first
+ *
+ * param[0] (value-input) 	: a : GCM_CHUNK_FIRST | GCM_CHUNK_LAST, both for a single call record
+ * param[1] (memref-input) 	: AAD, used with GCM_CHUNK_FIRST only, may be empty
+ * param[2] (memref-input) 	: the plain text chunk
+ * param[3] (memref-output) : the nonce (GCM_IV_SIZE bytes) on the first chunk, then the cipher text chunk,
+ * 							  followed by the tag (GCM_TAG_SIZE bytes) on the last chunk,
+ * 							  at least GCM_IV_SIZE (first chunk) + the chunk size + GCM_TAG_SIZE
+ */
+#define ECDH_GCM_ENCRYPT			10
+
+/* 
+ * @brief : AES-GCM decrypt with the receive GCM key of the key schedule, a record may be split into chunks
+ *          over several calls, the tag is checked on the last chunk so the plain text of the previous chunks
+ *          must not be trusted before it succeeds, TEE_ERROR_SECURITY if the nonce is not of the current
+ *          epoch or its counter is below the next expected one (replayed or reordered)
+ *
+ * param[0] (value-input) 	: a : GCM_CHUNK_FIRST | GCM_CHUNK_LAST, both for a single call record
+ * param[1] (memref-input) 	: AAD, used with GCM_CHUNK_FIRST only, may be empty
+ * param[2] (memref-input) 	: the nonce (GCM_IV_SIZE bytes) on the first chunk, then the cipher text chunk,
+ * 							  the last chunk ends with the whole tag
+ * param[3] (memref-output) : the plain text chunk, at least the chunk size + GCM_TAG_SIZE
+ */
+#define ECDH_GCM_DECRYPT			11
+
+/* 
+ * @brief : AES-GCM encrypt a batch of records in one call, each record takes the next send nonce
+ *
+ * param[0] (memref-input) 	: struct gcm_record | plain text, ...
+ * param[1] (memref-output) : struct gcm_record | cipher text | tag, ...
+ * param[2] (value-output) 	: a : record count
+ * param[3] (unsued)
+ */
+#define ECDH_GCM_ENCRYPT_BATCH		12
+
+/* 
+ * @brief : AES-GCM decrypt a batch of records in one call, stops at the first bad tag or rejected nonce
+ *
+ * param[0] (memref-input) 	: struct gcm_record | cipher text | tag, ...
+ * param[1] (memref-output) : struct gcm_record | plain text, ...
+ * param[2] (value-output) 	: a : record count
+ * param[3] (unsued)
+ */
+#define ECDH_GCM_DECRYPT_BATCH		13
+
 #endif /* _ECDH_XXX_H */
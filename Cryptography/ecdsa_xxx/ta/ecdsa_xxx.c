@@ -204,6 +204,134 @@ err_free_operation:
     return res;
 }
 
+static uint32_t der_tlv_size(uint32_t len)
+{
+    return 1 + (len < 0x80 ? 1 : 2) + len;
+}
+
+static uint8_t *der_put_header(uint8_t *p, uint8_t tag, uint32_t len)
+{
+    *p++ = tag;
+    if(len >= 0x80)
+        *p++ = 0x81;
+    *p++ = len & 0xFF;
+
+    return p;
+}
+
+// 曲线 OID, 包括 tag 和长度
+static const uint8_t *curve_oid(uint32_t curve, uint32_t *len)
+{
+    static const uint8_t p192[] = { 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x01 };
+    static const uint8_t p224[] = { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x21 };
+    static const uint8_t p256[] = { 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 };
+    static const uint8_t p384[] = { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x22 };
+    static const uint8_t p521[] = { 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x23 };
+
+    switch(curve) {
+        case TEE_ECC_CURVE_NIST_P192:
+            *len = sizeof(p192);
+            return p192;
+
+        case TEE_ECC_CURVE_NIST_P224:
+            *len = sizeof(p224);
+            return p224;
+
+        case TEE_ECC_CURVE_NIST_P256:
+            *len = sizeof(p256);
+            return p256;
+
+        case TEE_ECC_CURVE_NIST_P384:
+            *len = sizeof(p384);
+            return p384;
+
+        default:
+            *len = sizeof(p521);
+            return p521;
+    }
+}
+
+// 坐标去掉了前导0时, 左侧补0到 KEYPAIR_SIZE
+static TEE_Result get_coordinate(TEE_ObjectHandle keypair, uint32_t attr, uint8_t *out)
+{
+    uint8_t buf[KEYPAIR_SIZE];
+    uint32_t len = sizeof(buf);
+    TEE_Result res;
+
+    res = TEE_GetObjectBufferAttribute(keypair, attr, buf, &len);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    TEE_MemFill(out, 0, KEYPAIR_SIZE - len);
+    TEE_MemMove(out + KEYPAIR_SIZE - len, buf, len);
+
+    return TEE_SUCCESS;
+}
+
+/**
+ * raw format：0x04 + X + Y, 未压缩的点
+ * DER format：SubjectPublicKeyInfo, 与 openssl ec -pubout -outform der 的输出相同
+ */
+static TEE_Result export_public_key(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct ecdsa_xxx_ctx *ctx = (struct ecdsa_xxx_ctx *)sess_ctx;
+    static const uint8_t ec_public_key_oid[] = { 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01 };
+    TEE_Result res;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if(param_type != exp_param_type) {
+        EMSG("param type is not correct\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t format = params[0].value.a;
+    if(format != PUBKEY_FORMAT_RAW && format != PUBKEY_FORMAT_DER) {
+        EMSG("unknown public key format %u\n", format);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if(ctx->keypair == TEE_HANDLE_NULL) {
+        EMSG("key pair is not generated\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    uint32_t oid_len;
+    const uint8_t *oid = curve_oid(USE_ELEMENT, &oid_len);
+    uint32_t point_len = 1 + KEYPAIR_SIZE * 2;
+    uint32_t alg_len = sizeof(ec_public_key_oid) + oid_len;
+    uint32_t spki_len = der_tlv_size(alg_len) + der_tlv_size(1 + point_len);
+    uint32_t need = format == PUBKEY_FORMAT_RAW ? point_len : der_tlv_size(spki_len);
+    if(params[1].memref.size < need) {
+        params[1].memref.size = need;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    uint8_t *p = params[1].memref.buffer;
+    if(format == PUBKEY_FORMAT_DER) {
+        // SEQUENCE { SEQUENCE { ecPublicKey, curve }, BIT STRING { point } }
+        p = der_put_header(p, 0x30, spki_len);
+        p = der_put_header(p, 0x30, alg_len);
+        TEE_MemMove(p, ec_public_key_oid, sizeof(ec_public_key_oid));
+        p += sizeof(ec_public_key_oid);
+        TEE_MemMove(p, oid, oid_len);
+        p += oid_len;
+        p = der_put_header(p, 0x03, 1 + point_len);
+        *p++ = 0; // 没有未使用的位
+    }
+
+    *p++ = 0x04;
+    res = get_coordinate(ctx->keypair, TEE_ATTR_ECC_PUBLIC_VALUE_X, p);
+    if(res == TEE_SUCCESS)
+        res = get_coordinate(ctx->keypair, TEE_ATTR_ECC_PUBLIC_VALUE_Y, p + KEYPAIR_SIZE);
+    if(res != TEE_SUCCESS) {
+        EMSG("get public value failed\n");
+        return res;
+    }
+    params[1].memref.size = need;
+
+    return TEE_SUCCESS;
+}
+
 /*******************************************************************************
  * Mandatory TA functions.
  ******************************************************************************/
@@ -262,6 +390,9 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
         case ECDSA_XXX_VERIFY:
             return verify(sess_ctx, param_type, params);
 
+        case ECDSA_XXX_EXPORT_PUBKEY:
+            return export_public_key(sess_ctx, param_type, params);
+
         default:
             return TEE_ERROR_BAD_PARAMETERS;
     }
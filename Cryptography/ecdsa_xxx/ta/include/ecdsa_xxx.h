@@ -36,6 +36,9 @@
 
 #define DIGEST_BITS (256)
 
+#define PUBKEY_FORMAT_RAW (0) // 0x04 | X | Y, uncompressed point
+#define PUBKEY_FORMAT_DER (1) // SubjectPublicKeyInfo
+
 /* 
  * @brief : generate keypair
  *
@@ -76,4 +79,14 @@
  */
 #define ECDSA_XXX_VERIFY 	3
 
+/* 
+ * @brief : export the public key, the signature can then be verified in the normal world
+ *
+ * param[0] (value-input) 	: a : PUBKEY_FORMAT_RAW or PUBKEY_FORMAT_DER
+ * param[1] (memref-output)	: public key, TEE_ERROR_SHORT_BUFFER returns the needed size
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define ECDSA_XXX_EXPORT_PUBKEY 	4
+
 #endif /* _ECDSA_XXX_H */
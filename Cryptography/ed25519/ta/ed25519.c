@@ -161,6 +161,57 @@ err_free_operation:
     return res;
 }
 
+/**
+ * raw format：32 字节公钥
+ * DER format：SubjectPublicKeyInfo, 与 openssl pkey -pubout -outform der 的输出相同
+ */
+static TEE_Result export_public_key(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct ed25519_xxx_ctx *ctx = (struct ed25519_xxx_ctx *)sess_ctx;
+    // SEQUENCE { SEQUENCE { id-Ed25519 }, BIT STRING { public key } }
+    static const uint8_t spki_prefix[] = {
+        0x30, 0x2a, 0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x70, 0x03, 0x21, 0x00
+    };
+    TEE_Result res;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if(param_type != exp_param_type) {
+        EMSG("param type is not correct\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t format = params[0].value.a;
+    if(format != PUBKEY_FORMAT_RAW && format != PUBKEY_FORMAT_DER) {
+        EMSG("unknown public key format %u\n", format);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if(ctx->keypair == TEE_HANDLE_NULL) {
+        EMSG("key pair is not generated\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    uint32_t prefix_len = format == PUBKEY_FORMAT_DER ? sizeof(spki_prefix) : 0;
+    uint32_t need = prefix_len + KEYPAIR_SIZE;
+    if(params[1].memref.size < need) {
+        params[1].memref.size = need;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    uint8_t *p = params[1].memref.buffer;
+    TEE_MemMove(p, spki_prefix, prefix_len);
+
+    uint32_t key_len = KEYPAIR_SIZE;
+    res = TEE_GetObjectBufferAttribute(ctx->keypair, TEE_ATTR_ED25519_PUBLIC_VALUE, p + prefix_len, &key_len);
+    if(res != TEE_SUCCESS) {
+        EMSG("get public value failed\n");
+        return res;
+    }
+    params[1].memref.size = need;
+
+    return TEE_SUCCESS;
+}
+
 /*******************************************************************************
  * Mandatory TA functions.
  ******************************************************************************/
@@ -216,6 +267,9 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
         case ED25519_VERIFY:
             return verify(sess_ctx, param_type, params);
 
+        case ED25519_EXPORT_PUBKEY:
+            return export_public_key(sess_ctx, param_type, params);
+
         default:
             return TEE_ERROR_BAD_PARAMETERS;
     }
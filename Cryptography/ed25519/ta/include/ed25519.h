@@ -8,6 +8,9 @@
 #define KEYPAIR_BITS 					(256)
 #define KEYPAIR_SIZE 					(KEYPAIR_BITS / 8)
 
+#define PUBKEY_FORMAT_RAW (0) // 32 bytes public key
+#define PUBKEY_FORMAT_DER (1) // SubjectPublicKeyInfo
+
 /* 
  * @brief : generate keypair
  *
@@ -38,4 +41,14 @@
  */
 #define ED25519_VERIFY 	2
 
+/* 
+ * @brief : export the public key, the signature can then be verified in the normal world
+ *
+ * param[0] (value-input) 	: a : PUBKEY_FORMAT_RAW or PUBKEY_FORMAT_DER
+ * param[1] (memref-output)	: public key, TEE_ERROR_SHORT_BUFFER returns the needed size
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define ED25519_EXPORT_PUBKEY 	3
+
 #endif /* _ED25519_H */
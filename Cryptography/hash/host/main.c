@@ -2,17 +2,27 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <tee_client_api.h>
 
 #include "../ta/include/hash.h"
+#include "shm_pool.h"
 
 #define DIGEST_SIZE (DIGEST_BITS / 8)
 
 char *message = "hello world";
 
+// 摘要和小消息用 256B, bench 用到 4KiB 和 1MiB
+static const struct shm_pool_class shm_classes[] = {
+	{ 256, 2 },
+	{ 4 * 1024, 1 },
+	{ 1024 * 1024, 1 },
+};
+
 struct hash_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
+	struct shm_pool *pool;
 };
 
 static void digest(struct hash_ctx *ctx)
@@ -20,16 +30,22 @@ static void digest(struct hash_ctx *ctx)
 	TEEC_Operation op;
 	uint32_t error_origin;
 	TEEC_Result res;
-	uint8_t digest[DIGEST_SIZE];
+	struct shm_buf *in, *out;
+	uint8_t *digest;
 	uint32_t i;
 
+	in = shm_pool_get(ctx->pool, strlen(message));
+	out = shm_pool_get(ctx->pool, DIGEST_SIZE);
+	if(!in || !out)
+		errx(1, "shm_pool_get failed\n");
+	memcpy(in->data, message, strlen(message));
+	digest = out->data;
+
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
 										TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = message;
-	op.params[0].tmpref.size = strlen(message);
-	op.params[1].tmpref.buffer = digest;
-	op.params[1].tmpref.size = DIGEST_SIZE;
+	shm_buf_param(&op.params[0], in, strlen(message));
+	shm_buf_param(&op.params[1], out, DIGEST_SIZE);
 
 	res = TEEC_InvokeCommand(&ctx->sess, HASH_DIGEST, &op, &error_origin);
 	if(res != TEEC_SUCCESS) 
@@ -37,12 +53,100 @@ static void digest(struct hash_ctx *ctx)
 	
 	printf("orgin message is %s\n\n", message);
 
-	uint32_t digest_size = op.params[1].tmpref.size;
+	uint32_t digest_size = op.params[1].memref.size;
 	printf("digestis :\n");
 	for(i = 0; i < digest_size; i++) {
 		printf("%02x", digest[i]);
 	}
 	printf("\n\n");
+
+	shm_pool_put(ctx->pool, in);
+	shm_pool_put(ctx->pool, out);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void digest_invoke(struct hash_ctx *ctx, TEEC_Operation *op)
+{
+	uint32_t error_origin;
+	TEEC_Result res;
+
+	res = TEEC_InvokeCommand(&ctx->sess, HASH_DIGEST, op, &error_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "digest failed with code 0x%x origin 0x%x", res, error_origin);
+}
+
+/*
+ * 同样大小的消息分别用 TEEC_MEMREF_TEMP_* (libteec 每次调用临时申请共享内存并拷贝)
+ * 和共享内存池中的缓冲区(消息直接写在共享内存中)计算摘要, 比较每秒的调用次数
+ */
+static void bench_size(struct hash_ctx *ctx, size_t size)
+{
+	uint32_t rounds = size > 64 * 1024 ? 50 : 2000;
+	uint8_t digest[DIGEST_SIZE];
+	struct shm_buf *in, *out;
+	uint64_t start, t_tmpref, t_pool;
+	TEEC_Operation op;
+	uint8_t *msg;
+
+	msg = malloc(size);
+	in = shm_pool_get(ctx->pool, size);
+	out = shm_pool_get(ctx->pool, DIGEST_SIZE);
+	if(!msg || !in || !out)
+		errx(1, "out of memory\n");
+	memset(msg, 0xA5, size);
+	memset(in->data, 0xA5, size);
+
+	start = now_ns();
+	for(uint32_t i = 0; i < rounds; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+											TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = msg;
+		op.params[0].tmpref.size = size;
+		op.params[1].tmpref.buffer = digest;
+		op.params[1].tmpref.size = DIGEST_SIZE;
+		digest_invoke(ctx, &op);
+	}
+	t_tmpref = now_ns() - start;
+
+	start = now_ns();
+	for(uint32_t i = 0; i < rounds; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+											TEEC_NONE, TEEC_NONE);
+		shm_buf_param(&op.params[0], in, size);
+		shm_buf_param(&op.params[1], out, DIGEST_SIZE);
+		digest_invoke(ctx, &op);
+	}
+	t_pool = now_ns() - start;
+
+	if(memcmp(digest, out->data, DIGEST_SIZE))
+		errx(1, "digest mismatch at %zu bytes\n", size);
+
+	printf("%8zu B %14.0f %14.0f %8.2fx\n", size,
+		(double)rounds * 1000000000 / t_tmpref,
+		(double)rounds * 1000000000 / t_pool,
+		(double)t_tmpref / t_pool);
+
+	shm_pool_put(ctx->pool, in);
+	shm_pool_put(ctx->pool, out);
+	free(msg);
+}
+
+static void bench(struct hash_ctx *ctx)
+{
+	size_t sizes[] = { 64, 4 * 1024, 1024 * 1024 };
+
+	printf("%10s %14s %14s %9s\n", "size", "tmpref ops/s", "shm_pool ops/s", "speedup");
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		bench_size(ctx, sizes[i]);
 }
 
 static void prepare_tee_session(struct hash_ctx *ctx)
@@ -57,6 +161,10 @@ static void prepare_tee_session(struct hash_ctx *ctx)
 	    exit(0);
 	}
 
+	ctx->pool = shm_pool_create(&ctx->ctx, shm_classes, sizeof(shm_classes) / sizeof(shm_classes[0]));
+	if (!ctx->pool)
+		errx(1, "shm_pool_create failed");
+
 	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
 			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
 	if (res != TEEC_SUCCESS) {
@@ -68,16 +176,21 @@ static void prepare_tee_session(struct hash_ctx *ctx)
 static void terminate_tee_session(struct hash_ctx *ctx)
 {
 	TEEC_CloseSession(&ctx->sess);
+	shm_pool_destroy(ctx->pool);
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     struct hash_ctx ctx;
 
     prepare_tee_session(&ctx);
 
-    digest(&ctx);
+    // hash bench : 64B/4KiB/1MiB 消息 tmpref 和共享内存池的每秒调用次数
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        bench(&ctx);
+    else
+        digest(&ctx);
 
     terminate_tee_session(&ctx);
 
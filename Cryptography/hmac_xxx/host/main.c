@@ -5,12 +5,19 @@
 #include <tee_client_api.h>
 
 #include "../ta/include/hmac_xxx.h"
+#include "shm_pool.h"
 
 #define MAC_LEN (MAC_BITS / 8)
 
+// 密钥、消息和MAC各一个缓冲区
+static const struct shm_pool_class shm_classes[] = {
+	{ 256, 3 },
+};
+
 struct hmac_xxx_ctx {
 	TEEC_Context ctx;
 	TEEC_Session sess;
+	struct shm_pool *pool;
 };
 
 /**
@@ -26,57 +33,63 @@ static void hmac_xxx_example(struct hmac_xxx_ctx *ctx)
 	uint32_t error_origin;
 	uint16_t i;
 	char *origin_data = "Hello World";
-	uint8_t key[MAC_LEN] = {0};
-	uint8_t mac[MAC_LEN] = {0};
+	struct shm_buf *key_buf = shm_pool_get(ctx->pool, MAC_LEN);
+	struct shm_buf *data_buf = shm_pool_get(ctx->pool, strlen(origin_data));
+	struct shm_buf *mac_buf = shm_pool_get(ctx->pool, MAC_LEN);
+	if(!key_buf || !data_buf || !mac_buf)
+		errx(1, "shm_pool_get failed\n");
+
+	uint8_t *key = key_buf->data;
+	uint8_t *mac = mac_buf->data;
+	memcpy(data_buf->data, origin_data, strlen(origin_data));
 
 	// generate key
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE,
 					 TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = key;
-	op.params[0].tmpref.size = MAC_LEN;
+	shm_buf_param(&op.params[0], key_buf, MAC_LEN);
 
 	ret = TEEC_InvokeCommand(&ctx->sess, HMAC_XXX_GEN_KEY, &op, &error_origin);
 	if(ret != TEEC_SUCCESS) 
 		errx(1, "generate key failed\n");
 
 	printf("random key is :\n");
-	for(i = 0; i < op.params[0].tmpref.size; i++) 
+	for(i = 0; i < op.params[0].memref.size; i++) 
 		printf("%02x", key[i]);
 	printf("\n\n");
 
 	// generate mac
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
 					 TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = origin_data;
-	op.params[0].tmpref.size = strlen(origin_data);
-	op.params[1].tmpref.buffer = mac;
-	op.params[1].tmpref.size = MAC_LEN;
+	shm_buf_param(&op.params[0], data_buf, strlen(origin_data));
+	shm_buf_param(&op.params[1], mac_buf, MAC_LEN);
 
 	ret = TEEC_InvokeCommand(&ctx->sess, HMAC_XXX_GEN_MAC, &op, &error_origin);
 	if(ret != TEEC_SUCCESS)
 		errx(1, "generate mac failed\n");
 
 	printf("MAC is :\n");
-	for(i = 0; i < op.params[1].tmpref.size; i++) 
+	for(i = 0; i < op.params[1].memref.size; i++) 
 		printf("%02x", mac[i]);
 	printf("\n\n");
 
 	// verify mac
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_INPUT,
 					 TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = origin_data;
-	op.params[0].tmpref.size = strlen(origin_data);
-	op.params[1].tmpref.buffer = mac;
-	op.params[1].tmpref.size = MAC_LEN;
+	shm_buf_param(&op.params[0], data_buf, strlen(origin_data));
+	shm_buf_param(&op.params[1], mac_buf, MAC_LEN);
 
 	ret = TEEC_InvokeCommand(&ctx->sess, HMAC_XXX_VERIFY_MAC, &op, &error_origin);
 	if(ret != TEEC_SUCCESS)
 		errx(1, "verify mac failed\n");
 
 	printf("verify success\n");
+
+	shm_pool_put(ctx->pool, key_buf);
+	shm_pool_put(ctx->pool, data_buf);
+	shm_pool_put(ctx->pool, mac_buf);
 }
 
 static void prepare_tee_session(struct hmac_xxx_ctx *ctx)
@@ -91,6 +104,10 @@ static void prepare_tee_session(struct hmac_xxx_ctx *ctx)
 	    exit(0);
 	}
 
+	ctx->pool = shm_pool_create(&ctx->ctx, shm_classes, sizeof(shm_classes) / sizeof(shm_classes[0]));
+	if (!ctx->pool)
+		errx(1, "shm_pool_create failed");
+
 	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
 			       TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
 	if (res != TEEC_SUCCESS) {
@@ -102,6 +119,7 @@ static void prepare_tee_session(struct hmac_xxx_ctx *ctx)
 static void terminate_tee_session(struct hmac_xxx_ctx *ctx)
 {
 	TEEC_CloseSession(&ctx->sess);
+	shm_pool_destroy(ctx->pool);
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
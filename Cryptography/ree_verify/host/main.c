@@ -0,0 +1,338 @@
+#include <err.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <tee_client_api.h>
+
+/*
+ * 几个签名工程的头文件里 KEYPAIR_SIZE 等宏同名但取值不同, 逐个包含后取消定义,
+ * 这里只用到 UUID, 命令号和 PUBKEY_FORMAT_*
+ */
+#include "../../rsassa_pkcs1_v1_5_xxx/ta/include/rsassa_pkcs1_v1_5_xxx.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+#undef USE_RSA_ALGORITHM
+#undef USE_DIGEST_ALGORITHM
+#undef DIGEST_BITS
+
+#include "../../rsassa_pkcs1_pss_mgf1_xxx/ta/include/rsassa_pkcs1_pss_mgf1_xxx.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+#undef USE_RSA_ALGORITHM
+#undef USE_DIGEST_ALGORITHM
+#undef DIGEST_BITS
+
+#include "../../ecdsa_xxx/ta/include/ecdsa_xxx.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+#undef USE_ECDSA_ALGORITHM
+#undef USE_ELEMENT
+#undef DIGEST_BITS
+
+#include "../../ed25519/ta/include/ed25519.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+
+#include "ree_verify.h"
+
+#define BUFFER_SIZE 	(1024)
+#define DEFAULT_ROUNDS 	(200)
+#define NO_DIGEST 		(0xFFFFFFFF)
+
+char *message = "hello world";
+
+struct verify_ta {
+	const char *name;
+	TEEC_UUID uuid;
+	uint32_t gen_key_cmd;
+	uint32_t digest_cmd; 	// Ed25519 直接对消息签名, 为 NO_DIGEST
+	uint32_t sign_cmd;
+	uint32_t verify_cmd;
+	uint32_t export_cmd;
+	enum ree_verify_alg alg;
+};
+
+static const struct verify_ta verify_tas[] = {
+	{
+		"rsassa_pkcs1_v1_5", TA_RSASSA_PKCS1_V1_5_XXX_UUID,
+		RSASSA_PKCS1_V1_5_XXX_GEN_KEY, RSASSA_PKCS1_V1_5_XXX_DIGEST, RSASSA_PKCS1_V1_5_XXX_SIGN,
+		RSASSA_PKCS1_V1_5_XXX_VERIFY, RSASSA_PKCS1_V1_5_XXX_EXPORT_PUBKEY, REE_VERIFY_RSA_PKCS1_V1_5
+	},
+	{
+		"rsassa_pkcs1_pss_mgf1", TA_RSASSA_PKCS1_PSS_MGF1_XXX_UUID,
+		RSASSA_PKCS1_PSS_MGF1_XXX_GEN_KEY, RSASSA_PKCS1_PSS_MGF1_XXX_DIGEST, RSASSA_PKCS1_PSS_MGF1_XXX_SIGN,
+		RSASSA_PKCS1_PSS_MGF1_XXX_VERIFY, RSASSA_PKCS1_PSS_MGF1_XXX_EXPORT_PUBKEY, REE_VERIFY_RSA_PSS
+	},
+	{
+		"ecdsa", TA_ECDSA_XXX_UUID,
+		ECDSA_XXX_GEN_KEY, ECDSA_XXX_DIGEST, ECDSA_XXX_SIGN,
+		ECDSA_XXX_VERIFY, ECDSA_XXX_EXPORT_PUBKEY, REE_VERIFY_ECDSA
+	},
+	{
+		"ed25519", TA_ED25519_UUID,
+		ED25519_GEN_KEY, NO_DIGEST, ED25519_SIGN,
+		ED25519_VERIFY, ED25519_EXPORT_PUBKEY, REE_VERIFY_ED25519
+	},
+};
+
+struct verify_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	const struct verify_ta *ta;
+	uint8_t data[BUFFER_SIZE]; 		// 摘要, Ed25519 为消息
+	uint32_t data_len;
+	uint8_t signature[BUFFER_SIZE];
+	uint32_t signature_len;
+	uint8_t pub_key[BUFFER_SIZE];
+	uint32_t pub_key_len;
+};
+
+struct verify_worker {
+	pthread_t thread;
+	const struct ree_verify_key *key;
+	struct verify_ctx *ctx;
+	uint32_t rounds;
+	uint32_t failures;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static TEEC_Result invoke_inout(struct verify_ctx *ctx, uint32_t cmd, uint32_t out_type,
+								void *in, uint32_t in_len, void *out, uint32_t *out_len)
+{
+	TEEC_Operation op;
+	uint32_t error_origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, out_type,
+										TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = in;
+	op.params[0].tmpref.size = in_len;
+	op.params[1].tmpref.buffer = out;
+	op.params[1].tmpref.size = *out_len;
+
+	res = TEEC_InvokeCommand(&ctx->sess, cmd, &op, &error_origin);
+	if(out_type == TEEC_MEMREF_TEMP_OUTPUT)
+		*out_len = op.params[1].tmpref.size;
+
+	return res;
+}
+
+static uint32_t export_public_key(struct verify_ctx *ctx, uint32_t format, uint8_t *out, uint32_t size)
+{
+	TEEC_Operation op;
+	uint32_t error_origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+										TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = format;
+	op.params[1].tmpref.buffer = out;
+	op.params[1].tmpref.size = size;
+
+	res = TEEC_InvokeCommand(&ctx->sess, ctx->ta->export_cmd, &op, &error_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "%s: export public key failed, res is 0x%x\n", ctx->ta->name, res);
+
+	return op.params[1].tmpref.size;
+}
+
+/*
+ * 生成密钥对, 计算摘要并签名, 签名只在TA中进行
+ */
+static void sign_in_tee(struct verify_ctx *ctx)
+{
+	TEEC_Operation op;
+	uint32_t error_origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE, TEEC_NONE,
+										TEEC_NONE, TEEC_NONE);
+
+	res = TEEC_InvokeCommand(&ctx->sess, ctx->ta->gen_key_cmd, &op, &error_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "%s: generate key pair failed\n", ctx->ta->name);
+
+	if(ctx->ta->digest_cmd == NO_DIGEST) {
+		ctx->data_len = strlen(message);
+		memcpy(ctx->data, message, ctx->data_len);
+	} else {
+		ctx->data_len = sizeof(ctx->data);
+		res = invoke_inout(ctx, ctx->ta->digest_cmd, TEEC_MEMREF_TEMP_OUTPUT,
+							message, strlen(message), ctx->data, &ctx->data_len);
+		if(res != TEEC_SUCCESS)
+			errx(1, "%s: digest failed\n", ctx->ta->name);
+	}
+
+	ctx->signature_len = sizeof(ctx->signature);
+	res = invoke_inout(ctx, ctx->ta->sign_cmd, TEEC_MEMREF_TEMP_OUTPUT,
+						ctx->data, ctx->data_len, ctx->signature, &ctx->signature_len);
+	if(res != TEEC_SUCCESS)
+		errx(1, "%s: sign failed\n", ctx->ta->name);
+}
+
+static void *verify_worker_run(void *arg)
+{
+	struct verify_worker *worker = arg;
+	uint32_t i;
+
+	for(i = 0; i < worker->rounds; i++) {
+		if(ree_verify(worker->key, worker->ctx->ta->alg, worker->ctx->data, worker->ctx->data_len,
+						worker->ctx->signature, worker->ctx->signature_len) != 1)
+			worker->failures++;
+	}
+
+	return NULL;
+}
+
+// 多个线程共享同一个公钥同时验签, 不需要切换到安全世界
+static double ree_verify_parallel(struct verify_ctx *ctx, const struct ree_verify_key *key,
+									uint32_t threads, uint32_t rounds)
+{
+	struct verify_worker *workers;
+	uint64_t start, elapsed;
+	uint32_t failures = 0;
+	uint32_t i;
+
+	workers = calloc(threads, sizeof(*workers));
+	if(!workers)
+		errx(1, "alloc workers failed\n");
+
+	start = now_ns();
+	for(i = 0; i < threads; i++) {
+		workers[i].key = key;
+		workers[i].ctx = ctx;
+		workers[i].rounds = rounds;
+		if(pthread_create(&workers[i].thread, NULL, verify_worker_run, &workers[i]))
+			errx(1, "create verify thread failed\n");
+	}
+
+	for(i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		failures += workers[i].failures;
+	}
+	elapsed = now_ns() - start;
+
+	free(workers);
+
+	if(failures)
+		errx(1, "%s: %u REE verifications failed\n", ctx->ta->name, failures);
+
+	return (double)threads * rounds * 1e9 / elapsed;
+}
+
+static void verify_example(const struct verify_ta *ta, uint32_t rounds, uint32_t threads)
+{
+	struct ree_verify_key *key;
+	struct verify_ctx ctx;
+	uint8_t tampered[BUFFER_SIZE];
+	uint32_t error_origin;
+	uint32_t raw_len, len;
+	TEEC_Result res;
+	char pem_path[64];
+	uint64_t start;
+	double tee_ops, ree_ops, ree_parallel_ops;
+	uint32_t i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.ta = ta;
+
+	res = TEEC_InitializeContext(NULL, &ctx.ctx);
+	if(res != TEEC_SUCCESS)
+		errx(1, "initialize context failed\n");
+
+	res = TEEC_OpenSession(&ctx.ctx, &ctx.sess, &ta->uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &error_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "%s: open session failed\n", ta->name);
+
+	sign_in_tee(&ctx);
+
+	raw_len = export_public_key(&ctx, PUBKEY_FORMAT_RAW, ctx.pub_key, sizeof(ctx.pub_key));
+	ctx.pub_key_len = export_public_key(&ctx, PUBKEY_FORMAT_DER, ctx.pub_key, sizeof(ctx.pub_key));
+
+	key = ree_verify_load_der(ctx.pub_key, ctx.pub_key_len);
+	if(!key)
+		errx(1, "%s: load public key failed\n", ta->name);
+
+	snprintf(pem_path, sizeof(pem_path), "%s_pub_key.pem", ta->name);
+	if(ree_verify_save_pem(key, pem_path))
+		warnx("%s: save %s failed", ta->name, pem_path);
+
+	if(ree_verify(key, ta->alg, ctx.data, ctx.data_len, ctx.signature, ctx.signature_len) != 1)
+		errx(1, "%s: REE verify failed\n", ta->name);
+
+	memcpy(tampered, ctx.signature, ctx.signature_len);
+	tampered[ctx.signature_len / 2] ^= 0x01;
+	if(ree_verify(key, ta->alg, ctx.data, ctx.data_len, tampered, ctx.signature_len) != 0)
+		errx(1, "%s: REE verify accepted a tampered signature\n", ta->name);
+
+	start = now_ns();
+	for(i = 0; i < rounds; i++) {
+		len = ctx.signature_len;
+		res = invoke_inout(&ctx, ta->verify_cmd, TEEC_MEMREF_TEMP_INPUT,
+							ctx.data, ctx.data_len, ctx.signature, &len);
+		if(res != TEEC_SUCCESS)
+			errx(1, "%s: TEE verify failed\n", ta->name);
+	}
+	tee_ops = rounds * 1e9 / (now_ns() - start);
+
+	ree_ops = ree_verify_parallel(&ctx, key, 1, rounds);
+	ree_parallel_ops = ree_verify_parallel(&ctx, key, threads, rounds);
+
+	printf("%s: public key raw %u bytes, DER %u bytes, saved to %s\n",
+			ta->name, raw_len, ctx.pub_key_len, pem_path);
+	printf("  TEE verify             : %10.1f ops/s\n", tee_ops);
+	printf("  REE verify (1 thread)  : %10.1f ops/s\n", ree_ops);
+	printf("  REE verify (%u threads) : %10.1f ops/s\n\n", threads, ree_parallel_ops);
+
+	ree_verify_free(key);
+	TEEC_CloseSession(&ctx.sess);
+	TEEC_FinalizeContext(&ctx.ctx);
+}
+
+// ree_verify [rounds] [threads] : 对比在TA中验签和在REE中多线程验签的吞吐
+int main(int argc, char *argv[])
+{
+	uint32_t rounds = DEFAULT_ROUNDS;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t i;
+
+	if(argc > 1)
+		rounds = strtoul(argv[1], NULL, 0);
+	if(argc > 2)
+		threads = strtol(argv[2], NULL, 0);
+
+	if(!rounds || threads < 1)
+		errx(1, "usage: %s [rounds] [threads]\n", argv[0]);
+
+	for(i = 0; i < sizeof(verify_tas) / sizeof(verify_tas[0]); i++)
+		verify_example(&verify_tas[i], rounds, threads);
+
+	return 0;
+}
+
+/**
+ * @brief 配置到开发板指令
+
+ * 注意: 开发本需提前配置好SSH环境,
+ * 根文件系统也需要支持OPTEE和OpenSSL, buildroot自行配置
+ * 四个签名工程的TA需要先按各自工程的说明拷贝到开发板
+
+ * /usr/bin 让CA目标文件可以直接当作命令运行
+
+ * scp ree_verify/host/ree_verify wenshuyu@192.168.1.6:/usr/bin
+ * ree_verify 200 4
+ * openssl pkey -pubin -in ecdsa_pub_key.pem -text -noout
+ */
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <openssl/bn.h>
+#include <openssl/ecdsa.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include "ree_verify.h"
+
+struct ree_verify_key {
+	EVP_PKEY *pkey;
+};
+
+struct ree_verify_key *ree_verify_load_der(const uint8_t *der, size_t len)
+{
+	const unsigned char *p = der;
+	struct ree_verify_key *key;
+	EVP_PKEY *pkey;
+
+	pkey = d2i_PUBKEY(NULL, &p, len);
+	if(!pkey || p != der + len) {
+		EVP_PKEY_free(pkey);
+		ERR_clear_error();
+		return NULL;
+	}
+
+	key = calloc(1, sizeof(*key));
+	if(!key) {
+		EVP_PKEY_free(pkey);
+		return NULL;
+	}
+	key->pkey = pkey;
+
+	return key;
+}
+
+int ree_verify_save_pem(const struct ree_verify_key *key, const char *path)
+{
+	FILE *fp;
+	int ok;
+
+	fp = fopen(path, "w");
+	if(!fp)
+		return -1;
+
+	ok = PEM_write_PUBKEY(fp, key->pkey);
+	fclose(fp);
+
+	return ok ? 0 : -1;
+}
+
+void ree_verify_free(struct ree_verify_key *key)
+{
+	if(!key)
+		return;
+
+	EVP_PKEY_free(key->pkey);
+	free(key);
+}
+
+// TA中的签名都是对摘要做的, 按摘要长度确定摘要算法
+static const EVP_MD *digest_md(size_t len)
+{
+	switch(len) {
+		case 16:
+			return EVP_md5();
+		case 20:
+			return EVP_sha1();
+		case 28:
+			return EVP_sha224();
+		case 32:
+			return EVP_sha256();
+		case 48:
+			return EVP_sha384();
+		case 64:
+			return EVP_sha512();
+		default:
+			return NULL;
+	}
+}
+
+/*
+ * GP 接口输出的 ECDSA 签名是定长的 r | s, OpenSSL 需要 DER 编码的 ECDSA-Sig-Value
+ */
+static int ecdsa_sig_to_der(const uint8_t *sig, size_t sig_len, uint8_t **der)
+{
+	ECDSA_SIG *ec_sig;
+	BIGNUM *r, *s;
+	int len;
+
+	if(!sig_len || sig_len % 2)
+		return -1;
+
+	ec_sig = ECDSA_SIG_new();
+	r = BN_bin2bn(sig, sig_len / 2, NULL);
+	s = BN_bin2bn(sig + sig_len / 2, sig_len / 2, NULL);
+	if(!ec_sig || !r || !s || !ECDSA_SIG_set0(ec_sig, r, s)) {
+		BN_free(r);
+		BN_free(s);
+		ECDSA_SIG_free(ec_sig);
+		return -1;
+	}
+
+	*der = NULL;
+	len = i2d_ECDSA_SIG(ec_sig, der);
+	ECDSA_SIG_free(ec_sig);
+
+	return len;
+}
+
+static int verify_message(EVP_PKEY *pkey, const uint8_t *data, size_t data_len,
+							const uint8_t *sig, size_t sig_len)
+{
+	EVP_MD_CTX *md_ctx;
+	int ret = -1;
+
+	md_ctx = EVP_MD_CTX_new();
+	if(!md_ctx)
+		return -1;
+
+	// Ed25519 没有单独的摘要步骤, 直接对消息验签
+	if(EVP_DigestVerifyInit(md_ctx, NULL, NULL, NULL, pkey) == 1)
+		ret = EVP_DigestVerify(md_ctx, sig, sig_len, data, data_len);
+
+	EVP_MD_CTX_free(md_ctx);
+
+	return ret;
+}
+
+static int verify_digest(EVP_PKEY *pkey, enum ree_verify_alg alg, const uint8_t *data, size_t data_len,
+							const uint8_t *sig, size_t sig_len)
+{
+	const EVP_MD *md = digest_md(data_len);
+	EVP_PKEY_CTX *pkey_ctx;
+	int ret = -1;
+
+	if(!md)
+		return -1;
+
+	pkey_ctx = EVP_PKEY_CTX_new(pkey, NULL);
+	if(!pkey_ctx)
+		return -1;
+
+	if(EVP_PKEY_verify_init(pkey_ctx) <= 0 || EVP_PKEY_CTX_set_signature_md(pkey_ctx, md) <= 0)
+		goto out;
+
+	if(alg == REE_VERIFY_RSA_PKCS1_V1_5) {
+		if(EVP_PKEY_CTX_set_rsa_padding(pkey_ctx, RSA_PKCS1_PADDING) <= 0)
+			goto out;
+	} else if(alg == REE_VERIFY_RSA_PSS) {
+		// 盐长度从签名中恢复, OP-TEE 默认使用摘要长度
+		if(EVP_PKEY_CTX_set_rsa_padding(pkey_ctx, RSA_PKCS1_PSS_PADDING) <= 0 ||
+			EVP_PKEY_CTX_set_rsa_pss_saltlen(pkey_ctx, RSA_PSS_SALTLEN_AUTO) <= 0)
+			goto out;
+	}
+
+	ret = EVP_PKEY_verify(pkey_ctx, sig, sig_len, data, data_len);
+
+out:
+	EVP_PKEY_CTX_free(pkey_ctx);
+
+	return ret;
+}
+
+int ree_verify(const struct ree_verify_key *key, enum ree_verify_alg alg,
+				const uint8_t *data, size_t data_len, const uint8_t *sig, size_t sig_len)
+{
+	uint8_t *der_sig = NULL;
+	int der_len;
+	int ret;
+
+	switch(alg) {
+		case REE_VERIFY_RSA_PKCS1_V1_5:
+		case REE_VERIFY_RSA_PSS:
+			if(EVP_PKEY_base_id(key->pkey) != EVP_PKEY_RSA)
+				return -1;
+			ret = verify_digest(key->pkey, alg, data, data_len, sig, sig_len);
+			break;
+
+		case REE_VERIFY_ECDSA:
+			if(EVP_PKEY_base_id(key->pkey) != EVP_PKEY_EC)
+				return -1;
+			der_len = ecdsa_sig_to_der(sig, sig_len, &der_sig);
+			if(der_len <= 0)
+				return -1;
+			ret = verify_digest(key->pkey, alg, data, data_len, der_sig, der_len);
+			OPENSSL_free(der_sig);
+			break;
+
+		case REE_VERIFY_ED25519:
+			if(EVP_PKEY_base_id(key->pkey) != EVP_PKEY_ED25519)
+				return -1;
+			ret = verify_message(key->pkey, data, data_len, sig, sig_len);
+			break;
+
+		default:
+			return -1;
+	}
+
+	// 签名不对时 OpenSSL 会在当前线程的错误队列里留下记录, 验签频繁时需要清掉
+	if(ret != 1)
+		ERR_clear_error();
+
+	return ret == 1 ? 1 : ret == 0 ? 0 : -1;
+}
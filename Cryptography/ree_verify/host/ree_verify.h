@@ -0,0 +1,47 @@
+#ifndef _REE_VERIFY_H
+#define _REE_VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 在REE侧用 OpenSSL 验证TA生成的签名, 公钥由TA的 EXPORT_PUBKEY 命令导出,
+ * 签名仍然只在TA中完成
+ */
+
+enum ree_verify_alg {
+	REE_VERIFY_RSA_PKCS1_V1_5, 	// data 为摘要
+	REE_VERIFY_RSA_PSS, 		// data 为摘要, MGF1 使用相同的摘要算法
+	REE_VERIFY_ECDSA, 			// data 为摘要, sig 为TA输出的 r | s
+	REE_VERIFY_ED25519, 		// data 为原始消息
+};
+
+struct ree_verify_key;
+
+/*
+ * @brief : load a SubjectPublicKeyInfo exported by a TA with PUBKEY_FORMAT_DER
+ *
+ * @return : the key, NULL on failure
+ */
+struct ree_verify_key *ree_verify_load_der(const uint8_t *der, size_t len);
+
+/*
+ * @brief : write the public key as PEM, so it can be used by
+ *          openssl dgst -sha256 -verify pub_key.pem -signature signature.bin plaintext.txt
+ *
+ * @return : 0 on success, -1 on failure
+ */
+int ree_verify_save_pem(const struct ree_verify_key *key, const char *path);
+
+/*
+ * @brief : verify a signature, the digest algorithm is chosen by the digest size
+ *          one key can be used by several threads at the same time
+ *
+ * @return : 1 the signature is valid, 0 the signature is invalid, -1 error
+ */
+int ree_verify(const struct ree_verify_key *key, enum ree_verify_alg alg,
+				const uint8_t *data, size_t data_len, const uint8_t *sig, size_t sig_len);
+
+void ree_verify_free(struct ree_verify_key *key);
+
+#endif /* _REE_VERIFY_H */
@@ -0,0 +1,355 @@
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <tee_client_api.h>
+
+/*
+ * 四个RSA工程的头文件里 KEYPAIR_SIZE 等宏同名但取值不同, 逐个包含后取消定义,
+ * 这里只用到 UUID 和命令号
+ */
+
+#include "../../rsassa_pkcs1_v1_5_xxx/ta/include/rsassa_pkcs1_v1_5_xxx.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+#undef USE_RSA_ALGORITHM
+#undef USE_DIGEST_ALGORITHM
+#undef DIGEST_BITS
+
+#include "../../rsassa_pkcs1_pss_mgf1_xxx/ta/include/rsassa_pkcs1_pss_mgf1_xxx.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+#undef USE_RSA_ALGORITHM
+#undef USE_DIGEST_ALGORITHM
+#undef DIGEST_BITS
+
+#include "../../rsaes_pkcs1_v1_5/ta/include/rsaes_pkcs1_v1_5.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+
+#include "../../rsaes_pkcs1_oaep_mgf1_xxx/ta/include/rsaes_pkcs1_oaep_mgf1_xxx.h"
+#undef KEYPAIR_SIZE
+#undef KEYPAIR_BITS
+#undef USE_ALGORITHM
+
+#define BUFFER_SIZE 		(KEYPAIR_MAX_BITS / 8)
+#define DEFAULT_ROUNDS 		(100)
+#define WARMUP_ROUNDS 		(3)
+#define PLAIN_SIZE 			(32) // OAEP-SHA512 在 1024 位下放不下, 会被跳过
+
+struct bench_ta {
+	const char *name;
+	TEEC_UUID uuid;
+	uint32_t gen_key_cmd;
+	uint32_t digest_cmd; 		// 只有签名TA需要, 加密TA不使用
+	uint32_t cmd[2]; 			// sign/verify 或 encrypt/decrypt
+	const char *op_name[2];
+	int is_signature;
+};
+
+static const struct bench_ta bench_tas[] = {
+	{
+		"rsassa_pkcs1_v1_5", TA_RSASSA_PKCS1_V1_5_XXX_UUID,
+		RSASSA_PKCS1_V1_5_XXX_GEN_KEY, RSASSA_PKCS1_V1_5_XXX_DIGEST,
+		{ RSASSA_PKCS1_V1_5_XXX_SIGN, RSASSA_PKCS1_V1_5_XXX_VERIFY },
+		{ "sign", "verify" }, 1
+	},
+	{
+		"rsassa_pkcs1_pss_mgf1", TA_RSASSA_PKCS1_PSS_MGF1_XXX_UUID,
+		RSASSA_PKCS1_PSS_MGF1_XXX_GEN_KEY, RSASSA_PKCS1_PSS_MGF1_XXX_DIGEST,
+		{ RSASSA_PKCS1_PSS_MGF1_XXX_SIGN, RSASSA_PKCS1_PSS_MGF1_XXX_VERIFY },
+		{ "sign", "verify" }, 1
+	},
+	{
+		"rsaes_pkcs1_v1_5", TA_RSAES_PKCS1_V1_5_UUID,
+		RSAES_PKCS1_V1_5_GEN_KEY, 0,
+		{ RSAES_PKCS1_V1_5_ENCRYPT, RSAES_PKCS1_V1_5_DECRYPT },
+		{ "encrypt", "decrypt" }, 0
+	},
+	{
+		"rsaes_pkcs1_oaep_mgf1", TA_RSAES_PKCS1_OAEP_MGF1_XXX_UUID,
+		RSAES_PKCS1_OAEP_MGF1_GEN_KEY, 0,
+		{ RSAES_PKCS1_OAEP_MGF1_ENCRYPT, RSAES_PKCS1_OAEP_MGF1_DECRYPT },
+		{ "encrypt", "decrypt" }, 0
+	},
+};
+
+static const uint32_t default_key_bits[] = { 1024, 2048, 3072, 4096 };
+
+struct bench_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	const struct bench_ta *ta;
+	uint8_t input[BUFFER_SIZE]; 		// 摘要或明文
+	uint32_t input_size;
+	uint8_t output[BUFFER_SIZE]; 		// 签名或密文
+	uint32_t output_size;
+	uint8_t scratch[BUFFER_SIZE]; 		// 解密结果
+	uint64_t *samples;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile_us(uint64_t *sorted, uint32_t n, uint32_t pct)
+{
+	uint32_t idx = (uint32_t)(((uint64_t)n * pct + 99) / 100);
+
+	if(idx)
+		idx--;
+	return sorted[idx] / 1000.0;
+}
+
+static void print_row(const char *ta, const char *op, uint32_t key_bits, uint32_t rounds,
+						uint64_t total_ns, uint64_t *samples)
+{
+	qsort(samples, rounds, sizeof(uint64_t), cmp_u64);
+	printf("%s,%s,%u,%u,%.1f,%.1f,%.1f\n", ta, op, key_bits, rounds,
+			rounds * 1e9 / total_ns, percentile_us(samples, rounds, 50), percentile_us(samples, rounds, 99));
+	fflush(stdout);
+}
+
+static TEEC_Result generate_key(struct bench_ctx *ctx, uint32_t key_bits)
+{
+	TEEC_Operation op;
+	uint32_t error_origin;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE,
+										TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = key_bits;
+
+	return TEEC_InvokeCommand(&ctx->sess, ctx->ta->gen_key_cmd, &op, &error_origin);
+}
+
+/*
+ * 签名TA先用 DIGEST 得到 SHA 摘要作为输入, 加密TA直接用随机明文
+ */
+static TEEC_Result prepare_input(struct bench_ctx *ctx)
+{
+	TEEC_Operation op;
+	uint32_t error_origin;
+	TEEC_Result res;
+	uint8_t message[PLAIN_SIZE];
+	uint32_t i;
+
+	for(i = 0; i < PLAIN_SIZE; i++)
+		message[i] = rand();
+
+	if(!ctx->ta->is_signature) {
+		memcpy(ctx->input, message, PLAIN_SIZE);
+		ctx->input_size = PLAIN_SIZE;
+		return TEEC_SUCCESS;
+	}
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+										TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = message;
+	op.params[0].tmpref.size = PLAIN_SIZE;
+	op.params[1].tmpref.buffer = ctx->input;
+	op.params[1].tmpref.size = sizeof(ctx->input);
+
+	res = TEEC_InvokeCommand(&ctx->sess, ctx->ta->digest_cmd, &op, &error_origin);
+	if(res == TEEC_SUCCESS)
+		ctx->input_size = op.params[1].tmpref.size;
+
+	return res;
+}
+
+/*
+ * idx 0 : sign / encrypt, 输入 -> output
+ * idx 1 : verify / decrypt, 输入 + output (签名校验) 或 output -> scratch (解密)
+ */
+static TEEC_Result run_once(struct bench_ctx *ctx, uint32_t idx)
+{
+	TEEC_Operation op;
+	uint32_t error_origin;
+	TEEC_Result res;
+
+	memset(&op, 0, sizeof(op));
+
+	if(idx == 0) {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+											TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = ctx->input;
+		op.params[0].tmpref.size = ctx->input_size;
+		op.params[1].tmpref.buffer = ctx->output;
+		op.params[1].tmpref.size = sizeof(ctx->output);
+	} else if(ctx->ta->is_signature) {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
+											TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = ctx->input;
+		op.params[0].tmpref.size = ctx->input_size;
+		op.params[1].tmpref.buffer = ctx->output;
+		op.params[1].tmpref.size = ctx->output_size;
+	} else {
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
+											TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = ctx->output;
+		op.params[0].tmpref.size = ctx->output_size;
+		op.params[1].tmpref.buffer = ctx->scratch;
+		op.params[1].tmpref.size = sizeof(ctx->scratch);
+	}
+
+	res = TEEC_InvokeCommand(&ctx->sess, ctx->ta->cmd[idx], &op, &error_origin);
+	if(res != TEEC_SUCCESS)
+		return res;
+
+	if(idx == 0) {
+		ctx->output_size = op.params[1].tmpref.size;
+	} else if(!ctx->ta->is_signature) {
+		if(op.params[1].tmpref.size != ctx->input_size ||
+			memcmp(ctx->scratch, ctx->input, ctx->input_size))
+			return TEEC_ERROR_GENERIC;
+	}
+
+	return TEEC_SUCCESS;
+}
+
+static void bench_key_size(struct bench_ctx *ctx, uint32_t key_bits, uint32_t rounds)
+{
+	TEEC_Result res;
+	uint64_t start, total;
+	uint32_t idx, i;
+
+	start = now_ns();
+	res = generate_key(ctx, key_bits);
+	if(res != TEEC_SUCCESS) {
+		fprintf(stderr, "%s: generate %u bits key failed, res is 0x%x, skip\n", ctx->ta->name, key_bits, res);
+		return;
+	}
+	ctx->samples[0] = now_ns() - start;
+	print_row(ctx->ta->name, "keygen", key_bits, 1, ctx->samples[0], ctx->samples);
+
+	res = prepare_input(ctx);
+	if(res != TEEC_SUCCESS) {
+		fprintf(stderr, "%s: prepare input failed, res is 0x%x, skip\n", ctx->ta->name, res);
+		return;
+	}
+
+	// 第二个操作依赖第一个操作的输出, 按顺序测
+	for(idx = 0; idx < 2; idx++) {
+		// 预热时TA分配并缓存操作句柄, 不计入结果
+		for(i = 0; i < WARMUP_ROUNDS; i++) {
+			res = run_once(ctx, idx);
+			if(res != TEEC_SUCCESS)
+				break;
+		}
+
+		total = 0;
+		for(i = 0; i < rounds && res == TEEC_SUCCESS; i++) {
+			start = now_ns();
+			res = run_once(ctx, idx);
+			ctx->samples[i] = now_ns() - start;
+			total += ctx->samples[i];
+		}
+
+		if(res != TEEC_SUCCESS) {
+			fprintf(stderr, "%s: %s with %u bits key failed, res is 0x%x, skip\n",
+					ctx->ta->name, ctx->ta->op_name[idx], key_bits, res);
+			return;
+		}
+
+		print_row(ctx->ta->name, ctx->ta->op_name[idx], key_bits, rounds, total, ctx->samples);
+	}
+}
+
+static void bench_ta(const struct bench_ta *ta, const uint32_t *key_bits, uint32_t key_count, uint32_t rounds)
+{
+	struct bench_ctx ctx;
+	uint32_t error_origin;
+	TEEC_Result res;
+	uint32_t i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.ta = ta;
+
+	ctx.samples = calloc(rounds, sizeof(uint64_t));
+	if(!ctx.samples)
+		errx(1, "alloc samples failed\n");
+
+	res = TEEC_InitializeContext(NULL, &ctx.ctx);
+	if(res != TEEC_SUCCESS)
+		errx(1, "initialize context failed\n");
+
+	res = TEEC_OpenSession(&ctx.ctx, &ctx.sess, &ta->uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &error_origin);
+	if(res != TEEC_SUCCESS) {
+		fprintf(stderr, "%s: open session failed, res is 0x%x, skip\n", ta->name, res);
+		goto out;
+	}
+
+	for(i = 0; i < key_count; i++)
+		bench_key_size(&ctx, key_bits[i], rounds);
+
+	TEEC_CloseSession(&ctx.sess);
+
+out:
+	TEEC_FinalizeContext(&ctx.ctx);
+	free(ctx.samples);
+}
+
+// rsa_bench [rounds] [key bits ...] : CSV 输出到 stdout, 跳过的组合输出到 stderr
+int main(int argc, char *argv[])
+{
+	const uint32_t *key_bits = default_key_bits;
+	uint32_t key_count = sizeof(default_key_bits) / sizeof(default_key_bits[0]);
+	uint32_t *custom_bits = NULL;
+	uint32_t rounds = DEFAULT_ROUNDS;
+	uint32_t i;
+
+	if(argc > 1) {
+		rounds = strtoul(argv[1], NULL, 0);
+		if(!rounds)
+			errx(1, "usage: %s [rounds] [key bits ...]\n", argv[0]);
+	}
+
+	if(argc > 2) {
+		key_count = argc - 2;
+		custom_bits = calloc(key_count, sizeof(uint32_t));
+		if(!custom_bits)
+			errx(1, "alloc key sizes failed\n");
+
+		for(i = 0; i < key_count; i++)
+			custom_bits[i] = strtoul(argv[i + 2], NULL, 0);
+		key_bits = custom_bits;
+	}
+
+	srand(time(NULL));
+
+	printf("ta,op,key_bits,rounds,ops_per_sec,p50_us,p99_us\n");
+
+	for(i = 0; i < sizeof(bench_tas) / sizeof(bench_tas[0]); i++)
+		bench_ta(&bench_tas[i], key_bits, key_count, rounds);
+
+	free(custom_bits);
+
+	return 0;
+}
+
+/**
+ * @brief 配置到开发板指令
+
+ * 注意: 开发本需提前配置好SSH环境,
+ * 根文件系统也需要支持OPTEE, buildroot自行配置
+ * 被测的四个TA需要先按各自工程的说明拷贝到开发板
+
+ * /usr/bin 让CA目标文件可以直接当作命令运行
+
+ * scp rsa_bench/host/rsa_bench wenshuyu@192.168.1.6:/usr/bin
+ * rsa_bench 200 > rsa_bench.csv
+ */
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <tee_client_api.h>
 
 #include "../ta/include/rsaes_pkcs1_oaep_mgf1_xxx.h"
@@ -10,6 +11,10 @@ const char *plain_src = "hello world hello world\n";
 
 #define BUFFER_SIZE 256
 
+#define ENVELOPE_PAYLOAD_SIZE	(64 * 1024)
+#define ENVELOPE_CHUNK_SIZE		(4 * 1024)
+#define OAEP_MAX_PLAIN_SIZE		(KEYPAIR_SIZE - 2 * 64 - 2)	// SHA512 的 OAEP 填充
+
 uint8_t cipher_buf[BUFFER_SIZE] = {0};
 uint16_t cipher_len;
 
@@ -94,6 +99,146 @@ static void decrypt(struct rsaes_pkcs1_v1_5_ctx *ctx)
 	printf("\n\n");
 }
 
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t invoke_inout(struct rsaes_pkcs1_v1_5_ctx *ctx, uint32_t cmd, const void *in, size_t in_len,
+						   void *out, size_t out_len, uint32_t out_type)
+{
+	TEEC_Result res;
+	TEEC_Operation op;
+	uint32_t err_origin;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = out_type == TEEC_MEMREF_TEMP_OUTPUT ?
+					TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE) :
+					TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = (void *)in;
+	op.params[0].tmpref.size = in_len;
+	op.params[1].tmpref.buffer = out;
+	op.params[1].tmpref.size = out_len;
+
+	res = TEEC_InvokeCommand(&ctx->sess, cmd, &op, &err_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "command %u failed, code 0x%x\n", cmd, res);
+
+	return op.params[1].tmpref.size;
+}
+
+/*
+ * 信封: 头部 + 分段密文, 最后一段带标签
+ * 返回信封总长度
+ */
+static size_t envelope_seal(struct rsaes_pkcs1_v1_5_ctx *ctx, const uint8_t *plain, size_t plain_len,
+							uint8_t *envelope, size_t envelope_len)
+{
+	size_t off = 0, out = 0;
+	TEEC_Result res;
+	TEEC_Operation op;
+	uint32_t err_origin;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = envelope;
+	op.params[0].tmpref.size = ENVELOPE_HEADER_SIZE;
+	op.params[1].tmpref.buffer = NULL;
+	op.params[1].tmpref.size = 0;
+
+	res = TEEC_InvokeCommand(&ctx->sess, RSAES_PKCS1_OAEP_MGF1_SEAL_INIT, &op, &err_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "seal init failed, code 0x%x\n", res);
+	out = ENVELOPE_HEADER_SIZE;
+
+	while(plain_len - off > ENVELOPE_CHUNK_SIZE) {
+		out += invoke_inout(ctx, RSAES_PKCS1_OAEP_MGF1_ENVELOPE_UPDATE, plain + off, ENVELOPE_CHUNK_SIZE,
+							envelope + out, envelope_len - out, TEEC_MEMREF_TEMP_OUTPUT);
+		off += ENVELOPE_CHUNK_SIZE;
+	}
+
+	out += invoke_inout(ctx, RSAES_PKCS1_OAEP_MGF1_ENVELOPE_FINAL, plain + off, plain_len - off,
+						envelope + out, envelope_len - out, TEEC_MEMREF_TEMP_OUTPUT);
+
+	return out;
+}
+
+static size_t envelope_open(struct rsaes_pkcs1_v1_5_ctx *ctx, const uint8_t *envelope, size_t envelope_len,
+							uint8_t *plain, size_t plain_len)
+{
+	size_t off = ENVELOPE_HEADER_SIZE, out = 0;
+
+	invoke_inout(ctx, RSAES_PKCS1_OAEP_MGF1_OPEN_INIT, envelope, ENVELOPE_HEADER_SIZE, NULL, 0, TEEC_MEMREF_TEMP_INPUT);
+
+	// 最后一段必须包含完整的标签
+	// FINAL 校验标签之前 UPDATE 返回的明文都未经认证, 只能先放在 plain 中, FINAL 失败时整体丢弃
+	while(envelope_len - off > ENVELOPE_CHUNK_SIZE + ENVELOPE_TAG_SIZE) {
+		out += invoke_inout(ctx, RSAES_PKCS1_OAEP_MGF1_ENVELOPE_UPDATE, envelope + off, ENVELOPE_CHUNK_SIZE,
+							plain + out, plain_len - out, TEEC_MEMREF_TEMP_OUTPUT);
+		off += ENVELOPE_CHUNK_SIZE;
+	}
+
+	out += invoke_inout(ctx, RSAES_PKCS1_OAEP_MGF1_ENVELOPE_FINAL, envelope + off, envelope_len - off,
+						plain + out, plain_len - out, TEEC_MEMREF_TEMP_OUTPUT);
+
+	return out;
+}
+
+/*
+ * 同样大小的数据: 信封模式 vs 每 OAEP_MAX_PLAIN_SIZE 字节做一次RSA加密
+ */
+static void envelope_example(struct rsaes_pkcs1_v1_5_ctx *ctx)
+{
+	size_t envelope_size = ENVELOPE_HEADER_SIZE + ENVELOPE_PAYLOAD_SIZE + ENVELOPE_CHUNK_SIZE + ENVELOPE_TAG_SIZE;
+	uint8_t *plain = malloc(ENVELOPE_PAYLOAD_SIZE);
+	uint8_t *envelope = malloc(envelope_size);
+	uint8_t *opened = malloc(ENVELOPE_PAYLOAD_SIZE + ENVELOPE_CHUNK_SIZE + ENVELOPE_TAG_SIZE);
+	uint64_t t0, t1, t2;
+
+	if(!plain || !envelope || !opened)
+		errx(1, "out of memory\n");
+
+	for(size_t i = 0; i < ENVELOPE_PAYLOAD_SIZE; i++)
+		plain[i] = (uint8_t)i;
+
+	generate_key(ctx);
+
+	t0 = now_ns();
+	size_t envelope_len = envelope_seal(ctx, plain, ENVELOPE_PAYLOAD_SIZE, envelope, envelope_size);
+	t1 = now_ns();
+	size_t opened_len = envelope_open(ctx, envelope, envelope_len, opened,
+									  ENVELOPE_PAYLOAD_SIZE + ENVELOPE_CHUNK_SIZE + ENVELOPE_TAG_SIZE);
+	t2 = now_ns();
+
+	if(opened_len != ENVELOPE_PAYLOAD_SIZE || memcmp(plain, opened, opened_len))
+		errx(1, "envelope round trip mismatch\n");
+
+	printf("envelope : %d bytes -> %zu bytes\n", ENVELOPE_PAYLOAD_SIZE, envelope_len);
+	printf("seal     : %8.2f MB/s\n", ENVELOPE_PAYLOAD_SIZE * 1e3 / (t1 - t0));
+	printf("open     : %8.2f MB/s\n", ENVELOPE_PAYLOAD_SIZE * 1e3 / (t2 - t1));
+
+	// 再次打开同一个信封, 数据密钥已缓存, 不再做RSA解密
+	t1 = now_ns();
+	envelope_open(ctx, envelope, envelope_len, opened, ENVELOPE_PAYLOAD_SIZE + ENVELOPE_CHUNK_SIZE + ENVELOPE_TAG_SIZE);
+	t2 = now_ns();
+	printf("reopen   : %8.2f MB/s\n", ENVELOPE_PAYLOAD_SIZE * 1e3 / (t2 - t1));
+
+	uint8_t block[KEYPAIR_SIZE];
+	t0 = now_ns();
+	for(size_t off = 0; off < ENVELOPE_PAYLOAD_SIZE; off += OAEP_MAX_PLAIN_SIZE) {
+		size_t n = ENVELOPE_PAYLOAD_SIZE - off < OAEP_MAX_PLAIN_SIZE ? ENVELOPE_PAYLOAD_SIZE - off : OAEP_MAX_PLAIN_SIZE;
+		invoke_inout(ctx, RSAES_PKCS1_OAEP_MGF1_ENCRYPT, plain + off, n, block, sizeof(block), TEEC_MEMREF_TEMP_OUTPUT);
+	}
+	t1 = now_ns();
+	printf("RSA only : %8.2f MB/s (encrypt)\n", ENVELOPE_PAYLOAD_SIZE * 1e3 / (t1 - t0));
+
+	free(plain);
+	free(envelope);
+	free(opened);
+}
+
 static void prepare_tee_session(struct rsaes_pkcs1_v1_5_ctx *ctx)
 {
 	TEEC_UUID uuid = TA_RSAES_PKCS1_OAEP_MGF1_XXX_UUID;
@@ -127,13 +272,17 @@ static void terminate_tee_session(struct rsaes_pkcs1_v1_5_ctx *ctx)
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     struct rsaes_pkcs1_v1_5_ctx ctx;
 
     prepare_tee_session(&ctx);
 
-    example(&ctx);
+    // rsaes_pkcs1_oaep_mgf1_xxx envelope : RSA-OAEP 封装密钥 + AES-GCM 加密大数据
+    if (argc > 1 && strcmp(argv[1], "envelope") == 0)
+        envelope_example(&ctx);
+    else
+        example(&ctx);
 
     terminate_tee_session(&ctx);
 
@@ -7,6 +7,8 @@
 
 #define KEYPAIR_BITS (2048) // can be 1024, 2048, 3072, 4096
 #define KEYPAIR_SIZE (KEYPAIR_BITS / 8)
+#define KEYPAIR_MIN_BITS (1024) // GEN_KEY may choose another size at runtime
+#define KEYPAIR_MAX_BITS (4096)
 
 // choose one 
 // #define USE_ALGORITHM 	TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA1
@@ -15,10 +17,19 @@
 // #define USE_ALGORITHM 	TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA384
 #define USE_ALGORITHM 	TEE_ALG_RSAES_PKCS1_OAEP_MGF1_SHA512 //if use this , KEYPAIR_BITS must choose 2048
 
+// envelope : RSA-OAEP wraps a random AES-256 data key, the payload is encrypted by AES-GCM
+#define ENVELOPE_VERSION 		(1)
+#define ENVELOPE_KEY_BITS 		(256)
+#define ENVELOPE_IV_SIZE 		(12)
+#define ENVELOPE_TAG_SIZE 		(16)
+#define ENVELOPE_IV_OFFSET 		(4)
+#define ENVELOPE_WRAPPED_OFFSET (ENVELOPE_IV_OFFSET + ENVELOPE_IV_SIZE)
+#define ENVELOPE_HEADER_SIZE 	(ENVELOPE_WRAPPED_OFFSET + KEYPAIR_SIZE)
+
 /* 
- * @brief : generate keypair
+ * @brief : generate keypair, the cached RSA operations of the old keypair are released
  *
- * param[0] (unsued)
+ * param[0] (value-input)	: a : key size in bits, 0 means KEYPAIR_BITS, the param may also be unused
  * param[1] (unsued)
  * param[2] (unsued)
  * param[3] (unsued)
@@ -45,4 +56,51 @@
  */
 #define RSAES_PKCS1_OAEP_MGF1_DECRYPT 		2
 
+/* 
+ * @brief : start sealing an envelope, a random data key is wrapped by the RSA public key,
+ *          the header is authenticated together with the AAD
+ *
+ * param[0] (memref-output)	: envelope header (ENVELOPE_HEADER_SIZE bytes)
+ * 							  version(1) | reserved(1) | wrapped key length(2, big endian) | IV | wrapped key
+ * param[1] (memref-input) 	: AAD, may be empty
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define RSAES_PKCS1_OAEP_MGF1_SEAL_INIT 		3
+
+/* 
+ * @brief : start opening an envelope, the data key is unwrapped once and cached in the session,
+ *          opening an envelope with the same wrapped key again skips the RSA operation
+ *
+ * param[0] (memref-input) 	: envelope header
+ * param[1] (memref-input) 	: AAD, may be empty
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define RSAES_PKCS1_OAEP_MGF1_OPEN_INIT 		4
+
+/* 
+ * @brief : encrypt or decrypt a chunk of the current envelope
+ *          when opening, the returned plain text is NOT authenticated until ENVELOPE_FINAL succeeds,
+ *          the CA must buffer it and discard all of it if ENVELOPE_FINAL fails
+ *
+ * param[0] (memref-input) 	: the chunk
+ * param[1] (memref-output)	: the result, at least the chunk size + ENVELOPE_TAG_SIZE
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define RSAES_PKCS1_OAEP_MGF1_ENVELOPE_UPDATE 	5
+
+/* 
+ * @brief : finish the current envelope, sealing appends the tag to the output,
+ *          opening expects the input to end with the tag and fails with TEE_ERROR_MAC_INVALID,
+ *          in which case the plain text of every earlier ENVELOPE_UPDATE is forged or corrupted as well
+ *
+ * param[0] (memref-input) 	: the last chunk, may be empty
+ * param[1] (memref-output)	: the result, at least the chunk size + ENVELOPE_TAG_SIZE
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define RSAES_PKCS1_OAEP_MGF1_ENVELOPE_FINAL 	6
+
 #endif /* _RSAES_PKCS1_OAEP_MGF1_XXX_H */
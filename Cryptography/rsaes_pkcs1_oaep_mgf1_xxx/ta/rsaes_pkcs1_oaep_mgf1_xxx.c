@@ -4,10 +4,79 @@
 #include "include/rsaes_pkcs1_oaep_mgf1_xxx.h"
 
 struct rsaes_pkcs1_oaep_mgf1_ctx {
-    TEE_OperationHandle operation;
     TEE_ObjectHandle keypair;
+    uint32_t key_bits;                      // 当前密钥对的模长
+    TEE_OperationHandle encrypt_op;         // 设置好密钥的RSA操作, 跨调用复用
+    TEE_OperationHandle decrypt_op;
+
+    TEE_ObjectHandle data_key;              // 信封的数据密钥, 解包后缓存
+    uint8_t wrapped_digest[32];             // data_key 对应的封装密钥的 SHA-256
+    TEE_OperationHandle envelope_op;        // 当前信封流的 AES-GCM 操作
+    uint32_t envelope_mode;                 // TEE_MODE_ENCRYPT / TEE_MODE_DECRYPT
+    uint32_t envelope_active;
 };
 
+static void free_envelope(struct rsaes_pkcs1_oaep_mgf1_ctx *ctx)
+{
+    if(ctx->envelope_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->envelope_op);
+        ctx->envelope_op = TEE_HANDLE_NULL;
+    }
+
+    if(ctx->data_key != TEE_HANDLE_NULL) {
+        TEE_FreeTransientObject(ctx->data_key);
+        ctx->data_key = TEE_HANDLE_NULL;
+    }
+
+    TEE_MemFill(ctx->wrapped_digest, 0, sizeof(ctx->wrapped_digest));
+    ctx->envelope_active = 0;
+}
+
+static void free_rsa_ops(struct rsaes_pkcs1_oaep_mgf1_ctx *ctx)
+{
+    if(ctx->encrypt_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->encrypt_op);
+        ctx->encrypt_op = TEE_HANDLE_NULL;
+    }
+
+    if(ctx->decrypt_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->decrypt_op);
+        ctx->decrypt_op = TEE_HANDLE_NULL;
+    }
+}
+
+/*
+ * 第一次使用时分配操作并设置密钥, 之后的调用直接复用
+ * 重新生成密钥对时由 free_rsa_ops 释放
+ */
+static TEE_Result cached_operation(struct rsaes_pkcs1_oaep_mgf1_ctx *ctx, TEE_OperationHandle *op, uint32_t mode)
+{
+    TEE_Result res;
+
+    if(*op != TEE_HANDLE_NULL)
+        return TEE_SUCCESS;
+
+    if(ctx->keypair == TEE_HANDLE_NULL) {
+        EMSG("key pair is not generated\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    res = TEE_AllocateOperation(op, USE_ALGORITHM, mode, ctx->key_bits);
+    if(res != TEE_SUCCESS) {
+        EMSG("alloc operation handle failed\n");
+        return res;
+    }
+
+    res = TEE_SetOperationKey(*op, ctx->keypair);
+    if(res != TEE_SUCCESS) {
+        EMSG("set operation key failed\n");
+        TEE_FreeOperation(*op);
+        *op = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
 /**
  * keypair format：modulus + exponent
  */
@@ -16,8 +85,6 @@ static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param p
     struct rsaes_pkcs1_oaep_mgf1_ctx *ctx = (struct rsaes_pkcs1_oaep_mgf1_ctx *)sess_ctx;
     TEE_Result res;
 
-    (void)params;
-
     uint32_t exp_param_type = TEE_PARAM_TYPES(
         TEE_PARAM_TYPE_NONE, 
         TEE_PARAM_TYPE_NONE,
@@ -25,33 +92,53 @@ static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param p
         TEE_PARAM_TYPE_NONE
     );
 
-    if (param_type != exp_param_type) {
+    uint32_t key_bits = KEYPAIR_BITS;
+
+    // 不带参数时使用头文件中的默认模长, 也可以通过 param[0].value.a 在运行时指定
+    if (param_type == TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_NONE,
+                                      TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE)) {
+        if (params[0].value.a)
+            key_bits = params[0].value.a;
+    } else if (param_type != exp_param_type) {
         EMSG("bad parameters\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
+    if (key_bits < KEYPAIR_MIN_BITS || key_bits > KEYPAIR_MAX_BITS || key_bits % 8) {
+        EMSG("unsupported key size %u\n", key_bits);
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+
     res = TEE_IsAlgorithmSupported(USE_ALGORITHM, TEE_CRYPTO_ELEMENT_NONE);
     if (res != TEE_SUCCESS) {
         EMSG("the algorithm is not supported\n");
         return res;
     }
 
+    // 缓存的数据密钥属于旧的密钥对
+    free_envelope(ctx);
+
+    // 缓存的操作绑定了旧的密钥对
+    free_rsa_ops(ctx);
+    ctx->key_bits = 0;
+
     if (ctx->keypair != TEE_HANDLE_NULL) {
         TEE_FreeTransientObject(ctx->keypair);
         ctx->keypair = TEE_HANDLE_NULL;
     }
 
-    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR, KEYPAIR_BITS, &ctx->keypair);
+    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR, key_bits, &ctx->keypair);
     if (res != TEE_SUCCESS) {
         EMSG("alloc key pair faild\n");
         return res;
     }
 
-    res = TEE_GenerateKey(ctx->keypair, KEYPAIR_BITS, NULL, 0);
+    res = TEE_GenerateKey(ctx->keypair, key_bits, NULL, 0);
     if (res != TEE_SUCCESS) {
         EMSG("generated key failed\n");
         goto err_free_key;
     }
+    ctx->key_bits = key_bits;
 
     return TEE_SUCCESS;
 
@@ -75,44 +162,25 @@ static TEE_Result encrypt(void **sess_ctx, uint32_t param_type, TEE_Param params
     }
 
     uint32_t cipher_size = params[1].memref.size;
-    if(cipher_size < KEYPAIR_SIZE) {
+    if(cipher_size < ctx->key_bits / 8) {
         EMSG("cipher buffer is too short\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
-    
-    res = TEE_AllocateOperation(&ctx->operation, USE_ALGORITHM, TEE_MODE_ENCRYPT, KEYPAIR_BITS);
-    if(res != TEE_SUCCESS) {
-        EMSG("alloc operation handle failed\n");
+    res = cached_operation(ctx, &ctx->encrypt_op, TEE_MODE_ENCRYPT);
+    if(res != TEE_SUCCESS)
         return res;
-    }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
-    if(res != TEE_SUCCESS) {
-        EMSG("set operation key failed\n");
-        goto err_free_operation;
-    }
-
-    res = TEE_AsymmetricEncrypt(ctx->operation, NULL, 0,
+    res = TEE_AsymmetricEncrypt(ctx->encrypt_op, NULL, 0,
                                     params[0].memref.buffer, params[0].memref.size,
                                     params[1].memref.buffer, &cipher_size);
     if(res != TEE_SUCCESS) {
         EMSG("encrypt failed\n");
-        goto err_free_operation;
+        return res;
     }
     params[1].memref.size = cipher_size;
 
     return TEE_SUCCESS;
-
-err_free_operation:
-    if(ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation); 
-        ctx->operation = TEE_HANDLE_NULL;
-    }
-        
-    return res;
 }
 
 static TEE_Result decrypt(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
@@ -127,46 +195,364 @@ static TEE_Result decrypt(void **sess_ctx, uint32_t param_type, TEE_Param params
     }
 
     uint32_t plain_size = params[1].memref.size;
-    if(plain_size < KEYPAIR_SIZE) {
+    if(plain_size < ctx->key_bits / 8) {
         EMSG("plain buffer is too short\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
-    
-    res = TEE_AllocateOperation(&ctx->operation, USE_ALGORITHM, TEE_MODE_DECRYPT, KEYPAIR_BITS);
+    res = cached_operation(ctx, &ctx->decrypt_op, TEE_MODE_DECRYPT);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_AsymmetricDecrypt(ctx->decrypt_op, NULL, 0,
+                                    params[0].memref.buffer, params[0].memref.size,
+                                    params[1].memref.buffer, &plain_size);
+    if(res != TEE_SUCCESS) {
+        EMSG("decrypt failed\n");
+        return res;
+    }
+    params[1].memref.size = plain_size;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result wrapped_key_digest(const void *wrapped, uint32_t wrapped_len, uint8_t digest[32])
+{
+    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    TEE_Result res;
+    uint32_t digest_len = 32;
+
+    res = TEE_AllocateOperation(&op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
     if(res != TEE_SUCCESS) {
-        EMSG("alloc operation handle failed\n");
+        EMSG("alloc digest operation failed\n");
         return res;
     }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
+    res = TEE_DigestDoFinal(op, wrapped, wrapped_len, digest, &digest_len);
+    if(res != TEE_SUCCESS)
+        EMSG("digest failed\n");
+
+    TEE_FreeOperation(op);
+
+    return res;
+}
+
+static TEE_Result set_data_key(struct rsaes_pkcs1_oaep_mgf1_ctx *ctx, const uint8_t *key, uint32_t key_len)
+{
+    TEE_Attribute attr;
+    TEE_Result res;
+
+    if(ctx->data_key != TEE_HANDLE_NULL) {
+        TEE_FreeTransientObject(ctx->data_key);
+        ctx->data_key = TEE_HANDLE_NULL;
+    }
+
+    res = TEE_AllocateTransientObject(TEE_TYPE_AES, ENVELOPE_KEY_BITS, &ctx->data_key);
     if(res != TEE_SUCCESS) {
-        EMSG("set operation key failed\n");
+        EMSG("alloc data key failed\n");
+        return res;
+    }
+
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_len);
+    res = TEE_PopulateTransientObject(ctx->data_key, &attr, 1);
+    if(res != TEE_SUCCESS) {
+        EMSG("set data key failed\n");
+        TEE_FreeTransientObject(ctx->data_key);
+        ctx->data_key = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
+/*
+ * 用数据密钥开始一个信封流, AAD 为完整的信封头加上调用者的 AAD
+ * 每个流只分配一次 AES-GCM 操作, 之后的分段都复用
+ */
+static TEE_Result envelope_start(struct rsaes_pkcs1_oaep_mgf1_ctx *ctx, uint32_t mode, const uint8_t *header,
+                                 const void *aad, uint32_t aad_len)
+{
+    TEE_Result res;
+
+    ctx->envelope_active = 0;
+
+    if(ctx->envelope_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->envelope_op);
+        ctx->envelope_op = TEE_HANDLE_NULL;
+    }
+
+    res = TEE_AllocateOperation(&ctx->envelope_op, TEE_ALG_AES_GCM, mode, ENVELOPE_KEY_BITS);
+    if(res != TEE_SUCCESS) {
+        EMSG("alloc AES-GCM operation failed\n");
+        return res;
+    }
+
+    res = TEE_SetOperationKey(ctx->envelope_op, ctx->data_key);
+    if(res != TEE_SUCCESS) {
+        EMSG("set AES-GCM key failed\n");
         goto err_free_operation;
     }
 
-    res = TEE_AsymmetricDecrypt(ctx->operation, NULL, 0,
-                                    params[0].memref.buffer, params[0].memref.size,
-                                    params[1].memref.buffer, &plain_size);
+    res = TEE_AEInit(ctx->envelope_op, header + ENVELOPE_IV_OFFSET, ENVELOPE_IV_SIZE, ENVELOPE_TAG_SIZE * 8, 0, 0);
     if(res != TEE_SUCCESS) {
-        EMSG("decrypt failed\n");
+        EMSG("AE init failed\n");
         goto err_free_operation;
     }
-    params[1].memref.size = plain_size;
+
+    TEE_AEUpdateAAD(ctx->envelope_op, header, ENVELOPE_HEADER_SIZE);
+    if(aad_len)
+        TEE_AEUpdateAAD(ctx->envelope_op, aad, aad_len);
+
+    ctx->envelope_mode = mode;
+    ctx->envelope_active = 1;
 
     return TEE_SUCCESS;
 
 err_free_operation:
-    if(ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation); 
-        ctx->operation = TEE_HANDLE_NULL;
+    TEE_FreeOperation(ctx->envelope_op);
+    ctx->envelope_op = TEE_HANDLE_NULL;
+
+    return res;
+}
+
+/**
+ * header format：version(1) + reserved(1) + wrapped key length(2, big endian) + iv + wrapped key
+ */
+static TEE_Result envelope_seal_init(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct rsaes_pkcs1_oaep_mgf1_ctx *ctx = (struct rsaes_pkcs1_oaep_mgf1_ctx *)sess_ctx;
+    uint8_t key[ENVELOPE_KEY_BITS / 8];
+    TEE_Result res;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if(param_type != exp_param_type) {
+        EMSG("param type is not correct\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if(params[0].memref.size < ENVELOPE_HEADER_SIZE) {
+        EMSG("header buffer is too short\n");
+        params[0].memref.size = ENVELOPE_HEADER_SIZE;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    // 信封头按默认模长定长, 运行时指定了其他模长的密钥对不能用于信封
+    if(ctx->keypair == TEE_HANDLE_NULL || ctx->key_bits != KEYPAIR_BITS) {
+        EMSG("key pair is not generated with %u bits\n", KEYPAIR_BITS);
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    uint8_t *header = params[0].memref.buffer;
+    header[0] = ENVELOPE_VERSION;
+    header[1] = 0;
+    header[2] = KEYPAIR_SIZE >> 8;
+    header[3] = KEYPAIR_SIZE & 0xFF;
+    TEE_GenerateRandom(header + ENVELOPE_IV_OFFSET, ENVELOPE_IV_SIZE);
+
+    // 每个信封一个新的随机数据密钥, 只做一次RSA运算
+    TEE_GenerateRandom(key, sizeof(key));
+
+    res = cached_operation(ctx, &ctx->encrypt_op, TEE_MODE_ENCRYPT);
+    if(res != TEE_SUCCESS)
+        goto out;
+
+    uint32_t wrapped_len = KEYPAIR_SIZE;
+    res = TEE_AsymmetricEncrypt(ctx->encrypt_op, NULL, 0, key, sizeof(key),
+                                header + ENVELOPE_WRAPPED_OFFSET, &wrapped_len);
+    if(res != TEE_SUCCESS) {
+        EMSG("wrap data key failed\n");
+        goto out;
     }
-        
+
+    res = set_data_key(ctx, key, sizeof(key));
+    if(res != TEE_SUCCESS)
+        goto out;
+
+    res = wrapped_key_digest(header + ENVELOPE_WRAPPED_OFFSET, wrapped_len, ctx->wrapped_digest);
+    if(res != TEE_SUCCESS)
+        goto out;
+
+    res = envelope_start(ctx, TEE_MODE_ENCRYPT, header, params[1].memref.buffer, params[1].memref.size);
+    if(res != TEE_SUCCESS)
+        goto out;
+
+    params[0].memref.size = ENVELOPE_HEADER_SIZE;
+
+out:
+    TEE_MemFill(key, 0, sizeof(key));
+
+    return res;
+}
+
+static TEE_Result envelope_open_init(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct rsaes_pkcs1_oaep_mgf1_ctx *ctx = (struct rsaes_pkcs1_oaep_mgf1_ctx *)sess_ctx;
+    uint8_t digest[32];
+    uint8_t *key = NULL;
+    TEE_Result res;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if(param_type != exp_param_type) {
+        EMSG("param type is not correct\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint8_t *header = params[0].memref.buffer;
+    if(params[0].memref.size != ENVELOPE_HEADER_SIZE || header[0] != ENVELOPE_VERSION ||
+       ((header[2] << 8) | header[3]) != KEYPAIR_SIZE) {
+        EMSG("bad envelope header\n");
+        return TEE_ERROR_BAD_FORMAT;
+    }
+
+    // 信封头按默认模长定长, 运行时指定了其他模长的密钥对不能用于信封
+    if(ctx->keypair == TEE_HANDLE_NULL || ctx->key_bits != KEYPAIR_BITS) {
+        EMSG("key pair is not generated with %u bits\n", KEYPAIR_BITS);
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    res = wrapped_key_digest(header + ENVELOPE_WRAPPED_OFFSET, KEYPAIR_SIZE, digest);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    // 同一个封装密钥已经解包过, 直接使用缓存的数据密钥
+    if(ctx->data_key != TEE_HANDLE_NULL && !TEE_MemCompare(digest, ctx->wrapped_digest, sizeof(digest)))
+        return envelope_start(ctx, TEE_MODE_DECRYPT, header, params[1].memref.buffer, params[1].memref.size);
+
+    // RSA解密的输出缓冲区按模长分配, 放在堆上避免占用TA栈
+    uint32_t key_len = KEYPAIR_SIZE;
+    key = TEE_Malloc(key_len, TEE_MALLOC_FILL_ZERO);
+    if(!key) {
+        EMSG("alloc key buffer failed\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    res = cached_operation(ctx, &ctx->decrypt_op, TEE_MODE_DECRYPT);
+    if(res != TEE_SUCCESS)
+        goto out;
+
+    res = TEE_AsymmetricDecrypt(ctx->decrypt_op, NULL, 0, header + ENVELOPE_WRAPPED_OFFSET, KEYPAIR_SIZE,
+                                key, &key_len);
+    if(res != TEE_SUCCESS) {
+        EMSG("unwrap data key failed\n");
+        goto out;
+    }
+
+    if(key_len != ENVELOPE_KEY_BITS / 8) {
+        EMSG("bad data key length %u\n", key_len);
+        res = TEE_ERROR_BAD_FORMAT;
+        goto out;
+    }
+
+    res = set_data_key(ctx, key, key_len);
+    if(res != TEE_SUCCESS)
+        goto out;
+
+    TEE_MemMove(ctx->wrapped_digest, digest, sizeof(digest));
+
+    res = envelope_start(ctx, TEE_MODE_DECRYPT, header, params[1].memref.buffer, params[1].memref.size);
+
+out:
+    TEE_MemFill(key, 0, KEYPAIR_SIZE);
+    TEE_Free(key);
+
     return res;
 }
 
+static TEE_Result envelope_update(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct rsaes_pkcs1_oaep_mgf1_ctx *ctx = (struct rsaes_pkcs1_oaep_mgf1_ctx *)sess_ctx;
+    TEE_Result res;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if(param_type != exp_param_type) {
+        EMSG("param type is not correct\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if(!ctx->envelope_active) {
+        EMSG("no envelope stream in progress\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    uint32_t out_size = params[1].memref.size;
+    if(out_size < params[0].memref.size + ENVELOPE_TAG_SIZE) {
+        EMSG("output buffer is too short\n");
+        params[1].memref.size = params[0].memref.size + ENVELOPE_TAG_SIZE;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    // 解封时这里输出的明文在 envelope_final 校验标签之前未经认证, 由CA负责在校验失败时丢弃
+    res = TEE_AEUpdate(ctx->envelope_op, params[0].memref.buffer, params[0].memref.size,
+                       params[1].memref.buffer, &out_size);
+    if(res != TEE_SUCCESS) {
+        EMSG("AE update failed\n");
+        ctx->envelope_active = 0;
+        return res;
+    }
+    params[1].memref.size = out_size;
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * 封装时输出最后一段密文并追加标签, 解封时输入的最后一段以标签结尾
+ */
+static TEE_Result envelope_final(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct rsaes_pkcs1_oaep_mgf1_ctx *ctx = (struct rsaes_pkcs1_oaep_mgf1_ctx *)sess_ctx;
+    TEE_Result res;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if(param_type != exp_param_type) {
+        EMSG("param type is not correct\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if(!ctx->envelope_active) {
+        EMSG("no envelope stream in progress\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    uint8_t *in = params[0].memref.buffer;
+    uint8_t *out = params[1].memref.buffer;
+    uint32_t in_size = params[0].memref.size;
+    uint32_t out_size = params[1].memref.size;
+    if(out_size < in_size + ENVELOPE_TAG_SIZE) {
+        EMSG("output buffer is too short\n");
+        params[1].memref.size = in_size + ENVELOPE_TAG_SIZE;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    if(ctx->envelope_mode == TEE_MODE_ENCRYPT) {
+        uint8_t tag[ENVELOPE_TAG_SIZE];
+        uint32_t tag_len = sizeof(tag);
+
+        out_size -= ENVELOPE_TAG_SIZE;
+        res = TEE_AEEncryptFinal(ctx->envelope_op, in, in_size, out, &out_size, tag, &tag_len);
+        if(res == TEE_SUCCESS) {
+            TEE_MemMove(out + out_size, tag, tag_len);
+            out_size += tag_len;
+        }
+    } else if(in_size < ENVELOPE_TAG_SIZE) {
+        EMSG("the tag is missing\n");
+        res = TEE_ERROR_BAD_PARAMETERS;
+    } else {
+        in_size -= ENVELOPE_TAG_SIZE;
+        res = TEE_AEDecryptFinal(ctx->envelope_op, in, in_size, out, &out_size,
+                                 in + in_size, ENVELOPE_TAG_SIZE);
+    }
+
+    // 无论成功与否当前流都结束, 数据密钥继续缓存
+    ctx->envelope_active = 0;
+
+    if(res != TEE_SUCCESS) {
+        EMSG("AE final failed, res is 0x%x\n", res);
+        return res;
+    }
+    params[1].memref.size = out_size;
+
+    return TEE_SUCCESS;
+}
+
 /*******************************************************************************
  * Mandatory TA functions.
  ******************************************************************************/
@@ -201,12 +587,13 @@ void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
     struct rsaes_pkcs1_oaep_mgf1_ctx *ctx = (struct rsaes_pkcs1_oaep_mgf1_ctx *)sess_ctx;
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
+    free_rsa_ops(ctx);
 
     if(ctx->keypair != TEE_HANDLE_NULL)
         TEE_FreeTransientObject(ctx->keypair);
 
+    free_envelope(ctx);
+
     TEE_Free(ctx);
 }
 
@@ -222,6 +609,18 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
         case RSAES_PKCS1_OAEP_MGF1_DECRYPT:
             return decrypt(sess_ctx, param_type, params);
 
+        case RSAES_PKCS1_OAEP_MGF1_SEAL_INIT:
+            return envelope_seal_init(sess_ctx, param_type, params);
+
+        case RSAES_PKCS1_OAEP_MGF1_OPEN_INIT:
+            return envelope_open_init(sess_ctx, param_type, params);
+
+        case RSAES_PKCS1_OAEP_MGF1_ENVELOPE_UPDATE:
+            return envelope_update(sess_ctx, param_type, params);
+
+        case RSAES_PKCS1_OAEP_MGF1_ENVELOPE_FINAL:
+            return envelope_final(sess_ctx, param_type, params);
+
         default:
             return TEE_ERROR_BAD_PARAMETERS;
     }
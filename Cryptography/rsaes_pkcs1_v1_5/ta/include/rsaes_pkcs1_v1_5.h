@@ -7,11 +7,13 @@
 
 #define KEYPAIR_SIZE (128)
 #define KEYPAIR_BITS (KEYPAIR_SIZE * 8) // can be 1024, 2048, 3072, 4096
+#define KEYPAIR_MIN_BITS (1024) // GEN_KEY may choose another size at runtime
+#define KEYPAIR_MAX_BITS (4096)
 
 /* 
- * @brief : generate keypair
+ * @brief : generate keypair, the cached RSA operations of the old keypair are released
  *
- * param[0] (unsued)
+ * param[0] (value-input)	: a : key size in bits, 0 means KEYPAIR_BITS, the param may also be unused
  * param[1] (unsued)
  * param[2] (unsued)
  * param[3] (unsued)
@@ -4,10 +4,57 @@
 #include "include/rsaes_pkcs1_v1_5.h"
 
 struct rsaes_pkcs1_v1_5_ctx {
-    TEE_OperationHandle operation;
     TEE_ObjectHandle keypair;
+    uint32_t key_bits;                      // 当前密钥对的模长
+    TEE_OperationHandle encrypt_op;         // 设置好密钥的RSA操作, 跨调用复用
+    TEE_OperationHandle decrypt_op;
 };
 
+static void free_rsa_ops(struct rsaes_pkcs1_v1_5_ctx *ctx)
+{
+    if(ctx->encrypt_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->encrypt_op);
+        ctx->encrypt_op = TEE_HANDLE_NULL;
+    }
+
+    if(ctx->decrypt_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->decrypt_op);
+        ctx->decrypt_op = TEE_HANDLE_NULL;
+    }
+}
+
+/*
+ * 第一次使用时分配操作并设置密钥, 之后的调用直接复用
+ * 重新生成密钥对时由 free_rsa_ops 释放
+ */
+static TEE_Result cached_operation(struct rsaes_pkcs1_v1_5_ctx *ctx, TEE_OperationHandle *op, uint32_t mode)
+{
+    TEE_Result res;
+
+    if(*op != TEE_HANDLE_NULL)
+        return TEE_SUCCESS;
+
+    if(ctx->keypair == TEE_HANDLE_NULL) {
+        EMSG("key pair is not generated\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    res = TEE_AllocateOperation(op, TEE_ALG_RSAES_PKCS1_V1_5, mode, ctx->key_bits);
+    if(res != TEE_SUCCESS) {
+        EMSG("alloc operation handle failed\n");
+        return res;
+    }
+
+    res = TEE_SetOperationKey(*op, ctx->keypair);
+    if(res != TEE_SUCCESS) {
+        EMSG("set operation key failed\n");
+        TEE_FreeOperation(*op);
+        *op = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
 /**
  * keypair format：modulus + exponent
  */
@@ -16,8 +63,6 @@ static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param p
     struct rsaes_pkcs1_v1_5_ctx *ctx = (struct rsaes_pkcs1_v1_5_ctx *)sess_ctx;
     TEE_Result res;
 
-    (void)params;
-
     uint32_t exp_param_type = TEE_PARAM_TYPES(
         TEE_PARAM_TYPE_NONE, 
         TEE_PARAM_TYPE_NONE,
@@ -25,11 +70,23 @@ static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param p
         TEE_PARAM_TYPE_NONE
     );
 
-    if (param_type != exp_param_type) {
+    uint32_t key_bits = KEYPAIR_BITS;
+
+    // 不带参数时使用头文件中的默认模长, 也可以通过 param[0].value.a 在运行时指定
+    if (param_type == TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_NONE,
+                                      TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE)) {
+        if (params[0].value.a)
+            key_bits = params[0].value.a;
+    } else if (param_type != exp_param_type) {
         EMSG("bad parameters\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
+    if (key_bits < KEYPAIR_MIN_BITS || key_bits > KEYPAIR_MAX_BITS || key_bits % 8) {
+        EMSG("unsupported key size %u\n", key_bits);
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+
     // not supported ?
     // res = TEE_IsAlgorithmSupported(TEE_ALG_RSAES_PKCS1_V1_5, TEE_CRYPTO_ELEMENT_NONE);
     // if (res != TEE_SUCCESS) {
@@ -37,22 +94,27 @@ static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param p
     //     return res;
     // }
 
+    // 缓存的操作绑定了旧的密钥对
+    free_rsa_ops(ctx);
+    ctx->key_bits = 0;
+
     if (ctx->keypair != TEE_HANDLE_NULL) {
         TEE_FreeTransientObject(ctx->keypair);
         ctx->keypair = TEE_HANDLE_NULL;
     }
 
-    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR, KEYPAIR_BITS, &ctx->keypair);
+    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR, key_bits, &ctx->keypair);
     if (res != TEE_SUCCESS) {
         EMSG("alloc key pair faild\n");
         return res;
     }
 
-    res = TEE_GenerateKey(ctx->keypair, KEYPAIR_BITS, NULL, 0);
+    res = TEE_GenerateKey(ctx->keypair, key_bits, NULL, 0);
     if (res != TEE_SUCCESS) {
         EMSG("generated key failed\n");
         goto err_free_key;
     }
+    ctx->key_bits = key_bits;
 
     return TEE_SUCCESS;
 
@@ -76,44 +138,25 @@ static TEE_Result encrypt(void **sess_ctx, uint32_t param_type, TEE_Param params
     }
 
     uint32_t cipher_size = params[1].memref.size;
-    if(cipher_size < KEYPAIR_SIZE) {
+    if(cipher_size < ctx->key_bits / 8) {
         EMSG("cipher buffer is too short\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
-    
-    res = TEE_AllocateOperation(&ctx->operation, TEE_ALG_RSAES_PKCS1_V1_5, TEE_MODE_ENCRYPT, KEYPAIR_BITS);
-    if(res != TEE_SUCCESS) {
-        EMSG("alloc operation handle failed\n");
+    res = cached_operation(ctx, &ctx->encrypt_op, TEE_MODE_ENCRYPT);
+    if(res != TEE_SUCCESS)
         return res;
-    }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
-    if(res != TEE_SUCCESS) {
-        EMSG("set operation key failed\n");
-        goto err_free_operation;
-    }
-
-    res = TEE_AsymmetricEncrypt(ctx->operation, NULL, 0,
+    res = TEE_AsymmetricEncrypt(ctx->encrypt_op, NULL, 0,
                                     params[0].memref.buffer, params[0].memref.size,
                                     params[1].memref.buffer, &cipher_size);
     if(res != TEE_SUCCESS) {
         EMSG("encrypt failed\n");
-        goto err_free_operation;
+        return res;
     }
     params[1].memref.size = cipher_size;
 
     return TEE_SUCCESS;
-
-err_free_operation:
-    if(ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation); 
-        ctx->operation = TEE_HANDLE_NULL;
-    }
-        
-    return res;
 }
 
 static TEE_Result decrypt(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
@@ -128,44 +171,25 @@ static TEE_Result decrypt(void **sess_ctx, uint32_t param_type, TEE_Param params
     }
 
     uint32_t plain_size = params[1].memref.size;
-    if(plain_size < KEYPAIR_SIZE) {
+    if(plain_size < ctx->key_bits / 8) {
         EMSG("plain buffer is too short\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
-    
-    res = TEE_AllocateOperation(&ctx->operation, TEE_ALG_RSAES_PKCS1_V1_5, TEE_MODE_DECRYPT, KEYPAIR_BITS);
-    if(res != TEE_SUCCESS) {
-        EMSG("alloc operation handle failed\n");
+    res = cached_operation(ctx, &ctx->decrypt_op, TEE_MODE_DECRYPT);
+    if(res != TEE_SUCCESS)
         return res;
-    }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
-    if(res != TEE_SUCCESS) {
-        EMSG("set operation key failed\n");
-        goto err_free_operation;
-    }
-
-    res = TEE_AsymmetricDecrypt(ctx->operation, NULL, 0,
+    res = TEE_AsymmetricDecrypt(ctx->decrypt_op, NULL, 0,
                                     params[0].memref.buffer, params[0].memref.size,
                                     params[1].memref.buffer, &plain_size);
     if(res != TEE_SUCCESS) {
         EMSG("decrypt failed\n");
-        goto err_free_operation;
+        return res;
     }
     params[1].memref.size = plain_size;
 
     return TEE_SUCCESS;
-
-err_free_operation:
-    if(ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation); 
-        ctx->operation = TEE_HANDLE_NULL;
-    }
-        
-    return res;
 }
 
 /*******************************************************************************
@@ -202,8 +226,7 @@ void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
     struct rsaes_pkcs1_v1_5_ctx *ctx = (struct rsaes_pkcs1_v1_5_ctx *)sess_ctx;
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
+    free_rsa_ops(ctx);
 
     if(ctx->keypair != TEE_HANDLE_NULL)
         TEE_FreeTransientObject(ctx->keypair);
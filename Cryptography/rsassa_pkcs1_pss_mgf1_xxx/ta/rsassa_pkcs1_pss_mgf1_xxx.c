@@ -4,17 +4,62 @@
 #include "include/rsassa_pkcs1_pss_mgf1_xxx.h"
 
 struct rsassa_pkcs1_pss_mgf1_xxx_ctx {
-    TEE_OperationHandle operation;
     TEE_ObjectHandle keypair;
+    uint32_t key_bits;                      // 当前密钥对的模长
+    TEE_OperationHandle sign_op;            // 设置好密钥的RSA操作, 跨调用复用
+    TEE_OperationHandle verify_op;
 };
 
+static void free_rsa_ops(struct rsassa_pkcs1_pss_mgf1_xxx_ctx *ctx)
+{
+    if(ctx->sign_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->sign_op);
+        ctx->sign_op = TEE_HANDLE_NULL;
+    }
+
+    if(ctx->verify_op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(ctx->verify_op);
+        ctx->verify_op = TEE_HANDLE_NULL;
+    }
+}
+
+/*
+ * 第一次使用时分配操作并设置密钥, 之后的调用直接复用
+ * 重新生成密钥对时由 free_rsa_ops 释放
+ */
+static TEE_Result cached_operation(struct rsassa_pkcs1_pss_mgf1_xxx_ctx *ctx, TEE_OperationHandle *op, uint32_t mode)
+{
+    TEE_Result res;
+
+    if(*op != TEE_HANDLE_NULL)
+        return TEE_SUCCESS;
+
+    if(ctx->keypair == TEE_HANDLE_NULL) {
+        EMSG("key pair is not generated\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    res = TEE_AllocateOperation(op, USE_RSA_ALGORITHM, mode, ctx->key_bits);
+    if(res != TEE_SUCCESS) {
+        EMSG("alloc operation handle failed\n");
+        return res;
+    }
+
+    res = TEE_SetOperationKey(*op, ctx->keypair);
+    if(res != TEE_SUCCESS) {
+        EMSG("set operation key failed\n");
+        TEE_FreeOperation(*op);
+        *op = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
 /**
  * keypair format：modulus + exponent
  */
 static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
-    (void)params;
-
     struct rsassa_pkcs1_pss_mgf1_xxx_ctx *ctx = (struct rsassa_pkcs1_pss_mgf1_xxx_ctx *)sess_ctx;
     TEE_Result res;
     uint32_t exp_param_type = TEE_PARAM_TYPES(
@@ -24,33 +69,50 @@ static TEE_Result generate_key(void **sess_ctx, uint32_t param_type, TEE_Param p
         TEE_PARAM_TYPE_NONE
     );
 
-    if (param_type != exp_param_type) {
+    uint32_t key_bits = KEYPAIR_BITS;
+
+    // 不带参数时使用头文件中的默认模长, 也可以通过 param[0].value.a 在运行时指定
+    if (param_type == TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_NONE,
+                                      TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE)) {
+        if (params[0].value.a)
+            key_bits = params[0].value.a;
+    } else if (param_type != exp_param_type) {
         EMSG("bad parameters\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
+    if (key_bits < KEYPAIR_MIN_BITS || key_bits > KEYPAIR_MAX_BITS || key_bits % 8) {
+        EMSG("unsupported key size %u\n", key_bits);
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+
     res = TEE_IsAlgorithmSupported(USE_RSA_ALGORITHM, TEE_CRYPTO_ELEMENT_NONE);
     if (res != TEE_SUCCESS) {
         EMSG("the algorithm is not supported\n");
         return res;
     }
 
+    // 缓存的操作绑定了旧的密钥对
+    free_rsa_ops(ctx);
+    ctx->key_bits = 0;
+
     if (ctx->keypair != TEE_HANDLE_NULL) {
         TEE_FreeTransientObject(ctx->keypair);
         ctx->keypair = TEE_HANDLE_NULL;
     }
 
-    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR, KEYPAIR_BITS, &ctx->keypair);
+    res = TEE_AllocateTransientObject(TEE_TYPE_RSA_KEYPAIR, key_bits, &ctx->keypair);
     if (res != TEE_SUCCESS) {
         EMSG("alloc key pair faild\n");
         return res;
     }
 
-    res = TEE_GenerateKey(ctx->keypair, KEYPAIR_BITS, NULL, 0);
+    res = TEE_GenerateKey(ctx->keypair, key_bits, NULL, 0);
     if (res != TEE_SUCCESS) {
         EMSG("generated key failed\n");
         goto err_free_key;
     }
+    ctx->key_bits = key_bits;
 
     return TEE_SUCCESS;
 
@@ -65,7 +127,9 @@ err_free_key:
 
 static TEE_Result digest(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
-    struct rsassa_pkcs1_pss_mgf1_xxx_ctx *ctx = (struct rsassa_pkcs1_pss_mgf1_xxx_ctx *)sess_ctx;
+    (void)sess_ctx;
+
+    TEE_OperationHandle operation;
     TEE_Result res;
     uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
                                                 TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
@@ -80,20 +144,16 @@ static TEE_Result digest(void **sess_ctx, uint32_t param_type, TEE_Param params[
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
-    
-    res = TEE_AllocateOperation(&ctx->operation, USE_DIGEST_ALGORITHM, TEE_MODE_DIGEST, 0); // digest no need key size
+    res = TEE_AllocateOperation(&operation, USE_DIGEST_ALGORITHM, TEE_MODE_DIGEST, 0); // digest no need key size
     if(res != TEE_SUCCESS) {
         EMSG("alloc operation handle failed\n");
         return res;
     }
 
-    res = TEE_DigestDoFinal(ctx->operation,params[0].memref.buffer, params[0].memref.size,
+    res = TEE_DigestDoFinal(operation,params[0].memref.buffer, params[0].memref.size,
                                     params[1].memref.buffer, &digest_size);
+    TEE_FreeOperation(operation);
     if(res != TEE_SUCCESS) {
-        TEE_FreeOperation(ctx->operation);
-        ctx->operation = TEE_HANDLE_NULL;
         EMSG("digest failed\n");
         return res;
     }
@@ -114,44 +174,25 @@ static TEE_Result sign(void **sess_ctx, uint32_t param_type, TEE_Param params[4]
     }
 
     uint32_t signature_size = params[1].memref.size;
-    if(signature_size < KEYPAIR_SIZE) {
+    if(signature_size < ctx->key_bits / 8) {
         EMSG("signature buffer is too short\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
-    
-    res = TEE_AllocateOperation(&ctx->operation, USE_RSA_ALGORITHM, TEE_MODE_SIGN, KEYPAIR_BITS);
-    if(res != TEE_SUCCESS) {
-        EMSG("alloc operation handle failed\n");
+    res = cached_operation(ctx, &ctx->sign_op, TEE_MODE_SIGN);
+    if(res != TEE_SUCCESS)
         return res;
-    }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
-    if(res != TEE_SUCCESS) {
-        EMSG("set operation key failed\n");
-        goto err_free_operation;
-    }
-
-    res = TEE_AsymmetricSignDigest(ctx->operation, NULL, 0,
+    res = TEE_AsymmetricSignDigest(ctx->sign_op, NULL, 0,
                                     params[0].memref.buffer, params[0].memref.size,
                                     params[1].memref.buffer, &signature_size);
     if(res != TEE_SUCCESS) {
         EMSG("sign failed\n");
-        goto err_free_operation;
+        return res;
     }
     params[1].memref.size = signature_size;
 
     return TEE_SUCCESS;
-
-err_free_operation:
-    if(ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation); 
-        ctx->operation = TEE_HANDLE_NULL;
-    }
-        
-    return res;
 }
 
 static TEE_Result verify(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
@@ -165,39 +206,159 @@ static TEE_Result verify(void **sess_ctx, uint32_t param_type, TEE_Param params[
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
-    
-    res = TEE_AllocateOperation(&ctx->operation, USE_RSA_ALGORITHM, TEE_MODE_VERIFY, KEYPAIR_BITS);
+    res = cached_operation(ctx, &ctx->verify_op, TEE_MODE_VERIFY);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_AsymmetricVerifyDigest(ctx->verify_op, NULL, 0,
+                                    params[0].memref.buffer, params[0].memref.size,
+                                    params[1].memref.buffer, params[1].memref.size);
     if(res != TEE_SUCCESS) {
-        EMSG("alloc operation handle failed\n");
+        EMSG("verify failed\n");
         return res;
     }
 
-    res = TEE_SetOperationKey(ctx->operation, ctx->keypair);
-    if(res != TEE_SUCCESS) {
-        EMSG("set operation key failed\n");
-        goto err_free_operation;
+    return TEE_SUCCESS;
+}
+
+static uint32_t der_tlv_size(uint32_t len)
+{
+    return 1 + (len < 0x80 ? 1 : len < 0x100 ? 2 : 3) + len;
+}
+
+static uint8_t *der_put_header(uint8_t *p, uint8_t tag, uint32_t len)
+{
+    *p++ = tag;
+    if(len >= 0x100) {
+        *p++ = 0x82;
+        *p++ = len >> 8;
+    } else if(len >= 0x80) {
+        *p++ = 0x81;
     }
+    *p++ = len & 0xFF;
 
-    res = TEE_AsymmetricVerifyDigest(ctx->operation, NULL, 0,
-                                    params[0].memref.buffer, params[0].memref.size,
-                                    params[1].memref.buffer, params[1].memref.size);
+    return p;
+}
+
+// 无符号大数编码成 INTEGER, 最高位为1时补一个0
+static uint8_t *der_put_integer(uint8_t *p, const uint8_t *num, uint32_t len)
+{
+    uint32_t pad = num[0] & 0x80 ? 1 : 0;
+
+    p = der_put_header(p, 0x02, len + pad);
+    if(pad)
+        *p++ = 0;
+    TEE_MemMove(p, num, len);
+
+    return p + len;
+}
+
+static const uint8_t *der_trim(const uint8_t *num, uint32_t *len)
+{
+    while(*len > 1 && !num[0]) {
+        num++;
+        (*len)--;
+    }
+
+    return num;
+}
+
+/**
+ * raw format：modulus length(2, big endian) + modulus + exponent
+ * DER format：SubjectPublicKeyInfo, 与 openssl rsa -pubout -outform der 的输出相同
+ */
+static TEE_Result export_public_key(void **sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct rsassa_pkcs1_pss_mgf1_xxx_ctx *ctx = (struct rsassa_pkcs1_pss_mgf1_xxx_ctx *)sess_ctx;
+    static const uint8_t rsa_alg_id[] = {
+        0x30, 0x0d, 0x06, 0x09, 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x01, 0x05, 0x00
+    };
+    uint8_t exponent[8];
+    uint8_t *modulus;
+    TEE_Result res;
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if(param_type != exp_param_type) {
+        EMSG("param type is not correct\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t format = params[0].value.a;
+    if(format != PUBKEY_FORMAT_RAW && format != PUBKEY_FORMAT_DER) {
+        EMSG("unknown public key format %u\n", format);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if(ctx->keypair == TEE_HANDLE_NULL) {
+        EMSG("key pair is not generated\n");
+        return TEE_ERROR_BAD_STATE;
+    }
+
+    // 模长最大 512 字节, 放在堆上
+    uint32_t mod_len = KEYPAIR_MAX_BITS / 8;
+    modulus = TEE_Malloc(mod_len, TEE_MALLOC_FILL_ZERO);
+    if(!modulus) {
+        EMSG("alloc modulus buffer failed\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    res = TEE_GetObjectBufferAttribute(ctx->keypair, TEE_ATTR_RSA_MODULUS, modulus, &mod_len);
     if(res != TEE_SUCCESS) {
-        EMSG("sign failed\n");
-        goto err_free_operation;
+        EMSG("get modulus failed\n");
+        goto out;
     }
 
-    IMSG("verify signature success\n");
+    uint32_t exp_len = sizeof(exponent);
+    res = TEE_GetObjectBufferAttribute(ctx->keypair, TEE_ATTR_RSA_PUBLIC_EXPONENT, exponent, &exp_len);
+    if(res != TEE_SUCCESS) {
+        EMSG("get public exponent failed\n");
+        goto out;
+    }
 
-    return TEE_SUCCESS;
+    const uint8_t *n = der_trim(modulus, &mod_len);
+    const uint8_t *e = der_trim(exponent, &exp_len);
+    uint8_t *p = params[1].memref.buffer;
+
+    if(format == PUBKEY_FORMAT_RAW) {
+        uint32_t need = 2 + mod_len + exp_len;
+        if(params[1].memref.size < need) {
+            params[1].memref.size = need;
+            res = TEE_ERROR_SHORT_BUFFER;
+            goto out;
+        }
+
+        p[0] = mod_len >> 8;
+        p[1] = mod_len & 0xFF;
+        TEE_MemMove(p + 2, n, mod_len);
+        TEE_MemMove(p + 2 + mod_len, e, exp_len);
+        params[1].memref.size = need;
+        goto out;
+    }
 
-err_free_operation:
-    if(ctx->operation != TEE_HANDLE_NULL) {
-        TEE_FreeOperation(ctx->operation); 
-        ctx->operation = TEE_HANDLE_NULL;
+    // SEQUENCE { AlgorithmIdentifier, BIT STRING { SEQUENCE { INTEGER n, INTEGER e } } }
+    uint32_t rsa_key_len = der_tlv_size(mod_len + (n[0] >> 7)) + der_tlv_size(exp_len + (e[0] >> 7));
+    uint32_t bit_string_len = 1 + der_tlv_size(rsa_key_len);
+    uint32_t spki_len = sizeof(rsa_alg_id) + der_tlv_size(bit_string_len);
+    uint32_t need = der_tlv_size(spki_len);
+    if(params[1].memref.size < need) {
+        params[1].memref.size = need;
+        res = TEE_ERROR_SHORT_BUFFER;
+        goto out;
     }
-        
+
+    p = der_put_header(p, 0x30, spki_len);
+    TEE_MemMove(p, rsa_alg_id, sizeof(rsa_alg_id));
+    p += sizeof(rsa_alg_id);
+    p = der_put_header(p, 0x03, bit_string_len);
+    *p++ = 0; // 没有未使用的位
+    p = der_put_header(p, 0x30, rsa_key_len);
+    p = der_put_integer(p, n, mod_len);
+    der_put_integer(p, e, exp_len);
+    params[1].memref.size = need;
+
+out:
+    TEE_Free(modulus);
+
     return res;
 }
 
@@ -235,8 +396,7 @@ void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
     struct rsassa_pkcs1_pss_mgf1_xxx_ctx *ctx = (struct rsassa_pkcs1_pss_mgf1_xxx_ctx *)sess_ctx;
 
-    if(ctx->operation != TEE_HANDLE_NULL)
-        TEE_FreeOperation(ctx->operation);
+    free_rsa_ops(ctx);
 
     if(ctx->keypair != TEE_HANDLE_NULL)
         TEE_FreeTransientObject(ctx->keypair);
@@ -259,6 +419,9 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
         case RSASSA_PKCS1_PSS_MGF1_XXX_VERIFY:
             return verify(sess_ctx, param_type, params);
 
+        case RSASSA_PKCS1_PSS_MGF1_XXX_EXPORT_PUBKEY:
+            return export_public_key(sess_ctx, param_type, params);
+
         default:
             return TEE_ERROR_BAD_PARAMETERS;
     }
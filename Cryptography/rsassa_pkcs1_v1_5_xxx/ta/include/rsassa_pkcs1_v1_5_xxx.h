@@ -36,11 +36,16 @@
 
 #define KEYPAIR_SIZE (128)
 #define KEYPAIR_BITS (KEYPAIR_SIZE * 8) // can be 1024, 2048, 3072, 4096
+#define KEYPAIR_MIN_BITS (1024) // GEN_KEY may choose another size at runtime
+#define KEYPAIR_MAX_BITS (4096)
+
+#define PUBKEY_FORMAT_RAW (0) // modulus length(2, big endian) | modulus | exponent
+#define PUBKEY_FORMAT_DER (1) // SubjectPublicKeyInfo
 
 /* 
- * @brief : generate keypair
+ * @brief : generate keypair, the cached RSA operations of the old keypair are released
  *
- * param[0] (unsued)
+ * param[0] (value-input)	: a : key size in bits, 0 means KEYPAIR_BITS, the param may also be unused
  * param[1] (unsued)
  * param[2] (unsued)
  * param[3] (unsued)
@@ -77,4 +82,14 @@
  */
 #define RSASSA_PKCS1_V1_5_XXX_VERIFY 	3
 
+/* 
+ * @brief : export the public key, the signature can then be verified in the normal world
+ *
+ * param[0] (value-input) 	: a : PUBKEY_FORMAT_RAW or PUBKEY_FORMAT_DER
+ * param[1] (memref-output)	: public key, TEE_ERROR_SHORT_BUFFER returns the needed size
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define RSASSA_PKCS1_V1_5_XXX_EXPORT_PUBKEY 	4
+
 #endif /* _RSASSA_PKCS1_V1_5_XXX_H */
@@ -0,0 +1,562 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "async_invoke.h"
+
+// 已请求取消但调用仍未返回时, 隔多久再请求一次(调用可能还没真正进入TA, 第一次取消会丢失)
+#define CANCEL_RETRY_NS		(10 * 1000000ULL)
+
+enum req_state {
+	REQ_QUEUED,
+	REQ_RUNNING,
+	REQ_DONE,
+};
+
+struct req_list {
+	struct async_future *head;
+	struct async_future *tail;
+};
+
+/*
+ * 一个请求, 同一时刻只在 queue/running/done 其中一个链表里(done 链表只放未取走的 future)
+ */
+struct async_future {
+	struct async_future *prev;
+	struct async_future *next;
+	struct req_list *list;
+	struct async_invoke *as;
+	TEEC_UUID uuid;
+	uint32_t cmd;
+	TEEC_Operation *op;
+	uint64_t deadline;			// 0 表示没有截止时间
+	uint64_t cancel_at;			// 运行中的请求下一次调用 TEEC_RequestCancellation 的时间, 0 表示不需要
+	enum req_state state;
+	int expired;
+	TEEC_Result res;
+	uint32_t err_origin;
+	async_invoke_cb cb;			// 非 NULL 时完成后回调并释放
+	void *arg;
+};
+
+struct async_invoke {
+	struct session_pool *pool;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	// 有新请求或停止
+	pthread_cond_t done_cond;	// 有请求完成
+	pthread_cond_t watch_cond;	// 截止时间变化或停止
+	struct req_list queue;
+	struct req_list running;
+	struct req_list done;
+	struct async_invoke_stats stats;
+	int stop;					// 工作线程处理完队列后退出
+	int watch_stop;				// 工作线程全部退出后才停止截止时间线程
+	int efd;
+	uint32_t nr_workers;
+	pthread_t *workers;
+	pthread_t watchdog;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void list_push(struct req_list *list, struct async_future *f)
+{
+	f->list = list;
+	f->next = NULL;
+	f->prev = list->tail;
+	if(list->tail)
+		list->tail->next = f;
+	else
+		list->head = f;
+	list->tail = f;
+}
+
+static void list_del(struct async_future *f)
+{
+	struct req_list *list = f->list;
+
+	if(!list)
+		return;
+
+	if(f->prev)
+		f->prev->next = f->next;
+	else
+		list->head = f->next;
+	if(f->next)
+		f->next->prev = f->prev;
+	else
+		list->tail = f->prev;
+
+	f->prev = f->next = NULL;
+	f->list = NULL;
+}
+
+/*
+ * 在锁内把请求标记为完成, 返回 1 表示需要在锁外执行回调(之后释放)
+ */
+static int complete_locked(struct async_invoke *as, struct async_future *f, TEEC_Result res, uint32_t origin)
+{
+	uint64_t one = 1;
+
+	list_del(f);
+	f->state = REQ_DONE;
+	f->res = res;
+	f->err_origin = origin;
+	as->stats.completed++;
+
+	if(f->cb)
+		return 1;
+
+	list_push(&as->done, f);
+	pthread_cond_broadcast(&as->done_cond);
+	if(write(as->efd, &one, sizeof(one)) < 0) {
+		// 计数器已满(不可能)或 efd 异常, 等待者仍可通过 done_cond 得知完成
+	}
+
+	return 0;
+}
+
+static void run_callback(struct async_future *f)
+{
+	f->cb(f->res, f->err_origin, f->op, f->arg);
+	free(f);
+}
+
+static void *worker_main(void *arg)
+{
+	struct async_invoke *as = arg;
+	struct pooled_session *ps;
+	struct async_future *f;
+	TEEC_Result res;
+	uint32_t origin;
+	uint64_t now;
+	int timeout_ms, cb;
+
+	pthread_mutex_lock(&as->lock);
+	for(;;) {
+		while(!as->queue.head && !as->stop)
+			pthread_cond_wait(&as->work_cond, &as->lock);
+		if(!as->queue.head)
+			break;
+
+		f = as->queue.head;
+		list_del(f);
+		as->stats.queued--;
+
+		// 截止时间剩余多少就最多等多久会话
+		timeout_ms = -1;
+		if(f->deadline) {
+			now = now_ns();
+			if(now >= f->deadline) {
+				f->expired = 1;
+				as->stats.expired++;
+				cb = complete_locked(as, f, TEEC_ERROR_CANCEL, TEEC_ORIGIN_API);
+				if(cb) {
+					pthread_mutex_unlock(&as->lock);
+					run_callback(f);
+					pthread_mutex_lock(&as->lock);
+				}
+				continue;
+			}
+			timeout_ms = (f->deadline - now + 999999) / 1000000;
+		}
+
+		// 借会话期间请求不在任何链表中, 不会被取消或超时处理
+		f->state = REQ_RUNNING;
+		pthread_mutex_unlock(&as->lock);
+
+		ps = session_pool_acquire(as->pool, &f->uuid, timeout_ms);
+
+		pthread_mutex_lock(&as->lock);
+		if(!ps) {
+			if(f->deadline && now_ns() >= f->deadline) {
+				f->expired = 1;
+				as->stats.expired++;
+				res = TEEC_ERROR_CANCEL;
+			} else {
+				res = TEEC_ERROR_BUSY;
+			}
+			cb = complete_locked(as, f, res, TEEC_ORIGIN_API);
+			if(cb) {
+				pthread_mutex_unlock(&as->lock);
+				run_callback(f);
+				pthread_mutex_lock(&as->lock);
+			}
+			continue;
+		}
+
+		// 等待会话期间被 async_future_cancel 取消, 不再调用
+		if(f->cancel_at) {
+			pthread_mutex_unlock(&as->lock);
+			session_pool_release(as->pool, ps);
+			pthread_mutex_lock(&as->lock);
+			cb = complete_locked(as, f, TEEC_ERROR_CANCEL, TEEC_ORIGIN_API);
+			if(cb) {
+				pthread_mutex_unlock(&as->lock);
+				run_callback(f);
+				pthread_mutex_lock(&as->lock);
+			}
+			continue;
+		}
+
+		// TEEC_InvokeCommand 设置 op->session 之前, 重复使用的 op 中还是上一次调用的会话,
+		// 该会话可能正被其他工作线程使用. 清零后此时的取消请求为空操作, 由 CANCEL_RETRY_NS 重试
+		f->op->session = NULL;
+		list_push(&as->running, f);
+		as->stats.running++;
+		// 等待会话期间过期的请求, 交给截止时间线程立即请求取消
+		if(f->deadline)
+			pthread_cond_signal(&as->watch_cond);
+		pthread_mutex_unlock(&as->lock);
+
+		res = session_pool_invoke(ps, f->cmd, f->op, &origin);
+
+		// 先移出运行链表再归还会话, 否则截止时间线程可能对 op->session 请求取消,
+		// 而该会话已被其他工作线程借出
+		pthread_mutex_lock(&as->lock);
+		list_del(f);
+		f->cancel_at = 0;
+		as->stats.running--;
+		pthread_mutex_unlock(&as->lock);
+
+		session_pool_release(as->pool, ps);
+
+		pthread_mutex_lock(&as->lock);
+		cb = complete_locked(as, f, res, origin);
+		if(cb) {
+			pthread_mutex_unlock(&as->lock);
+			run_callback(f);
+			pthread_mutex_lock(&as->lock);
+		}
+	}
+	pthread_mutex_unlock(&as->lock);
+
+	return NULL;
+}
+
+static void request_cancel_locked(struct async_invoke *as, struct async_future *f, uint64_t now)
+{
+	TEEC_RequestCancellation(f->op);
+	as->stats.cancel_requests++;
+	f->cancel_at = now + CANCEL_RETRY_NS;
+}
+
+/*
+ * 截止时间线程 : 排队中过期的请求直接完成, 运行中过期的请求周期性地请求取消直到调用返回
+ */
+static void *watchdog_main(void *arg)
+{
+	struct async_invoke *as = arg;
+	struct async_future *f, *next;
+	struct req_list expired = { NULL, NULL };
+	struct timespec ts;
+	uint64_t now, wake;
+
+	pthread_mutex_lock(&as->lock);
+	while(!as->watch_stop) {
+		now = now_ns();
+		wake = 0;
+
+		for(f = as->queue.head; f; f = next) {
+			next = f->next;
+			if(!f->deadline)
+				continue;
+			if(now >= f->deadline) {
+				list_del(f);
+				as->stats.queued--;
+				f->expired = 1;
+				as->stats.expired++;
+				if(complete_locked(as, f, TEEC_ERROR_CANCEL, TEEC_ORIGIN_API))
+					list_push(&expired, f);
+			} else if(!wake || f->deadline < wake) {
+				wake = f->deadline;
+			}
+		}
+
+		for(f = as->running.head; f; f = f->next) {
+			if(f->cancel_at) {
+				if(now >= f->cancel_at)
+					request_cancel_locked(as, f, now);
+			} else if(f->deadline && now >= f->deadline) {
+				f->expired = 1;
+				as->stats.expired++;
+				request_cancel_locked(as, f, now);
+			}
+
+			uint64_t t = f->cancel_at ? f->cancel_at : f->deadline;
+			if(t && (!wake || t < wake))
+				wake = t;
+		}
+
+		// 排队中过期的回调请求在锁外回调
+		if(expired.head) {
+			pthread_mutex_unlock(&as->lock);
+			while((f = expired.head)) {
+				list_del(f);
+				run_callback(f);
+			}
+			pthread_mutex_lock(&as->lock);
+			continue;
+		}
+
+		if(!wake) {
+			pthread_cond_wait(&as->watch_cond, &as->lock);
+		} else {
+			ts.tv_sec = wake / 1000000000ULL;
+			ts.tv_nsec = wake % 1000000000ULL;
+			pthread_cond_timedwait(&as->watch_cond, &as->lock, &ts);
+		}
+	}
+	pthread_mutex_unlock(&as->lock);
+
+	return NULL;
+}
+
+struct async_invoke *async_invoke_create(struct session_pool *pool, uint32_t nr_workers)
+{
+	struct async_invoke *as;
+	pthread_condattr_t attr;
+	uint32_t started = 0;
+
+	if(!nr_workers)
+		return NULL;
+
+	as = calloc(1, sizeof(*as));
+	if(!as)
+		return NULL;
+
+	as->pool = pool;
+	as->nr_workers = nr_workers;
+	as->workers = calloc(nr_workers, sizeof(*as->workers));
+	as->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(!as->workers || as->efd < 0)
+		goto err_free;
+
+	pthread_mutex_init(&as->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&as->work_cond, &attr);
+	pthread_cond_init(&as->done_cond, &attr);
+	pthread_cond_init(&as->watch_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if(pthread_create(&as->watchdog, NULL, watchdog_main, as))
+		goto err_destroy;
+
+	for(; started < nr_workers; started++) {
+		if(pthread_create(&as->workers[started], NULL, worker_main, as))
+			goto err_stop;
+	}
+
+	return as;
+
+err_stop:
+	as->nr_workers = started;
+	async_invoke_destroy(as);
+	return NULL;
+
+err_destroy:
+	pthread_cond_destroy(&as->watch_cond);
+	pthread_cond_destroy(&as->done_cond);
+	pthread_cond_destroy(&as->work_cond);
+	pthread_mutex_destroy(&as->lock);
+
+err_free:
+	if(as->efd >= 0)
+		close(as->efd);
+	free(as->workers);
+	free(as);
+	return NULL;
+}
+
+void async_invoke_destroy(struct async_invoke *as)
+{
+	if(!as)
+		return;
+
+	pthread_mutex_lock(&as->lock);
+	as->stop = 1;
+	pthread_cond_broadcast(&as->work_cond);
+	pthread_mutex_unlock(&as->lock);
+
+	// 工作线程处理完队列中剩余的请求才退出, 期间截止时间仍然有效
+	for(uint32_t i = 0; i < as->nr_workers; i++)
+		pthread_join(as->workers[i], NULL);
+
+	pthread_mutex_lock(&as->lock);
+	as->watch_stop = 1;
+	pthread_cond_broadcast(&as->watch_cond);
+	pthread_mutex_unlock(&as->lock);
+	pthread_join(as->watchdog, NULL);
+
+	pthread_cond_destroy(&as->watch_cond);
+	pthread_cond_destroy(&as->done_cond);
+	pthread_cond_destroy(&as->work_cond);
+	pthread_mutex_destroy(&as->lock);
+	close(as->efd);
+	free(as->workers);
+	free(as);
+}
+
+static struct async_future *submit(struct async_invoke *as, const TEEC_UUID *uuid, uint32_t cmd,
+								TEEC_Operation *op, int timeout_ms, async_invoke_cb cb, void *arg)
+{
+	struct async_future *f;
+
+	f = calloc(1, sizeof(*f));
+	if(!f)
+		return NULL;
+
+	f->as = as;
+	f->uuid = *uuid;
+	f->cmd = cmd;
+	f->op = op;
+	f->cb = cb;
+	f->arg = arg;
+	f->state = REQ_QUEUED;
+	if(timeout_ms >= 0)
+		f->deadline = now_ns() + (uint64_t)timeout_ms * 1000000 + 1;
+
+	pthread_mutex_lock(&as->lock);
+	if(as->stop) {
+		pthread_mutex_unlock(&as->lock);
+		free(f);
+		return NULL;
+	}
+	list_push(&as->queue, f);
+	as->stats.queued++;
+	as->stats.submitted++;
+	pthread_cond_signal(&as->work_cond);
+	if(f->deadline)
+		pthread_cond_signal(&as->watch_cond);
+	pthread_mutex_unlock(&as->lock);
+
+	return f;
+}
+
+struct async_future *async_invoke_submit(struct async_invoke *as, const TEEC_UUID *uuid, uint32_t cmd,
+										TEEC_Operation *op, int timeout_ms)
+{
+	return submit(as, uuid, cmd, op, timeout_ms, NULL, NULL);
+}
+
+int async_invoke_submit_cb(struct async_invoke *as, const TEEC_UUID *uuid, uint32_t cmd,
+						TEEC_Operation *op, int timeout_ms, async_invoke_cb cb, void *arg)
+{
+	if(!cb)
+		return -1;
+
+	return submit(as, uuid, cmd, op, timeout_ms, cb, arg) ? 0 : -1;
+}
+
+int async_invoke_eventfd(struct async_invoke *as)
+{
+	return as->efd;
+}
+
+struct async_future *async_invoke_reap(struct async_invoke *as)
+{
+	struct async_future *f;
+
+	pthread_mutex_lock(&as->lock);
+	f = as->done.head;
+	if(f)
+		list_del(f);
+	pthread_mutex_unlock(&as->lock);
+
+	return f;
+}
+
+void async_invoke_stats(struct async_invoke *as, struct async_invoke_stats *stats)
+{
+	pthread_mutex_lock(&as->lock);
+	*stats = as->stats;
+	pthread_mutex_unlock(&as->lock);
+}
+
+TEEC_Result async_future_wait(struct async_future *f, uint32_t *err_origin)
+{
+	struct async_invoke *as = f->as;
+
+	pthread_mutex_lock(&as->lock);
+	while(f->state != REQ_DONE)
+		pthread_cond_wait(&as->done_cond, &as->lock);
+	pthread_mutex_unlock(&as->lock);
+
+	if(err_origin)
+		*err_origin = f->err_origin;
+
+	return f->res;
+}
+
+int async_future_poll(struct async_future *f)
+{
+	struct async_invoke *as = f->as;
+	int done;
+
+	pthread_mutex_lock(&as->lock);
+	done = f->state == REQ_DONE;
+	pthread_mutex_unlock(&as->lock);
+
+	return done;
+}
+
+void async_future_cancel(struct async_future *f)
+{
+	struct async_invoke *as = f->as;
+
+	pthread_mutex_lock(&as->lock);
+	if(f->state == REQ_QUEUED && f->list == &as->queue) {
+		as->stats.queued--;
+		complete_locked(as, f, TEEC_ERROR_CANCEL, TEEC_ORIGIN_API);
+	} else if(f->state == REQ_RUNNING) {
+		// 仍在等待会话时只做标记, 进入运行链表后由截止时间线程请求取消
+		f->cancel_at = 1;
+		pthread_cond_signal(&as->watch_cond);
+	}
+	pthread_mutex_unlock(&as->lock);
+}
+
+int async_future_expired(struct async_future *f)
+{
+	struct async_invoke *as = f->as;
+	int expired;
+
+	pthread_mutex_lock(&as->lock);
+	expired = f->expired;
+	pthread_mutex_unlock(&as->lock);
+
+	return expired;
+}
+
+TEEC_Operation *async_future_op(struct async_future *f)
+{
+	return f->op;
+}
+
+void async_future_free(struct async_future *f)
+{
+	struct async_invoke *as;
+
+	if(!f)
+		return;
+
+	as = f->as;
+	async_future_wait(f, NULL);
+
+	pthread_mutex_lock(&as->lock);
+	list_del(f);
+	pthread_mutex_unlock(&as->lock);
+
+	free(f);
+}
@@ -0,0 +1,122 @@
+#ifndef _ASYNC_INVOKE_H
+#define _ASYNC_INVOKE_H
+
+#include <stdint.h>
+#include <tee_client_api.h>
+
+#include "session_pool.h"
+
+/*
+ * CA侧异步调用 : 请求提交到工作线程池, 工作线程从会话池借出会话执行 TEEC_InvokeCommand,
+ * 调用方立即返回, 通过 future 等待/轮询结果, 或在完成时回调.
+ * 事件循环(epoll)可以监听 async_invoke_eventfd(), 可读时用 async_invoke_reap() 取出完成的 future,
+ * 不必为每个进行中的请求占用一个阻塞线程
+ *
+ * 每个请求可以设置截止时间, 超时仍在排队的请求不再调用, 已进入TA的请求通过
+ * TEEC_RequestCancellation 取消, 这要求TA在耗时操作前调用 TEE_UnmaskCancellation,
+ * 否则请求会正常执行完, 只是被标记为超时
+ */
+
+struct async_invoke;
+struct async_future;
+
+/*
+ * @brief : completion callback, runs on a worker thread or on the deadline thread
+ *          (for requests that expire while queued), must not block for long
+ *
+ * @param res : result of the invoke, TEEC_ERROR_CANCEL when cancelled or expired before running
+ */
+typedef void (*async_invoke_cb)(TEEC_Result res, uint32_t err_origin, TEEC_Operation *op, void *arg);
+
+struct async_invoke_stats {
+	uint32_t queued;			// 当前排队的请求数
+	uint32_t running;			// 当前正在调用的请求数
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t expired;			// 超过截止时间的请求数
+	uint64_t cancel_requests;	// 调用 TEEC_RequestCancellation 的次数
+};
+
+/*
+ * @brief : start nr_workers threads invoking through sessions of the pool, plus one deadline thread
+ *          the pool must outlive the async object
+ *
+ * @return : the async object, NULL on failure
+ */
+struct async_invoke *async_invoke_create(struct session_pool *pool, uint32_t nr_workers);
+
+/*
+ * @brief : run the queued requests, stop the threads and free the object,
+ *          all futures must have been freed
+ */
+void async_invoke_destroy(struct async_invoke *as);
+
+/*
+ * @brief : queue an invoke and return a future
+ *          op and the memory it references must stay valid until the future completes,
+ *          op->started must be 0
+ *
+ * @param timeout_ms : deadline relative to now, < 0 means none
+ *
+ * @return : the future, free it with async_future_free, NULL on failure
+ */
+struct async_future *async_invoke_submit(struct async_invoke *as, const TEEC_UUID *uuid, uint32_t cmd,
+										TEEC_Operation *op, int timeout_ms);
+
+/*
+ * @brief : queue an invoke and call cb when it completes, nothing needs to be freed
+ *
+ * @return : 0 on success, -1 on failure (cb is not called)
+ */
+int async_invoke_submit_cb(struct async_invoke *as, const TEEC_UUID *uuid, uint32_t cmd,
+						TEEC_Operation *op, int timeout_ms, async_invoke_cb cb, void *arg);
+
+/*
+ * @brief : an eventfd that becomes readable whenever a future completes,
+ *          read it to clear, then drain async_invoke_reap
+ */
+int async_invoke_eventfd(struct async_invoke *as);
+
+/*
+ * @brief : take the next completed future that has not been reaped or freed, in completion order
+ *
+ * @return : the future, NULL if none
+ */
+struct async_future *async_invoke_reap(struct async_invoke *as);
+
+void async_invoke_stats(struct async_invoke *as, struct async_invoke_stats *stats);
+
+/*
+ * @brief : block until the future completes
+ *
+ * @return : result of the invoke, err_origin may be NULL
+ */
+TEEC_Result async_future_wait(struct async_future *f, uint32_t *err_origin);
+
+/*
+ * @brief : 1 if the future has completed, 0 otherwise
+ */
+int async_future_poll(struct async_future *f);
+
+/*
+ * @brief : cancel a request, a queued one or one still waiting for a session completes with
+ *          TEEC_ERROR_CANCEL without running, a running one gets TEEC_RequestCancellation
+ */
+void async_future_cancel(struct async_future *f);
+
+/*
+ * @brief : 1 if the request missed its deadline
+ */
+int async_future_expired(struct async_future *f);
+
+/*
+ * @brief : the operation passed to async_invoke_submit
+ */
+TEEC_Operation *async_future_op(struct async_future *f);
+
+/*
+ * @brief : wait for the future if needed and free it
+ */
+void async_future_free(struct async_future *f);
+
+#endif /* _ASYNC_INVOKE_H */
@@ -0,0 +1,164 @@
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <tee_client_api.h>
+
+#include "../ta/include/cancel.h"
+#include "session_pool.h"
+#include "async_invoke.h"
+
+/*
+ * 异步调用示例 : 主线程不阻塞在 TEEC_InvokeCommand 上, 用 epoll 监听完成事件
+ *
+ * A : 截止时间 2s, 到期后由异步层调用 TEEC_RequestCancellation, 返回 TEEC_ERROR_CANCEL
+ * B : 没有截止时间, 主线程在 3s 时主动取消
+ * C : 回调方式, 截止时间 0.5s, 两个工作线程都在忙, 在队列中过期, 不会进入TA
+ *
+ * TA 为 TA_FLAG_SINGLE_INSTANCE, B 在 OP-TEE 中排队到 A 被取消后才进入TA
+ * TA 在 TEE_Wait 前调用了 TEE_UnmaskCancellation, 否则取消请求不会生效
+ */
+
+#define NR_SESSIONS			(2)
+#define NR_WORKERS			(2)
+
+#define A_TIMEOUT_MS		(2000)
+#define B_CANCEL_MS			(3000)
+#define C_TIMEOUT_MS		(500)
+
+static uint64_t start_ns;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int elapsed_ms(void)
+{
+	return (now_ns() - start_ns) / 1000000;
+}
+
+static void report(const char *name, TEEC_Result res, uint32_t err_origin, int expired)
+{
+	if(res == TEEC_ERROR_CANCEL)
+		printf("[%5ums] %s canceled%s\n", elapsed_ms(), name, expired ? " (deadline)" : "");
+	else if(res != TEEC_SUCCESS)
+		printf("[%5ums] %s failed with code 0x%x origin 0x%x\n", elapsed_ms(), name, res, err_origin);
+	else
+		printf("[%5ums] %s count complete\n", elapsed_ms(), name);
+}
+
+// 在截止时间线程中执行
+static void c_done(TEEC_Result res, uint32_t err_origin, TEEC_Operation *op, void *arg)
+{
+	(void)op;
+	(void)arg;
+
+	report("C", res, err_origin, res == TEEC_ERROR_CANCEL);
+}
+
+int main(void)
+{
+	struct session_pool *pool;
+	struct async_invoke *as;
+	struct async_future *a, *b, *f;
+	struct async_invoke_stats stats;
+	struct epoll_event ev;
+	TEEC_UUID uuid = TA_CANCEL_UUID;
+	TEEC_Operation op_a, op_b, op_c;
+	TEEC_Result res;
+	uint32_t err_origin;
+	uint64_t counter;
+	int epfd, timeout, pending = 2, b_canceled = 0;
+
+	pool = session_pool_create();
+	if(!pool)
+		errx(1, "session_pool_create failed");
+
+	if(session_pool_add(pool, &uuid, NR_SESSIONS, NULL, NULL))
+		errx(1, "open %u sessions failed", NR_SESSIONS);
+
+	as = async_invoke_create(pool, NR_WORKERS);
+	if(!as)
+		errx(1, "async_invoke_create failed");
+
+	epfd = epoll_create1(0);
+	if(epfd < 0)
+		err(1, "epoll_create1");
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, async_invoke_eventfd(as), &ev))
+		err(1, "epoll_ctl");
+
+	// 每个请求的 TEEC_Operation 在完成前都必须有效
+	memset(&op_a, 0, sizeof(op_a));
+	memset(&op_b, 0, sizeof(op_b));
+	memset(&op_c, 0, sizeof(op_c));
+
+	start_ns = now_ns();
+
+	a = async_invoke_submit(as, &uuid, TA_CANCEL_CMD_DELAY, &op_a, A_TIMEOUT_MS);
+	b = async_invoke_submit(as, &uuid, TA_CANCEL_CMD_DELAY, &op_b, -1);
+	if(!a || !b)
+		errx(1, "async_invoke_submit failed");
+
+	if(async_invoke_submit_cb(as, &uuid, TA_CANCEL_CMD_DELAY, &op_c, C_TIMEOUT_MS, c_done, NULL))
+		errx(1, "async_invoke_submit_cb failed");
+
+	printf("[%5ums] submitted A (deadline %dms), B (no deadline), C (deadline %dms)\n",
+		elapsed_ms(), A_TIMEOUT_MS, C_TIMEOUT_MS);
+
+	while(pending) {
+		timeout = -1;
+		if(!b_canceled)
+			timeout = elapsed_ms() >= B_CANCEL_MS ? 0 : B_CANCEL_MS - elapsed_ms();
+
+		if(epoll_wait(epfd, &ev, 1, timeout) < 0)
+			err(1, "epoll_wait");
+
+		if(!b_canceled && elapsed_ms() >= B_CANCEL_MS) {
+			printf("[%5ums] CA request the cancelation of B...\n", elapsed_ms());
+			async_future_cancel(b);
+			b_canceled = 1;
+		}
+
+		// 先清零 eventfd 再取, 不会漏掉两者之间完成的请求
+		if(read(async_invoke_eventfd(as), &counter, sizeof(counter)) < 0)
+			continue;
+
+		while((f = async_invoke_reap(as))) {
+			res = async_future_wait(f, &err_origin);
+			report(f == a ? "A" : "B", res, err_origin, async_future_expired(f));
+			pending--;
+		}
+	}
+
+	async_invoke_stats(as, &stats);
+	printf("submitted %llu completed %llu expired %llu cancel requests %llu\n",
+		(unsigned long long)stats.submitted,
+		(unsigned long long)stats.completed, (unsigned long long)stats.expired,
+		(unsigned long long)stats.cancel_requests);
+
+	async_future_free(a);
+	async_future_free(b);
+	close(epfd);
+	async_invoke_destroy(as);
+	session_pool_destroy(pool);
+
+	return 0;
+}
+
+/**
+ * @brief 配置到开发板指令
+
+ * scp cancel/ta/5d39015c-23c2-4a90-b14b-e7721904f3d0.ta wenshuyu@192.168.1.6:/lib/optee_armtz
+ * scp cancel/host/cancel_async wenshuyu@192.168.1.6:/usr/bin
+ */
@@ -0,0 +1,365 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "session_pool.h"
+
+#define SESSION_POOL_MAX_TA		8
+
+struct session_group;
+
+struct pooled_session {
+	TEEC_Session sess;
+	struct session_group *group;
+	uint32_t gen;				// 打开时所在 group 的代数
+	int open;
+	int opened_before;			// 曾经打开过, 再次打开计为 reopen
+	int dead;					// 调用返回 TEEC_ERROR_TARGET_DEAD
+};
+
+/*
+ * 一个 TA 的所有会话, 空闲会话的下标放在栈里, 最近归还的先借出
+ * TA 崩溃时 gen 加一, 打开于旧代数的会话在借出前重新打开
+ */
+struct session_group {
+	struct session_pool *pool;
+	TEEC_UUID uuid;
+	session_setup_fn setup;
+	void *arg;
+	uint32_t nr_sessions;
+	struct pooled_session *slots;
+	uint32_t *free_stack;
+	uint32_t nr_free;
+	uint32_t gen;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct session_pool_stats stats;
+};
+
+struct session_pool {
+	TEEC_Context ctx;
+	pthread_mutex_t lock;		// 保护 groups
+	uint32_t nr_groups;
+	struct session_group *groups[SESSION_POOL_MAX_TA];
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct session_group *find_group(struct session_pool *pool, const TEEC_UUID *uuid)
+{
+	struct session_group *group = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	for(uint32_t i = 0; i < pool->nr_groups; i++) {
+		if(!memcmp(&pool->groups[i]->uuid, uuid, sizeof(*uuid))) {
+			group = pool->groups[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return group;
+}
+
+// 在锁外调用, 会话已被当前线程独占
+static TEEC_Result open_slot(struct session_group *group, struct pooled_session *ps, uint32_t gen)
+{
+	TEEC_Result res;
+	uint32_t origin;
+
+	res = TEEC_OpenSession(&group->pool->ctx, &ps->sess, &group->uuid,
+				TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+	if(res != TEEC_SUCCESS)
+		return res;
+
+	if(group->setup) {
+		res = group->setup(&ps->sess, group->arg);
+		if(res != TEEC_SUCCESS) {
+			TEEC_CloseSession(&ps->sess);
+			return res;
+		}
+	}
+
+	ps->open = 1;
+	ps->opened_before = 1;
+	ps->dead = 0;
+	ps->gen = gen;
+
+	return TEEC_SUCCESS;
+}
+
+static void close_slot(struct pooled_session *ps)
+{
+	if(ps->open)
+		TEEC_CloseSession(&ps->sess);
+	ps->open = 0;
+	ps->dead = 0;
+}
+
+static void group_free(struct session_group *group)
+{
+	for(uint32_t i = 0; group->slots && i < group->nr_sessions; i++)
+		close_slot(&group->slots[i]);
+
+	pthread_cond_destroy(&group->cond);
+	pthread_mutex_destroy(&group->lock);
+	free(group->slots);
+	free(group->free_stack);
+	free(group);
+}
+
+struct session_pool *session_pool_create(void)
+{
+	struct session_pool *pool;
+
+	pool = calloc(1, sizeof(*pool));
+	if(!pool)
+		return NULL;
+
+	if(TEEC_InitializeContext(NULL, &pool->ctx) != TEEC_SUCCESS) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+
+	return pool;
+}
+
+void session_pool_destroy(struct session_pool *pool)
+{
+	if(!pool)
+		return;
+
+	for(uint32_t i = 0; i < pool->nr_groups; i++)
+		group_free(pool->groups[i]);
+
+	pthread_mutex_destroy(&pool->lock);
+	TEEC_FinalizeContext(&pool->ctx);
+	free(pool);
+}
+
+TEEC_Context *session_pool_context(struct session_pool *pool)
+{
+	return &pool->ctx;
+}
+
+int session_pool_add(struct session_pool *pool, const TEEC_UUID *uuid, uint32_t nr_sessions,
+					session_setup_fn setup, void *arg)
+{
+	struct session_group *group;
+	pthread_condattr_t attr;
+
+	if(!nr_sessions || find_group(pool, uuid))
+		return -1;
+
+	group = calloc(1, sizeof(*group));
+	if(!group)
+		return -1;
+
+	group->pool = pool;
+	group->uuid = *uuid;
+	group->setup = setup;
+	group->arg = arg;
+	group->nr_sessions = nr_sessions;
+	group->slots = calloc(nr_sessions, sizeof(*group->slots));
+	group->free_stack = calloc(nr_sessions, sizeof(*group->free_stack));
+
+	// 超时按 CLOCK_MONOTONIC 计算, 不受系统时间调整影响
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&group->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&group->lock, NULL);
+
+	if(!group->slots || !group->free_stack)
+		goto err;
+
+	for(uint32_t i = 0; i < nr_sessions; i++) {
+		group->slots[i].group = group;
+		if(open_slot(group, &group->slots[i], 0) != TEEC_SUCCESS)
+			goto err;
+		// 下标 0 在栈顶
+		group->free_stack[i] = nr_sessions - 1 - i;
+	}
+	group->nr_free = nr_sessions;
+	group->stats.sessions = nr_sessions;
+
+	pthread_mutex_lock(&pool->lock);
+	if(pool->nr_groups == SESSION_POOL_MAX_TA) {
+		pthread_mutex_unlock(&pool->lock);
+		goto err;
+	}
+	pool->groups[pool->nr_groups++] = group;
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+
+err:
+	group_free(group);
+	return -1;
+}
+
+static void push_free(struct session_group *group, struct pooled_session *ps)
+{
+	pthread_mutex_lock(&group->lock);
+	group->free_stack[group->nr_free++] = ps - group->slots;
+	group->stats.in_use--;
+	pthread_cond_signal(&group->cond);
+	pthread_mutex_unlock(&group->lock);
+}
+
+struct pooled_session *session_pool_acquire(struct session_pool *pool, const TEEC_UUID *uuid,
+											int timeout_ms)
+{
+	struct session_group *group = find_group(pool, uuid);
+	struct pooled_session *ps;
+	struct timespec deadline;
+	uint64_t start, wait;
+	uint32_t gen;
+	int waited = 0, reopen;
+
+	if(!group)
+		return NULL;
+
+	if(timeout_ms >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+		if(deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	start = now_ns();
+	pthread_mutex_lock(&group->lock);
+	while(!group->nr_free) {
+		int rc = 0;
+
+		if(!waited) {
+			waited = 1;
+			group->stats.waits++;
+		}
+
+		group->stats.queue_depth++;
+		if(group->stats.queue_depth > group->stats.max_queue_depth)
+			group->stats.max_queue_depth = group->stats.queue_depth;
+
+		if(timeout_ms < 0)
+			pthread_cond_wait(&group->cond, &group->lock);
+		else
+			rc = pthread_cond_timedwait(&group->cond, &group->lock, &deadline);
+
+		group->stats.queue_depth--;
+
+		if(rc == ETIMEDOUT && !group->nr_free) {
+			group->stats.timeouts++;
+			pthread_mutex_unlock(&group->lock);
+			return NULL;
+		}
+	}
+
+	ps = &group->slots[group->free_stack[--group->nr_free]];
+	group->stats.in_use++;
+	group->stats.acquires++;
+	wait = now_ns() - start;
+	group->stats.wait_ns += wait;
+	if(wait > group->stats.max_wait_ns)
+		group->stats.max_wait_ns = wait;
+	gen = group->gen;
+	pthread_mutex_unlock(&group->lock);
+
+	// 同一 TA 的其他会话遇到过 TARGET_DEAD, 这个会话也已失效
+	if(ps->open && ps->gen != gen)
+		close_slot(ps);
+
+	if(!ps->open) {
+		reopen = ps->opened_before;
+		if(open_slot(group, ps, gen) != TEEC_SUCCESS) {
+			push_free(group, ps);
+			return NULL;
+		}
+
+		if(reopen) {
+			pthread_mutex_lock(&group->lock);
+			group->stats.reopens++;
+			pthread_mutex_unlock(&group->lock);
+		}
+	}
+
+	return ps;
+}
+
+void session_pool_release(struct session_pool *pool, struct pooled_session *ps)
+{
+	struct session_group *group = ps->group;
+
+	(void)pool;
+
+	if(ps->dead) {
+		pthread_mutex_lock(&group->lock);
+		// 只让每次崩溃推进一次代数
+		if(ps->gen == group->gen)
+			group->gen++;
+		pthread_mutex_unlock(&group->lock);
+
+		close_slot(ps);
+	}
+
+	push_free(group, ps);
+}
+
+TEEC_Result session_pool_invoke(struct pooled_session *ps, uint32_t cmd, TEEC_Operation *op,
+								uint32_t *err_origin)
+{
+	TEEC_Result res;
+
+	res = TEEC_InvokeCommand(&ps->sess, cmd, op, err_origin);
+	if(res == TEEC_ERROR_TARGET_DEAD)
+		ps->dead = 1;
+
+	return res;
+}
+
+int session_pool_stats(struct session_pool *pool, const TEEC_UUID *uuid, struct session_pool_stats *stats)
+{
+	struct session_group *group = find_group(pool, uuid);
+
+	if(!group)
+		return -1;
+
+	pthread_mutex_lock(&group->lock);
+	*stats = group->stats;
+	pthread_mutex_unlock(&group->lock);
+
+	return 0;
+}
+
+void session_pool_reset_stats(struct session_pool *pool, const TEEC_UUID *uuid)
+{
+	struct session_group *group = find_group(pool, uuid);
+	struct session_pool_stats *stats;
+
+	if(!group)
+		return;
+
+	pthread_mutex_lock(&group->lock);
+	stats = &group->stats;
+	stats->max_queue_depth = stats->queue_depth;
+	stats->acquires = 0;
+	stats->waits = 0;
+	stats->wait_ns = 0;
+	stats->max_wait_ns = 0;
+	stats->timeouts = 0;
+	stats->reopens = 0;
+	pthread_mutex_unlock(&group->lock);
+}
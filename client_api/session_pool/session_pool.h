@@ -0,0 +1,98 @@
+#ifndef _SESSION_POOL_H
+#define _SESSION_POOL_H
+
+#include <stdint.h>
+#include <tee_client_api.h>
+
+/*
+ * CA侧会话池 : 一个 TEEC_Context 下为每个 TA UUID 预先打开若干会话,
+ * 线程借出一个会话独占使用, 用完归还. 同一个 TEEC_Session 不能并发调用,
+ * 多线程访问同一个 TA 时每个线程需要各自的会话
+ *
+ * TA 崩溃(TEEC_ERROR_TARGET_DEAD)后, 该 TA 的所有会话在下次借出前自动关闭并重新打开,
+ * 重新打开后会再次调用 setup 恢复会话状态(例如密钥)
+ */
+
+struct session_pool;
+struct pooled_session;
+
+/*
+ * @brief : called after a session is (re)opened, e.g. to load or generate a key
+ *
+ * @return : TEEC_SUCCESS, otherwise the session is closed and the acquire fails
+ */
+typedef TEEC_Result (*session_setup_fn)(TEEC_Session *sess, void *arg);
+
+struct session_pool_stats {
+	uint32_t sessions;			// 会话总数
+	uint32_t in_use;			// 当前借出的会话数
+	uint32_t queue_depth;		// 当前等待会话的线程数
+	uint32_t max_queue_depth;	// 等待线程数的峰值
+	uint64_t acquires;			// 成功借出的次数
+	uint64_t waits;				// 其中需要等待的次数
+	uint64_t wait_ns;			// 所有借出的累计等待时间
+	uint64_t max_wait_ns;		// 单次借出的最长等待时间
+	uint64_t timeouts;			// 等待超时的次数
+	uint64_t reopens;			// TA 崩溃后重新打开会话的次数
+};
+
+/*
+ * @brief : initialize the TEEC_Context shared by all sessions of the pool
+ *
+ * @return : the pool, NULL on failure
+ */
+struct session_pool *session_pool_create(void);
+
+/*
+ * @brief : close every session and finalize the context, all sessions must have been released
+ */
+void session_pool_destroy(struct session_pool *pool);
+
+/*
+ * @brief : the context of the pool, used to allocate/register shared memory for pooled sessions
+ */
+TEEC_Context *session_pool_context(struct session_pool *pool);
+
+/*
+ * @brief : open nr_sessions sessions to the TA, setup may be NULL
+ *          call for every TA before the pool is used from several threads
+ *
+ * @return : 0 on success, -1 on failure (no session is left open)
+ */
+int session_pool_add(struct session_pool *pool, const TEEC_UUID *uuid, uint32_t nr_sessions,
+					session_setup_fn setup, void *arg);
+
+/*
+ * @brief : check out a session of the TA, waiting for one to be released if all are in use
+ *
+ * @param timeout_ms : maximum wait, < 0 waits forever
+ *
+ * @return : the session, NULL on timeout, unknown uuid or when a dead session cannot be reopened
+ */
+struct pooled_session *session_pool_acquire(struct session_pool *pool, const TEEC_UUID *uuid,
+											int timeout_ms);
+
+/*
+ * @brief : return a session taken by session_pool_acquire
+ */
+void session_pool_release(struct session_pool *pool, struct pooled_session *ps);
+
+/*
+ * @brief : TEEC_InvokeCommand on a checked out session, TEEC_ERROR_TARGET_DEAD marks the TA for reopening
+ */
+TEEC_Result session_pool_invoke(struct pooled_session *ps, uint32_t cmd, TEEC_Operation *op,
+								uint32_t *err_origin);
+
+/*
+ * @brief : copy the metrics of the TA's sessions
+ *
+ * @return : 0 on success, -1 for an unknown uuid
+ */
+int session_pool_stats(struct session_pool *pool, const TEEC_UUID *uuid, struct session_pool_stats *stats);
+
+/*
+ * @brief : clear the counters of the TA's sessions, current values (in_use, queue_depth) are kept
+ */
+void session_pool_reset_stats(struct session_pool *pool, const TEEC_UUID *uuid);
+
+#endif /* _SESSION_POOL_H */
@@ -0,0 +1,445 @@
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <tee_client_api.h>
+
+#include "../ta/include/shared_mem.h"
+
+/*
+ * 共享内存性能测试, 对 16B ~ 16MiB 的负载分别用不同的参数传递方式调用
+ * TA 的 echo/sink/source 命令, 以 CSV 输出每次往返的延迟(us)和吞吐(GB/s),
+ * 最后在 stderr 给出各方式之间的交叉点, 用于决定多大的数据值得换成共享内存
+ *
+ * 参数传递方式:
+ *  tmpref        : TEEC_MEMREF_TEMP_*, 每次调用由 libteec 申请临时共享内存并拷贝
+ *  alloc         : TEEC_AllocateSharedMemory 预先申请, TEEC_MEMREF_PARTIAL_*
+ *  reg_aligned   : 页对齐的用户内存 TEEC_RegisterSharedMemory, TEEC_MEMREF_PARTIAL_*
+ *  reg_unaligned : 非页对齐的用户内存 TEEC_RegisterSharedMemory, TEEC_MEMREF_PARTIAL_*
+ *  whole         : TEEC_AllocateSharedMemory 预先申请, TEEC_MEMREF_WHOLE
+ *
+ * shared_mem_bench [echo|sink|source|all] [最大负载] > result.csv
+ */
+
+#define MIN_SIZE			(16)
+#define DEFAULT_MAX_SIZE	(16 * 1024 * 1024)
+
+// 每个组合大约传输这么多数据, 轮数限制在 [MIN_ROUNDS, MAX_ROUNDS]
+#define TARGET_BYTES		(128 * 1024 * 1024)
+#define MIN_ROUNDS			(8)
+#define MAX_ROUNDS			(2000)
+#define WARMUP_ROUNDS		(2)
+
+// 非页对齐注册时相对页首的偏移, 同时也不在 cache line 边界上
+#define UNALIGNED_OFFSET	(1)
+
+#define MAX_SIZES			(32)
+
+enum bench_mode {
+	MODE_TMPREF,
+	MODE_ALLOC,
+	MODE_REG_ALIGNED,
+	MODE_REG_UNALIGNED,
+	MODE_WHOLE,
+	MODE_NUM,
+};
+
+static const char *mode_names[MODE_NUM] = {
+	"tmpref", "alloc", "reg_aligned", "reg_unaligned", "whole",
+};
+
+enum bench_cmd {
+	BENCH_ECHO,
+	BENCH_SINK,
+	BENCH_SOURCE,
+	BENCH_NUM,
+};
+
+static const char *cmd_names[BENCH_NUM] = {
+	"echo", "sink", "source",
+};
+
+static const uint32_t cmd_ids[BENCH_NUM] = {
+	SHARED_MEM_ECHO, SHARED_MEM_SINK, SHARED_MEM_SOURCE,
+};
+
+// 一个输入或输出缓冲区
+struct bench_buf {
+	uint8_t *raw;			// malloc/posix_memalign 得到的内存, alloc/whole 为 NULL
+	uint8_t *data;			// 实际传给TA的地址
+	TEEC_SharedMemory shm;
+	int has_shm;
+};
+
+struct bench_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	size_t page_size;
+	uint64_t lat[MAX_ROUNDS];		// 每次调用的延迟(ns)
+	double gbps[MAX_SIZES][MODE_NUM];	// 0 表示该组合失败
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// 第 p/1000 分位, 取不小于该比例的最小样本
+static double percentile_us(const uint64_t *lat, uint32_t n, uint32_t p)
+{
+	uint64_t rank = ((uint64_t)n * p + 999) / 1000;
+
+	return (double)lat[rank ? rank - 1 : 0] / 1000;
+}
+
+static uint32_t rounds_for(uint32_t size)
+{
+	uint32_t rounds = TARGET_BYTES / size;
+
+	if(rounds < MIN_ROUNDS)
+		return MIN_ROUNDS;
+	if(rounds > MAX_ROUNDS)
+		return MAX_ROUNDS;
+	return rounds;
+}
+
+/*
+ * 按方式准备一个 size 字节的缓冲区, flags 为 TEEC_MEM_INPUT 或 TEEC_MEM_OUTPUT,
+ * whole 方式下 TA 看到的方向由 flags 决定
+ */
+static int buf_setup(struct bench_ctx *bench, enum bench_mode mode, uint32_t size, uint32_t flags,
+					struct bench_buf *b)
+{
+	TEEC_Result res;
+	void *p = NULL;
+
+	memset(b, 0, sizeof(*b));
+
+	switch(mode) {
+		case MODE_TMPREF:
+			b->raw = malloc(size);
+			if(!b->raw)
+				return -1;
+			b->data = b->raw;
+			return 0;
+
+		case MODE_ALLOC:
+		case MODE_WHOLE:
+			b->shm.size = size;
+			b->shm.flags = flags;
+			res = TEEC_AllocateSharedMemory(&bench->ctx, &b->shm);
+			if(res != TEEC_SUCCESS) {
+				warnx("TEEC_AllocateSharedMemory %u bytes failed with code 0x%x", size, res);
+				return -1;
+			}
+			b->has_shm = 1;
+			b->data = b->shm.buffer;
+			return 0;
+
+		case MODE_REG_ALIGNED:
+		case MODE_REG_UNALIGNED:
+			if(posix_memalign(&p, bench->page_size, size + bench->page_size))
+				return -1;
+			b->raw = p;
+			b->data = b->raw + (mode == MODE_REG_UNALIGNED ? UNALIGNED_OFFSET : 0);
+
+			b->shm.buffer = b->data;
+			b->shm.size = size;
+			b->shm.flags = flags;
+			res = TEEC_RegisterSharedMemory(&bench->ctx, &b->shm);
+			if(res != TEEC_SUCCESS) {
+				warnx("TEEC_RegisterSharedMemory %u bytes failed with code 0x%x", size, res);
+				free(b->raw);
+				b->raw = NULL;
+				return -1;
+			}
+			b->has_shm = 1;
+			return 0;
+
+		default:
+			return -1;
+	}
+}
+
+static void buf_release(struct bench_buf *b)
+{
+	if(b->has_shm)
+		TEEC_ReleaseSharedMemory(&b->shm);
+	free(b->raw);
+	memset(b, 0, sizeof(*b));
+}
+
+// 填写 op 的第 idx 个参数并返回其参数类型, output 的 size 每次调用后会被TA改写, 需每次重设
+static uint32_t buf_param(TEEC_Operation *op, int idx, enum bench_mode mode, struct bench_buf *b,
+						uint32_t size, int output)
+{
+	TEEC_Parameter *param = &op->params[idx];
+
+	if(mode == MODE_TMPREF) {
+		param->tmpref.buffer = b->data;
+		param->tmpref.size = size;
+		return output ? TEEC_MEMREF_TEMP_OUTPUT : TEEC_MEMREF_TEMP_INPUT;
+	}
+
+	param->memref.parent = &b->shm;
+	param->memref.offset = 0;
+	param->memref.size = size;
+	if(mode == MODE_WHOLE)
+		return TEEC_MEMREF_WHOLE;
+
+	return output ? TEEC_MEMREF_PARTIAL_OUTPUT : TEEC_MEMREF_PARTIAL_INPUT;
+}
+
+static void fill_op(TEEC_Operation *op, enum bench_cmd cmd, enum bench_mode mode, struct bench_buf *in,
+					struct bench_buf *out, uint32_t size)
+{
+	uint32_t t0, t1;
+
+	memset(op, 0, sizeof(*op));
+	switch(cmd) {
+		case BENCH_ECHO:
+			t0 = buf_param(op, 0, mode, in, size, 0);
+			t1 = buf_param(op, 1, mode, out, size, 1);
+			op->paramTypes = TEEC_PARAM_TYPES(t0, t1, TEEC_NONE, TEEC_NONE);
+			break;
+
+		case BENCH_SINK:
+			t0 = buf_param(op, 0, mode, in, size, 0);
+			op->paramTypes = TEEC_PARAM_TYPES(t0, TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE);
+			break;
+
+		case BENCH_SOURCE:
+		default:
+			t0 = buf_param(op, 0, mode, out, size, 1);
+			op->paramTypes = TEEC_PARAM_TYPES(t0, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+			break;
+	}
+}
+
+// 预热后检查一次结果, 确认每种方式的数据确实到达了对端
+static int check_result(enum bench_cmd cmd, struct bench_buf *in, struct bench_buf *out,
+						TEEC_Operation *op, uint32_t size)
+{
+	switch(cmd) {
+		case BENCH_ECHO:
+			return memcmp(in->data, out->data, size) ? -1 : 0;
+
+		case BENCH_SINK:
+			return op->params[1].value.a == size ? 0 : -1;
+
+		case BENCH_SOURCE:
+		default:
+			for(uint32_t i = 0; i < size; i++) {
+				if(out->data[i] != SHARED_MEM_SOURCE_PATTERN)
+					return -1;
+			}
+			return 0;
+	}
+}
+
+/*
+ * 测量一个 (命令, 负载, 方式) 组合, 返回吞吐 GB/s, 失败返回 0
+ * 缓冲区的申请/注册不计入时间, tmpref 的临时共享内存和拷贝由 libteec 在每次调用内完成, 计入时间
+ */
+static double bench_one(struct bench_ctx *bench, enum bench_cmd cmd, enum bench_mode mode, uint32_t size)
+{
+	struct bench_buf in, out;
+	TEEC_Operation op;
+	TEEC_Result res;
+	uint32_t err_origin;
+	uint32_t rounds = rounds_for(size);
+	uint64_t total = 0, start;
+	double gbps = 0;
+
+	memset(&in, 0, sizeof(in));
+	memset(&out, 0, sizeof(out));
+	if(cmd != BENCH_SOURCE && buf_setup(bench, mode, size, TEEC_MEM_INPUT, &in))
+		goto out;
+	if(cmd != BENCH_SINK && buf_setup(bench, mode, size, TEEC_MEM_OUTPUT, &out))
+		goto out;
+
+	if(in.data) {
+		for(uint32_t i = 0; i < size; i++)
+			in.data[i] = (uint8_t)(i * 31 + size);
+	}
+	if(out.data)
+		memset(out.data, 0, size);
+
+	for(uint32_t i = 0; i < WARMUP_ROUNDS + rounds; i++) {
+		fill_op(&op, cmd, mode, &in, &out, size);
+
+		start = now_ns();
+		res = TEEC_InvokeCommand(&bench->sess, cmd_ids[cmd], &op, &err_origin);
+		if(i >= WARMUP_ROUNDS)
+			bench->lat[i - WARMUP_ROUNDS] = now_ns() - start;
+
+		if(res != TEEC_SUCCESS) {
+			warnx("%s %u bytes via %s failed with code 0x%x origin 0x%x", cmd_names[cmd], size,
+				mode_names[mode], res, err_origin);
+			goto out;
+		}
+
+		if(i == WARMUP_ROUNDS - 1 && check_result(cmd, &in, &out, &op, size))
+			errx(1, "%s %u bytes via %s returned wrong data", cmd_names[cmd], size, mode_names[mode]);
+	}
+
+	for(uint32_t i = 0; i < rounds; i++)
+		total += bench->lat[i];
+	qsort(bench->lat, rounds, sizeof(bench->lat[0]), cmp_u64);
+
+	// echo 一次往返搬运 2 倍负载, 字节/ns 即 GB/s
+	gbps = (double)size * (cmd == BENCH_ECHO ? 2 : 1) * rounds / total;
+
+	printf("%s,%u,%s,%u,%.2f,%.2f,%.2f,%.3f\n", cmd_names[cmd], size, mode_names[mode], rounds,
+		(double)total / rounds / 1000, percentile_us(bench->lat, rounds, 500),
+		percentile_us(bench->lat, rounds, 990), gbps);
+	fflush(stdout);
+
+out:
+	if(gbps == 0) {
+		printf("%s,%u,%s,0,,,,\n", cmd_names[cmd], size, mode_names[mode]);
+		fflush(stdout);
+	}
+	buf_release(&in);
+	buf_release(&out);
+	return gbps;
+}
+
+/*
+ * 交叉点 :
+ *  1. 相邻两个负载之间最快的方式发生变化的位置
+ *  2. 每种共享内存方式从哪个负载开始(直到最大负载)一直快于 tmpref
+ */
+static void report_crossover(struct bench_ctx *bench, enum bench_cmd cmd, const uint32_t *sizes, int n)
+{
+	int best[MAX_SIZES];
+
+	fprintf(stderr, "\n[%s] fastest mode per size:\n", cmd_names[cmd]);
+	for(int s = 0; s < n; s++) {
+		best[s] = -1;
+		for(int m = 0; m < MODE_NUM; m++) {
+			if(bench->gbps[s][m] > 0 && (best[s] < 0 || bench->gbps[s][m] > bench->gbps[s][best[s]]))
+				best[s] = m;
+		}
+		fprintf(stderr, "  %9u B : %s\n", sizes[s], best[s] < 0 ? "(all failed)" : mode_names[best[s]]);
+	}
+
+	for(int s = 1; s < n; s++) {
+		if(best[s] >= 0 && best[s - 1] >= 0 && best[s] != best[s - 1]) {
+			fprintf(stderr, "  crossover %s -> %s between %u and %u bytes\n", mode_names[best[s - 1]],
+				mode_names[best[s]], sizes[s - 1], sizes[s]);
+		}
+	}
+
+	for(int m = MODE_TMPREF + 1; m < MODE_NUM; m++) {
+		int from = -1;
+
+		for(int s = n - 1; s >= 0; s--) {
+			if(bench->gbps[s][m] <= 0 || bench->gbps[s][MODE_TMPREF] <= 0 ||
+				bench->gbps[s][m] <= bench->gbps[s][MODE_TMPREF])
+				break;
+			from = s;
+		}
+
+		if(from < 0)
+			fprintf(stderr, "  %s never beats tmpref at the largest size\n", mode_names[m]);
+		else
+			fprintf(stderr, "  %s beats tmpref from %u bytes (%.2fx at %u bytes)\n", mode_names[m],
+				sizes[from], bench->gbps[n - 1][m] / bench->gbps[n - 1][MODE_TMPREF], sizes[n - 1]);
+	}
+}
+
+static void sweep(struct bench_ctx *bench, enum bench_cmd cmd, uint32_t max_size)
+{
+	uint32_t sizes[MAX_SIZES];
+	int n = 0;
+
+	// 16B 起每次乘 4 : 16, 64, 256, 1K, ..., 16M
+	for(uint64_t size = MIN_SIZE; size <= max_size && n < MAX_SIZES; size *= 4)
+		sizes[n++] = size;
+
+	memset(bench->gbps, 0, sizeof(bench->gbps));
+	for(int s = 0; s < n; s++) {
+		fprintf(stderr, "%s : %u bytes\n", cmd_names[cmd], sizes[s]);
+		for(int m = 0; m < MODE_NUM; m++)
+			bench->gbps[s][m] = bench_one(bench, cmd, m, sizes[s]);
+	}
+
+	report_crossover(bench, cmd, sizes, n);
+}
+
+static void prepare_tee_session(struct bench_ctx *bench)
+{
+	TEEC_UUID uuid = TA_SHARED_MEM_UUID;
+	uint32_t origin;
+	TEEC_Result res;
+
+	res = TEEC_InitializeContext(NULL, &bench->ctx);
+	if(res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+
+	res = TEEC_OpenSession(&bench->ctx, &bench->sess, &uuid,
+				TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x", res, origin);
+}
+
+static void terminate_tee_session(struct bench_ctx *bench)
+{
+	TEEC_CloseSession(&bench->sess);
+	TEEC_FinalizeContext(&bench->ctx);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct bench_ctx bench;
+	const char *which = argc > 1 ? argv[1] : "all";
+	uint32_t max_size = DEFAULT_MAX_SIZE;
+	int found = 0;
+
+	if(argc > 2)
+		max_size = strtoul(argv[2], NULL, 0);
+	if(max_size < MIN_SIZE)
+		errx(1, "max size must be at least %u bytes", MIN_SIZE);
+
+	bench.page_size = sysconf(_SC_PAGESIZE);
+
+	prepare_tee_session(&bench);
+
+	printf("cmd,size,mode,rounds,avg_us,p50_us,p99_us,gb_per_s\n");
+	for(int c = 0; c < BENCH_NUM; c++) {
+		if(strcmp(which, "all") && strcmp(which, cmd_names[c]))
+			continue;
+
+		found = 1;
+		sweep(&bench, c, max_size);
+	}
+
+	terminate_tee_session(&bench);
+
+	if(!found)
+		errx(1, "usage: %s [echo|sink|source|all] [max size]", argv[0]);
+
+	return 0;
+}
+
+/**
+ * @brief 配置到开发板指令
+
+ * scp shared_mem/ta/79457d8a-e919-46f4-8ad1-bb7243388cc5.ta wenshuyu@192.168.1.6:/lib/optee_armtz
+ * scp shared_mem/host/shared_mem_bench wenshuyu@192.168.1.6:/usr/bin
+ * shared_mem_bench all > shm.csv
+ * shared_mem_bench echo 1048576 > echo.csv
+ */
@@ -0,0 +1,507 @@
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <tee_client_api.h>
+
+#include "../ta/include/shared_mem.h"
+
+/*
+ * 环形队列传输示例, CA 与 TA 共用一块注册的共享内存:
+ * CA 把请求(操作码, 数据区内的偏移和长度)写入提交队列, 一次 TEEC_InvokeCommand
+ * 让 TA 连续处理最多 N 个请求并把结果写入完成队列, 多个小请求只需一次世界切换
+ *
+ * shared_mem_ring			: 用环形队列批量执行 SHA256/AES-GCM/HMAC-SHA256 并校验结果
+ * shared_mem_ring bench [请求数]	: 不同批大小下小请求的 ops/s, 批大小 1 相当于每个请求一次调用
+ */
+
+#define RING_SQ_ENTRIES		(256)
+#define RING_CQ_ENTRIES		(256)
+#define RING_DATA_SIZE		(1024 * 1024)
+
+#define DATA_ALIGN			(16)
+#define ALIGN_UP(x, a)		(((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+#define SHA256_SIZE			(32)
+
+// 较旧的 optee_client 未定义, 取值与 TEE_ERROR_MAC_INVALID 相同
+#ifndef TEEC_ERROR_MAC_INVALID
+#define TEEC_ERROR_MAC_INVALID	0xFFFF3071
+#endif
+
+#define EXAMPLE_MSGS		(8)
+#define BENCH_MSG_SIZE		(64)
+#define DEFAULT_BENCH_OPS	(20000)
+
+static const uint32_t batch_sizes[] = { 1, 4, 16, 64, 256 };
+
+struct ring {
+	uint8_t *block;				// 页对齐, TEEC_RegisterSharedMemory 注册
+	size_t block_size;
+	TEEC_SharedMemory shm;
+	struct shm_ring_header *hdr;
+	struct shm_ring_sqe *sq;
+	struct shm_ring_cqe *cq;
+	uint8_t *data;
+	uint32_t data_used;			// 数据区按顺序分配, 队列清空后 ring_data_reset 回收
+	uint32_t sq_pending;		// 已填写但尚未发布到 sq_tail 的请求数
+};
+
+struct ring_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	struct ring ring;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void ring_init(struct ring_ctx *ctx, uint32_t sq_entries, uint32_t cq_entries, uint32_t data_size)
+{
+	struct ring *ring = &ctx->ring;
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t sq_off, cq_off, data_off;
+	void *p = NULL;
+	TEEC_Result res;
+
+	sq_off = ALIGN_UP(sizeof(struct shm_ring_header), 64);
+	cq_off = ALIGN_UP(sq_off + sq_entries * sizeof(struct shm_ring_sqe), 64);
+	data_off = ALIGN_UP(cq_off + cq_entries * sizeof(struct shm_ring_cqe), 64);
+	ring->block_size = ALIGN_UP(data_off + data_size, page);
+
+	if(posix_memalign(&p, page, ring->block_size))
+		errx(1, "out of memory");
+	memset(p, 0, ring->block_size);
+
+	ring->block = p;
+	ring->hdr = p;
+	ring->sq = (struct shm_ring_sqe *)(ring->block + sq_off);
+	ring->cq = (struct shm_ring_cqe *)(ring->block + cq_off);
+	ring->data = ring->block + data_off;
+
+	ring->hdr->magic = SHARED_MEM_RING_MAGIC;
+	ring->hdr->sq_entries = sq_entries;
+	ring->hdr->cq_entries = cq_entries;
+	ring->hdr->sq_off = sq_off;
+	ring->hdr->cq_off = cq_off;
+	ring->hdr->data_off = data_off;
+	ring->hdr->data_size = data_size;
+
+	ring->shm.buffer = ring->block;
+	ring->shm.size = ring->block_size;
+	ring->shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	res = TEEC_RegisterSharedMemory(&ctx->ctx, &ring->shm);
+	if(res != TEEC_SUCCESS)
+		errx(1, "TEEC_RegisterSharedMemory failed with code 0x%x", res);
+}
+
+static void ring_destroy(struct ring *ring)
+{
+	TEEC_ReleaseSharedMemory(&ring->shm);
+	free(ring->block);
+	memset(ring, 0, sizeof(*ring));
+}
+
+// 在数据区分配 len 字节, 返回相对数据区的偏移, 空间不足返回 -1
+static int64_t ring_data_alloc(struct ring *ring, uint32_t len)
+{
+	uint32_t off = ALIGN_UP(ring->data_used, DATA_ALIGN);
+
+	if((uint64_t)off + len > ring->hdr->data_size)
+		return -1;
+
+	ring->data_used = off + len;
+	return off;
+}
+
+static void ring_data_reset(struct ring *ring)
+{
+	ring->data_used = 0;
+}
+
+// 取一个空闲的提交队列项, 队列已满返回 NULL
+static struct shm_ring_sqe *ring_get_sqe(struct ring *ring)
+{
+	struct shm_ring_header *hdr = ring->hdr;
+	uint32_t tail = hdr->sq_tail + ring->sq_pending;
+	struct shm_ring_sqe *sqe;
+
+	if(tail - hdr->sq_head >= hdr->sq_entries)
+		return NULL;
+
+	sqe = &ring->sq[tail & (hdr->sq_entries - 1)];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_pending++;
+	return sqe;
+}
+
+/*
+ * 发布已填写的请求并让 TA 处理最多 max 个(0 表示不限), 返回本次处理的请求数
+ * 请求在 TA 中依次同步执行, 调用返回时结果已在完成队列中
+ */
+static uint32_t ring_enter(struct ring_ctx *ctx, uint32_t max)
+{
+	struct ring *ring = &ctx->ring;
+	TEEC_Operation op;
+	TEEC_Result res;
+	uint32_t err_origin;
+
+	ring->hdr->sq_tail += ring->sq_pending;
+	ring->sq_pending = 0;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_WHOLE, TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+	op.params[0].memref.parent = &ring->shm;
+	op.params[1].value.a = max;
+
+	res = TEEC_InvokeCommand(&ctx->sess, SHARED_MEM_RING_ENTER, &op, &err_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "ring enter failed with code 0x%x origin 0x%x", res, err_origin);
+
+	return op.params[2].value.a;
+}
+
+// 取下一个完成项, 没有返回 NULL, 用完后调用 ring_cqe_seen
+static struct shm_ring_cqe *ring_peek_cqe(struct ring *ring)
+{
+	struct shm_ring_header *hdr = ring->hdr;
+
+	if(hdr->cq_head == hdr->cq_tail)
+		return NULL;
+
+	return &ring->cq[hdr->cq_head & (hdr->cq_entries - 1)];
+}
+
+static void ring_cqe_seen(struct ring *ring)
+{
+	ring->hdr->cq_head++;
+}
+
+static void ring_prep(struct shm_ring_sqe *sqe, uint32_t opcode, uint64_t user_data,
+					uint32_t in_off, uint32_t in_len, uint32_t out_off, uint32_t out_len)
+{
+	sqe->opcode = opcode;
+	sqe->user_data = user_data;
+	sqe->in_off = in_off;
+	sqe->in_len = in_len;
+	sqe->out_off = out_off;
+	sqe->out_len = out_len;
+}
+
+static void ring_prep_gcm(struct shm_ring_sqe *sqe, uint32_t iv_off, uint32_t aad_off, uint32_t aad_len,
+						uint32_t tag_off)
+{
+	sqe->iv_off = iv_off;
+	sqe->aad_off = aad_off;
+	sqe->aad_len = aad_len;
+	sqe->tag_off = tag_off;
+}
+
+static int64_t data_alloc_or_die(struct ring *ring, uint32_t len)
+{
+	int64_t off = ring_data_alloc(ring, len);
+
+	if(off < 0)
+		errx(1, "ring data region is full");
+
+	return off;
+}
+
+static void print_hex(const char *what, const uint8_t *buf, uint32_t len)
+{
+	printf("%s : ", what);
+	for(uint32_t i = 0; i < len; i++)
+		printf("%02x", buf[i]);
+	printf("\n");
+}
+
+static void set_keys(struct ring_ctx *ctx)
+{
+	TEEC_Operation op;
+	TEEC_Result res;
+	uint32_t err_origin;
+	uint8_t aes_key[32];
+	uint8_t hmac_key[32];
+
+	for(uint32_t i = 0; i < sizeof(aes_key); i++)
+		aes_key[i] = (uint8_t)i;
+	for(uint32_t i = 0; i < sizeof(hmac_key); i++)
+		hmac_key[i] = (uint8_t)(0x80 + i);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = aes_key;
+	op.params[0].tmpref.size = sizeof(aes_key);
+	op.params[1].tmpref.buffer = hmac_key;
+	op.params[1].tmpref.size = sizeof(hmac_key);
+
+	res = TEEC_InvokeCommand(&ctx->sess, SHARED_MEM_RING_SET_KEYS, &op, &err_origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "set keys failed with code 0x%x origin 0x%x", res, err_origin);
+}
+
+/*
+ * user_data 编码 : 高 8 位操作码, 低位消息序号
+ */
+#define USER_DATA(op, idx)	(((uint64_t)(op) << 56) | (idx))
+#define USER_OP(ud)			((uint32_t)((ud) >> 56))
+#define USER_IDX(ud)		((uint32_t)((ud) & 0xffffffff))
+
+struct example_msg {
+	uint32_t plain_off;
+	uint32_t len;
+	uint32_t digest_off;
+	uint32_t mac_off;
+	uint32_t iv_off;
+	uint32_t aad_off;
+	uint32_t cipher_off;
+	uint32_t tag_off;
+	uint32_t check_off;
+};
+
+static void example(struct ring_ctx *ctx)
+{
+	struct ring *ring = &ctx->ring;
+	struct example_msg msgs[EXAMPLE_MSGS];
+	struct shm_ring_sqe *sqe;
+	struct shm_ring_cqe *cqe;
+	const char aad[] = "ring header";
+	uint32_t done;
+
+	set_keys(ctx);
+
+	// 第一批 : 每条消息一个 SHA256, 一个 HMAC, 一个 GCM 加密, 共 3 * EXAMPLE_MSGS 个请求一次提交
+	for(uint32_t i = 0; i < EXAMPLE_MSGS; i++) {
+		struct example_msg *m = &msgs[i];
+
+		m->len = 16 + i * 40;
+		m->plain_off = data_alloc_or_die(ring, m->len);
+		m->digest_off = data_alloc_or_die(ring, SHA256_SIZE);
+		m->mac_off = data_alloc_or_die(ring, SHA256_SIZE);
+		m->iv_off = data_alloc_or_die(ring, SHARED_MEM_RING_IV_SIZE);
+		m->aad_off = data_alloc_or_die(ring, sizeof(aad));
+		m->cipher_off = data_alloc_or_die(ring, m->len);
+		m->tag_off = data_alloc_or_die(ring, SHARED_MEM_RING_TAG_SIZE);
+		m->check_off = data_alloc_or_die(ring, m->len);
+
+		for(uint32_t j = 0; j < m->len; j++)
+			ring->data[m->plain_off + j] = (uint8_t)(i * 7 + j);
+		// 每条消息使用不同的 IV
+		memset(ring->data + m->iv_off, 0, SHARED_MEM_RING_IV_SIZE);
+		memcpy(ring->data + m->iv_off, &i, sizeof(i));
+		memcpy(ring->data + m->aad_off, aad, sizeof(aad));
+
+		sqe = ring_get_sqe(ring);
+		ring_prep(sqe, SHARED_MEM_RING_OP_SHA256, USER_DATA(SHARED_MEM_RING_OP_SHA256, i),
+				m->plain_off, m->len, m->digest_off, SHA256_SIZE);
+
+		sqe = ring_get_sqe(ring);
+		ring_prep(sqe, SHARED_MEM_RING_OP_HMAC_SHA256, USER_DATA(SHARED_MEM_RING_OP_HMAC_SHA256, i),
+				m->plain_off, m->len, m->mac_off, SHA256_SIZE);
+
+		sqe = ring_get_sqe(ring);
+		ring_prep(sqe, SHARED_MEM_RING_OP_GCM_ENCRYPT, USER_DATA(SHARED_MEM_RING_OP_GCM_ENCRYPT, i),
+				m->plain_off, m->len, m->cipher_off, m->len);
+		ring_prep_gcm(sqe, m->iv_off, m->aad_off, sizeof(aad), m->tag_off);
+	}
+
+	done = ring_enter(ctx, 0);
+	printf("batch 1 : %u requests in one invoke\n\n", done);
+
+	while((cqe = ring_peek_cqe(ring))) {
+		uint32_t idx = USER_IDX(cqe->user_data);
+
+		if(cqe->res != TEEC_SUCCESS)
+			errx(1, "request op %u msg %u failed with code 0x%x", USER_OP(cqe->user_data), idx, cqe->res);
+
+		if(idx == 0) {
+			switch(USER_OP(cqe->user_data)) {
+				case SHARED_MEM_RING_OP_SHA256:
+					print_hex("sha256", ring->data + msgs[idx].digest_off, cqe->out_len);
+					break;
+				case SHARED_MEM_RING_OP_HMAC_SHA256:
+					print_hex("hmac", ring->data + msgs[idx].mac_off, cqe->out_len);
+					break;
+				case SHARED_MEM_RING_OP_GCM_ENCRYPT:
+					print_hex("gcm cipher", ring->data + msgs[idx].cipher_off, cqe->out_len);
+					print_hex("gcm tag", ring->data + msgs[idx].tag_off, SHARED_MEM_RING_TAG_SIZE);
+					break;
+			}
+		}
+		ring_cqe_seen(ring);
+	}
+
+	// 第二批 : 解密全部密文, 最后一条消息的 tag 故意改错, 应返回 TEEC_ERROR_MAC_INVALID
+	ring->data[msgs[EXAMPLE_MSGS - 1].tag_off] ^= 1;
+	for(uint32_t i = 0; i < EXAMPLE_MSGS; i++) {
+		struct example_msg *m = &msgs[i];
+
+		sqe = ring_get_sqe(ring);
+		ring_prep(sqe, SHARED_MEM_RING_OP_GCM_DECRYPT, USER_DATA(SHARED_MEM_RING_OP_GCM_DECRYPT, i),
+				m->cipher_off, m->len, m->check_off, m->len);
+		ring_prep_gcm(sqe, m->iv_off, m->aad_off, sizeof(aad), m->tag_off);
+	}
+
+	// 每次最多处理 3 个, 演示 TA 按 max 分段消费
+	while((done = ring_enter(ctx, 3)))
+		printf("batch 2 : %u requests in one invoke\n", done);
+	printf("\n");
+
+	while((cqe = ring_peek_cqe(ring))) {
+		uint32_t idx = USER_IDX(cqe->user_data);
+		struct example_msg *m = &msgs[idx];
+
+		if(idx == EXAMPLE_MSGS - 1) {
+			if(cqe->res != TEEC_ERROR_MAC_INVALID)
+				errx(1, "tampered tag was not detected, res 0x%x", cqe->res);
+			printf("msg %u : tampered tag rejected\n", idx);
+		} else {
+			if(cqe->res != TEEC_SUCCESS)
+				errx(1, "decrypt msg %u failed with code 0x%x", idx, cqe->res);
+			if(cqe->out_len != m->len || memcmp(ring->data + m->check_off, ring->data + m->plain_off, m->len))
+				errx(1, "decrypt msg %u mismatch", idx);
+			printf("msg %u : %u bytes decrypted ok\n", idx, cqe->out_len);
+		}
+		ring_cqe_seen(ring);
+	}
+
+	ring_data_reset(ring);
+}
+
+/*
+ * 每个批次提交 batch 个 BENCH_MSG_SIZE 字节的请求(轮流 SHA256/HMAC/GCM 加密), 一次调用处理完
+ */
+static void bench(struct ring_ctx *ctx, uint32_t total)
+{
+	struct ring *ring = &ctx->ring;
+	struct shm_ring_sqe *sqe;
+	struct shm_ring_cqe *cqe;
+	uint32_t in_off, iv_off, out_off, tag_off;
+	uint64_t start, ns, nonce = 0;
+
+	set_keys(ctx);
+
+	/*
+	 * 所有请求共用同一份输入, 每个槽位有独立的 IV 和输出
+	 * GCM 同一个密钥下 IV 绝不能重复, 每次加密写入新的计数值 : 前 4 字节 0xFF(与示例的 IV 区分) | 64位计数
+	 */
+	in_off = data_alloc_or_die(ring, BENCH_MSG_SIZE);
+	iv_off = data_alloc_or_die(ring, RING_SQ_ENTRIES * SHARED_MEM_RING_IV_SIZE);
+	memset(ring->data + in_off, 0x5a, BENCH_MSG_SIZE);
+	memset(ring->data + iv_off, 0xff, RING_SQ_ENTRIES * SHARED_MEM_RING_IV_SIZE);
+	out_off = data_alloc_or_die(ring, RING_SQ_ENTRIES * BENCH_MSG_SIZE);
+	tag_off = data_alloc_or_die(ring, RING_SQ_ENTRIES * SHARED_MEM_RING_TAG_SIZE);
+
+	printf("batch,requests,invokes,ops_per_sec,us_per_op\n");
+	for(size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+		uint32_t batch = batch_sizes[b];
+		uint32_t invokes = 0, submitted = 0;
+
+		if(batch > RING_SQ_ENTRIES || batch > RING_CQ_ENTRIES)
+			continue;
+
+		start = now_ns();
+		while(submitted < total) {
+			uint32_t n = total - submitted < batch ? total - submitted : batch;
+
+			for(uint32_t i = 0; i < n; i++) {
+				uint32_t op = (submitted + i) % 3;
+				uint32_t out = out_off + i * BENCH_MSG_SIZE;
+
+				sqe = ring_get_sqe(ring);
+				if(op == 0) {
+					ring_prep(sqe, SHARED_MEM_RING_OP_SHA256, submitted + i, in_off, BENCH_MSG_SIZE,
+							out, SHA256_SIZE);
+				} else if(op == 1) {
+					ring_prep(sqe, SHARED_MEM_RING_OP_HMAC_SHA256, submitted + i, in_off, BENCH_MSG_SIZE,
+							out, SHA256_SIZE);
+				} else {
+					uint32_t iv = iv_off + i * SHARED_MEM_RING_IV_SIZE;
+
+					nonce++;
+					memcpy(ring->data + iv + 4, &nonce, sizeof(nonce));
+					ring_prep(sqe, SHARED_MEM_RING_OP_GCM_ENCRYPT, submitted + i, in_off, BENCH_MSG_SIZE,
+							out, BENCH_MSG_SIZE);
+					ring_prep_gcm(sqe, iv, 0, 0, tag_off + i * SHARED_MEM_RING_TAG_SIZE);
+				}
+			}
+
+			if(ring_enter(ctx, 0) != n)
+				errx(1, "ring consumed fewer requests than submitted");
+			invokes++;
+
+			while((cqe = ring_peek_cqe(ring))) {
+				if(cqe->res != TEEC_SUCCESS)
+					errx(1, "request %llu failed with code 0x%x", (unsigned long long)cqe->user_data, cqe->res);
+				ring_cqe_seen(ring);
+			}
+			submitted += n;
+		}
+		ns = now_ns() - start;
+
+		printf("%u,%u,%u,%.0f,%.2f\n", batch, total, invokes, (double)total * 1000000000 / ns,
+			(double)ns / total / 1000);
+		fflush(stdout);
+	}
+
+	ring_data_reset(ring);
+}
+
+static void prepare_tee_session(struct ring_ctx *ctx)
+{
+	TEEC_UUID uuid = TA_SHARED_MEM_UUID;
+	uint32_t origin;
+	TEEC_Result res;
+
+	res = TEEC_InitializeContext(NULL, &ctx->ctx);
+	if(res != TEEC_SUCCESS)
+		errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+
+	res = TEEC_OpenSession(&ctx->ctx, &ctx->sess, &uuid,
+				TEEC_LOGIN_PUBLIC, NULL, NULL, &origin);
+	if(res != TEEC_SUCCESS)
+		errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x", res, origin);
+
+	ring_init(ctx, RING_SQ_ENTRIES, RING_CQ_ENTRIES, RING_DATA_SIZE);
+}
+
+static void terminate_tee_session(struct ring_ctx *ctx)
+{
+	TEEC_CloseSession(&ctx->sess);
+	ring_destroy(&ctx->ring);
+	TEEC_FinalizeContext(&ctx->ctx);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ring_ctx ctx;
+
+	memset(&ctx, 0, sizeof(ctx));
+	prepare_tee_session(&ctx);
+
+	// shared_mem_ring bench [请求数] : 批大小与吞吐
+	if(argc > 1 && !strcmp(argv[1], "bench"))
+		bench(&ctx, argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_BENCH_OPS);
+	else
+		example(&ctx);
+
+	terminate_tee_session(&ctx);
+
+	return 0;
+}
+
+/**
+ * @brief 配置到开发板指令
+
+ * scp shared_mem/ta/79457d8a-e919-46f4-8ad1-bb7243388cc5.ta wenshuyu@192.168.1.6:/lib/optee_armtz
+ * scp shared_mem/host/shared_mem_ring wenshuyu@192.168.1.6:/usr/bin
+ * shared_mem_ring
+ * shared_mem_ring bench 20000
+ */
@@ -25,4 +25,112 @@
  */
 #define SHARED_MEM_TA_TO_CA 	1
 
+/* 
+ * @brief : 性能测试, TA 将输入原样拷贝到输出
+ *
+ * param[0] (memref-input) : 数据
+ * param[1] (memref-output) : 数据, 长度不小于 param[0]
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SHARED_MEM_ECHO 	2
+
+/* 
+ * @brief : 性能测试, TA 读取全部输入后丢弃
+ *
+ * param[0] (memref-input) : 数据
+ * param[1] (value-output) : a : 读取的字节数
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SHARED_MEM_SINK 	3
+
+/* 
+ * @brief : 性能测试, TA 用 SHARED_MEM_SOURCE_PATTERN 填满输出
+ *
+ * param[0] (memref-output) : 数据
+ * param[1] (unsued)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SHARED_MEM_SOURCE 	4
+
+#define SHARED_MEM_SOURCE_PATTERN	0xA5
+
+/* 
+ * @brief : 设置环形队列中 AES-GCM 和 HMAC-SHA256 使用的密钥
+ *
+ * param[0] (memref-input) : AES 密钥, 16/24/32 字节
+ * param[1] (memref-input) : HMAC-SHA256 密钥, 24~128 字节
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SHARED_MEM_RING_SET_KEYS 	5
+
+/* 
+ * @brief : TA 从提交队列依次取出请求执行, 结果写入完成队列
+ * 		    遇到提交队列为空, 完成队列已满或已处理 max 个请求时返回
+ *
+ * param[0] (memref-inout) : 整个环形队列共享内存块, 布局见 struct shm_ring_header
+ * param[1] (value-input) : a : 本次最多处理的请求数 max, 0 表示不限
+ * param[2] (value-output) : a : 本次处理的请求数, b : 完成队列中待CA取走的结果数
+ * param[3] (unsued)
+ */
+#define SHARED_MEM_RING_ENTER 	6
+
+/*
+ * 环形队列共享内存块布局, 所有偏移都相对块首:
+ *
+ * | shm_ring_header | 提交队列 sq_entries * shm_ring_sqe | 完成队列 cq_entries * shm_ring_cqe | 数据区 |
+ *
+ * sq_tail/cq_head 只由CA写, sq_head/cq_tail 只由TA写, 下标自由增长, 取余队列长度(2的幂)得到槽位
+ */
+#define SHARED_MEM_RING_MAGIC 	0x474E4952	// "RING"
+
+struct shm_ring_header {
+	uint32_t magic;
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	uint32_t sq_off;
+	uint32_t cq_off;
+	uint32_t data_off;
+	uint32_t data_size;
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint32_t reserved;
+};
+
+// 请求的操作码
+#define SHARED_MEM_RING_OP_SHA256 		0	// in -> out(32 字节摘要)
+#define SHARED_MEM_RING_OP_GCM_ENCRYPT 	1	// in -> out(密文), tag 写入 tag_off
+#define SHARED_MEM_RING_OP_GCM_DECRYPT 	2	// in -> out(明文), 校验 tag_off 处的 tag
+#define SHARED_MEM_RING_OP_HMAC_SHA256 	3	// in -> out(32 字节 MAC)
+
+#define SHARED_MEM_RING_IV_SIZE 		12
+#define SHARED_MEM_RING_TAG_SIZE 		16
+
+// 提交队列项, 偏移均相对数据区, 不用的字段填 0
+struct shm_ring_sqe {
+	uint64_t user_data;		// 原样带回完成队列, 用于CA匹配请求
+	uint32_t opcode;
+	uint32_t in_off;
+	uint32_t in_len;
+	uint32_t out_off;
+	uint32_t out_len;		// 输出缓冲区大小
+	uint32_t iv_off;		// GCM : SHARED_MEM_RING_IV_SIZE 字节
+	uint32_t aad_off;		// GCM : 附加数据
+	uint32_t aad_len;
+	uint32_t tag_off;		// GCM : SHARED_MEM_RING_TAG_SIZE 字节
+	uint32_t reserved;
+};
+
+// 完成队列项
+struct shm_ring_cqe {
+	uint64_t user_data;
+	uint32_t res;			// TEE_Result
+	uint32_t out_len;		// 实际输出长度
+};
+
 #endif /* _SHARED_MEM_H */
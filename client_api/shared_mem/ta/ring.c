@@ -0,0 +1,302 @@
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "include/shared_mem.h"
+#include "ring.h"
+
+#define SHA256_SIZE         (32)
+#define HMAC_KEY_MIN        (24)
+#define HMAC_KEY_MAX        (128)
+
+static void free_operation(TEE_OperationHandle *op)
+{
+    if (*op != TEE_HANDLE_NULL) {
+        TEE_FreeOperation(*op);
+        *op = TEE_HANDLE_NULL;
+    }
+}
+
+void ring_release(struct ring_ctx *ring)
+{
+    free_operation(&ring->digest);
+    free_operation(&ring->gcm_enc);
+    free_operation(&ring->gcm_dec);
+    free_operation(&ring->hmac);
+}
+
+// 分配一个操作并设置密钥, 密钥对象在设置到操作后即可释放
+static TEE_Result alloc_keyed_operation(TEE_OperationHandle *op, uint32_t alg, uint32_t mode,
+                                        uint32_t key_type, void *key, uint32_t key_size)
+{
+    TEE_Result res;
+    TEE_ObjectHandle obj = TEE_HANDLE_NULL;
+    TEE_Attribute attr;
+
+    res = TEE_AllocateOperation(op, alg, mode, key_size * 8);
+    if (res != TEE_SUCCESS) {
+        EMSG("alloc operation failed, res is 0x%x\n", res);
+        return res;
+    }
+
+    res = TEE_AllocateTransientObject(key_type, key_size * 8, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("alloc key handle failed, res is 0x%x\n", res);
+        goto err_free_operation;
+    }
+
+    TEE_InitRefAttribute(&attr, TEE_ATTR_SECRET_VALUE, key, key_size);
+    res = TEE_PopulateTransientObject(obj, &attr, 1);
+    if (res != TEE_SUCCESS) {
+        EMSG("populate key failed, res is 0x%x\n", res);
+        goto err_free_key;
+    }
+
+    res = TEE_SetOperationKey(*op, obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("set key to operation failed, res is 0x%x\n", res);
+        goto err_free_key;
+    }
+
+    TEE_FreeTransientObject(obj);
+
+    return TEE_SUCCESS;
+
+err_free_key:
+    TEE_FreeTransientObject(obj);
+
+err_free_operation:
+    free_operation(op);
+
+    return res;
+}
+
+TEE_Result ring_set_keys(struct ring_ctx *ring, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t aes_size = params[0].memref.size;
+    if (aes_size != 16 && aes_size != 24 && aes_size != 32) {
+        EMSG("aes key size %u is not supported\n", aes_size);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t hmac_size = params[1].memref.size;
+    if (hmac_size < HMAC_KEY_MIN || hmac_size > HMAC_KEY_MAX) {
+        EMSG("hmac key size %u is not supported\n", hmac_size);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 密钥拷贝到TA内存后再使用, CA可能同时修改共享内存
+    uint8_t aes_key[32];
+    uint8_t hmac_key[HMAC_KEY_MAX];
+    TEE_MemMove(aes_key, params[0].memref.buffer, aes_size);
+    TEE_MemMove(hmac_key, params[1].memref.buffer, hmac_size);
+
+    ring_release(ring);
+
+    res = TEE_AllocateOperation(&ring->digest, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+    if (res != TEE_SUCCESS) {
+        EMSG("alloc digest operation failed, res is 0x%x\n", res);
+        goto out;
+    }
+
+    res = alloc_keyed_operation(&ring->gcm_enc, TEE_ALG_AES_GCM, TEE_MODE_ENCRYPT, TEE_TYPE_AES,
+                                aes_key, aes_size);
+    if (res != TEE_SUCCESS)
+        goto out;
+
+    res = alloc_keyed_operation(&ring->gcm_dec, TEE_ALG_AES_GCM, TEE_MODE_DECRYPT, TEE_TYPE_AES,
+                                aes_key, aes_size);
+    if (res != TEE_SUCCESS)
+        goto out;
+
+    res = alloc_keyed_operation(&ring->hmac, TEE_ALG_HMAC_SHA256, TEE_MODE_MAC, TEE_TYPE_HMAC_SHA256,
+                                hmac_key, hmac_size);
+
+out:
+    if (res != TEE_SUCCESS)
+        ring_release(ring);
+
+    TEE_MemFill(aes_key, 0, sizeof(aes_key));
+    TEE_MemFill(hmac_key, 0, sizeof(hmac_key));
+
+    return res;
+}
+
+// 数据区内 [off, off + len) 的地址, 越界返回 NULL
+static uint8_t *data_range(uint8_t *data, uint32_t data_size, uint32_t off, uint32_t len)
+{
+    if ((uint64_t)off + len > data_size)
+        return NULL;
+
+    return data + off;
+}
+
+/*
+ * 执行一个请求, 结果长度写入 out_len
+ * 请求内容已拷贝到TA内存, 但输入输出数据仍直接位于共享内存, CA同时修改只会影响它自己的结果
+ */
+static TEE_Result exec_sqe(struct ring_ctx *ring, const struct shm_ring_sqe *sqe, uint8_t *data,
+                           uint32_t data_size, uint32_t *out_len)
+{
+    TEE_Result res;
+    uint8_t *in, *out, *iv, *aad, *tag;
+    uint32_t size = sqe->out_len;
+    uint32_t tag_size = SHARED_MEM_RING_TAG_SIZE;
+
+    *out_len = 0;
+
+    in = data_range(data, data_size, sqe->in_off, sqe->in_len);
+    out = data_range(data, data_size, sqe->out_off, sqe->out_len);
+    if (!in || !out)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    switch (sqe->opcode) {
+        case SHARED_MEM_RING_OP_SHA256:
+            if (ring->digest == TEE_HANDLE_NULL)
+                return TEE_ERROR_BAD_STATE;
+            if (size < SHA256_SIZE)
+                return TEE_ERROR_SHORT_BUFFER;
+
+            TEE_ResetOperation(ring->digest);
+            res = TEE_DigestDoFinal(ring->digest, in, sqe->in_len, out, &size);
+            break;
+
+        case SHARED_MEM_RING_OP_HMAC_SHA256:
+            if (ring->hmac == TEE_HANDLE_NULL)
+                return TEE_ERROR_BAD_STATE;
+            if (size < SHA256_SIZE)
+                return TEE_ERROR_SHORT_BUFFER;
+
+            TEE_MACInit(ring->hmac, NULL, 0);
+            res = TEE_MACComputeFinal(ring->hmac, in, sqe->in_len, out, &size);
+            break;
+
+        case SHARED_MEM_RING_OP_GCM_ENCRYPT:
+        case SHARED_MEM_RING_OP_GCM_DECRYPT: {
+            TEE_OperationHandle op = sqe->opcode == SHARED_MEM_RING_OP_GCM_ENCRYPT ?
+                                     ring->gcm_enc : ring->gcm_dec;
+            if (op == TEE_HANDLE_NULL)
+                return TEE_ERROR_BAD_STATE;
+            if (size < sqe->in_len)
+                return TEE_ERROR_SHORT_BUFFER;
+
+            iv = data_range(data, data_size, sqe->iv_off, SHARED_MEM_RING_IV_SIZE);
+            aad = data_range(data, data_size, sqe->aad_off, sqe->aad_len);
+            tag = data_range(data, data_size, sqe->tag_off, SHARED_MEM_RING_TAG_SIZE);
+            if (!iv || !aad || !tag)
+                return TEE_ERROR_BAD_PARAMETERS;
+
+            // 上一个请求解密失败时操作可能停在中间状态, 先复位
+            TEE_ResetOperation(op);
+            res = TEE_AEInit(op, iv, SHARED_MEM_RING_IV_SIZE, SHARED_MEM_RING_TAG_SIZE * 8,
+                             sqe->aad_len, sqe->in_len);
+            if (res != TEE_SUCCESS)
+                return res;
+
+            if (sqe->aad_len)
+                TEE_AEUpdateAAD(op, aad, sqe->aad_len);
+
+            if (sqe->opcode == SHARED_MEM_RING_OP_GCM_ENCRYPT)
+                res = TEE_AEEncryptFinal(op, in, sqe->in_len, out, &size, tag, &tag_size);
+            else
+                res = TEE_AEDecryptFinal(op, in, sqe->in_len, out, &size, tag, tag_size);
+            break;
+        }
+
+        default:
+            return TEE_ERROR_NOT_SUPPORTED;
+    }
+
+    if (res == TEE_SUCCESS)
+        *out_len = size;
+
+    return res;
+}
+
+// 检查 [off, off + n * item) 是否在共享内存块内
+static int region_ok(uint32_t block_size, uint32_t off, uint32_t n, uint32_t item)
+{
+    return (uint64_t)off + (uint64_t)n * item <= block_size;
+}
+
+static int is_pow2(uint32_t x)
+{
+    return x && !(x & (x - 1));
+}
+
+TEE_Result ring_enter(struct ring_ctx *ring, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+    struct shm_ring_header hdr;
+    struct shm_ring_sqe sqe;
+    struct shm_ring_cqe cqe;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INOUT, TEE_PARAM_TYPE_VALUE_INPUT,
+                                              TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint8_t *block = params[0].memref.buffer;
+    uint32_t block_size = params[0].memref.size;
+    if (block_size < sizeof(hdr)) {
+        EMSG("ring block is too small\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 头部只读一次到TA内存, 之后的检查和下标都基于这份拷贝
+    TEE_MemMove(&hdr, block, sizeof(hdr));
+    if (hdr.magic != SHARED_MEM_RING_MAGIC || !is_pow2(hdr.sq_entries) || !is_pow2(hdr.cq_entries) ||
+        !region_ok(block_size, hdr.sq_off, hdr.sq_entries, sizeof(struct shm_ring_sqe)) ||
+        !region_ok(block_size, hdr.cq_off, hdr.cq_entries, sizeof(struct shm_ring_cqe)) ||
+        !region_ok(block_size, hdr.data_off, hdr.data_size, 1)) {
+        EMSG("ring header is invalid\n");
+        return TEE_ERROR_BAD_FORMAT;
+    }
+
+    if (hdr.sq_tail - hdr.sq_head > hdr.sq_entries || hdr.cq_tail - hdr.cq_head > hdr.cq_entries) {
+        EMSG("ring index is invalid\n");
+        return TEE_ERROR_BAD_FORMAT;
+    }
+
+    uint8_t *sq = block + hdr.sq_off;
+    uint8_t *cq = block + hdr.cq_off;
+    uint8_t *data = block + hdr.data_off;
+    uint32_t max = params[1].value.a ? params[1].value.a : UINT32_MAX;
+    uint32_t done = 0;
+
+    while (done < max && hdr.sq_head != hdr.sq_tail && hdr.cq_tail - hdr.cq_head < hdr.cq_entries) {
+        uint32_t slot = hdr.sq_head & (hdr.sq_entries - 1);
+
+        TEE_MemMove(&sqe, sq + slot * sizeof(sqe), sizeof(sqe));
+
+        res = exec_sqe(ring, &sqe, data, hdr.data_size, &cqe.out_len);
+        cqe.user_data = sqe.user_data;
+        cqe.res = res;
+
+        slot = hdr.cq_tail & (hdr.cq_entries - 1);
+        TEE_MemMove(cq + slot * sizeof(cqe), &cqe, sizeof(cqe));
+
+        hdr.sq_head++;
+        hdr.cq_tail++;
+        done++;
+    }
+
+    // 只回写TA负责的两个下标
+    TEE_MemMove(block + offsetof(struct shm_ring_header, sq_head), &hdr.sq_head, sizeof(hdr.sq_head));
+    TEE_MemMove(block + offsetof(struct shm_ring_header, cq_tail), &hdr.cq_tail, sizeof(hdr.cq_tail));
+
+    params[2].value.a = done;
+    params[2].value.b = hdr.cq_tail - hdr.cq_head;
+
+    return TEE_SUCCESS;
+}
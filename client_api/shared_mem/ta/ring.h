@@ -0,0 +1,24 @@
+#ifndef _RING_H
+#define _RING_H
+
+#include <tee_internal_api.h>
+
+/*
+ * 环形队列模式的会话状态, 操作句柄在 SET_KEYS 时分配, 之后每个请求只 Reset/Init 复用
+ */
+struct ring_ctx {
+    TEE_OperationHandle digest;
+    TEE_OperationHandle gcm_enc;
+    TEE_OperationHandle gcm_dec;
+    TEE_OperationHandle hmac;
+};
+
+/*
+ * 环形队列模式的命令处理函数, 参数说明见 include/shared_mem.h
+ */
+TEE_Result ring_set_keys(struct ring_ctx *ring, uint32_t param_type, TEE_Param params[4]);
+TEE_Result ring_enter(struct ring_ctx *ring, uint32_t param_type, TEE_Param params[4]);
+
+void ring_release(struct ring_ctx *ring);
+
+#endif /* _RING_H */
@@ -3,9 +3,10 @@
 #include <string.h>
 
 #include "include/shared_mem.h"
+#include "ring.h"
 
 struct shrd_mme_ctx {
-
+    struct ring_ctx ring;
 };
 
 static TEE_Result from_ca(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
@@ -51,6 +52,75 @@ static TEE_Result to_ca(void *sess_ctx, uint32_t param_type, TEE_Param params[4]
 
     return TEE_SUCCESS;
 }
+
+// sink 分块读入的缓冲区, 放在 bss 而不是栈上(TA_STACK_SIZE 只有 2KB)
+#define SINK_CHUNK_SIZE (4 * 1024)
+
+static uint8_t sink_buf[SINK_CHUNK_SIZE];
+
+static TEE_Result echo(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    (void)sess_ctx;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t in_size = params[0].memref.size;
+    if(params[1].memref.size < in_size) {
+        params[1].memref.size = in_size;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    TEE_MemMove(params[1].memref.buffer, params[0].memref.buffer, in_size);
+    params[1].memref.size = in_size;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result sink(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    (void)sess_ctx;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 逐块拷贝到TA内存, 保证每个字节都被实际读取
+    uint8_t *in = params[0].memref.buffer;
+    uint32_t in_size = params[0].memref.size;
+    for(uint32_t off = 0; off < in_size; off += SINK_CHUNK_SIZE) {
+        uint32_t n = in_size - off < SINK_CHUNK_SIZE ? in_size - off : SINK_CHUNK_SIZE;
+        TEE_MemMove(sink_buf, in + off, n);
+    }
+
+    params[1].value.a = in_size;
+    params[1].value.b = 0;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result source(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    (void)sess_ctx;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT, TEE_PARAM_TYPE_NONE,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    TEE_MemFill(params[0].memref.buffer, SHARED_MEM_SOURCE_PATTERN, params[0].memref.size);
+
+    return TEE_SUCCESS;
+}
 /*******************************************************************************
  * Mandatory TA functions.
  ******************************************************************************/
@@ -84,6 +154,7 @@ void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
     struct shrd_mme_ctx *ctx = (struct shrd_mme_ctx *)sess_ctx;
 
+    ring_release(&ctx->ring);
     TEE_Free(ctx);
 }
 
@@ -97,6 +168,21 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
             case SHARED_MEM_TA_TO_CA:
                 return to_ca(sess_ctx, param_type, params);
 
+            case SHARED_MEM_ECHO:
+                return echo(sess_ctx, param_type, params);
+
+            case SHARED_MEM_SINK:
+                return sink(sess_ctx, param_type, params);
+
+            case SHARED_MEM_SOURCE:
+                return source(sess_ctx, param_type, params);
+
+            case SHARED_MEM_RING_SET_KEYS:
+                return ring_set_keys(&((struct shrd_mme_ctx *)sess_ctx)->ring, param_type, params);
+
+            case SHARED_MEM_RING_ENTER:
+                return ring_enter(&((struct shrd_mme_ctx *)sess_ctx)->ring, param_type, params);
+
             return TEE_ERROR_BAD_PARAMETERS;
     }
 }
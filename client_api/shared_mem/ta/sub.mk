@@ -1,5 +1,6 @@
 global-incdirs-y += include
 srcs-y += shared_mem.c
+srcs-y += ring.c
 
 # To remove a certain compiler flag, add a line like this
 # cflags-template_ta.c-y += -Wno-strict-prototypes
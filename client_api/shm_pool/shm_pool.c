@@ -0,0 +1,186 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shm_pool.h"
+
+#define SHM_POOL_MAX_CLASSES	8
+
+/*
+ * 每级的空闲缓冲区组成一个无锁栈(Treiber stack),
+ * head 低32位是栈顶缓冲区的下标 + 1(0 表示空), 高32位是版本号, 每次修改加一, 避免 ABA
+ */
+struct shm_slab {
+	TEEC_SharedMemory shm;
+	size_t size;
+	uint32_t count;
+	struct shm_buf *bufs;
+	_Atomic uint32_t *next;		// 空闲链表中下一个缓冲区的下标 + 1
+	_Atomic uint64_t head;
+};
+
+struct shm_pool {
+	uint32_t nr_slabs;
+	struct shm_slab slabs[SHM_POOL_MAX_CLASSES];
+};
+
+static const struct shm_pool_class default_classes[] = {
+	{ 256, 16 },
+	{ 4 * 1024, 8 },
+	{ 64 * 1024, 2 },
+};
+
+static void slab_push(struct shm_slab *slab, uint32_t idx)
+{
+	uint64_t old = atomic_load_explicit(&slab->head, memory_order_relaxed);
+	uint64_t new;
+
+	do {
+		atomic_store_explicit(&slab->next[idx], (uint32_t)old, memory_order_relaxed);
+		new = ((old >> 32) + 1) << 32 | (idx + 1);
+	} while(!atomic_compare_exchange_weak_explicit(&slab->head, &old, new,
+					memory_order_release, memory_order_relaxed));
+}
+
+static struct shm_buf *slab_pop(struct shm_slab *slab)
+{
+	uint64_t old = atomic_load_explicit(&slab->head, memory_order_acquire);
+	uint64_t new;
+	uint32_t top;
+
+	do {
+		top = (uint32_t)old;
+		if(!top)
+			return NULL;
+		// 栈顶可能同时被别的线程取走, 读到的 next 过期时版本号不同, CAS 失败重试
+		new = ((old >> 32) + 1) << 32 |
+			atomic_load_explicit(&slab->next[top - 1], memory_order_relaxed);
+	} while(!atomic_compare_exchange_weak_explicit(&slab->head, &old, new,
+					memory_order_acquire, memory_order_acquire));
+
+	return &slab->bufs[top - 1];
+}
+
+static void slab_release(struct shm_slab *slab)
+{
+	if(slab->bufs)
+		TEEC_ReleaseSharedMemory(&slab->shm);
+	free(slab->bufs);
+	free(slab->next);
+}
+
+static int slab_init(struct shm_slab *slab, TEEC_Context *ctx, const struct shm_pool_class *cls)
+{
+	slab->size = cls->size;
+	slab->count = cls->count;
+	slab->bufs = calloc(cls->count, sizeof(*slab->bufs));
+	slab->next = calloc(cls->count, sizeof(*slab->next));
+	if(!slab->bufs || !slab->next)
+		goto err;
+
+	slab->shm.size = cls->size * cls->count;
+	slab->shm.flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+	if(TEEC_AllocateSharedMemory(ctx, &slab->shm) != TEEC_SUCCESS)
+		goto err;
+
+	atomic_init(&slab->head, 0);
+	for(uint32_t i = 0; i < cls->count; i++) {
+		struct shm_buf *buf = &slab->bufs[i];
+
+		buf->offset = i * cls->size;
+		buf->data = (uint8_t *)slab->shm.buffer + buf->offset;
+		buf->size = cls->size;
+		buf->shm = &slab->shm;
+		slab_push(slab, i);
+	}
+
+	return 0;
+
+err:
+	free(slab->bufs);
+	free(slab->next);
+	slab->bufs = NULL;
+	slab->next = NULL;
+	return -1;
+}
+
+static int class_cmp(const void *a, const void *b)
+{
+	const struct shm_pool_class *x = a, *y = b;
+
+	return (x->size > y->size) - (x->size < y->size);
+}
+
+struct shm_pool *shm_pool_create(TEEC_Context *ctx, const struct shm_pool_class *classes, size_t nr_classes)
+{
+	struct shm_pool_class sorted[SHM_POOL_MAX_CLASSES];
+	struct shm_pool *pool;
+
+	if(!classes) {
+		classes = default_classes;
+		nr_classes = sizeof(default_classes) / sizeof(default_classes[0]);
+	}
+	if(!nr_classes || nr_classes > SHM_POOL_MAX_CLASSES)
+		return NULL;
+
+	// 从小到大排列, 取缓冲区时找第一个放得下的级别
+	memcpy(sorted, classes, nr_classes * sizeof(*classes));
+	qsort(sorted, nr_classes, sizeof(*sorted), class_cmp);
+
+	pool = calloc(1, sizeof(*pool));
+	if(!pool)
+		return NULL;
+
+	for(size_t i = 0; i < nr_classes; i++) {
+		if(!sorted[i].size || !sorted[i].count ||
+			slab_init(&pool->slabs[i], ctx, &sorted[i])) {
+			shm_pool_destroy(pool);
+			return NULL;
+		}
+		pool->nr_slabs++;
+	}
+
+	return pool;
+}
+
+void shm_pool_destroy(struct shm_pool *pool)
+{
+	if(!pool)
+		return;
+
+	for(uint32_t i = 0; i < pool->nr_slabs; i++)
+		slab_release(&pool->slabs[i]);
+	free(pool);
+}
+
+struct shm_buf *shm_pool_get(struct shm_pool *pool, size_t size)
+{
+	struct shm_buf *buf;
+
+	// 本级用完时借用更大的级别
+	for(uint32_t i = 0; i < pool->nr_slabs; i++) {
+		if(pool->slabs[i].size < size)
+			continue;
+
+		buf = slab_pop(&pool->slabs[i]);
+		if(buf)
+			return buf;
+	}
+
+	return NULL;
+}
+
+void shm_pool_put(struct shm_pool *pool, struct shm_buf *buf)
+{
+	if(!buf)
+		return;
+
+	for(uint32_t i = 0; i < pool->nr_slabs; i++) {
+		struct shm_slab *slab = &pool->slabs[i];
+
+		if(buf >= slab->bufs && buf < slab->bufs + slab->count) {
+			slab_push(slab, buf - slab->bufs);
+			return;
+		}
+	}
+}
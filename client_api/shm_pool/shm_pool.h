@@ -0,0 +1,65 @@
+#ifndef _SHM_POOL_H
+#define _SHM_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tee_client_api.h>
+
+/*
+ * CA侧共享内存池 : 按大小分级, 每级一次 TEEC_AllocateSharedMemory 申请一整块(slab)再切成等大的缓冲区,
+ * 缓冲区以 TEEC_MEMREF_PARTIAL_* 的形式(父共享内存 + 偏移)传给TA,
+ * 不再像 TEEC_MEMREF_TEMP_* 那样每次调用都临时申请共享内存并拷贝数据
+ *
+ * 取出/归还是无锁的, 多个线程可以同时使用同一个池
+ */
+
+struct shm_pool_class {
+	size_t size;			// 每个缓冲区的大小
+	uint32_t count;			// 缓冲区个数
+};
+
+struct shm_buf {
+	void *data;				// CA可以直接读写的地址
+	size_t size;			// 缓冲区大小, 不小于申请的大小
+	TEEC_SharedMemory *shm;	// 所在的 slab
+	size_t offset;			// 在 slab 中的偏移
+};
+
+struct shm_pool;
+
+/*
+ * @brief : allocate the slabs of a pool, classes NULL uses the default classes
+ *          (256B x 16, 4KiB x 8, 64KiB x 2), larger buffers need their own class
+ *
+ * @return : the pool, NULL on failure
+ */
+struct shm_pool *shm_pool_create(TEEC_Context *ctx, const struct shm_pool_class *classes, size_t nr_classes);
+
+/*
+ * @brief : release the slabs, all buffers must have been returned
+ */
+void shm_pool_destroy(struct shm_pool *pool);
+
+/*
+ * @brief : take a buffer of at least size bytes, from the smallest class that has a free one
+ *
+ * @return : the buffer, NULL if size is larger than every class or all fitting classes are empty
+ */
+struct shm_buf *shm_pool_get(struct shm_pool *pool, size_t size);
+
+/*
+ * @brief : return a buffer taken by shm_pool_get
+ */
+void shm_pool_put(struct shm_pool *pool, struct shm_buf *buf);
+
+/*
+ * @brief : fill a TEEC_MEMREF_PARTIAL_* parameter with the first size bytes of the buffer
+ */
+static inline void shm_buf_param(TEEC_Parameter *param, const struct shm_buf *buf, size_t size)
+{
+	param->memref.parent = buf->shm;
+	param->memref.offset = buf->offset;
+	param->memref.size = size;
+}
+
+#endif /* _SHM_POOL_H */
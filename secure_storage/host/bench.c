@@ -0,0 +1,323 @@
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <tee_client_api.h>
+
+#include "../ta/include/secure_storage.h"
+
+/*
+ * secure_storage 性能测试, 对不同的对象数量和对象大小分别测量
+ * create/open/exists/read/write/get_all/delete 每次调用的延迟,
+ * 以 CSV 输出 ops/s 和 p50/p99/p999 延迟(us), 用于规划存储布局和发现性能回退
+ * dir 列表示这一轮 TA 的对象目录是否在用, 对象数超过目录的上限后目录停用(直到TA重新加载),
+ * exists/create 退回到逐个探测, 之后各轮的结果不能和之前的直接比较
+ *
+ * secure_storage_bench [private|ree|rpmb] [最大对象数] [最大对象大小] > result.csv
+ */
+
+#define DEFAULT_MAX_COUNT	(100000)
+#define DEFAULT_MAX_SIZE	(1024 * 1024)
+
+// 对象数 * 对象大小超过该值的组合跳过, 否则 100k 个 1MiB 的对象需要 100GB
+#define MAX_TOTAL_BYTES		(64 * 1024 * 1024)
+
+static const uint32_t counts[] = { 10, 100, 1000, 10000, 100000 };
+static const uint32_t sizes[] = { 16, 256, 4096, 64 * 1024, 1024 * 1024 };
+
+enum bench_op {
+	OP_CREATE,
+	OP_OPEN,
+	OP_EXISTS,
+	OP_READ,
+	OP_WRITE,
+	OP_GET_ALL,
+	OP_DELETE,
+	OP_NUM,
+};
+
+static const char *op_names[OP_NUM] = {
+	"create", "open", "exists", "read", "write", "get_all", "delete",
+};
+
+struct bench_ctx {
+	TEEC_Context ctx;
+	TEEC_Session sess;
+	const char *storage_name;
+	uint8_t *buf;
+	uint8_t *out;
+	uint64_t *lat[OP_NUM];		// 每次调用的延迟(ns)
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 执行一次调用并记录延迟
+static void timed_invoke(struct bench_ctx *bench, uint32_t cmd, TEEC_Operation *op, enum bench_op which,
+						uint32_t idx)
+{
+	TEEC_Result res;
+	uint32_t err_origin;
+	uint64_t start;
+
+	start = now_ns();
+	res = TEEC_InvokeCommand(&bench->sess, cmd, op, &err_origin);
+	if(which < OP_NUM)
+		bench->lat[which][idx] = now_ns() - start;
+
+	if(res != TEEC_SUCCESS) {
+		errx(1, "%s failed with code 0x%x origin 0x%x", which < OP_NUM ? op_names[which] : "invoke",
+			res, err_origin);
+	}
+}
+
+// param[0] 设为第 idx 个对象的名字
+static void set_name(TEEC_Operation *op, uint32_t idx, char *name, size_t len)
+{
+	snprintf(name, len, "bench.%06u", idx);
+	op->params[0].tmpref.buffer = name;
+	op->params[0].tmpref.size = strlen(name) + 1;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// 第 p/1000 分位, 取不小于该比例的最小样本
+static double percentile_us(const uint64_t *lat, uint32_t n, uint32_t p)
+{
+	uint64_t rank = ((uint64_t)n * p + 999) / 1000;
+
+	return (double)lat[rank ? rank - 1 : 0] / 1000;
+}
+
+// 对象目录是否在用
+static int dir_in_use(struct bench_ctx *bench)
+{
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE);
+	timed_invoke(bench, SECURE_STORAGE_CMD_DIR_STATS, &op, OP_NUM, 0);
+
+	return op.params[0].value.a;
+}
+
+static void report(struct bench_ctx *bench, uint32_t count, uint32_t size, int dir)
+{
+	for(int i = 0; i < OP_NUM; i++) {
+		uint64_t *lat = bench->lat[i];
+		uint64_t total = 0;
+
+		for(uint32_t j = 0; j < count; j++)
+			total += lat[j];
+		qsort(lat, count, sizeof(lat[0]), cmp_u64);
+
+		printf("%s,%u,%u,%s,%.1f,%.1f,%.1f,%.1f,%s\n", bench->storage_name, count, size, op_names[i],
+			(double)count * 1000000000 / total,
+			percentile_us(lat, count, 500), percentile_us(lat, count, 990), percentile_us(lat, count, 999),
+			dir ? "on" : "off");
+	}
+	fflush(stdout);
+}
+
+/*
+ * 每一轮 : 创建 count 个对象, 逐个 open/write/read/close, 再依次 exists, get_all, delete
+ */
+static void bench_round(struct bench_ctx *bench, uint32_t count, uint32_t size)
+{
+	TEEC_Operation op;
+	char name[32];
+	uint32_t handle;
+	int dir;
+
+	for(uint32_t i = 0; i < size; i++)
+		bench->buf[i] = (uint8_t)(i * 31 + count);
+
+	for(uint32_t i = 0; i < count; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+		set_name(&op, i, name, sizeof(name));
+		op.params[1].value.a = 0;
+		timed_invoke(bench, SECURE_STORAGE_CMD_CREATE, &op, OP_CREATE, i);
+
+		// 关闭句柄, 之后的 open 需要真正打开对象
+		handle = op.params[2].value.a;
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		timed_invoke(bench, SECURE_STORAGE_CMD_CLOSE, &op, OP_NUM, i);
+	}
+
+	// 所有对象都创建之后目录还在用, 这一轮的 exists/create 才是走目录的结果
+	dir = dir_in_use(bench);
+
+	for(uint32_t i = 0; i < count; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE);
+		set_name(&op, i, name, sizeof(name));
+		timed_invoke(bench, SECURE_STORAGE_CMD_OPEN, &op, OP_OPEN, i);
+		handle = op.params[1].value.a;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].tmpref.buffer = bench->buf;
+		op.params[1].tmpref.size = size;
+		timed_invoke(bench, SECURE_STORAGE_CMD_WRITE, &op, OP_WRITE, i);
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].value.a = 0;
+		op.params[1].value.b = 0;	// TEE_DATA_SEEK_SET
+		timed_invoke(bench, SECURE_STORAGE_CMD_SEEK, &op, OP_NUM, i);
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].tmpref.buffer = bench->out;
+		op.params[1].tmpref.size = size;
+		timed_invoke(bench, SECURE_STORAGE_CMD_READ, &op, OP_READ, i);
+
+		if(op.params[1].tmpref.size != size || memcmp(bench->buf, bench->out, size))
+			errx(1, "read back mismatch at %s", name);
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		timed_invoke(bench, SECURE_STORAGE_CMD_CLOSE, &op, OP_NUM, i);
+	}
+
+	for(uint32_t i = 0; i < count; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		set_name(&op, i, name, sizeof(name));
+		timed_invoke(bench, SECURE_STORAGE_CMD_EXISTS, &op, OP_EXISTS, i);
+	}
+
+	for(uint32_t i = 0; i < count; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+		set_name(&op, i, name, sizeof(name));
+		op.params[1].tmpref.buffer = bench->out;
+		op.params[1].tmpref.size = size;
+		timed_invoke(bench, SECURE_STORAGE_CMD_GET_ALL, &op, OP_GET_ALL, i);
+	}
+
+	for(uint32_t i = 0; i < count; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		set_name(&op, i, name, sizeof(name));
+		timed_invoke(bench, SECURE_STORAGE_CMD_DELETE, &op, OP_DELETE, i);
+	}
+
+	report(bench, count, size, dir);
+}
+
+static uint32_t parse_storage(const char *name)
+{
+	if(strcmp(name, "private") == 0)
+		return SECURE_STORAGE_STORAGE_PRIVATE;
+	if(strcmp(name, "ree") == 0)
+		return SECURE_STORAGE_STORAGE_REE;
+	if(strcmp(name, "rpmb") == 0)
+		return SECURE_STORAGE_STORAGE_RPMB;
+
+	errx(1, "unknown storage %s, use private, ree or rpmb", name);
+}
+
+static void prepare_tee_session(struct bench_ctx *bench, uint32_t storage_id)
+{
+	TEEC_UUID uuid = TA_SECURE_STORAGE_UUID;
+	TEEC_Operation op;
+	uint32_t origin;
+	TEEC_Result res;
+
+	res = TEEC_InitializeContext(NULL, &bench->ctx);
+	if (res != TEEC_SUCCESS) {
+	    errx(1, "TEEC_InitializeContext failed with code 0x%x", res);
+	}
+
+	// 会话打开时选择存储
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = storage_id;
+
+	res = TEEC_OpenSession(&bench->ctx, &bench->sess, &uuid,
+			       TEEC_LOGIN_PUBLIC, NULL, &op, &origin);
+	if (res != TEEC_SUCCESS) {
+	    errx(1, "TEEC_Opensession failed with code 0x%x origin 0x%x", res, origin);
+	}
+}
+
+static void terminate_tee_session(struct bench_ctx *bench)
+{
+	TEEC_CloseSession(&bench->sess);
+	TEEC_FinalizeContext(&bench->ctx);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_ctx bench;
+	uint32_t max_count = DEFAULT_MAX_COUNT;
+	uint32_t max_size = DEFAULT_MAX_SIZE;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.storage_name = argc > 1 ? argv[1] : "private";
+	if(argc > 2)
+		max_count = strtoul(argv[2], NULL, 0);
+	if(argc > 3)
+		max_size = strtoul(argv[3], NULL, 0);
+
+	bench.buf = malloc(max_size);
+	bench.out = malloc(max_size);
+	for(int i = 0; i < OP_NUM; i++)
+		bench.lat[i] = calloc(max_count, sizeof(uint64_t));
+	if(!bench.buf || !bench.out)
+		errx(1, "out of memory");
+	for(int i = 0; i < OP_NUM; i++) {
+		if(!bench.lat[i])
+			errx(1, "out of memory");
+	}
+
+	prepare_tee_session(&bench, parse_storage(bench.storage_name));
+
+	printf("storage,objects,size,op,ops_per_sec,p50_us,p99_us,p999_us,dir\n");
+	for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			if(counts[c] > max_count || sizes[s] > max_size ||
+				(uint64_t)counts[c] * sizes[s] > MAX_TOTAL_BYTES)
+				continue;
+
+			fprintf(stderr, "%s : %u objects of %u bytes\n", bench.storage_name, counts[c], sizes[s]);
+			bench_round(&bench, counts[c], sizes[s]);
+		}
+	}
+
+	terminate_tee_session(&bench);
+
+	for(int i = 0; i < OP_NUM; i++)
+		free(bench.lat[i]);
+	free(bench.buf);
+	free(bench.out);
+
+	return 0;
+}
+
+/**
+ * @brief 配置到开发板指令
+
+ * scp secure_storage/host/secure_storage_bench wenshuyu@192.168.1.6:/usr/bin
+ * secure_storage_bench ree > ree.csv
+ * secure_storage_bench rpmb 1000 65536 > rpmb.csv
+ */
@@ -2,12 +2,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <tee_client_api.h>
 
 #include "../ta/include/secure_storage.h"
 
 #define OBJECT_SIZE		(256)
 
+#define BENCH_ROUNDS	(10)
+
 char *name_1 = "secure_storage_old";
 char *name_2 = "secure_storage_new";
 
@@ -24,7 +27,7 @@ typedef enum {
 	TEE_DATA_SEEK_END = 2
 } TEE_Whence;
 
-static void obj_create(struct secure_storage_ctx *ctx)
+static void obj_create(struct secure_storage_ctx *ctx, char *name)
 {
 	TEEC_Result res;
 	uint32_t err_origin;
@@ -32,8 +35,8 @@ static void obj_create(struct secure_storage_ctx *ctx)
 
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = name_1;
-	op.params[0].tmpref.size = strlen(name_1) + 1;
+	op.params[0].tmpref.buffer = name;
+	op.params[0].tmpref.size = strlen(name) + 1;
 	op.params[1].value.a = OBJECT_SIZE;
 
 	res = TEEC_InvokeCommand(&ctx->sess, SECURE_STORAGE_CMD_CREATE, &op, &err_origin);
@@ -42,21 +45,24 @@ static void obj_create(struct secure_storage_ctx *ctx)
 	}
 }
 
-static void obj_open(struct secure_storage_ctx *ctx)
+// 返回的句柄用于后续的读写, 同一个会话可以同时打开 SECURE_STORAGE_MAX_HANDLES 个对象
+static uint32_t obj_open(struct secure_storage_ctx *ctx, char *name)
 {
 	TEEC_Result res;
 	uint32_t err_origin;
 	TEEC_Operation op;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = name_1;
-	op.params[0].tmpref.size = strlen(name_1) + 1;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = name;
+	op.params[0].tmpref.size = strlen(name) + 1;
 
 	res = TEEC_InvokeCommand(&ctx->sess, SECURE_STORAGE_CMD_OPEN, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
 		errx(1, "Object obj_open failed with code 0x%x origin 0x%x", res, err_origin);
 	}
+
+	return op.params[1].value.a;
 }
 
 static void obj_rename(struct secure_storage_ctx *ctx)
@@ -84,18 +90,17 @@ static void obj_rename(struct secure_storage_ctx *ctx)
 	printf("obj_rename success\n\n");
 }
 
-static void obj_write(struct secure_storage_ctx *ctx)
+static void obj_write(struct secure_storage_ctx *ctx, uint32_t handle, char *data)
 {
 	TEEC_Result res;
 	uint32_t err_origin;
 	TEEC_Operation op;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = name_1;
-	op.params[0].tmpref.size = strlen(name_1) + 1;
-	op.params[1].tmpref.buffer = message;
-	op.params[1].tmpref.size = strlen(message) + 1;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = handle;
+	op.params[1].tmpref.buffer = data;
+	op.params[1].tmpref.size = strlen(data) + 1;
 
 	res = TEEC_InvokeCommand(&ctx->sess, SECURE_STORAGE_CMD_WRITE, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
@@ -105,16 +110,15 @@ static void obj_write(struct secure_storage_ctx *ctx)
 	printf("obj_write success\n\n");
 }
 
-static void obj_seek(struct secure_storage_ctx *ctx, uint32_t offset, TEE_Whence whence)
+static void obj_seek(struct secure_storage_ctx *ctx, uint32_t handle, uint32_t offset, TEE_Whence whence)
 {
 	TEEC_Result res;
 	uint32_t err_origin;
 	TEEC_Operation op;
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = name_1;
-	op.params[0].tmpref.size = strlen(name_1) + 1;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = handle;
 	op.params[1].value.a = offset;
 	op.params[1].value.b = whence;
 
@@ -126,7 +130,7 @@ static void obj_seek(struct secure_storage_ctx *ctx, uint32_t offset, TEE_Whence
 	printf("obj_seek success\n\n");
 }
 
-static void obj_read(struct secure_storage_ctx *ctx)
+static void obj_read(struct secure_storage_ctx *ctx, uint32_t handle)
 {
 	TEEC_Result res;
 	uint32_t err_origin;
@@ -134,9 +138,8 @@ static void obj_read(struct secure_storage_ctx *ctx)
 	uint8_t read_buf[OBJECT_SIZE];
 
 	memset(&op, 0, sizeof(op));
-	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = name_1;
-	op.params[0].tmpref.size = strlen(name_1) + 1;
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = handle;
 	op.params[1].tmpref.buffer = read_buf;
 	op.params[1].tmpref.size = OBJECT_SIZE;
 
@@ -152,13 +155,15 @@ static void obj_read(struct secure_storage_ctx *ctx)
 	printf("\n\n");
 }
 
-static void obj_close(struct secure_storage_ctx *ctx)
+static void obj_close(struct secure_storage_ctx *ctx, uint32_t handle)
 {
 	TEEC_Result res;
 	uint32_t err_origin;
 	TEEC_Operation op;
 
 	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = handle;
 
 	res = TEEC_InvokeCommand(&ctx->sess, SECURE_STORAGE_CMD_CLOSE, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
@@ -168,7 +173,7 @@ static void obj_close(struct secure_storage_ctx *ctx)
 	printf("obj_close success\n\n");
 }
 
-static void obj_delete(struct secure_storage_ctx *ctx)
+static void obj_delete(struct secure_storage_ctx *ctx, char *name)
 {
 	TEEC_Result res;
 	uint32_t err_origin;
@@ -176,8 +181,8 @@ static void obj_delete(struct secure_storage_ctx *ctx)
 
 	memset(&op, 0, sizeof(op));
 	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
-	op.params[0].tmpref.buffer = name_1;
-	op.params[0].tmpref.size = strlen(name_1) + 1;
+	op.params[0].tmpref.buffer = name;
+	op.params[0].tmpref.size = strlen(name) + 1;
 
 	res = TEEC_InvokeCommand(&ctx->sess, SECURE_STORAGE_CMD_DELETE, &op, &err_origin);
 	if(res != TEEC_SUCCESS) {
@@ -189,19 +194,841 @@ static void obj_delete(struct secure_storage_ctx *ctx)
 
 static void example(struct secure_storage_ctx *ctx)
 {
-	obj_create(ctx);
+	uint32_t handle_1, handle_2;
+
+	obj_create(ctx, name_1);
+	obj_create(ctx, name_2);
 	// obj_rename(ctx);
 
-	obj_open(ctx);
-	obj_write(ctx);
-	obj_seek(ctx, 0, TEE_DATA_SEEK_SET);
-	obj_read(ctx);
+	// 两个对象同时保持打开, 交替读写时不会反复打开关闭
+	handle_1 = obj_open(ctx, name_1);
+	handle_2 = obj_open(ctx, name_2);
+
+	obj_write(ctx, handle_1, message);
+	obj_write(ctx, handle_2, name_2);
+	obj_seek(ctx, handle_1, 0, TEE_DATA_SEEK_SET);
+	obj_seek(ctx, handle_2, 0, TEE_DATA_SEEK_SET);
+	obj_read(ctx, handle_1);
+	obj_read(ctx, handle_2);
+
+	obj_seek(ctx, handle_1, 7, TEE_DATA_SEEK_SET);
+	obj_read(ctx, handle_1);
+	obj_close(ctx, handle_1);
+	obj_close(ctx, handle_2);
+
+	obj_delete(ctx, name_1);
+	obj_delete(ctx, name_2);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_invoke(struct secure_storage_ctx *ctx, uint32_t cmd, TEEC_Operation *op, const char *what)
+{
+	TEEC_Result res;
+	uint32_t err_origin;
+
+	res = TEEC_InvokeCommand(&ctx->sess, cmd, op, &err_origin);
+	if(res != TEEC_SUCCESS) {
+		errx(1, "%s failed with code 0x%x origin 0x%x", what, res, err_origin);
+	}
+}
+
+/*
+ * 一次调用写入/读出整个对象, TA内部经过固定大小的缓冲区分块拷贝,
+ * 对象大于 TA_DATA_SIZE 时也不会因为申请不到堆内存而失败
+ */
+static void bench_size(struct secure_storage_ctx *ctx, uint8_t *buf, uint8_t *out, size_t size)
+{
+	char *name = "secure_storage_bench";
+	uint64_t t_write = 0, t_read = 0, t_get_all = 0, start;
+	TEEC_Operation op;
+	uint32_t handle;
+
+	for(int i = 0; i < BENCH_ROUNDS; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].value.a = 0;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE, &op, "create");
+		handle = op.params[2].value.a;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].tmpref.buffer = buf;
+		op.params[1].tmpref.size = size;
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_WRITE, &op, "write");
+		t_write += now_ns() - start;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].value.a = 0;
+		op.params[1].value.b = TEE_DATA_SEEK_SET;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_SEEK, &op, "seek");
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].tmpref.buffer = out;
+		op.params[1].tmpref.size = size;
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_READ, &op, "read");
+		t_read += now_ns() - start;
+
+		if(op.params[1].tmpref.size != size || memcmp(buf, out, size))
+			errx(1, "read back mismatch at %zu bytes", size);
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].tmpref.buffer = out;
+		op.params[1].tmpref.size = size;
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_GET_ALL, &op, "get_all");
+		t_get_all += now_ns() - start;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_DELETE, &op, "delete");
+	}
+
+	// 字节数 / 纳秒 * 1000 = MB/s
+	printf("%8zu KiB %12.2f %12.2f %12.2f\n", size / 1024,
+		(double)size * BENCH_ROUNDS * 1000 / t_write,
+		(double)size * BENCH_ROUNDS * 1000 / t_read,
+		(double)size * BENCH_ROUNDS * 1000 / t_get_all);
+}
+
+static void bench_example(struct secure_storage_ctx *ctx)
+{
+	size_t sizes[] = { 1024, 4096, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 };
+	size_t max_size = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+	uint8_t *buf, *out;
+
+	buf = malloc(max_size);
+	out = malloc(max_size);
+	if(!buf || !out)
+		errx(1, "out of memory");
+
+	for(size_t i = 0; i < max_size; i++)
+		buf[i] = (uint8_t)(i * 31 + 7);
+
+	printf("%12s %12s %12s %12s\n", "size", "write MB/s", "read MB/s", "get_all MB/s");
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		bench_size(ctx, buf, out, sizes[i]);
+
+	free(buf);
+	free(out);
+}
+
+/*
+ * READ_AT/WRITE_AT 自带偏移, 不需要先 SEEK, 也不改变对象的当前位置
+ * 批量版本一次调用更新同一对象中分散的多个区间
+ */
+static void positional_example(struct secure_storage_ctx *ctx)
+{
+	struct secure_storage_extent extents[3];
+	uint64_t offsets[3] = { 0, 100, 200 };
+	char *parts[3] = { "head", "middle", "tail" };
+	uint8_t data[64], out[64];
+	size_t data_len = 0;
+	TEEC_Operation op;
+	uint32_t handle;
+
+	obj_create(ctx, name_1);
+	handle = obj_open(ctx, name_1);
+
+	for(int i = 0; i < 3; i++) {
+		extents[i].offset = offsets[i];
+		extents[i].len = strlen(parts[i]);
+		extents[i].reserved = 0;
+		memcpy(data + data_len, parts[i], extents[i].len);
+		data_len += extents[i].len;
+	}
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_OUTPUT);
+	op.params[0].value.a = handle;
+	op.params[1].tmpref.buffer = extents;
+	op.params[1].tmpref.size = sizeof(extents);
+	op.params[2].tmpref.buffer = data;
+	op.params[2].tmpref.size = data_len;
+	bench_invoke(ctx, SECURE_STORAGE_CMD_WRITE_AT_BATCH, &op, "write_at_batch");
+	printf("write_at_batch : %u extents\n", op.params[3].value.a);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE);
+	op.params[0].value.a = handle;
+	op.params[1].value.a = SECURE_STORAGE_OFFSET_LO(offsets[1]);
+	op.params[1].value.b = SECURE_STORAGE_OFFSET_HI(offsets[1]);
+	op.params[2].tmpref.buffer = out;
+	op.params[2].tmpref.size = strlen(parts[1]);
+	bench_invoke(ctx, SECURE_STORAGE_CMD_READ_AT, &op, "read_at");
+	printf("read_at %llu : %.*s\n", (unsigned long long)offsets[1], (int)op.params[2].tmpref.size, out);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_VALUE_OUTPUT);
+	op.params[0].value.a = handle;
+	op.params[1].tmpref.buffer = extents;
+	op.params[1].tmpref.size = sizeof(extents);
+	op.params[2].tmpref.buffer = out;
+	op.params[2].tmpref.size = sizeof(out);
+	bench_invoke(ctx, SECURE_STORAGE_CMD_READ_AT_BATCH, &op, "read_at_batch");
+	printf("read_at_batch : %u extents, %.*s\n", op.params[3].value.a, (int)op.params[2].tmpref.size, out);
+
+	obj_close(ctx, handle);
+	obj_delete(ctx, name_1);
+}
+
+static size_t batch_pack(uint8_t *buf, size_t off, uint32_t type, char *name, char *data)
+{
+	struct secure_storage_batch_op op;
+
+	op.type = type;
+	op.id_len = strlen(name) + 1;
+	op.data_len = data ? strlen(data) + 1 : 0;
+
+	memcpy(buf + off, &op, sizeof(op));
+	off += sizeof(op);
+	memcpy(buf + off, name, op.id_len);
+	off += op.id_len;
+	if(data) {
+		memcpy(buf + off, data, op.data_len);
+		off += op.data_len;
+	}
+
+	return off;
+}
+
+static void print_object(struct secure_storage_ctx *ctx, char *name)
+{
+	TEEC_Result res;
+	uint32_t err_origin;
+	TEEC_Operation op;
+	char buf[OBJECT_SIZE];
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = name;
+	op.params[0].tmpref.size = strlen(name) + 1;
+	op.params[1].tmpref.buffer = buf;
+	op.params[1].tmpref.size = sizeof(buf);
+
+	res = TEEC_InvokeCommand(&ctx->sess, SECURE_STORAGE_CMD_GET_ALL, &op, &err_origin);
+	if(res == TEEC_ERROR_ITEM_NOT_FOUND)
+		printf("%-12s : (none)\n", name);
+	else if(res != TEEC_SUCCESS)
+		errx(1, "get_all failed with code 0x%x origin 0x%x", res, err_origin);
+	else
+		printf("%-12s : %.*s\n", name, (int)op.params[1].tmpref.size, buf);
+}
+
+/*
+ * 一次调用更新一组配置对象, 掉电时要么全部生效要么全部不生效
+ */
+static void batch_example(struct secure_storage_ctx *ctx)
+{
+	char *names[] = { "cfg.network", "cfg.server", "cfg.legacy" };
+	uint8_t buf[512];
+	TEEC_Operation op;
+	size_t len;
+
+	len = batch_pack(buf, 0, SECURE_STORAGE_BATCH_PUT, names[0], "dhcp=off ip=192.168.1.6");
+	len = batch_pack(buf, len, SECURE_STORAGE_BATCH_PUT, names[2], "version=1");
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = buf;
+	op.params[0].tmpref.size = len;
+	bench_invoke(ctx, SECURE_STORAGE_CMD_BATCH, &op, "batch");
+
+	printf("first push\n");
+	for(int i = 0; i < 3; i++)
+		print_object(ctx, names[i]);
+
+	// 替换 network, 新增 server, 删除 legacy
+	len = batch_pack(buf, 0, SECURE_STORAGE_BATCH_PUT, names[0], "dhcp=on");
+	len = batch_pack(buf, len, SECURE_STORAGE_BATCH_PUT, names[1], "host=example.com port=443");
+	len = batch_pack(buf, len, SECURE_STORAGE_BATCH_DELETE, names[2], NULL);
+	op.params[0].tmpref.size = len;
+	bench_invoke(ctx, SECURE_STORAGE_CMD_BATCH, &op, "batch");
+
+	printf("second push\n");
+	for(int i = 0; i < 3; i++)
+		print_object(ctx, names[i]);
+
+	len = batch_pack(buf, 0, SECURE_STORAGE_BATCH_DELETE, names[0], NULL);
+	len = batch_pack(buf, len, SECURE_STORAGE_BATCH_DELETE, names[1], NULL);
+	op.params[0].tmpref.size = len;
+	bench_invoke(ctx, SECURE_STORAGE_CMD_BATCH, &op, "batch");
+}
+
+#define CACHE_BENCH_READS	(1000)
+
+static void print_cache_stats(struct secure_storage_ctx *ctx)
+{
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE);
+	bench_invoke(ctx, SECURE_STORAGE_CMD_CACHE_STATS, &op, "cache_stats");
+
+	printf("cache hits %u misses %u objects %u bytes %u\n", op.params[0].value.a, op.params[0].value.b,
+		op.params[1].value.a, op.params[1].value.b);
+}
+
+/*
+ * 反复读取同一个配置对象, 第一次之后都由TA内的缓存返回, 写入后缓存失效
+ */
+static void cache_example(struct secure_storage_ctx *ctx)
+{
+	char *name = "cfg.cache";
+	char buf[OBJECT_SIZE];
+	TEEC_Operation op;
+	uint64_t start, first;
+	uint32_t handle;
+
+	obj_create(ctx, name);
+	handle = obj_open(ctx, name);
+	obj_write(ctx, handle, "log_level=info");
+	obj_close(ctx, handle);
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = name;
+	op.params[0].tmpref.size = strlen(name) + 1;
+	op.params[1].tmpref.buffer = buf;
+	op.params[1].tmpref.size = sizeof(buf);
+
+	start = now_ns();
+	bench_invoke(ctx, SECURE_STORAGE_CMD_GET_ALL, &op, "get_all");
+	first = now_ns() - start;
+
+	start = now_ns();
+	for(int i = 0; i < CACHE_BENCH_READS; i++) {
+		op.params[1].tmpref.size = sizeof(buf);
+		bench_invoke(ctx, SECURE_STORAGE_CMD_GET_ALL, &op, "get_all");
+	}
+	printf("first get_all %.1f us, cached get_all %.1f us\n", (double)first / 1000,
+		(double)(now_ns() - start) / 1000 / CACHE_BENCH_READS);
+	print_cache_stats(ctx);
+
+	handle = obj_open(ctx, name);
+	obj_write(ctx, handle, "log_level=debug");
+	obj_close(ctx, handle);
+
+	print_object(ctx, name);
+	print_cache_stats(ctx);
+
+	obj_delete(ctx, name);
+}
+
+#define LIST_BENCH_OBJECTS	(1000)
+#define LIST_PAGE_SIZE		(16 * 1024)
+
+static void list_objects(struct secure_storage_ctx *ctx, int verbose)
+{
+	static uint8_t page[LIST_PAGE_SIZE];
+	struct secure_storage_list_entry entry;
+	uint32_t total = 0, calls = 0;
+	TEEC_Operation op;
+	uint64_t start;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INOUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = 0;
+
+	start = now_ns();
+	do {
+		op.params[1].tmpref.buffer = page;
+		op.params[1].tmpref.size = sizeof(page);
+		bench_invoke(ctx, SECURE_STORAGE_CMD_LIST, &op, "list");
+		calls++;
+
+		for(size_t off = 0, i = 0; i < op.params[0].value.b; i++) {
+			memcpy(&entry, page + off, sizeof(entry));
+			if(verbose)
+				printf("%-24.*s %8u bytes flags 0x%x\n", (int)entry.id_len, (char *)page + off + sizeof(entry),
+					entry.data_size, entry.flags);
+			off += (sizeof(entry) + entry.id_len + 3) & ~3U;
+		}
+		total += op.params[0].value.b;
+	} while(op.params[0].value.a != SECURE_STORAGE_LIST_END);
 
-	obj_seek(ctx, 7, TEE_DATA_SEEK_SET);
-	obj_read(ctx);
-	obj_close(ctx);
+	printf("listed %u objects in %u invokes, %.1f ms\n", total, calls, (double)(now_ns() - start) / 1000000);
+}
+
+/*
+ * 一次调用列出一页对象(名字, 大小, 标志), 上万个对象也只需要几次调用
+ */
+static void list_example(struct secure_storage_ctx *ctx, int count)
+{
+	char name[32];
+	TEEC_Operation op;
+
+	for(int i = 0; i < count; i++) {
+		snprintf(name, sizeof(name), "list.%d", i);
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].value.a = 0;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE, &op, "create");
+	}
+
+	list_objects(ctx, count <= 20);
+
+	for(int i = 0; i < count; i++) {
+		snprintf(name, sizeof(name), "list.%d", i);
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_DELETE, &op, "delete");
+	}
+}
+
+#define KV_BENCH_RECORDS	(100000)
+#define KV_BENCH_VALUE		(100)
+#define KV_BENCH_OBJECTS	(200)
+
+static void kv_put(struct secure_storage_ctx *ctx, char *key, uint8_t *value, size_t len)
+{
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = key;
+	op.params[0].tmpref.size = strlen(key);
+	op.params[1].tmpref.buffer = value;
+	op.params[1].tmpref.size = len;
+	bench_invoke(ctx, SECURE_STORAGE_CMD_KV_PUT, &op, "kv_put");
+}
+
+static void kv_delete(struct secure_storage_ctx *ctx, char *key)
+{
+	TEEC_Operation op;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].tmpref.buffer = key;
+	op.params[0].tmpref.size = strlen(key);
+	bench_invoke(ctx, SECURE_STORAGE_CMD_KV_DELETE, &op, "kv_delete");
+}
+
+static void kv_print_stats(struct secure_storage_ctx *ctx, const char *what)
+{
+	TEEC_Operation op;
+	uint64_t live, log;
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+	bench_invoke(ctx, SECURE_STORAGE_CMD_KV_STATS, &op, "kv_stats");
+
+	live = (uint64_t)op.params[1].value.b << 32 | op.params[1].value.a;
+	log = (uint64_t)op.params[2].value.b << 32 | op.params[2].value.a;
+
+	// 存储放大 = 日志总字节数 / 有效记录字节数
+	printf("%-16s records %7u segments %4u live %10llu log %10llu amplification %.2f\n", what,
+		op.params[0].value.a, op.params[0].value.b, (unsigned long long)live,
+		(unsigned long long)log, live ? (double)log / live : 0.0);
+}
+
+// 对照 : 每条记录一个对象
+static double object_puts_per_sec(struct secure_storage_ctx *ctx, uint8_t *value)
+{
+	char name[32];
+	TEEC_Operation op;
+	uint64_t start, elapsed;
+
+	start = now_ns();
+	for(int i = 0; i < KV_BENCH_OBJECTS; i++) {
+		snprintf(name, sizeof(name), "kv_bench.%d", i);
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].value.a = 0;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE, &op, "create");
+
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = op.params[2].value.a;
+		op.params[1].tmpref.buffer = value;
+		op.params[1].tmpref.size = KV_BENCH_VALUE;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_WRITE, &op, "write");
+
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CLOSE, &op, "close");
+	}
+	elapsed = now_ns() - start;
+
+	for(int i = 0; i < KV_BENCH_OBJECTS; i++) {
+		snprintf(name, sizeof(name), "kv_bench.%d", i);
+		obj_delete(ctx, name);
+	}
+
+	return (double)KV_BENCH_OBJECTS * 1000000000 / elapsed;
+}
+
+/*
+ * 小记录写入速度 : 日志结构的 KV 与每条记录一个对象对比,
+ * 再覆盖/删除一部分记录, 观察存储放大和整理的效果
+ * 默认 10 万条记录, TA 的索引按页存放在存储中, 记录数不受TA堆大小限制
+ */
+static void kv_example(struct secure_storage_ctx *ctx, int records)
+{
+	uint8_t value[KV_BENCH_VALUE], out[KV_BENCH_VALUE];
+	uint8_t scan_buf[1024];
+	char key[32];
+	TEEC_Operation op;
+	uint64_t start, elapsed;
+	uint32_t count = 0;
+
+	for(size_t i = 0; i < sizeof(value); i++)
+		value[i] = (uint8_t)(i * 31 + 7);
+
+	start = now_ns();
+	for(int i = 0; i < records; i++) {
+		snprintf(key, sizeof(key), "user.%d", i);
+		kv_put(ctx, key, value, sizeof(value));
+	}
+	elapsed = now_ns() - start;
+	printf("kv put     : %10.1f records/s\n", (double)records * 1000000000 / elapsed);
+	printf("object put : %10.1f records/s\n", object_puts_per_sec(ctx, value));
+
+	start = now_ns();
+	for(int i = 0; i < records; i++) {
+		snprintf(key, sizeof(key), "user.%d", i);
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = key;
+		op.params[0].tmpref.size = strlen(key);
+		op.params[1].tmpref.buffer = out;
+		op.params[1].tmpref.size = sizeof(out);
+		bench_invoke(ctx, SECURE_STORAGE_CMD_KV_GET, &op, "kv_get");
+
+		if(op.params[1].tmpref.size != sizeof(value) || memcmp(out, value, sizeof(value)))
+			errx(1, "kv read back mismatch at %s", key);
+	}
+	elapsed = now_ns() - start;
+	printf("kv get     : %10.1f records/s\n", (double)records * 1000000000 / elapsed);
+
+	kv_print_stats(ctx, "after put");
+
+	// 覆盖一遍, 再删掉一半
+	for(int i = 0; i < records; i++) {
+		snprintf(key, sizeof(key), "user.%d", i);
+		kv_put(ctx, key, value, sizeof(value));
+	}
+	for(int i = 0; i < records; i += 2) {
+		snprintf(key, sizeof(key), "user.%d", i);
+		kv_delete(ctx, key);
+	}
+	kv_print_stats(ctx, "after overwrite");
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_OUTPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	start = now_ns();
+	bench_invoke(ctx, SECURE_STORAGE_CMD_KV_COMPACT, &op, "kv_compact");
+	elapsed = now_ns() - start;
+	printf("compacted %u segments in %.1f ms\n", op.params[0].value.a, (double)elapsed / 1000000);
+	kv_print_stats(ctx, "after compact");
+
+	// 按前缀列出 user.1xxx, 每次调用取一批
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INOUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE);
+	op.params[1].value.a = 0;
+	do {
+		op.params[0].tmpref.buffer = "user.1";
+		op.params[0].tmpref.size = strlen("user.1");
+		op.params[2].tmpref.buffer = scan_buf;
+		op.params[2].tmpref.size = sizeof(scan_buf);
+		bench_invoke(ctx, SECURE_STORAGE_CMD_KV_SCAN, &op, "kv_scan");
+		count += op.params[1].value.b;
+	} while(op.params[1].value.a != SECURE_STORAGE_KV_SCAN_END);
+	printf("scan user.1* : %u records\n", count);
+
+	for(int i = 1; i < records; i += 2) {
+		snprintf(key, sizeof(key), "user.%d", i);
+		kv_delete(ctx, key);
+	}
+	kv_print_stats(ctx, "after delete all");
+}
+
+#define APPEND_BENCH_RECORDS	(2000)
+
+/*
+ * 同样的遥测记录分别用 WRITE(每条写穿到对象)、APPEND 和带 SYNC 的 APPEND 写到对象末尾,
+ * 比较每秒追加的记录数, APPEND 的记录攒满 4KB 或超过 1 秒才写一次
+ */
+static double append_records(struct secure_storage_ctx *ctx, uint32_t cmd, uint32_t flags)
+{
+	char *name = "telemetry.log";
+	TEEC_Operation op;
+	uint64_t start, elapsed;
+	uint32_t handle;
+	char rec[64];
+
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+	op.params[0].tmpref.buffer = name;
+	op.params[0].tmpref.size = strlen(name) + 1;
+	op.params[1].value.a = 0;
+	bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE, &op, "create");
+	handle = op.params[2].value.a;
+
+	start = now_ns();
+	for(int i = 0; i < APPEND_BENCH_RECORDS; i++) {
+		int n = snprintf(rec, sizeof(rec), "%d,temp=%d.%d,volt=3.%02d\n", i, 20 + i % 10, i % 7, i % 100);
+
+		memset(&op, 0, sizeof(op));
+		op.params[0].value.a = handle;
+		op.params[1].tmpref.buffer = rec;
+		op.params[1].tmpref.size = n;
+		if(cmd == SECURE_STORAGE_CMD_APPEND) {
+			op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INOUT, TEEC_NONE);
+			op.params[2].value.a = flags;
+		} else {
+			op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+		}
+		bench_invoke(ctx, cmd, &op, "append");
+	}
+
+	// 计时包括最后一次写出
+	memset(&op, 0, sizeof(op));
+	op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+	op.params[0].value.a = handle;
+	bench_invoke(ctx, SECURE_STORAGE_CMD_FLUSH, &op, "flush");
+	elapsed = now_ns() - start;
+
+	obj_close(ctx, handle);
+	obj_delete(ctx, name);
+
+	return (double)APPEND_BENCH_RECORDS * 1000000000 / elapsed;
+}
+
+static void append_example(struct secure_storage_ctx *ctx)
+{
+	double write = append_records(ctx, SECURE_STORAGE_CMD_WRITE, 0);
+	double append = append_records(ctx, SECURE_STORAGE_CMD_APPEND, 0);
+	double sync = append_records(ctx, SECURE_STORAGE_CMD_APPEND, SECURE_STORAGE_APPEND_SYNC);
+
+	printf("%d records: write %.0f/s, append %.0f/s, append sync %.0f/s\n",
+		APPEND_BENCH_RECORDS, write, append, sync);
+}
+
+#define COMPRESS_BENCH_ROUNDS	(20)
+
+// 生成 JSON 配置样例, 压缩率与实际的配置文件接近
+static void make_config(char *buf, size_t size)
+{
+	size_t off = 0;
+	int i = 0;
+
+	while(off < size) {
+		char line[128];
+		int n = snprintf(line, sizeof(line),
+			"{\"id\":%d,\"name\":\"sensor-%d\",\"enabled\":%s,\"threshold\":%d,\"unit\":\"celsius\"},\n",
+			i, i % 16, i % 3 ? "true" : "false", (i * 37) % 100);
+		size_t k = size - off < (size_t)n ? size - off : (size_t)n;
+
+		memcpy(buf + off, line, k);
+		off += k;
+		i++;
+	}
+}
+
+/*
+ * 同样的数据分别按普通对象(CREATE + WRITE)和压缩对象(PUT_COMPRESSED)写入,
+ * 比较写入TA的字节数(不含 REE FS 的加密和哈希树开销)和读出延迟,
+ * 对象都大于读缓存的上限, GET_ALL 每次都从存储中读出
+ */
+static void compress_size(struct secure_storage_ctx *ctx, char *buf, char *out, size_t size)
+{
+	char *name = "cfg.compress";
+	uint64_t t_write = 0, t_put = 0, t_get_all = 0, t_get = 0, start;
+	uint32_t stored = 0;
+	TEEC_Operation op;
+	uint32_t handle;
+
+	make_config(buf, size);
+
+	for(int i = 0; i < COMPRESS_BENCH_ROUNDS; i++) {
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].value.a = 0;
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE, &op, "create");
+		handle = op.params[2].value.a;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].tmpref.buffer = buf;
+		op.params[1].tmpref.size = size;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_WRITE, &op, "write");
+		t_write += now_ns() - start;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].tmpref.buffer = out;
+		op.params[1].tmpref.size = size;
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_GET_ALL, &op, "get_all");
+		t_get_all += now_ns() - start;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_DELETE, &op, "delete");
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].tmpref.buffer = buf;
+		op.params[1].tmpref.size = size;
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_PUT_COMPRESSED, &op, "put_compressed");
+		t_put += now_ns() - start;
+		stored = op.params[2].value.b;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].tmpref.buffer = out;
+		op.params[1].tmpref.size = size;
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_GET_COMPRESSED, &op, "get_compressed");
+		t_get += now_ns() - start;
+
+		if(op.params[1].tmpref.size != size || memcmp(buf, out, size))
+			errx(1, "decompressed data mismatch at %zu bytes", size);
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_DELETE, &op, "delete");
+	}
+
+	printf("%8zu KiB %10zu %10u %6.1fx %10.1f %10.1f %10.1f %10.1f\n", size / 1024,
+		size, stored, (double)size / stored,
+		(double)t_write / 1000 / COMPRESS_BENCH_ROUNDS,
+		(double)t_put / 1000 / COMPRESS_BENCH_ROUNDS,
+		(double)t_get_all / 1000 / COMPRESS_BENCH_ROUNDS,
+		(double)t_get / 1000 / COMPRESS_BENCH_ROUNDS);
+}
+
+static void compress_example(struct secure_storage_ctx *ctx)
+{
+	size_t sizes[] = { 16 * 1024, 64 * 1024, SECURE_STORAGE_COMPRESS_MAX_SIZE };
+	char *buf = malloc(SECURE_STORAGE_COMPRESS_MAX_SIZE);
+	char *out = malloc(SECURE_STORAGE_COMPRESS_MAX_SIZE);
+
+	if(!buf || !out)
+		errx(1, "out of memory");
+
+	printf("%12s %10s %10s %7s %10s %10s %10s %10s\n", "size", "raw bytes", "stored", "ratio",
+		"write us", "put_z us", "get_all us", "get_z us");
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		compress_size(ctx, buf, out, sizes[i]);
+
+	free(buf);
+	free(out);
+}
+
+#define CREATE_BENCH_OBJECTS	(200)
+
+/*
+ * 新建带内容的小对象 : CREATE + WRITE + CLOSE 三次调用, 对象先按大小补零再写入真实内容,
+ * CREATE_WITH_DATA 一次调用创建并写入, 比较每秒新建的对象数
+ */
+static void create_example(struct secure_storage_ctx *ctx)
+{
+	uint8_t data[OBJECT_SIZE];
+	char name[32];
+	TEEC_Operation op;
+	uint64_t start, t_separate = 0, t_with_data = 0;
+	uint32_t handle;
+
+	memset(data, 0x5A, sizeof(data));
+
+	for(int i = 0; i < CREATE_BENCH_OBJECTS; i++) {
+		snprintf(name, sizeof(name), "create.%d", i);
+
+		start = now_ns();
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_VALUE_INPUT, TEEC_VALUE_OUTPUT, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].value.a = sizeof(data);
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE, &op, "create");
+		handle = op.params[2].value.a;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		op.params[1].tmpref.buffer = data;
+		op.params[1].tmpref.size = sizeof(data);
+		bench_invoke(ctx, SECURE_STORAGE_CMD_WRITE, &op, "write");
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].value.a = handle;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CLOSE, &op, "close");
+		t_separate += now_ns() - start;
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_DELETE, &op, "delete");
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		op.params[1].tmpref.buffer = data;
+		op.params[1].tmpref.size = sizeof(data);
+		start = now_ns();
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE_WITH_DATA, &op, "create_with_data");
+		t_with_data += now_ns() - start;
+
+		// 再写一次是原子覆盖
+		memset(data, i, sizeof(data));
+		bench_invoke(ctx, SECURE_STORAGE_CMD_CREATE_WITH_DATA, &op, "create_with_data");
+
+		memset(&op, 0, sizeof(op));
+		op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+		op.params[0].tmpref.buffer = name;
+		op.params[0].tmpref.size = strlen(name) + 1;
+		bench_invoke(ctx, SECURE_STORAGE_CMD_DELETE, &op, "delete");
+	}
 
-	obj_delete(ctx);
+	printf("%d objects of %d bytes: create+write+close %.0f/s, create_with_data %.0f/s\n",
+		CREATE_BENCH_OBJECTS, OBJECT_SIZE,
+		(double)CREATE_BENCH_OBJECTS * 1000000000 / t_separate,
+		(double)CREATE_BENCH_OBJECTS * 1000000000 / t_with_data);
 }
 
 static void prepare_tee_session(struct secure_storage_ctx *ctx)
@@ -228,13 +1055,41 @@ static void terminate_tee_session(struct secure_storage_ctx *ctx)
 	TEEC_FinalizeContext(&ctx->ctx);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     struct secure_storage_ctx ctx;
 
     prepare_tee_session(&ctx);
 
-    example(&ctx);
+    // secure_storage bench : 不同大小对象的读写吞吐量
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        bench_example(&ctx);
+    // secure_storage at : 指定偏移读写(pread/pwrite)及批量区间读写
+    else if (argc > 1 && strcmp(argv[1], "at") == 0)
+        positional_example(&ctx);
+    // secure_storage batch : 一次调用原子地更新多个对象
+    else if (argc > 1 && strcmp(argv[1], "batch") == 0)
+        batch_example(&ctx);
+    // secure_storage kv [records] : 日志结构KV的写入速度和存储放大, 默认 100000 条记录
+    else if (argc > 1 && strcmp(argv[1], "kv") == 0)
+        kv_example(&ctx, argc > 2 ? atoi(argv[2]) : KV_BENCH_RECORDS);
+    // secure_storage cache : 反复读取小对象时TA内读缓存的效果
+    else if (argc > 1 && strcmp(argv[1], "cache") == 0)
+        cache_example(&ctx);
+    // secure_storage list [count] : 分页列出所有对象, 默认先创建 1000 个对象
+    else if (argc > 1 && strcmp(argv[1], "list") == 0)
+        list_example(&ctx, argc > 2 ? atoi(argv[2]) : LIST_BENCH_OBJECTS);
+    // secure_storage compress : 压缩对象写入的字节数和读出延迟
+    else if (argc > 1 && strcmp(argv[1], "compress") == 0)
+        compress_example(&ctx);
+    // secure_storage append : 小记录逐条写入和缓冲后合并写入的速度
+    else if (argc > 1 && strcmp(argv[1], "append") == 0)
+        append_example(&ctx);
+    // secure_storage create : 一次调用创建并写入小对象
+    else if (argc > 1 && strcmp(argv[1], "create") == 0)
+        create_example(&ctx);
+    else
+        example(&ctx);
 
     terminate_tee_session(&ctx);
 
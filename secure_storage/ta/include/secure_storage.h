@@ -5,12 +5,32 @@
 	{ 0xef83682b, 0x8a80, 0x45e0, \
 		{ 0x99, 0x93, 0xae, 0x58, 0x3a, 0x38, 0x66, 0x28} }
 
+/*
+ * open session : param[0] (value-input, a : storage) selects where the object commands keep
+ * their objects, TEE_STORAGE_PRIVATE (default, no parameter), TEE_STORAGE_PRIVATE_REE or
+ * TEE_STORAGE_PRIVATE_RPMB. BATCH is only supported on TEE_STORAGE_PRIVATE,
+ * the KV commands always use TEE_STORAGE_PRIVATE
+ */
+#define SECURE_STORAGE_STORAGE_PRIVATE		0x00000001
+#define SECURE_STORAGE_STORAGE_REE			0x80000000
+#define SECURE_STORAGE_STORAGE_RPMB			0x80000100
+
+/*
+ * every session has a table of SECURE_STORAGE_MAX_HANDLES open objects
+ * OPEN/CREATE return a handle, READ/WRITE/SEEK/CLOSE accept the handle as param[0] (value-input, a : handle)
+ * in place of the object name. When the table is full, the least recently used object is closed
+ * and its handle becomes invalid (TEE_ERROR_ITEM_NOT_FOUND), open the object again to get a new one
+ */
+#define SECURE_STORAGE_MAX_HANDLES			8
+
 /* 
  * @brief : create a persistent object in TEE
+ *          nothing is done if the object already exists, see CREATE_WITH_DATA to replace it
+ *          the name must not be longer than TEE_OBJECT_ID_MAX_LEN
  *
  * param[0] (memerf-input) 		: object name
  * param[1] (value-input)		: a : size
- * param[2] (unsued)
+ * param[2] (value-output)		: a : handle, optional
  * param[3] (unsued)
  */
 #define SECURE_STORAGE_CMD_CREATE			0
@@ -19,7 +39,7 @@
  * @brief : open a persistent object in TEE
  *
  * param[0] (memerf-input) 		: object name
- * param[1] (unsued)
+ * param[1] (value-output)		: a : handle, optional
  * param[2] (unsued)
  * param[3] (unsued)
  */
@@ -38,8 +58,8 @@
 /* 
  * @brief : seek
  *
- * param[0] (memerf-input) 		: object name
- * param[0] (value-input) 		: a : offset, b : whence
+ * param[0] (memerf-input) 		: object name or (value-input) a : handle
+ * param[1] (value-input) 		: a : offset, b : whence
  * param[2] (unsued)
  * param[3] (unsued)
  */
@@ -48,7 +68,7 @@
 /* 
  * @brief : write data to a persistent object
  *
- * param[0] (memerf-input) 		: object name
+ * param[0] (memerf-input) 		: object name or (value-input) a : handle
  * param[1] (memerf-input) 		: data to be written
  * param[2] (unsued)
  * param[3] (unsued)
@@ -58,7 +78,7 @@
 /* 
  * @brief : read data from a persistent object
  *
- * param[0] (memerf-input)		: object name
+ * param[0] (memerf-input)		: object name or (value-input) a : handle
  * param[1] (memerf-output)		: data read from the object
  * param[2] (unsued)
  * param[3] (unsued)
@@ -68,8 +88,9 @@
 
 /* 
  * @brief : close a persistent object
+ *          all objects of the session are closed when no handle is given
  *
- * param[0] (unsued)
+ * param[0] (value-input)		: a : handle, optional
  * param[1] (unsued)
  * param[2] (unsued)
  * param[3] (unsued)
@@ -88,6 +109,9 @@
 
 /* 
  * @brief : check a persistent object exist
+ *          the TA keeps a hash index of all object names, a name that is not in the
+ *          index is reported as missing without touching the storage, a name in the
+ *          index is confirmed by opening the object
  *
  * param[0] (memerf-input)		: object name
  * param[1] (unsued)
@@ -97,7 +121,7 @@
 #define SECURE_STORAGE_CMD_EXISTS     		8
 
 /* 
- * @brief : get all object data
+ * @brief : get all object data, repeated reads of small objects are served from the TA cache
  *
  * param[0] (memerf-input)		: object name
  * param[1] (memerf-output)		: onject size
@@ -106,4 +130,305 @@
  */
 #define SECURE_STORAGE_CMD_GET_ALL   		9
 
+/*
+ * 64-bit offset for READ_AT/WRITE_AT, the storage only accepts offsets up to 0xFFFFFFFF
+ */
+#define SECURE_STORAGE_OFFSET_LO(off)		((uint32_t)(off))
+#define SECURE_STORAGE_OFFSET_HI(off)		((uint32_t)((uint64_t)(off) >> 32))
+
+/* 
+ * @brief : read at an offset without using or moving the position of the object (pread)
+ *          the read stops at the end of the object
+ *
+ * param[0] (memerf-input)		: object name or (value-input) a : handle
+ * param[1] (value-input)		: a : offset low 32 bits, b : offset high 32 bits
+ * param[2] (memerf-output)		: data read from the object
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_READ_AT			10
+
+/* 
+ * @brief : write at an offset without using or moving the position of the object (pwrite)
+ *          writing past the end of the object fills the gap with zeros
+ *
+ * param[0] (memerf-input)		: object name or (value-input) a : handle
+ * param[1] (value-input)		: a : offset low 32 bits, b : offset high 32 bits
+ * param[2] (memerf-input)		: data to be written
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_WRITE_AT			11
+
+/*
+ * one extent of READ_AT_BATCH/WRITE_AT_BATCH, the data of all extents are packed
+ * back to back in the data buffer in the same order
+ */
+struct secure_storage_extent {
+	uint64_t offset;
+	uint32_t len;
+	uint32_t reserved;
+};
+
+// READ_AT_BATCH/WRITE_AT_BATCH 一次最多的区间数
+#define SECURE_STORAGE_MAX_EXTENTS			64
+
+/* 
+ * @brief : read several extents in one call, stops at the first extent that reaches the end of the object
+ *
+ * param[0] (memerf-input)		: object name or (value-input) a : handle
+ * param[1] (memerf-input)		: struct secure_storage_extent array, at most SECURE_STORAGE_MAX_EXTENTS
+ * param[2] (memerf-output)		: data of the extents, size is the number of bytes read
+ * param[3] (value-output)		: a : number of extents read completely
+ */
+#define SECURE_STORAGE_CMD_READ_AT_BATCH	12
+
+/* 
+ * @brief : write several extents in one call, extents are written in order, not atomically
+ *
+ * param[0] (memerf-input)		: object name or (value-input) a : handle
+ * param[1] (memerf-input)		: struct secure_storage_extent array, at most SECURE_STORAGE_MAX_EXTENTS
+ * param[2] (memerf-input)		: data of the extents
+ * param[3] (value-output)		: a : number of extents written
+ */
+#define SECURE_STORAGE_CMD_WRITE_AT_BATCH	13
+
+/*
+ * one operation of SECURE_STORAGE_CMD_BATCH, followed by id_len bytes of object name
+ * and, for a put, data_len bytes of object data. Operations are packed back to back
+ */
+#define SECURE_STORAGE_BATCH_PUT			0
+#define SECURE_STORAGE_BATCH_DELETE			1
+
+#define SECURE_STORAGE_BATCH_MAX_OPS		16
+
+struct secure_storage_batch_op {
+	uint32_t type;
+	uint32_t id_len;
+	uint32_t data_len;
+};
+
+/* 
+ * @brief : put (create or replace) and delete several objects atomically in one call
+ *          either all operations take effect or none does, also across a power loss
+ *          objects of the batch that are open in the calling session are closed first,
+ *          the batch fails with TEE_ERROR_ACCESS_CONFLICT if another session has one of them open
+ *          a batch that was committed but not finished (e.g. the renames failed) is finished first,
+ *          the call fails with TEE_ERROR_BUSY without staging anything if that still fails
+ *
+ * param[0] (memerf-input)		: struct secure_storage_batch_op | name | data, ...
+ * param[1] (unsued)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_BATCH			14
+
+/*
+ * KV mode: small records are packed into a few large segment objects as an append-only log,
+ * the TA keeps a hash index of all keys in an index object, paged through a small cache and written
+ * back at checkpoints, so a put is one append, a get is one read, and the number of records is not
+ * bounded by the TA heap. After a crash the index is replayed from the log since the last checkpoint.
+ * Old versions and deleted records are garbage, they are compacted away when the garbage
+ * exceeds half of the log, a bit on every put/delete and all at once with KV_COMPACT
+ */
+#define SECURE_STORAGE_KV_MAX_KEY			64
+#define SECURE_STORAGE_KV_MAX_VALUE			1024
+
+#define SECURE_STORAGE_KV_SCAN_END			0xFFFFFFFF
+
+/*
+ * one record of KV_SCAN output, followed by key_len bytes of key and value_len bytes of value
+ */
+struct secure_storage_kv_entry {
+	uint16_t key_len;
+	uint16_t value_len;
+};
+
+/* 
+ * @brief : insert or replace a record
+ *
+ * param[0] (memerf-input)		: key, 1 ~ SECURE_STORAGE_KV_MAX_KEY bytes
+ * param[1] (memerf-input)		: value, 0 ~ SECURE_STORAGE_KV_MAX_VALUE bytes
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_KV_PUT			15
+
+/* 
+ * @brief : read a record, TEE_ERROR_SHORT_BUFFER gives the value size in param[1]
+ *
+ * param[0] (memerf-input)		: key
+ * param[1] (memerf-output)		: value
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_KV_GET			16
+
+/* 
+ * @brief : delete a record, TEE_ERROR_ITEM_NOT_FOUND if there is no such key
+ *
+ * param[0] (memerf-input)		: key
+ * param[1] (unsued)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_KV_DELETE		17
+
+/* 
+ * @brief : list records whose key starts with a prefix, in no particular order
+ *          call again with the returned cursor until it is SECURE_STORAGE_KV_SCAN_END,
+ *          records put or deleted between two calls may be missed or listed twice
+ *
+ * param[0] (memerf-input)		: key prefix, may be empty
+ * param[1] (value-inout)		: a : cursor, 0 for the first call, b : number of records returned
+ * param[2] (memerf-output)		: struct secure_storage_kv_entry | key | value, ...
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_KV_SCAN			18
+
+/* 
+ * @brief : compact the log until the garbage is below the threshold, e.g. when the device is idle
+ *
+ * param[0] (value-output)		: a : number of segments compacted
+ * param[1] (unsued)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_KV_COMPACT		19
+
+/* 
+ * @brief : statistics of the KV log, storage amplification = log bytes / live bytes
+ *
+ * param[0] (value-output)		: a : number of records, b : number of segments
+ * param[1] (value-output)		: a : live bytes low 32 bits, b : live bytes high 32 bits
+ * param[2] (value-output)		: a : log bytes low 32 bits, b : log bytes high 32 bits
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_KV_STATS			20
+
+/* 
+ * @brief : statistics of the GET_ALL read cache
+ *          objects up to 4KB read by GET_ALL are cached in the TA, up to 16KB in total,
+ *          the cache of an object is dropped by WRITE, WRITE_AT, RENAME, DELETE and BATCH
+ *
+ * param[0] (value-output)		: a : hits, b : misses
+ * param[1] (value-output)		: a : cached objects, b : cached bytes
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_CACHE_STATS		21
+
+#define SECURE_STORAGE_LIST_END				0xFFFFFFFF
+
+/*
+ * one object of LIST output, followed by id_len bytes of object id, padded to 4 bytes
+ */
+struct secure_storage_list_entry {
+	uint32_t id_len;
+	uint32_t data_size;
+	uint32_t flags;			// TEE_DATA_FLAG_* the object was created with
+};
+
+/* 
+ * @brief : list objects page by page, each page holds as many entries as fit in param[1]
+ *          start with cursor 0 and call again with the returned cursor until it is
+ *          SECURE_STORAGE_LIST_END, the enumerator is kept in the session between pages,
+ *          one session lists one sequence at a time, cursor 0 restarts it.
+ *          objects created or deleted while listing may be missed.
+ *          TEE_ERROR_SHORT_BUFFER gives the size of the next entry in param[1]
+ *
+ * param[0] (value-inout)		: a : cursor, b : number of entries returned
+ * param[1] (memerf-output)		: struct secure_storage_list_entry | id, ...
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_LIST				22
+
+/*
+ * compressed objects, for text and config data that compresses well
+ * the object is stored as a small header with the raw size followed by LZ77 compressed 4KB blocks,
+ * blocks that do not get smaller are stored uncompressed, so the TA only needs one block of memory.
+ * the header is written last, an object whose PUT_COMPRESSED was interrupted (e.g. power loss)
+ * has no valid header and GET_COMPRESSED returns TEE_ERROR_BAD_FORMAT for it.
+ * read a compressed object only with GET_COMPRESSED, other commands see the stored bytes
+ */
+#define SECURE_STORAGE_COMPRESS_MAX_SIZE	(256 * 1024)
+
+/* 
+ * @brief : compress data and store it as the whole object, creating or replacing it,
+ *          not atomic: the old object is gone as soon as the new one is created
+ *
+ * param[0] (memerf-input)		: object id
+ * param[1] (memerf-input)		: raw data, up to SECURE_STORAGE_COMPRESS_MAX_SIZE
+ * param[2] (value-output)		: a : raw size, b : bytes written to the object, header included
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_PUT_COMPRESSED	23
+
+/* 
+ * @brief : read a compressed object and return the raw data
+ *          TEE_ERROR_SHORT_BUFFER gives the raw size in param[1],
+ *          TEE_ERROR_BAD_FORMAT if the object was not written by PUT_COMPRESSED
+ *
+ * param[0] (memerf-input)		: object id
+ * param[1] (memerf-output)		: raw data
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_GET_COMPRESSED	24
+
+/*
+ * APPEND buffers records in the TA and writes them to the end of the object in one large write
+ * when the buffer (4KB) is full, the oldest buffered record is older than 1s, the record has
+ * SECURE_STORAGE_APPEND_SYNC, on FLUSH or CLOSE, or when another command accesses the object.
+ * the age is only checked on the next APPEND, buffered records are lost if the TA crashes or the
+ * device loses power, use SECURE_STORAGE_APPEND_SYNC for records that must be durable on return
+ */
+#define SECURE_STORAGE_APPEND_SYNC			0x1
+
+/* 
+ * @brief : append a record to the end of the object, the read/write position is not changed
+ *
+ * param[0] (memerf-input) 		: object name or (value-input) a : handle
+ * param[1] (memerf-input)		: record
+ * param[2] (value-inout)		: a : SECURE_STORAGE_APPEND_* flags, b : bytes still buffered on return
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_APPEND			25
+
+/* 
+ * @brief : write the buffered records of APPEND to the object
+ *
+ * param[0] (memerf-input) 		: object name or (value-input) a : handle
+ * param[1] (unsued)
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_FLUSH			26
+
+// the initial data is copied through a 4KB buffer of the session
+#define SECURE_STORAGE_CREATE_DATA_MAX_SIZE	(4 * 1024)
+
+/* 
+ * @brief : create a persistent object with its initial data in one call,
+ *          an existing object is replaced atomically, readers see either the old or the new data.
+ *          larger objects are created with CREATE and written with WRITE
+ *
+ * param[0] (memerf-input) 		: object name
+ * param[1] (memerf-input) 		: initial data, up to SECURE_STORAGE_CREATE_DATA_MAX_SIZE
+ * param[2] (value-output)		: a : handle, optional
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_CREATE_WITH_DATA	27
+
+/* 
+ * @brief : state of the object directory that EXISTS/CREATE/OPEN use instead of enumerating,
+ *          the directory is disabled for the life of the TA instance when it would outgrow its
+ *          memory (about 3000 objects) or cannot be written, lookups then probe the storage
+ *
+ * param[0] (value-output)		: a : 1 if the directory is in use, 0 if disabled, b : number of entries
+ * param[1] (value-output)		: a : number of slots, b : maximum number of slots
+ * param[2] (unsued)
+ * param[3] (unsued)
+ */
+#define SECURE_STORAGE_CMD_DIR_STATS		28
+
 #endif /* _SECURE_STORAGE_H */
@@ -0,0 +1,1381 @@
+#include <tee_internal_api.h>
+#include <tee_internal_api_extensions.h>
+
+#include "include/secure_storage.h"
+#include "kv_store.h"
+
+/*
+ * 小记录不再各占一个对象, 而是追加写到少数几个大的段对象中(日志结构), 一次 put 只有一次追加写
+ *
+ * 段对象 "\0kv.XXXXXXXX", 编号在 [first, next) 之间的段有效, next - 1 是当前追加的段
+ * 元数据对象 "\0kv.meta" 记录 first/next, 新建段之前先写 next, 删掉最老的段之后才写 first,
+ * 中途掉电最多出现不存在的段, 回放时跳过
+ *
+ * 记录 : struct kv_record | key | value, 按4字节对齐, 带 KV_FLAG_DELETED 的是删除标记
+ * 索引 : key 的哈希 -> 记录位置(段号低位 | 段内偏移 / 4), 哈希相同时从段中读出 key 比较
+ *
+ * 索引是保存在对象 "\0kv.index" 中的开放寻址表 : struct kv_index_header | 槽位, TA 内只缓存
+ * KV_INDEX_CACHE_PAGES 页, 堆的占用与记录数无关. 脏页只在检查点写回 : 先把头标记为不一致,
+ * 写回所有脏页, 再写头(索引已包含的日志位置 synced 和统计). 加载时只回放 synced 之后的日志,
+ * 头不一致(写回中途掉电)或索引不存在时回放所有段重建索引
+ *
+ * 覆盖和删除留下的旧记录是垃圾, 垃圾超过日志的一半时从最老的段开始整理 :
+ * 仍被索引指向的记录复制到日志末尾, 整段处理完后删除, 每次 put/delete 顺带整理一小块
+ */
+#define KV_SEGMENT_SIZE         (1024 * 1024)
+#define KV_SEG_BITS             10
+#define KV_OFF_BITS             22
+#define KV_MAX_SEGMENTS         (1 << KV_SEG_BITS)
+#define KV_SEG_ID_LEN           12
+
+#define KV_INDEX_PAGE_SIZE      4096
+#define KV_INDEX_PAGE_SLOTS     (KV_INDEX_PAGE_SIZE / sizeof(struct kv_slot))
+#define KV_INDEX_CACHE_PAGES    4
+#define KV_INDEX_MIN_SLOTS      (4 * KV_INDEX_PAGE_SLOTS)
+#define KV_INDEX_MAX_SLOTS      (1 << 24)
+#define KV_INDEX_SLOTS_OFF      (2 * KV_INDEX_PAGE_SIZE)    // 头占前两页
+#define KV_SLOT_EMPTY           0
+#define KV_SLOT_DELETED         1
+
+#define KV_RECORD_MAGIC         0x564B      // "KV"
+#define KV_FLAG_DELETED         0x01
+#define KV_META_MAGIC           0x4D564B53  // "SKVM"
+#define KV_INDEX_MAGIC          0x494B5353  // "SSKI"
+
+#define KV_IO_SIZE              (4 * 1024)
+#define KV_COMPACT_STEP         (4 * 1024)  // 每次 put/delete 顺带整理的字节数
+
+struct kv_record {
+    uint16_t magic;
+    uint8_t key_len;
+    uint8_t flags;
+    uint16_t value_len;
+    uint16_t reserved;
+};
+
+struct kv_slot {
+    uint32_t hash;          // 0 空槽, 1 删除标记
+    uint32_t loc;
+};
+
+struct kv_meta {
+    uint32_t magic;
+    uint32_t first;
+    uint32_t next;
+};
+
+struct kv_index_header {
+    uint32_t magic;
+    uint32_t clean;                         // 0 : 槽位可能比头新
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t used;                          // 有效槽位 + 删除标记
+    uint32_t synced_seg;                    // 索引包含 (synced_seg, synced_off) 之前的所有记录
+    uint32_t synced_off;
+    uint32_t reserved;
+    uint64_t live_bytes;
+    uint32_t seg_size[KV_MAX_SEGMENTS];     // 以段号低位为下标
+};
+
+struct kv_page {
+    uint32_t page;
+    uint32_t last_use;
+    bool valid;
+    bool dirty;
+};
+
+static const uint8_t kv_meta_id[] = "\0kv.meta";
+#define KV_META_ID_LEN          (sizeof(kv_meta_id) - 1)
+
+static const uint8_t kv_index_id[] = "\0kv.index";
+#define KV_INDEX_ID_LEN         (sizeof(kv_index_id) - 1)
+
+// 扩容时新表先写到这里, 完成后替换 kv_index_id
+static const uint8_t kv_index_tmp_id[] = "\0kv.index.tmp";
+#define KV_INDEX_TMP_ID_LEN     (sizeof(kv_index_tmp_id) - 1)
+
+static const uint32_t kv_access_flag = TEE_DATA_FLAG_ACCESS_READ |
+                                        TEE_DATA_FLAG_ACCESS_WRITE |
+                                        TEE_DATA_FLAG_ACCESS_WRITE_META |
+                                        TEE_DATA_FLAG_SHARE_READ |
+                                        TEE_DATA_FLAG_SHARE_WRITE;
+
+typedef TEE_Result (*kv_visit_fn)(const struct kv_record *rec, const uint8_t *data, uint32_t seg, uint32_t off);
+
+// 日志和索引在所有会话间共享(单实例TA), 第一次使用时打开索引并回放检查点之后的日志
+static struct {
+    bool loaded;
+    struct kv_meta meta;
+    TEE_ObjectHandle meta_obj;
+    TEE_ObjectHandle active;                // 段 next - 1
+    uint32_t active_size;
+    TEE_ObjectHandle reader;                // 最近随机读过的旧段
+    uint32_t reader_seg;
+    uint64_t log_bytes;
+    struct kv_index_header idx;             // 内存中的统计, 检查点时整个写入索引对象
+    TEE_ObjectHandle index_obj;
+    bool index_clean;                       // 索引对象中的槽位和头一致
+    struct kv_page pages[KV_INDEX_CACHE_PAGES];
+    uint32_t cache_pages;                   // 可用的缓存页, 扩容时留一页读旧表
+    uint32_t page_clock;
+    uint8_t *page_buf;
+    bool compacting;                        // 正在整理段 first
+    TEE_ObjectHandle compact_obj;
+    uint32_t compact_off;
+    uint8_t *buf;
+} kv;
+
+static void kv_seg_id(uint32_t seg, uint8_t id[KV_SEG_ID_LEN])
+{
+    static const char hex[] = "0123456789abcdef";
+
+    TEE_MemMove(id, "\0kv.", 4);
+    for (uint32_t i = 0; i < 8; i++)
+        id[4 + i] = hex[(seg >> (28 - i * 4)) & 0xF];
+}
+
+// FNV-1a, 0 和 1 作为空槽和删除标记
+static uint32_t kv_hash(const uint8_t *key, uint32_t key_len)
+{
+    uint32_t hash = 0x811c9dc5;
+
+    for (uint32_t i = 0; i < key_len; i++) {
+        hash ^= key[i];
+        hash *= 0x01000193;
+    }
+
+    if (hash <= KV_SLOT_DELETED)
+        hash += 2;
+
+    return hash;
+}
+
+static uint32_t kv_record_size(uint32_t key_len, uint32_t value_len)
+{
+    return (sizeof(struct kv_record) + key_len + value_len + 3) & ~3U;
+}
+
+static bool kv_record_valid(const struct kv_record *rec)
+{
+    return rec->magic == KV_RECORD_MAGIC && rec->key_len && rec->key_len <= SECURE_STORAGE_KV_MAX_KEY &&
+            rec->value_len <= SECURE_STORAGE_KV_MAX_VALUE;
+}
+
+static uint32_t kv_loc(uint32_t seg, uint32_t off)
+{
+    return ((seg & (KV_MAX_SEGMENTS - 1)) << KV_OFF_BITS) | (off >> 2);
+}
+
+// 有效段不超过 KV_MAX_SEGMENTS 个, 由段号低位还原完整段号
+static uint32_t kv_loc_seg(uint32_t loc)
+{
+    return kv.meta.first + (((loc >> KV_OFF_BITS) - kv.meta.first) & (KV_MAX_SEGMENTS - 1));
+}
+
+static uint32_t kv_loc_off(uint32_t loc)
+{
+    return (loc & ((1 << KV_OFF_BITS) - 1)) << 2;
+}
+
+static uint32_t *kv_seg_size(uint32_t seg)
+{
+    return &kv.idx.seg_size[seg & (KV_MAX_SEGMENTS - 1)];
+}
+
+static void kv_close(TEE_ObjectHandle *obj)
+{
+    if (*obj != TEE_HANDLE_NULL) {
+        TEE_CloseObject(*obj);
+        *obj = TEE_HANDLE_NULL;
+    }
+}
+
+// 丢弃内存中的状态, 不写检查点, 下次使用时从索引对象中的检查点回放
+static void kv_unload(void)
+{
+    kv_close(&kv.meta_obj);
+    kv_close(&kv.active);
+    kv_close(&kv.reader);
+    kv_close(&kv.compact_obj);
+    kv_close(&kv.index_obj);
+
+    TEE_Free(kv.page_buf);
+    TEE_Free(kv.buf);
+    TEE_MemFill(&kv, 0, sizeof(kv));
+}
+
+static TEE_Result kv_open_seg(uint32_t seg, TEE_ObjectHandle *obj)
+{
+    uint8_t id[KV_SEG_ID_LEN];
+
+    kv_seg_id(seg, id);
+
+    return TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, id, KV_SEG_ID_LEN, kv_access_flag, obj);
+}
+
+static TEE_Result kv_save_meta(void)
+{
+    TEE_Result res;
+
+    res = TEE_SeekObjectData(kv.meta_obj, 0, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    return TEE_WriteObjectData(kv.meta_obj, &kv.meta, sizeof(kv.meta));
+}
+
+/**********************************Index**********************************/
+static uint8_t *kv_page_data(uint32_t i)
+{
+    return kv.page_buf + i * KV_INDEX_PAGE_SIZE;
+}
+
+static TEE_Result kv_index_write(TEE_ObjectHandle obj, uint32_t offset, const void *buf, uint32_t len)
+{
+    TEE_Result res;
+
+    res = TEE_SeekObjectData(obj, offset, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    return TEE_WriteObjectData(obj, buf, len);
+}
+
+static TEE_Result kv_index_read_page(TEE_ObjectHandle obj, uint32_t page, uint8_t *buf)
+{
+    uint32_t read_count;
+    TEE_Result res;
+
+    res = TEE_SeekObjectData(obj, KV_INDEX_SLOTS_OFF + page * KV_INDEX_PAGE_SIZE, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_ReadObjectData(obj, buf, KV_INDEX_PAGE_SIZE, &read_count);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    return read_count == KV_INDEX_PAGE_SIZE ? TEE_SUCCESS : TEE_ERROR_CORRUPT_OBJECT;
+}
+
+static TEE_Result kv_page_writeback(uint32_t i)
+{
+    TEE_Result res;
+
+    res = kv_index_write(kv.index_obj, KV_INDEX_SLOTS_OFF + kv.pages[i].page * KV_INDEX_PAGE_SIZE,
+                            kv_page_data(i), KV_INDEX_PAGE_SIZE);
+    if (res == TEE_SUCCESS)
+        kv.pages[i].dirty = false;
+
+    return res;
+}
+
+static void kv_cache_drop(void)
+{
+    for (uint32_t i = 0; i < KV_INDEX_CACHE_PAGES; i++)
+        kv.pages[i].valid = false;
+}
+
+/*
+ * 检查点 : 写回所有脏页, 再写头, 头中的 synced 是最后一次完成的索引更新之后的日志位置
+ * 写回第一页之前先把头标记为不一致, 中途掉电时下次加载重建索引
+ */
+static TEE_Result kv_checkpoint(void)
+{
+    TEE_Result res;
+
+    for (uint32_t i = 0; i < kv.cache_pages; i++) {
+        if (!kv.pages[i].valid || !kv.pages[i].dirty)
+            continue;
+
+        if (kv.index_clean) {
+            kv.idx.clean = 0;
+            res = kv_index_write(kv.index_obj, 0, &kv.idx, 2 * sizeof(uint32_t));
+            if (res != TEE_SUCCESS)
+                return res;
+            kv.index_clean = false;
+        }
+
+        res = kv_page_writeback(i);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    if (kv.index_clean)
+        return TEE_SUCCESS;
+
+    kv.idx.magic = KV_INDEX_MAGIC;
+    kv.idx.clean = 1;
+    res = kv_index_write(kv.index_obj, 0, &kv.idx, sizeof(kv.idx));
+    if (res != TEE_SUCCESS)
+        return res;
+    kv.index_clean = true;
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * 槽位 idx 所在的页读入缓存, 返回的指针在下一次调用之前有效, write 为真时该页记为脏页
+ * 优先换出干净页, 全是脏页时先做检查点; 磁盘上的头已经不一致时(重建或扩容填新表)直接写回换出的页
+ */
+static TEE_Result kv_slot_get(uint32_t idx, bool write, struct kv_slot **slot)
+{
+    uint32_t page = idx / KV_INDEX_PAGE_SLOTS;
+    uint32_t i, victim = 0;
+    TEE_Result res;
+
+    for (i = 0; i < kv.cache_pages; i++) {
+        if (kv.pages[i].valid && kv.pages[i].page == page)
+            goto found;
+    }
+
+    for (i = 0; i < kv.cache_pages; i++) {
+        if (!kv.pages[i].valid) {
+            victim = i;
+            break;
+        }
+        if (kv.pages[victim].dirty != kv.pages[i].dirty ? kv.pages[victim].dirty :
+            kv.pages[i].last_use < kv.pages[victim].last_use)
+            victim = i;
+    }
+    i = victim;
+
+    if (kv.pages[i].valid && kv.pages[i].dirty) {
+        res = kv.index_clean ? kv_checkpoint() : kv_page_writeback(i);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    kv.pages[i].valid = false;
+    res = kv_index_read_page(kv.index_obj, page, kv_page_data(i));
+    if (res != TEE_SUCCESS)
+        return res;
+    kv.pages[i].valid = true;
+    kv.pages[i].dirty = false;
+    kv.pages[i].page = page;
+
+found:
+    kv.pages[i].last_use = ++kv.page_clock;
+    if (write)
+        kv.pages[i].dirty = true;
+    *slot = (struct kv_slot *)kv_page_data(i) + idx % KV_INDEX_PAGE_SLOTS;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result kv_slot_insert(uint32_t hash, uint32_t loc)
+{
+    uint32_t mask = kv.idx.capacity - 1;
+    uint32_t idx = hash & mask;
+    struct kv_slot *slot;
+    TEE_Result res;
+
+    while (true) {
+        res = kv_slot_get(idx, false, &slot);
+        if (res != TEE_SUCCESS)
+            return res;
+        if (slot->hash <= KV_SLOT_DELETED)
+            break;
+        idx = (idx + 1) & mask;
+    }
+
+    res = kv_slot_get(idx, true, &slot);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    slot->hash = hash;
+    slot->loc = loc;
+
+    return TEE_SUCCESS;
+}
+
+// 新建索引对象, 扩展出的数据都是 0 : 头无效, 槽位都是空槽
+static TEE_Result kv_index_create(const uint8_t *id, uint32_t id_len, uint32_t capacity, TEE_ObjectHandle *obj)
+{
+    TEE_Result res;
+
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, id, id_len, kv_access_flag | TEE_DATA_FLAG_OVERWRITE,
+                                    TEE_HANDLE_NULL, NULL, 0, obj);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_TruncateObjectData(*obj, KV_INDEX_SLOTS_OFF + capacity * sizeof(struct kv_slot));
+    if (res != TEE_SUCCESS) {
+        TEE_CloseAndDeletePersistentObject1(*obj);
+        *obj = TEE_HANDLE_NULL;
+    }
+
+    return res;
+}
+
+/*
+ * 所有有效槽位重新插入 capacity 大小的新表, 新表写到临时对象, 填完并写好头之后替换索引对象
+ * 旧表先写回, 再按页顺序读入留出的最后一个缓存页; 新表中的位置随旧表的顺序大致单调前进,
+ * 其余缓存页很少被换出
+ */
+static TEE_Result kv_index_resize(uint32_t capacity)
+{
+    TEE_ObjectHandle old = kv.index_obj, obj;
+    uint32_t old_capacity = kv.idx.capacity;
+    uint8_t *old_page = kv_page_data(KV_INDEX_CACHE_PAGES - 1);
+    struct kv_slot slot;
+    TEE_Result res;
+
+    res = kv_checkpoint();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = kv_index_create(kv_index_tmp_id, KV_INDEX_TMP_ID_LEN, capacity, &obj);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    kv_cache_drop();
+    kv.index_obj = obj;
+    kv.index_clean = false;
+    kv.idx.capacity = capacity;
+    kv.cache_pages = KV_INDEX_CACHE_PAGES - 1;
+
+    for (uint32_t page = 0; page < old_capacity / KV_INDEX_PAGE_SLOTS; page++) {
+        res = kv_index_read_page(old, page, old_page);
+        if (res != TEE_SUCCESS)
+            goto err;
+
+        for (uint32_t i = 0; i < KV_INDEX_PAGE_SLOTS; i++) {
+            TEE_MemMove(&slot, old_page + i * sizeof(slot), sizeof(slot));
+            if (slot.hash <= KV_SLOT_DELETED)
+                continue;
+
+            res = kv_slot_insert(slot.hash, slot.loc);
+            if (res != TEE_SUCCESS)
+                goto err;
+        }
+    }
+
+    kv.cache_pages = KV_INDEX_CACHE_PAGES;
+    kv.idx.used = kv.idx.count;
+
+    res = kv_checkpoint();
+    if (res != TEE_SUCCESS)
+        goto err;
+
+    // 删除旧表之后改名之前掉电, 下次加载找不到索引, 回放所有段重建
+    TEE_CloseAndDeletePersistentObject1(old);
+    res = TEE_RenamePersistentObject(kv.index_obj, kv_index_id, KV_INDEX_ID_LEN);
+    if (res != TEE_SUCCESS)
+        EMSG("rename KV index failed, res is 0x%x, it is rebuilt at next load\n\n", res);
+
+    return TEE_SUCCESS;
+
+err:
+    TEE_CloseAndDeletePersistentObject1(kv.index_obj);
+    kv_cache_drop();
+    kv.index_obj = old;
+    kv.index_clean = true;
+    kv.idx.capacity = old_capacity;
+    kv.cache_pages = KV_INDEX_CACHE_PAGES;
+
+    return res;
+}
+
+// 插入前保证有空位, 负载超过 3/4 时扩容, 删除标记多时原大小重建
+static TEE_Result kv_index_reserve(void)
+{
+    uint32_t capacity = kv.idx.capacity;
+
+    if ((kv.idx.used + 1) * 4 <= kv.idx.capacity * 3)
+        return TEE_SUCCESS;
+
+    if ((kv.idx.count + 1) * 2 > kv.idx.capacity) {
+        if (kv.idx.capacity >= KV_INDEX_MAX_SLOTS) {
+            EMSG("KV index is full, %u records\n\n", kv.idx.count);
+            return TEE_ERROR_STORAGE_NO_SPACE;
+        }
+        capacity = kv.idx.capacity * 2;
+    }
+
+    return kv_index_resize(capacity);
+}
+
+// 整理时用 : 找到指向 loc 的槽位, 找不到(idx 为容量)说明该记录已经是垃圾, 不需要读存储
+static TEE_Result kv_slot_of_loc(uint32_t hash, uint32_t loc, uint32_t *idx)
+{
+    uint32_t mask = kv.idx.capacity - 1;
+    struct kv_slot *slot;
+    TEE_Result res;
+
+    *idx = hash & mask;
+
+    for (uint32_t i = 0; i < kv.idx.capacity; i++) {
+        res = kv_slot_get(*idx, false, &slot);
+        if (res != TEE_SUCCESS)
+            return res;
+        if (slot->hash == hash && slot->loc == loc)
+            return TEE_SUCCESS;
+        if (slot->hash == KV_SLOT_EMPTY)
+            break;
+        *idx = (*idx + 1) & mask;
+    }
+
+    *idx = kv.idx.capacity;
+
+    return TEE_SUCCESS;
+}
+/**********************************Index**********************************/
+
+/**********************************Log**********************************/
+// 随机读 : 当前段用追加句柄, 旧段缓存一个只读句柄
+static TEE_Result kv_read(uint32_t seg, uint32_t off, void *buf, uint32_t len)
+{
+    TEE_ObjectHandle obj;
+    uint32_t read_count;
+    TEE_Result res;
+
+    if (seg == kv.meta.next - 1 && kv.active != TEE_HANDLE_NULL) {
+        obj = kv.active;
+    } else {
+        if (kv.reader == TEE_HANDLE_NULL || kv.reader_seg != seg) {
+            kv_close(&kv.reader);
+            res = kv_open_seg(seg, &kv.reader);
+            if (res != TEE_SUCCESS)
+                return res;
+            kv.reader_seg = seg;
+        }
+        obj = kv.reader;
+    }
+
+    res = TEE_SeekObjectData(obj, off, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_ReadObjectData(obj, buf, len, &read_count);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    return read_count == len ? TEE_SUCCESS : TEE_ERROR_CORRUPT_OBJECT;
+}
+
+// 在索引中查找 key, 找到时 idx 为槽位, loc 为记录位置, rec 为记录头
+static TEE_Result kv_find(const uint8_t *key, uint32_t key_len, uint32_t hash, uint32_t *idx, uint32_t *loc,
+                            struct kv_record *rec)
+{
+    uint8_t buf[sizeof(struct kv_record) + SECURE_STORAGE_KV_MAX_KEY];
+    uint32_t mask = kv.idx.capacity - 1;
+    uint32_t i = hash & mask;
+    struct kv_slot *slot;
+    TEE_Result res;
+
+    for (uint32_t n = 0; n < kv.idx.capacity; n++, i = (i + 1) & mask) {
+        res = kv_slot_get(i, false, &slot);
+        if (res != TEE_SUCCESS)
+            return res;
+        if (slot->hash == KV_SLOT_EMPTY)
+            break;
+        if (slot->hash != hash)
+            continue;
+
+        *loc = slot->loc;
+        res = kv_read(kv_loc_seg(*loc), kv_loc_off(*loc), buf, sizeof(struct kv_record) + key_len);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        TEE_MemMove(rec, buf, sizeof(struct kv_record));
+        if (rec->key_len == key_len && TEE_MemCompare(buf + sizeof(struct kv_record), key, key_len) == 0) {
+            *idx = i;
+            return TEE_SUCCESS;
+        }
+    }
+
+    return TEE_ERROR_ITEM_NOT_FOUND;
+}
+
+/*
+ * 记录已经写入 loc 之后更新索引和统计, found 为 kv_find 的结果, 调用前需要 kv_index_reserve
+ * 先改槽位再改统计和 synced, 取页时做的检查点只包含之前的记录
+ */
+static TEE_Result kv_index_set(uint32_t hash, bool found, uint32_t idx, const struct kv_record *old,
+                                const struct kv_record *rec, uint32_t loc)
+{
+    uint32_t size = kv_record_size(rec->key_len, rec->value_len);
+    bool deleted = rec->flags & KV_FLAG_DELETED;
+    struct kv_slot *slot;
+    TEE_Result res = TEE_SUCCESS;
+
+    if (found) {
+        res = kv_slot_get(idx, true, &slot);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        if (deleted) {
+            slot->hash = KV_SLOT_DELETED;
+            kv.idx.count--;
+        } else {
+            slot->loc = loc;
+        }
+        kv.idx.live_bytes -= kv_record_size(old->key_len, old->value_len);
+    } else if (!deleted) {
+        res = kv_slot_insert(hash, loc);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        kv.idx.count++;
+        kv.idx.used++;
+    }
+
+    if (!deleted)
+        kv.idx.live_bytes += size;
+
+    kv.idx.synced_seg = kv_loc_seg(loc);
+    kv.idx.synced_off = kv_loc_off(loc) + size;
+
+    return TEE_SUCCESS;
+}
+
+// 关闭当前段, 在 next 登记之后再创建新段
+static TEE_Result kv_new_segment(void)
+{
+    uint8_t id[KV_SEG_ID_LEN];
+    uint32_t seg = kv.meta.next;
+    TEE_Result res;
+
+    if (seg - kv.meta.first >= KV_MAX_SEGMENTS) {
+        EMSG("KV log is full\n\n");
+        return TEE_ERROR_STORAGE_NO_SPACE;
+    }
+
+    kv_close(&kv.active);
+
+    kv.meta.next++;
+    res = kv_save_meta();
+    if (res != TEE_SUCCESS) {
+        kv.meta.next--;
+        return res;
+    }
+
+    // 掉电残留的同名段还没有被索引引用过, 直接覆盖
+    kv_seg_id(seg, id);
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, id, KV_SEG_ID_LEN,
+                                    kv_access_flag | TEE_DATA_FLAG_OVERWRITE,
+                                    TEE_HANDLE_NULL, NULL, 0, &kv.active);
+    if (res != TEE_SUCCESS) {
+        EMSG("TEE_CreatePersistentObject failed, res is 0x%x\n\n", res);
+        return res;
+    }
+
+    kv.active_size = 0;
+    *kv_seg_size(seg) = 0;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result kv_append(const void *rec, uint32_t len, uint32_t *loc)
+{
+    TEE_Result res;
+
+    if (kv.active == TEE_HANDLE_NULL || kv.active_size + len > KV_SEGMENT_SIZE) {
+        res = kv_new_segment();
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    res = TEE_SeekObjectData(kv.active, kv.active_size, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_WriteObjectData(kv.active, rec, len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    *loc = kv_loc(kv.meta.next - 1, kv.active_size);
+    kv.active_size += len;
+    *kv_seg_size(kv.meta.next - 1) = kv.active_size;
+    kv.log_bytes += len;
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * 从 *off 开始顺序处理段中的记录, 处理完 budget 字节或遇到段尾/无效记录时返回
+ * 每次读之前重新定位, 回调中可以用同一个句柄随机读
+ *
+ * end : 是否已经到达段尾
+ */
+static TEE_Result kv_walk(TEE_ObjectHandle obj, uint32_t seg, uint32_t *off, uint32_t budget,
+                            kv_visit_fn visit, bool *end)
+{
+    uint32_t start = *off;
+    uint32_t len = 0, pos = 0;
+    uint32_t read_count, size;
+    struct kv_record rec;
+    bool eof = false;
+    TEE_Result res;
+
+    *end = false;
+
+    while (*off - start < budget) {
+        // kv.buf 中是段内 [*off - pos, *off - pos + len) 的数据
+        if (len - pos < sizeof(rec) + SECURE_STORAGE_KV_MAX_KEY + SECURE_STORAGE_KV_MAX_VALUE && !eof) {
+            TEE_MemMove(kv.buf, kv.buf + pos, len - pos);
+            len -= pos;
+            pos = 0;
+
+            res = TEE_SeekObjectData(obj, *off + len, TEE_DATA_SEEK_SET);
+            if (res != TEE_SUCCESS)
+                return res;
+
+            res = TEE_ReadObjectData(obj, kv.buf + len, KV_IO_SIZE - len, &read_count);
+            if (res != TEE_SUCCESS)
+                return res;
+
+            eof = read_count < KV_IO_SIZE - len;
+            len += read_count;
+        }
+
+        if (len - pos < sizeof(rec)) {
+            *end = true;
+            break;
+        }
+
+        TEE_MemMove(&rec, kv.buf + pos, sizeof(rec));
+        size = kv_record_size(rec.key_len, rec.value_len);
+        if (!kv_record_valid(&rec) || len - pos < size) {
+            // 追加写被打断留下的残缺记录, 其后没有数据
+            *end = true;
+            break;
+        }
+
+        res = visit(&rec, kv.buf + pos + sizeof(rec), seg, *off);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        pos += size;
+        *off += size;
+    }
+
+    return TEE_SUCCESS;
+}
+/**********************************Log**********************************/
+
+/**********************************Load**********************************/
+static TEE_Result kv_replay_visit(const struct kv_record *rec, const uint8_t *data, uint32_t seg, uint32_t off)
+{
+    uint32_t hash = kv_hash(data, rec->key_len);
+    struct kv_record old;
+    uint32_t idx, loc;
+    TEE_Result res;
+
+    res = kv_index_reserve();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = kv_find(data, rec->key_len, hash, &idx, &loc, &old);
+    if (res != TEE_SUCCESS && res != TEE_ERROR_ITEM_NOT_FOUND)
+        return res;
+
+    return kv_index_set(hash, res == TEE_SUCCESS, idx, &old, rec, kv_loc(seg, off));
+}
+
+// 从 start 开始回放一个段, start 之前的记录已经在索引中
+static TEE_Result kv_replay_segment(uint32_t seg, uint32_t start)
+{
+    TEE_ObjectHandle obj;
+    uint32_t off = start;
+    bool end = false;
+    TEE_Result res;
+
+    *kv_seg_size(seg) = 0;
+
+    res = kv_open_seg(seg, &obj);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND)
+        return TEE_SUCCESS;
+    if (res != TEE_SUCCESS)
+        return res;
+
+    while (!end) {
+        res = kv_walk(obj, seg, &off, KV_SEGMENT_SIZE, kv_replay_visit, &end);
+        if (res != TEE_SUCCESS) {
+            TEE_CloseObject(obj);
+            return res;
+        }
+        *kv_seg_size(seg) = off;
+    }
+
+    if (seg != kv.meta.next - 1) {
+        TEE_CloseObject(obj);
+        return TEE_SUCCESS;
+    }
+
+    // 当前段 : 截掉残缺的尾部, 之后从 off 继续追加
+    res = TEE_TruncateObjectData(obj, off);
+    if (res != TEE_SUCCESS) {
+        TEE_CloseObject(obj);
+        return res;
+    }
+
+    kv.active = obj;
+    kv.active_size = off;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result kv_load_meta(void)
+{
+    uint32_t read_count;
+    TEE_Result res;
+
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, kv_meta_id, KV_META_ID_LEN, kv_access_flag, &kv.meta_obj);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        kv.meta.magic = KV_META_MAGIC;
+        return TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, kv_meta_id, KV_META_ID_LEN, kv_access_flag,
+                                        TEE_HANDLE_NULL, &kv.meta, sizeof(kv.meta), &kv.meta_obj);
+    }
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_ReadObjectData(kv.meta_obj, &kv.meta, sizeof(kv.meta), &read_count);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (read_count != sizeof(kv.meta) || kv.meta.magic != KV_META_MAGIC ||
+        kv.meta.next - kv.meta.first > KV_MAX_SEGMENTS)
+        return TEE_ERROR_CORRUPT_OBJECT;
+
+    return TEE_SUCCESS;
+}
+
+// 头完整一致, 检查点在有效段内, 对象能放下所有槽位
+static bool kv_index_valid(uint32_t read_count, uint32_t data_size)
+{
+    const struct kv_index_header *hdr = &kv.idx;
+
+    return read_count == sizeof(*hdr) && hdr->magic == KV_INDEX_MAGIC && hdr->clean == 1 &&
+            hdr->capacity >= KV_INDEX_MIN_SLOTS && hdr->capacity <= KV_INDEX_MAX_SLOTS &&
+            !(hdr->capacity & (hdr->capacity - 1)) &&
+            hdr->count <= hdr->used && hdr->used < hdr->capacity &&
+            hdr->synced_seg - kv.meta.first <= kv.meta.next - kv.meta.first &&
+            hdr->synced_off <= KV_SEGMENT_SIZE &&
+            data_size >= KV_INDEX_SLOTS_OFF + hdr->capacity * sizeof(struct kv_slot);
+}
+
+/*
+ * 打开索引对象并读出头, start_seg/start_off 为需要回放的日志起点
+ * 索引不存在或不可用时新建一个空索引, 从最老的段开始回放
+ */
+static TEE_Result kv_index_load(uint32_t *start_seg, uint32_t *start_off)
+{
+    TEE_ObjectInfo info;
+    uint32_t read_count = 0;
+    TEE_Result res;
+
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, kv_index_id, KV_INDEX_ID_LEN, kv_access_flag, &kv.index_obj);
+    if (res == TEE_SUCCESS) {
+        res = TEE_GetObjectInfo1(kv.index_obj, &info);
+        if (res == TEE_SUCCESS)
+            res = TEE_ReadObjectData(kv.index_obj, &kv.idx, sizeof(kv.idx), &read_count);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        if (kv_index_valid(read_count, info.dataSize)) {
+            kv.index_clean = true;
+            *start_seg = kv.idx.synced_seg;
+            *start_off = kv.idx.synced_off;
+            return TEE_SUCCESS;
+        }
+
+        IMSG("KV index is not consistent with the log, rebuild it\n\n");
+        kv_close(&kv.index_obj);
+    } else if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+        return res;
+    }
+
+    res = kv_index_create(kv_index_id, KV_INDEX_ID_LEN, KV_INDEX_MIN_SLOTS, &kv.index_obj);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    TEE_MemFill(&kv.idx, 0, sizeof(kv.idx));
+    kv.idx.capacity = KV_INDEX_MIN_SLOTS;
+    kv.idx.synced_seg = kv.meta.first;
+    kv.index_clean = false;
+    *start_seg = kv.meta.first;
+    *start_off = 0;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result kv_load(void)
+{
+    uint32_t start_seg, start_off;
+    TEE_Result res;
+
+    if (kv.loaded)
+        return TEE_SUCCESS;
+
+    kv.buf = TEE_Malloc(KV_IO_SIZE, TEE_MALLOC_FILL_ZERO);
+    kv.page_buf = TEE_Malloc(KV_INDEX_CACHE_PAGES * KV_INDEX_PAGE_SIZE, TEE_MALLOC_FILL_ZERO);
+    if (!kv.buf || !kv.page_buf) {
+        EMSG("Out of memory\n\n");
+        res = TEE_ERROR_OUT_OF_MEMORY;
+        goto err;
+    }
+    kv.cache_pages = KV_INDEX_CACHE_PAGES;
+
+    res = kv_load_meta();
+    if (res != TEE_SUCCESS) {
+        EMSG("load KV meta failed, res is 0x%x\n\n", res);
+        goto err;
+    }
+
+    res = kv_index_load(&start_seg, &start_off);
+    if (res != TEE_SUCCESS) {
+        EMSG("load KV index failed, res is 0x%x\n\n", res);
+        goto err;
+    }
+
+    for (uint32_t seg = start_seg; seg != kv.meta.next; seg++) {
+        res = kv_replay_segment(seg, seg == start_seg ? start_off : 0);
+        if (res != TEE_SUCCESS) {
+            EMSG("replay KV segment %u failed, res is 0x%x\n\n", seg, res);
+            goto err;
+        }
+    }
+
+    for (uint32_t seg = kv.meta.first; seg != kv.meta.next; seg++)
+        kv.log_bytes += *kv_seg_size(seg);
+
+    // 回放过的记录马上写入检查点, 下次加载不用再回放
+    res = kv_checkpoint();
+    if (res != TEE_SUCCESS) {
+        EMSG("KV checkpoint failed, res is 0x%x\n\n", res);
+        goto err;
+    }
+
+    IMSG("KV index loaded, %u records in %u segments\n\n", kv.idx.count, kv.meta.next - kv.meta.first);
+    kv.loaded = true;
+
+    return TEE_SUCCESS;
+
+err:
+    kv_unload();
+    return res;
+}
+
+void kv_release(void)
+{
+    TEE_Result res;
+
+    if (kv.loaded) {
+        res = kv_checkpoint();
+        if (res != TEE_SUCCESS)
+            EMSG("KV checkpoint failed, res is 0x%x\n\n", res);
+    }
+
+    kv_unload();
+}
+/**********************************Load**********************************/
+
+/**********************************Compaction**********************************/
+static TEE_Result kv_compact_visit(const struct kv_record *rec, const uint8_t *data, uint32_t seg, uint32_t off)
+{
+    uint32_t loc = kv_loc(seg, off);
+    uint32_t size = kv_record_size(rec->key_len, rec->value_len);
+    uint32_t idx, new_loc;
+    struct kv_slot *slot;
+    TEE_Result res;
+
+    // 最老的段中的删除标记之前已没有同名记录, 直接丢弃
+    if (rec->flags & KV_FLAG_DELETED)
+        return TEE_SUCCESS;
+
+    res = kv_slot_of_loc(kv_hash(data, rec->key_len), loc, &idx);
+    if (res != TEE_SUCCESS || idx == kv.idx.capacity)
+        return res;
+
+    // data 指向 kv.buf 中的记录体, 连同记录头一起原样追加
+    res = kv_append(data - sizeof(*rec), size, &new_loc);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = kv_slot_get(idx, true, &slot);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    slot->loc = new_loc;
+    kv.idx.synced_seg = kv_loc_seg(new_loc);
+    kv.idx.synced_off = kv_loc_off(new_loc) + size;
+
+    return TEE_SUCCESS;
+}
+
+static bool kv_need_compact(void)
+{
+    // 当前段不参与整理, 至少要有一个写满的旧段
+    return kv.meta.next - kv.meta.first >= 2 && (kv.log_bytes - kv.idx.live_bytes) * 2 > kv.log_bytes;
+}
+
+/*
+ * 最老的段处理完后删除, 删除之后才写 first
+ * 删除之前先做检查点, 磁盘上的索引不再指向这个段, 段大小也已经在头中, 删除后掉电时由下次整理扣除
+ */
+static TEE_Result kv_drop_oldest(void)
+{
+    uint32_t seg = kv.meta.first;
+    TEE_Result res;
+
+    res = kv_checkpoint();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (kv.reader != TEE_HANDLE_NULL && kv.reader_seg == seg)
+        kv_close(&kv.reader);
+
+    TEE_CloseAndDeletePersistentObject1(kv.compact_obj);
+    kv.compact_obj = TEE_HANDLE_NULL;
+    kv.compacting = false;
+
+    kv.log_bytes -= *kv_seg_size(seg);
+    *kv_seg_size(seg) = 0;
+
+    kv.meta.first++;
+
+    return kv_save_meta();
+}
+
+/*
+ * 整理最多 budget 字节, 返回整理完的段数
+ * 整理中途复制出的记录会追加到当前段, 可能新建段, 但不会整理到当前段
+ */
+static TEE_Result kv_compact_step(uint32_t budget, uint32_t *segments)
+{
+    bool end = false;
+    TEE_Result res;
+
+    *segments = 0;
+
+    if (!kv.compacting) {
+        if (!kv_need_compact())
+            return TEE_SUCCESS;
+
+        res = kv_open_seg(kv.meta.first, &kv.compact_obj);
+        if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+            // 段在掉电前已删除, 只差写 first
+            kv.log_bytes -= *kv_seg_size(kv.meta.first);
+            *kv_seg_size(kv.meta.first) = 0;
+            kv.meta.first++;
+            *segments = 1;
+            return kv_save_meta();
+        }
+        if (res != TEE_SUCCESS)
+            return res;
+
+        kv.compacting = true;
+        kv.compact_off = 0;
+    }
+
+    res = kv_walk(kv.compact_obj, kv.meta.first, &kv.compact_off, budget, kv_compact_visit, &end);
+    if (res != TEE_SUCCESS || !end)
+        return res;
+
+    *segments = 1;
+
+    return kv_drop_oldest();
+}
+/**********************************Compaction**********************************/
+
+/**********************************KV Operation**********************************/
+static TEE_Result kv_check_key(uint32_t key_len)
+{
+    if (!key_len || key_len > SECURE_STORAGE_KV_MAX_KEY) {
+        EMSG("key length %u error\n\n", key_len);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    return TEE_SUCCESS;
+}
+
+// 写入一条记录(put 或删除标记)并更新索引, 记录已在 kv.buf 中
+static TEE_Result kv_write_record(bool must_exist)
+{
+    struct kv_record *rec = (struct kv_record *)kv.buf;
+    uint8_t *key = kv.buf + sizeof(*rec);
+    uint32_t hash = kv_hash(key, rec->key_len);
+    struct kv_record old;
+    uint32_t idx, loc, segments;
+    TEE_Result res, found;
+
+    res = kv_index_reserve();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    found = kv_find(key, rec->key_len, hash, &idx, &loc, &old);
+    if (found != TEE_SUCCESS && found != TEE_ERROR_ITEM_NOT_FOUND)
+        return found;
+    if (must_exist && found != TEE_SUCCESS)
+        return found;
+
+    res = kv_append(rec, kv_record_size(rec->key_len, rec->value_len), &loc);
+    if (res != TEE_SUCCESS) {
+        EMSG("KV append failed, res is 0x%x\n\n", res);
+        return res;
+    }
+
+    // 记录已在日志中而索引没有更新, 丢弃内存中的状态, 下次使用时从检查点回放
+    res = kv_index_set(hash, found == TEE_SUCCESS, idx, &old, rec, loc);
+    if (res != TEE_SUCCESS) {
+        EMSG("KV index update failed, res is 0x%x\n\n", res);
+        kv_unload();
+        return res;
+    }
+
+    // 整理失败不影响本次写入, 下次继续
+    res = kv_compact_step(KV_COMPACT_STEP, &segments);
+    if (res != TEE_SUCCESS)
+        EMSG("KV compaction failed, res is 0x%x\n\n", res);
+
+    return TEE_SUCCESS;
+}
+
+TEE_Result kv_put(uint32_t param_type, TEE_Param params[4])
+{
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                TEE_PARAM_TYPE_NONE,
+                                                TEE_PARAM_TYPE_NONE);
+    struct kv_record rec = { .magic = KV_RECORD_MAGIC };
+    uint32_t key_len = params[0].memref.size;
+    uint32_t value_len = params[1].memref.size;
+    TEE_Result res;
+
+    if (param_type != exp_param_type)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = kv_check_key(key_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (value_len > SECURE_STORAGE_KV_MAX_VALUE) {
+        EMSG("value length %u error\n\n", value_len);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = kv_load();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    rec.key_len = key_len;
+    rec.value_len = value_len;
+
+    // 参数先拷贝到TA内存, 再整条追加
+    TEE_MemFill(kv.buf, 0, kv_record_size(key_len, value_len));
+    TEE_MemMove(kv.buf, &rec, sizeof(rec));
+    TEE_MemMove(kv.buf + sizeof(rec), params[0].memref.buffer, key_len);
+    TEE_MemMove(kv.buf + sizeof(rec) + key_len, params[1].memref.buffer, value_len);
+
+    return kv_write_record(false);
+}
+
+TEE_Result kv_delete(uint32_t param_type, TEE_Param params[4])
+{
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                TEE_PARAM_TYPE_NONE,
+                                                TEE_PARAM_TYPE_NONE,
+                                                TEE_PARAM_TYPE_NONE);
+    struct kv_record rec = { .magic = KV_RECORD_MAGIC, .flags = KV_FLAG_DELETED };
+    uint32_t key_len = params[0].memref.size;
+    TEE_Result res;
+
+    if (param_type != exp_param_type)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = kv_check_key(key_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = kv_load();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    rec.key_len = key_len;
+
+    TEE_MemFill(kv.buf, 0, kv_record_size(key_len, 0));
+    TEE_MemMove(kv.buf, &rec, sizeof(rec));
+    TEE_MemMove(kv.buf + sizeof(rec), params[0].memref.buffer, key_len);
+
+    return kv_write_record(true);
+}
+
+TEE_Result kv_get(uint32_t param_type, TEE_Param params[4])
+{
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE,
+                                                TEE_PARAM_TYPE_NONE);
+    uint8_t key[SECURE_STORAGE_KV_MAX_KEY];
+    uint32_t key_len = params[0].memref.size;
+    struct kv_record rec;
+    uint32_t idx, loc;
+    TEE_Result res;
+
+    if (param_type != exp_param_type)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = kv_check_key(key_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = kv_load();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    TEE_MemMove(key, params[0].memref.buffer, key_len);
+
+    res = kv_find(key, key_len, kv_hash(key, key_len), &idx, &loc, &rec);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (params[1].memref.size < rec.value_len) {
+        params[1].memref.size = rec.value_len;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    res = kv_read(kv_loc_seg(loc), kv_loc_off(loc) + sizeof(rec) + key_len, kv.buf, rec.value_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    TEE_MemMove(params[1].memref.buffer, kv.buf, rec.value_len);
+    params[1].memref.size = rec.value_len;
+
+    return TEE_SUCCESS;
+}
+
+TEE_Result kv_scan(uint32_t param_type, TEE_Param params[4])
+{
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                TEE_PARAM_TYPE_VALUE_INOUT,
+                                                TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE);
+    uint8_t prefix[SECURE_STORAGE_KV_MAX_KEY];
+    uint32_t prefix_len = params[0].memref.size;
+    uint8_t *out = params[2].memref.buffer;
+    uint32_t out_size = params[2].memref.size;
+    struct secure_storage_kv_entry entry;
+    uint32_t out_len = 0, count = 0, i;
+    struct kv_record rec;
+    struct kv_slot *slot;
+    uint32_t loc, len;
+    TEE_Result res;
+
+    if (param_type != exp_param_type)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (prefix_len > SECURE_STORAGE_KV_MAX_KEY) {
+        EMSG("prefix length %u error\n\n", prefix_len);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    TEE_MemMove(prefix, params[0].memref.buffer, prefix_len);
+
+    res = kv_load();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 游标为槽位下标, 中途扩容或整理都不会让游标越界, 只会漏掉或重复部分记录
+    for (i = params[1].value.a; i < kv.idx.capacity; i++) {
+        res = kv_slot_get(i, false, &slot);
+        if (res != TEE_SUCCESS)
+            return res;
+        if (slot->hash <= KV_SLOT_DELETED)
+            continue;
+
+        loc = slot->loc;
+        res = kv_read(kv_loc_seg(loc), kv_loc_off(loc), kv.buf, sizeof(rec));
+        if (res != TEE_SUCCESS)
+            return res;
+        TEE_MemMove(&rec, kv.buf, sizeof(rec));
+
+        len = sizeof(rec) + rec.key_len + rec.value_len;
+        res = kv_read(kv_loc_seg(loc), kv_loc_off(loc), kv.buf, len);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        if (rec.key_len < prefix_len || TEE_MemCompare(kv.buf + sizeof(rec), prefix, prefix_len) != 0)
+            continue;
+
+        len = sizeof(entry) + rec.key_len + rec.value_len;
+        if (out_size - out_len < len) {
+            if (!count) {
+                params[2].memref.size = len;
+                return TEE_ERROR_SHORT_BUFFER;
+            }
+            break;
+        }
+
+        entry.key_len = rec.key_len;
+        entry.value_len = rec.value_len;
+        TEE_MemMove(out + out_len, &entry, sizeof(entry));
+        TEE_MemMove(out + out_len + sizeof(entry), kv.buf + sizeof(rec), rec.key_len + rec.value_len);
+        out_len += len;
+        count++;
+    }
+
+    params[1].value.a = i < kv.idx.capacity ? i : SECURE_STORAGE_KV_SCAN_END;
+    params[1].value.b = count;
+    params[2].memref.size = out_len;
+
+    return TEE_SUCCESS;
+}
+
+TEE_Result kv_compact(uint32_t param_type, TEE_Param params[4])
+{
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE,
+                                                TEE_PARAM_TYPE_NONE,
+                                                TEE_PARAM_TYPE_NONE);
+    uint32_t total = 0, segments;
+    TEE_Result res;
+
+    if (param_type != exp_param_type)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = kv_load();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 已经开始的段要处理完, 之后直到垃圾低于阈值
+    while (kv.compacting || kv_need_compact()) {
+        res = kv_compact_step(KV_SEGMENT_SIZE, &segments);
+        if (res != TEE_SUCCESS) {
+            EMSG("KV compaction failed, res is 0x%x\n\n", res);
+            return res;
+        }
+        total += segments;
+    }
+
+    params[0].value.a = total;
+    params[0].value.b = 0;
+
+    return TEE_SUCCESS;
+}
+
+TEE_Result kv_stats(uint32_t param_type, TEE_Param params[4])
+{
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+                                                TEE_PARAM_TYPE_VALUE_OUTPUT,
+                                                TEE_PARAM_TYPE_VALUE_OUTPUT,
+                                                TEE_PARAM_TYPE_NONE);
+    TEE_Result res;
+
+    if (param_type != exp_param_type)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = kv_load();
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 字节数是64位的, 分成低32位和高32位
+    params[0].value.a = kv.idx.count;
+    params[0].value.b = kv.meta.next - kv.meta.first;
+    params[1].value.a = (uint32_t)kv.idx.live_bytes;
+    params[1].value.b = (uint32_t)(kv.idx.live_bytes >> 32);
+    params[2].value.a = (uint32_t)kv.log_bytes;
+    params[2].value.b = (uint32_t)(kv.log_bytes >> 32);
+
+    return TEE_SUCCESS;
+}
+/**********************************KV Operation**********************************/
@@ -0,0 +1,19 @@
+#ifndef _KV_STORE_H
+#define _KV_STORE_H
+
+#include <tee_internal_api.h>
+
+/*
+ * KV 模式的命令处理函数, 参数说明见 include/secure_storage.h
+ * 日志和索引为TA全局数据, 所有会话共享
+ */
+TEE_Result kv_put(uint32_t param_type, TEE_Param params[4]);
+TEE_Result kv_get(uint32_t param_type, TEE_Param params[4]);
+TEE_Result kv_delete(uint32_t param_type, TEE_Param params[4]);
+TEE_Result kv_scan(uint32_t param_type, TEE_Param params[4]);
+TEE_Result kv_compact(uint32_t param_type, TEE_Param params[4]);
+TEE_Result kv_stats(uint32_t param_type, TEE_Param params[4]);
+
+void kv_release(void);
+
+#endif /* _KV_STORE_H */
@@ -0,0 +1,170 @@
+#include <tee_internal_api.h>
+
+#include "lz77.h"
+
+#define LZ77_MIN_MATCH          4
+#define LZ77_MAX_OFFSET         0xFFFF
+
+static uint32_t read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t lz77_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ77_HASH_BITS);
+}
+
+// 写 token 之后的长度扩展字节
+static bool put_length(uint8_t *dst, uint32_t dst_cap, uint32_t *op, uint32_t len)
+{
+    while (len >= 255) {
+        if (*op >= dst_cap)
+            return false;
+        dst[(*op)++] = 255;
+        len -= 255;
+    }
+    if (*op >= dst_cap)
+        return false;
+    dst[(*op)++] = len;
+    return true;
+}
+
+// 输出一个序列, match_len 为 0 表示最后一个只有字面量的序列
+static bool put_sequence(uint8_t *dst, uint32_t dst_cap, uint32_t *op,
+                         const uint8_t *lit, uint32_t lit_len,
+                         uint32_t offset, uint32_t match_len)
+{
+    uint32_t ml = match_len ? match_len - LZ77_MIN_MATCH : 0;
+
+    if (*op >= dst_cap)
+        return false;
+    dst[(*op)++] = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+
+    if (lit_len >= 15 && !put_length(dst, dst_cap, op, lit_len - 15))
+        return false;
+
+    if (dst_cap - *op < lit_len)
+        return false;
+    TEE_MemMove(dst + *op, lit, lit_len);
+    *op += lit_len;
+
+    if (!match_len)
+        return true;
+
+    if (dst_cap - *op < 2)
+        return false;
+    dst[(*op)++] = offset & 0xFF;
+    dst[(*op)++] = offset >> 8;
+
+    if (ml >= 15 && !put_length(dst, dst_cap, op, ml - 15))
+        return false;
+
+    return true;
+}
+
+uint32_t lz77_compress(const uint8_t *src, uint32_t src_len,
+                       uint8_t *dst, uint32_t dst_cap, uint32_t *table)
+{
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+    uint32_t op = 0;
+
+    // 表中存 位置 + 1, 0 表示空
+    TEE_MemFill(table, 0, LZ77_HASH_SIZE * sizeof(uint32_t));
+
+    while (src_len >= LZ77_MIN_MATCH && ip <= src_len - LZ77_MIN_MATCH) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = lz77_hash(seq);
+        uint32_t cand = table[h];
+
+        table[h] = ip + 1;
+
+        if (!cand || ip - (cand - 1) > LZ77_MAX_OFFSET || read32(src + cand - 1) != seq) {
+            ip++;
+            continue;
+        }
+
+        uint32_t ref = cand - 1;
+        uint32_t len = LZ77_MIN_MATCH;
+        while (ip + len < src_len && src[ref + len] == src[ip + len])
+            len++;
+
+        if (!put_sequence(dst, dst_cap, &op, src + anchor, ip - anchor, ip - ref, len))
+            return 0;
+
+        ip += len;
+        anchor = ip;
+    }
+
+    if (!put_sequence(dst, dst_cap, &op, src + anchor, src_len - anchor, 0, 0))
+        return 0;
+
+    return op;
+}
+
+// 读长度扩展字节, 累加到 len
+static bool get_length(const uint8_t *src, uint32_t src_len, uint32_t *ip, uint32_t *len)
+{
+    uint8_t b;
+
+    do {
+        if (*ip >= src_len)
+            return false;
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+
+    return true;
+}
+
+TEE_Result lz77_decompress(const uint8_t *src, uint32_t src_len,
+                           uint8_t *dst, uint32_t dst_len)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    while (ip < src_len) {
+        uint8_t token = src[ip++];
+
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15 && !get_length(src, src_len, &ip, &lit_len))
+            return TEE_ERROR_CORRUPT_OBJECT;
+
+        if (lit_len > src_len - ip || lit_len > dst_len - op)
+            return TEE_ERROR_CORRUPT_OBJECT;
+        TEE_MemMove(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        // 最后一个序列没有偏移
+        if (ip == src_len)
+            break;
+
+        if (src_len - ip < 2)
+            return TEE_ERROR_CORRUPT_OBJECT;
+        uint32_t offset = src[ip] | src[ip + 1] << 8;
+        ip += 2;
+        if (!offset || offset > op)
+            return TEE_ERROR_CORRUPT_OBJECT;
+
+        uint32_t match_len = token & 0x0F;
+        if (match_len == 15 && !get_length(src, src_len, &ip, &match_len))
+            return TEE_ERROR_CORRUPT_OBJECT;
+        match_len += LZ77_MIN_MATCH;
+
+        if (match_len > dst_len - op)
+            return TEE_ERROR_CORRUPT_OBJECT;
+
+        // 匹配可能和输出重叠(偏移小于长度), 逐字节复制
+        const uint8_t *ref = dst + op - offset;
+        for (uint32_t i = 0; i < match_len; i++)
+            dst[op + i] = ref[i];
+        op += match_len;
+    }
+
+    if (op != dst_len)
+        return TEE_ERROR_CORRUPT_OBJECT;
+
+    return TEE_SUCCESS;
+}
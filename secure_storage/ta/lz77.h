@@ -0,0 +1,34 @@
+#ifndef _LZ77_H
+#define _LZ77_H
+
+#include <tee_internal_api.h>
+
+/*
+ * LZ4 块格式的简化版本(LZ77, 窗口 64KB), 不依赖外部库, 只用调用者给的缓冲区
+ * 哈希表只有 1024 项(4KB), 用于压缩 4KB 左右的小块
+ *
+ * 序列 : token | 字面量长度扩展 | 字面量 | 偏移(2字节, 小端) | 匹配长度扩展
+ * token 高4位是字面量长度, 低4位是匹配长度 - 4, 等于15时后面跟扩展字节(每个255累加, 直到小于255)
+ * 最后一个序列只有字面量, 没有偏移
+ */
+#define LZ77_HASH_BITS          10
+#define LZ77_HASH_SIZE          (1 << LZ77_HASH_BITS)
+
+/* 最坏情况(完全不可压缩)下的输出大小 */
+#define LZ77_COMPRESS_BOUND(n)  ((n) + (n) / 255 + 16)
+
+/*
+ * 压缩 src, table 为 LZ77_HASH_SIZE 个 uint32_t 的工作区
+ * 返回输出的字节数, dst 放不下时返回 0
+ */
+uint32_t lz77_compress(const uint8_t *src, uint32_t src_len,
+                       uint8_t *dst, uint32_t dst_cap, uint32_t *table);
+
+/*
+ * 解压到 dst, 输出必须正好是 dst_len 字节
+ * 输入损坏(越界的长度或偏移)时返回 TEE_ERROR_CORRUPT_OBJECT
+ */
+TEE_Result lz77_decompress(const uint8_t *src, uint32_t src_len,
+                           uint8_t *dst, uint32_t dst_len);
+
+#endif /* _LZ77_H */
@@ -2,12 +2,64 @@
 #include <tee_internal_api_extensions.h>
 
 #include "include/secure_storage.h"
+#include "kv_store.h"
+#include "lz77.h"
+
+/*
+ * 每个会话的句柄表, OPEN 返回句柄, READ/WRITE/SEEK/CLOSE 通过句柄访问对象,
+ * 交替访问多个对象时不再需要反复打开关闭
+ *
+ * 句柄值 = 代数 << HANDLE_SLOT_BITS | 槽位, 槽位被释放或被LRU回收后代数加一, 旧句柄随之失效
+ */
+#define HANDLE_SLOT_BITS        4
+#define HANDLE_SLOT_MASK        ((1 << HANDLE_SLOT_BITS) - 1)
 
-struct secure_storage_ctx {
-    TEE_ObjectHandle persistant_object;
-    TEE_ObjectEnumHandle enum_handle;
+struct obj_handle {
+    TEE_ObjectHandle object;
     uint8_t *obj_id;
     uint32_t obj_len;
+    uint32_t gen;
+    uint32_t last_use;
+    uint8_t *journal;       // APPEND 的缓冲区, 第一次 APPEND 时申请
+    uint32_t journal_len;
+    uint32_t journal_since; // 缓冲区中最早一条记录的时间, 毫秒
+};
+
+/*
+ * APPEND 的记录先攒在句柄的缓冲区中, 以下情况一次写到对象末尾 :
+ * 缓冲区放不下新记录, 最早的记录超过 JOURNAL_MAX_AGE_MS, 带 SECURE_STORAGE_APPEND_SYNC,
+ * FLUSH/CLOSE, 或者其他命令要访问这个对象
+ * TA没有定时器, 超时只在下一次 APPEND 时检查, 没有写出的记录在TA崩溃或掉电时丢失
+ * 每个句柄一个缓冲区, 大小和 REE FS 的块一致, 一个会话最多 SECURE_STORAGE_MAX_HANDLES 个
+ */
+#define JOURNAL_SIZE            (4 * 1024)
+#define JOURNAL_MAX_AGE_MS      1000
+
+/*
+ * 读写数据时经过会话中固定大小的缓冲区分块拷贝, 不再按数据大小申请堆内存,
+ * 大小与 REE FS 的块大小一致, 对象可以大于 TA_DATA_SIZE
+ */
+#define IO_CHUNK_SIZE           4096
+
+/*
+ * LIST 的枚举状态, 枚举器在两页之间保留在会话中,
+ * 放不进上一页的对象暂存在 list_id/list_info, 作为下一页的第一项
+ */
+struct list_state {
+    uint32_t cursor;        // 已经返回的对象数, 下一页的游标
+    bool pending;
+    TEE_ObjectInfo info;
+    uint32_t id_len;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+};
+
+struct secure_storage_ctx {
+    uint32_t storage_id;    // 打开会话时选择, 默认 TEE_STORAGE_PRIVATE
+    struct obj_handle handles[SECURE_STORAGE_MAX_HANDLES];
+    uint32_t lru_clock;
+    TEE_ObjectEnumHandle enum_handle;
+    struct list_state list;
+    uint8_t *io_buf;
 };
 
 static void free_enum_handle(struct secure_storage_ctx *ctx)
@@ -18,165 +70,1659 @@ static void free_enum_handle(struct secure_storage_ctx *ctx)
     }
 }
 
-static void close_persistent_object(struct secure_storage_ctx *ctx)
+static uint32_t journal_now_ms(void)
+{
+    TEE_Time t;
+
+    TEE_GetSystemTime(&t);
+    return t.seconds * 1000 + t.millis;
+}
+
+static void read_cache_invalidate(const uint8_t *obj_id, uint32_t obj_id_len);
+
+// 缓冲的记录追加到对象末尾, 句柄的读写位置不变
+static TEE_Result journal_flush(struct obj_handle *h)
+{
+    TEE_ObjectInfo info;
+    TEE_Result res;
+
+    if (!h->journal_len)
+        return TEE_SUCCESS;
+
+    res = TEE_GetObjectInfo1(h->object, &info);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_SeekObjectData(h->object, 0, TEE_DATA_SEEK_END);
+    if (res == TEE_SUCCESS)
+        res = TEE_WriteObjectData(h->object, h->journal, h->journal_len);
+    TEE_SeekObjectData(h->object, info.dataPosition, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to flush journal, res is 0x%x\n\n", res);
+        return res;
+    }
+
+    // 排队到写出之间其他会话的 GET_ALL 可能又缓存了旧内容
+    read_cache_invalidate(h->obj_id, h->obj_len);
+    h->journal_len = 0;
+
+    return TEE_SUCCESS;
+}
+
+static void release_handle(struct obj_handle *h)
+{
+    if(h->journal) {
+        // 能保住记录的调用者(CLOSE, LRU回收)已经先写出过, 走到这里失败只能丢弃
+        if(h->object != TEE_HANDLE_NULL && journal_flush(h) != TEE_SUCCESS)
+            EMSG("%u appended bytes are lost\n\n", h->journal_len);
+        TEE_Free(h->journal);
+        h->journal = NULL;
+        h->journal_len = 0;
+    }
+
+    if(h->object != TEE_HANDLE_NULL) {
+        TEE_CloseObject(h->object);
+        h->object = TEE_HANDLE_NULL;
+    }
+
+    if(h->obj_id) {
+        TEE_Free(h->obj_id);
+        h->obj_id = NULL;
+    }
+    h->obj_len = 0;
+
+    h->gen = (h->gen + 1) & (UINT32_MAX >> HANDLE_SLOT_BITS);
+    if(!h->gen)
+        h->gen = 1;
+}
+
+static void release_all_handles(struct secure_storage_ctx *ctx)
+{
+    for(uint32_t i = 0; i < SECURE_STORAGE_MAX_HANDLES; i++) {
+        if(ctx->handles[i].object != TEE_HANDLE_NULL)
+            release_handle(&ctx->handles[i]);
+    }
+}
+
+static void touch_handle(struct secure_storage_ctx *ctx, struct obj_handle *h)
+{
+    h->last_use = ++ctx->lru_clock;
+}
+
+static uint32_t handle_value(struct secure_storage_ctx *ctx, struct obj_handle *h)
+{
+    return (h->gen << HANDLE_SLOT_BITS) | (uint32_t)(h - ctx->handles);
+}
+
+static struct obj_handle *lookup_handle(struct secure_storage_ctx *ctx, uint32_t value)
+{
+    uint32_t slot = value & HANDLE_SLOT_MASK;
+    struct obj_handle *h;
+
+    if(slot >= SECURE_STORAGE_MAX_HANDLES)
+        return NULL;
+
+    h = &ctx->handles[slot];
+    if(h->object == TEE_HANDLE_NULL || h->gen != value >> HANDLE_SLOT_BITS)
+        return NULL;
+
+    touch_handle(ctx, h);
+
+    return h;
+}
+
+static struct obj_handle *find_handle(struct secure_storage_ctx *ctx, const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    for(uint32_t i = 0; i < SECURE_STORAGE_MAX_HANDLES; i++) {
+        struct obj_handle *h = &ctx->handles[i];
+
+        if(h->object != TEE_HANDLE_NULL && h->obj_len == obj_id_len &&
+            TEE_MemCompare(h->obj_id, obj_id, obj_id_len) == 0)
+            return h;
+    }
+
+    return NULL;
+}
+
+// 取一个空槽位, 表满时关闭最久未使用的句柄, 它缓冲的记录写不出去时保留该句柄并返回错误
+static TEE_Result alloc_handle(struct secure_storage_ctx *ctx, struct obj_handle **out)
+{
+    struct obj_handle *lru = NULL;
+    TEE_Result res;
+
+    for(uint32_t i = 0; i < SECURE_STORAGE_MAX_HANDLES; i++) {
+        struct obj_handle *h = &ctx->handles[i];
+
+        if(h->object == TEE_HANDLE_NULL) {
+            *out = h;
+            return TEE_SUCCESS;
+        }
+        if(!lru || h->last_use < lru->last_use)
+            lru = h;
+    }
+
+    res = journal_flush(lru);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    IMSG("handle 0x%x is closed by LRU\n\n", handle_value(ctx, lru));
+    release_handle(lru);
+
+    *out = lru;
+    return TEE_SUCCESS;
+}
+
+static TEE_Result set_handle_id(struct obj_handle *h, const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    uint8_t *new_obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
+    if(!new_obj_id) {
+        EMSG("Out of memory\n\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+    TEE_MemMove(new_obj_id, obj_id, obj_id_len);
+
+    TEE_Free(h->obj_id);
+    h->obj_id = new_obj_id;
+    h->obj_len = obj_id_len;
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * 对象目录: 所有对象ID的哈希值组成的开放寻址哈希表, 以元数据对象的形式保存在安全存储中,
+ * 判断对象是否存在时不再需要枚举全部对象
+ *
+ * 目录始终是实际对象集合的超集 : 创建/重命名时先登记新ID再操作对象, 删除/重命名时操作成功后才注销旧ID,
+ * 中途掉电最多留下多余的条目, 因此目录中查不到的对象一定不存在, 查到的再用 TEE_OpenPersistentObject 确认一次
+ *
+ * 目录在所有会话间共享(单实例TA), 第一次使用时加载, 不存在时枚举一次已有对象重建
+ *
+ * 槽位表整个放在TA堆中, 最多 OBJ_DIR_MAX_SLOTS 个槽位(16KB, 扩容时新旧两张表共 24KB), 按 3/4 负载
+ * 最多登记 3072 个对象, 超过后目录停用, 退回到逐个探测, DIR_STATS 可以查询目录是否在用
+ */
+#define OBJ_DIR_MAGIC           0x52445353  // "SSDR"
+#define OBJ_DIR_MIN_SLOTS       256
+#define OBJ_DIR_MAX_SLOTS       4096
+#define OBJ_DIR_SLOT_EMPTY      0
+#define OBJ_DIR_SLOT_DELETED    1
+
+// 保留给目录自身的对象ID, 以 0 开头, 客户端的对象名是字符串, 不会与之冲突
+static const uint8_t obj_dir_id[] = "\0secure_storage.dir";
+#define OBJ_DIR_ID_LEN          (sizeof(obj_dir_id) - 1)
+
+struct obj_dir_header {
+    uint32_t magic;
+    uint32_t capacity;      // 槽位数, 2的幂
+    uint32_t count;         // 有效条目数
+    uint32_t used;          // 有效条目 + 删除标记
+};
+
+enum obj_dir_state {
+    OBJ_DIR_UNLOADED,
+    OBJ_DIR_READY,
+    OBJ_DIR_DISABLED,       // 目录不可用, 只用 TEE_OpenPersistentObject 探测
+};
+
+static struct {
+    enum obj_dir_state state;
+    struct obj_dir_header hdr;
+    uint32_t *slots;
+    TEE_ObjectHandle object;
+} obj_dir;
+
+static bool is_obj_dir_id(const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    return obj_id_len == OBJ_DIR_ID_LEN && TEE_MemCompare(obj_id, obj_dir_id, OBJ_DIR_ID_LEN) == 0;
+}
+
+// 客户端传入的对象ID检查, 不允许访问目录对象
+static TEE_Result check_obj_id(const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    if (!obj_id_len || obj_id_len > TEE_OBJECT_ID_MAX_LEN) {
+        EMSG("object id length %u error\n\n", obj_id_len);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 以 0 开头的ID留给TA内部使用(对象目录, 批量事务)
+    if (obj_id[0] == 0) {
+        EMSG("object id is reserved\n\n");
+        return TEE_ERROR_ACCESS_DENIED;
+    }
+
+    return TEE_SUCCESS;
+}
+
+// FNV-1a, 0 和 1 作为空槽和删除标记
+static uint32_t obj_dir_hash(const uint8_t *obj_id, uint32_t obj_id_len)
 {
-    if(ctx->persistant_object != TEE_HANDLE_NULL) {
-        TEE_CloseObject(ctx->persistant_object);
-        ctx->persistant_object = TEE_HANDLE_NULL;
+    uint32_t hash = 0x811c9dc5;
+
+    for (uint32_t i = 0; i < obj_id_len; i++) {
+        hash ^= obj_id[i];
+        hash *= 0x01000193;
     }
+
+    if (hash <= OBJ_DIR_SLOT_DELETED)
+        hash += 2;
+
+    return hash;
 }
 
-static void free_ctx_obj(struct secure_storage_ctx *ctx)
+// 同一个哈希值可以登记多次(哈希冲突的不同对象), 删除时只去掉其中一个
+static uint32_t obj_dir_find(uint32_t hash)
 {
-    if(ctx->obj_id) {
-        TEE_Free(ctx->obj_id);
-        ctx->obj_id = NULL;
+    uint32_t mask = obj_dir.hdr.capacity - 1;
+    uint32_t idx = hash & mask;
+
+    for (uint32_t i = 0; i < obj_dir.hdr.capacity; i++) {
+        if (obj_dir.slots[idx] == hash)
+            return idx;
+        if (obj_dir.slots[idx] == OBJ_DIR_SLOT_EMPTY)
+            break;
+        idx = (idx + 1) & mask;
     }
-    ctx->obj_len = 0;
+
+    return obj_dir.hdr.capacity;
 }
 
-static bool check_obj_correct(struct secure_storage_ctx *ctx, uint8_t *obj_id, uint32_t obj_id_len)
+static uint32_t obj_dir_slot_insert(uint32_t *slots, uint32_t capacity, uint32_t hash)
 {
-    if(!obj_id || !ctx->obj_id || !ctx->obj_len)
-        return false;
+    uint32_t mask = capacity - 1;
+    uint32_t idx = hash & mask;
 
-    return (ctx->obj_len == obj_id_len) && (TEE_MemCompare(ctx->obj_id, obj_id, ctx->obj_len) == 0);
+    while (slots[idx] != OBJ_DIR_SLOT_EMPTY && slots[idx] != OBJ_DIR_SLOT_DELETED)
+        idx = (idx + 1) & mask;
+
+    slots[idx] = hash;
+
+    return idx;
+}
+
+static TEE_Result obj_dir_write(uint32_t offset, const void *buf, uint32_t len)
+{
+    TEE_Result res;
+
+    res = TEE_SeekObjectData(obj_dir.object, offset, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    return TEE_WriteObjectData(obj_dir.object, buf, len);
 }
 
-static TEE_Result check_object_exists(struct secure_storage_ctx *ctx, uint8_t *obj_id, uint32_t obj_id_len)
+static TEE_Result obj_dir_save_all(void)
 {
     TEE_Result res;
 
-    res = TEE_StartPersistentObjectEnumerator(ctx->enum_handle, TEE_STORAGE_PRIVATE);
-    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+    res = TEE_TruncateObjectData(obj_dir.object, sizeof(obj_dir.hdr) + obj_dir.hdr.capacity * sizeof(uint32_t));
+    if (res != TEE_SUCCESS)
         return res;
-    } else if((res == TEE_ERROR_CORRUPT_OBJECT) || (res == TEE_ERROR_CORRUPT_OBJECT_2)) {
-        EMSG("the storage is corrupt, res is 0x%x\n\n", res);
+
+    res = obj_dir_write(sizeof(obj_dir.hdr), obj_dir.slots, obj_dir.hdr.capacity * sizeof(uint32_t));
+    if (res != TEE_SUCCESS)
         return res;
-    } else if (res == TEE_ERROR_STORAGE_NOT_AVAILABLE) {
-        EMSG("the object is not avaliable\n\n");
+
+    return obj_dir_write(0, &obj_dir.hdr, sizeof(obj_dir.hdr));
+}
+
+// 只写回变化的槽位和头部, 每次登记/注销的写入量与对象数量无关
+static TEE_Result obj_dir_save_slot(uint32_t idx)
+{
+    TEE_Result res;
+
+    res = obj_dir_write(sizeof(obj_dir.hdr) + idx * sizeof(uint32_t), &obj_dir.slots[idx], sizeof(uint32_t));
+    if (res != TEE_SUCCESS)
         return res;
+
+    return obj_dir_write(0, &obj_dir.hdr, sizeof(obj_dir.hdr));
+}
+
+static void obj_dir_release(void)
+{
+    if (obj_dir.object != TEE_HANDLE_NULL) {
+        TEE_CloseObject(obj_dir.object);
+        obj_dir.object = TEE_HANDLE_NULL;
     }
 
-    TEE_ObjectInfo tmp_info;
-    uint8_t tmp_obj_id[256];
-    uint32_t tmp_obj_id_len;
+    if (obj_dir.slots) {
+        TEE_Free(obj_dir.slots);
+        obj_dir.slots = NULL;
+    }
+}
 
-    while (true) {
-        tmp_obj_id_len = sizeof(tmp_obj_id);
+/*
+ * 目录写回失败后不能再保证是超集, 删掉目录对象让下次加载时重建, 本实例退回到逐个探测
+ */
+static void obj_dir_disable(TEE_Result res)
+{
+    EMSG("object directory disabled, res is 0x%x\n\n", res);
 
-        res = TEE_GetNextPersistentObject(ctx->enum_handle, &tmp_info, tmp_obj_id, &tmp_obj_id_len);
+    if (obj_dir.object != TEE_HANDLE_NULL) {
+        TEE_CloseAndDeletePersistentObject1(obj_dir.object);
+        obj_dir.object = TEE_HANDLE_NULL;
+    }
 
-        if (res == TEE_SUCCESS) {
-            if (obj_id_len == tmp_obj_id_len && TEE_MemCompare(tmp_obj_id, obj_id, obj_id_len) == 0) {
-                IMSG("object is already existed\n\n");
-                return res;
-            }
-        } else if (res == TEE_ERROR_ITEM_NOT_FOUND) {
-            return res;
-        } else if (res == TEE_ERROR_CORRUPT_OBJECT || res == TEE_ERROR_CORRUPT_OBJECT_2) {
+    obj_dir_release();
+    obj_dir.state = OBJ_DIR_DISABLED;
+}
+
+static TEE_Result obj_dir_resize(uint32_t capacity)
+{
+    uint32_t *slots = TEE_Malloc(capacity * sizeof(uint32_t), TEE_MALLOC_FILL_ZERO);
+    if (!slots)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    for (uint32_t i = 0; i < obj_dir.hdr.capacity; i++) {
+        if (obj_dir.slots[i] > OBJ_DIR_SLOT_DELETED)
+            obj_dir_slot_insert(slots, capacity, obj_dir.slots[i]);
+    }
+
+    TEE_Free(obj_dir.slots);
+    obj_dir.slots = slots;
+    obj_dir.hdr.capacity = capacity;
+    obj_dir.hdr.used = obj_dir.hdr.count;
+
+    return obj_dir_save_all();
+}
+
+/*
+ * 会话可以选择不同的存储(TEE_STORAGE_PRIVATE_REE/RPMB), 目录登记所有存储中的对象,
+ * 同一个名字在两个存储中各有一个对象时登记两次; TEE_STORAGE_PRIVATE 是其中之一的别名,
+ * 重建时同一个对象会被枚举两次, 只是多一个条目
+ */
+static const uint32_t obj_dir_storages[] = {
+    TEE_STORAGE_PRIVATE,
+    TEE_STORAGE_PRIVATE_REE,
+    TEE_STORAGE_PRIVATE_RPMB,
+};
+
+static TEE_Result obj_dir_rebuild_storage(TEE_ObjectEnumHandle enum_handle, uint32_t storage_id)
+{
+    TEE_ObjectInfo info;
+    uint8_t id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t id_len;
+    TEE_Result res;
+
+    // 没有配置的存储返回 TEE_ERROR_ITEM_NOT_FOUND, 与空存储一样
+    res = TEE_StartPersistentObjectEnumerator(enum_handle, storage_id);
+    while (res == TEE_SUCCESS) {
+        id_len = sizeof(id);
+        res = TEE_GetNextPersistentObject(enum_handle, &info, id, &id_len);
+        if (res == TEE_ERROR_CORRUPT_OBJECT || res == TEE_ERROR_CORRUPT_OBJECT_2) {
             EMSG("there is a corrupt object\n\n");
-            continue;;
-        } else if (res == TEE_ERROR_STORAGE_NOT_AVAILABLE) {
-            EMSG("the object is not avaliable\n\n");
+            res = TEE_SUCCESS;
+            continue;
+        }
+        if (res != TEE_SUCCESS || is_obj_dir_id(id, id_len))
             continue;
+
+        if ((obj_dir.hdr.used + 1) * 4 > obj_dir.hdr.capacity * 3) {
+            if (obj_dir.hdr.capacity >= OBJ_DIR_MAX_SLOTS)
+                return TEE_ERROR_OUT_OF_MEMORY;
+            res = obj_dir_resize(obj_dir.hdr.capacity * 2);
+            if (res != TEE_SUCCESS)
+                return res;
         }
+
+        obj_dir_slot_insert(obj_dir.slots, obj_dir.hdr.capacity, obj_dir_hash(id, id_len));
+        obj_dir.hdr.count++;
+        obj_dir.hdr.used++;
+    }
+
+    return res == TEE_ERROR_ITEM_NOT_FOUND ? TEE_SUCCESS : res;
+}
+
+// 只在目录对象不存在或损坏时执行一次, 兼容目录出现之前创建的对象
+static TEE_Result obj_dir_rebuild(void)
+{
+    TEE_ObjectEnumHandle enum_handle;
+    TEE_Result res;
+
+    obj_dir.hdr.count = 0;
+    obj_dir.hdr.used = 0;
+    TEE_MemFill(obj_dir.slots, 0, obj_dir.hdr.capacity * sizeof(uint32_t));
+
+    res = TEE_AllocatePersistentObjectEnumerator(&enum_handle);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    for (uint32_t i = 0; i < sizeof(obj_dir_storages) / sizeof(obj_dir_storages[0]); i++) {
+        res = obj_dir_rebuild_storage(enum_handle, obj_dir_storages[i]);
+        if (res != TEE_SUCCESS)
+            break;
     }
+
+    TEE_FreePersistentObjectEnumerator(enum_handle);
+
+    if (res != TEE_SUCCESS)
+        return res;
+
+    IMSG("object directory rebuilt, %u objects\n\n", obj_dir.hdr.count);
+
+    return obj_dir_save_all();
+}
+
+static TEE_Result obj_dir_load_slots(void)
+{
+    uint32_t read_count;
+    TEE_Result res;
+
+    res = TEE_ReadObjectData(obj_dir.object, &obj_dir.hdr, sizeof(obj_dir.hdr), &read_count);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (read_count != sizeof(obj_dir.hdr) || obj_dir.hdr.magic != OBJ_DIR_MAGIC ||
+        obj_dir.hdr.capacity < OBJ_DIR_MIN_SLOTS || obj_dir.hdr.capacity > OBJ_DIR_MAX_SLOTS ||
+        (obj_dir.hdr.capacity & (obj_dir.hdr.capacity - 1)) ||
+        obj_dir.hdr.count > obj_dir.hdr.used || obj_dir.hdr.used >= obj_dir.hdr.capacity)
+        return TEE_ERROR_CORRUPT_OBJECT;
+
+    obj_dir.slots = TEE_Malloc(obj_dir.hdr.capacity * sizeof(uint32_t), TEE_MALLOC_FILL_ZERO);
+    if (!obj_dir.slots)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    res = TEE_ReadObjectData(obj_dir.object, obj_dir.slots, obj_dir.hdr.capacity * sizeof(uint32_t), &read_count);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (read_count != obj_dir.hdr.capacity * sizeof(uint32_t))
+        return TEE_ERROR_CORRUPT_OBJECT;
+
+    return TEE_SUCCESS;
 }
 
-static TEE_Result open_persistent_object(struct secure_storage_ctx *ctx, uint8_t *obj_id, uint32_t obj_id_len)
+static TEE_Result obj_dir_load(void)
 {
+    uint32_t access_flag = TEE_DATA_FLAG_ACCESS_READ |
+                            TEE_DATA_FLAG_ACCESS_WRITE |
+                            TEE_DATA_FLAG_ACCESS_WRITE_META;
     TEE_Result res;
 
-    if (ctx->persistant_object != TEE_HANDLE_NULL) {
-        if (check_obj_correct(ctx, obj_id, obj_id_len)) 
+    if (obj_dir.state == OBJ_DIR_READY)
+        return TEE_SUCCESS;
+    if (obj_dir.state == OBJ_DIR_DISABLED)
+        return TEE_ERROR_NOT_SUPPORTED;
+
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_dir_id, OBJ_DIR_ID_LEN, access_flag, &obj_dir.object);
+    if (res == TEE_SUCCESS) {
+        res = obj_dir_load_slots();
+        if (res == TEE_SUCCESS) {
+            obj_dir.state = OBJ_DIR_READY;
             return TEE_SUCCESS;
-        else 
-            close_persistent_object(ctx);
+        }
+
+        EMSG("object directory is broken, res is 0x%x, rebuild it\n\n", res);
+        obj_dir_release();
+        res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, obj_dir_id, OBJ_DIR_ID_LEN,
+                                        access_flag | TEE_DATA_FLAG_OVERWRITE,
+                                        TEE_HANDLE_NULL, NULL, 0, &obj_dir.object);
+    } else if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, obj_dir_id, OBJ_DIR_ID_LEN, access_flag,
+                                        TEE_HANDLE_NULL, NULL, 0, &obj_dir.object);
+    }
+    if (res != TEE_SUCCESS)
+        goto err;
+
+    obj_dir.hdr.magic = OBJ_DIR_MAGIC;
+    obj_dir.hdr.capacity = OBJ_DIR_MIN_SLOTS;
+    obj_dir.slots = TEE_Malloc(OBJ_DIR_MIN_SLOTS * sizeof(uint32_t), TEE_MALLOC_FILL_ZERO);
+    if (!obj_dir.slots) {
+        res = TEE_ERROR_OUT_OF_MEMORY;
+        goto err;
+    }
+
+    res = obj_dir_rebuild();
+    if (res != TEE_SUCCESS)
+        goto err;
+
+    obj_dir.state = OBJ_DIR_READY;
+
+    return TEE_SUCCESS;
+
+err:
+    obj_dir_disable(res);
+
+    return res;
+}
+
+// 登记一个对象ID, 在创建对象之前调用
+static void obj_dir_add(const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    TEE_Result res;
+    uint32_t idx;
+
+    if (obj_dir_load() != TEE_SUCCESS)
+        return;
+
+    // 负载超过 3/4 时扩容, 删除标记太多时原大小重建
+    if ((obj_dir.hdr.used + 1) * 4 > obj_dir.hdr.capacity * 3) {
+        uint32_t capacity = obj_dir.hdr.capacity;
+
+        if ((obj_dir.hdr.count + 1) * 2 > capacity)
+            capacity *= 2;
+        if (capacity > OBJ_DIR_MAX_SLOTS) {
+            obj_dir_disable(TEE_ERROR_OUT_OF_MEMORY);
+            return;
+        }
+
+        res = obj_dir_resize(capacity);
+        if (res != TEE_SUCCESS) {
+            obj_dir_disable(res);
+            return;
+        }
+    }
+
+    idx = obj_dir_slot_insert(obj_dir.slots, obj_dir.hdr.capacity, obj_dir_hash(obj_id, obj_id_len));
+    obj_dir.hdr.count++;
+    obj_dir.hdr.used++;
+
+    res = obj_dir_save_slot(idx);
+    if (res != TEE_SUCCESS)
+        obj_dir_disable(res);
+}
+
+// 注销一个对象ID, 在对象删除/重命名成功之后调用, 写回失败只会留下多余的条目
+static void obj_dir_remove(const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    uint32_t idx;
+
+    if (obj_dir.state != OBJ_DIR_READY)
+        return;
+
+    idx = obj_dir_find(obj_dir_hash(obj_id, obj_id_len));
+    if (idx == obj_dir.hdr.capacity)
+        return;
+
+    obj_dir.slots[idx] = OBJ_DIR_SLOT_DELETED;
+    obj_dir.hdr.count--;
+
+    obj_dir_save_slot(idx);
+}
+
+/*
+ * 直接用 TEE_OpenPersistentObject 探测对象是否存在, 不需要读写权限
+ * 对象已被其他句柄独占打开时返回 TEE_ERROR_ACCESS_CONFLICT, 同样说明对象存在
+ */
+static TEE_Result probe_object(uint32_t storage_id, const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    TEE_ObjectHandle object;
+    TEE_Result res;
+
+    res = TEE_OpenPersistentObject(storage_id, obj_id, obj_id_len,
+                                    TEE_DATA_FLAG_SHARE_READ | TEE_DATA_FLAG_SHARE_WRITE, &object);
+    if (res == TEE_SUCCESS) {
+        TEE_CloseObject(object);
+        return TEE_SUCCESS;
+    }
+
+    if (res == TEE_ERROR_ACCESS_CONFLICT)
+        return TEE_SUCCESS;
+
+    return res;
+}
+
+static TEE_Result check_object_exists(uint32_t storage_id, const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    if (obj_dir_load() == TEE_SUCCESS && obj_dir_find(obj_dir_hash(obj_id, obj_id_len)) == obj_dir.hdr.capacity)
+        return TEE_ERROR_ITEM_NOT_FOUND;
+
+    return probe_object(storage_id, obj_id, obj_id_len);
+}
+
+// 按名字取得句柄, 已经打开的直接复用
+static TEE_Result open_handle(struct secure_storage_ctx *ctx, const uint8_t *obj_id, uint32_t obj_id_len,
+                                struct obj_handle **out)
+{
+    struct obj_handle *h;
+    TEE_Result res;
+
+    res = check_obj_id(obj_id, obj_id_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    h = find_handle(ctx, obj_id, obj_id_len);
+    if (h) {
+        res = journal_flush(h);
+        if (res != TEE_SUCCESS)
+            return res;
+        touch_handle(ctx, h);
+        *out = h;
+        return TEE_SUCCESS;
+    }
+
+    res = alloc_handle(ctx, &h);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    uint32_t access_flag = TEE_DATA_FLAG_ACCESS_READ|
+                            TEE_DATA_FLAG_ACCESS_WRITE|
+                            TEE_DATA_FLAG_ACCESS_WRITE_META;
+    res = TEE_OpenPersistentObject(ctx->storage_id, obj_id, obj_id_len, access_flag, &h->object);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to obj_open object, res is 0x%x\n\n", res);
+        h->object = TEE_HANDLE_NULL;
+        return res;
+    }
+
+    res = set_handle_id(h, obj_id, obj_id_len);
+    if (res != TEE_SUCCESS) {
+        release_handle(h);
+        return res;
+    }
+
+    touch_handle(ctx, h);
+    *out = h;
+
+    return TEE_SUCCESS;
+}
+
+/*
+ * READ/WRITE/SEEK 的 param[0] 可以是 OPEN 返回的句柄(value-input), 也可以是对象名(memref-input),
+ * 传对象名时按名字查找句柄, 没有打开的先打开
+ */
+static TEE_Result param_handle(struct secure_storage_ctx *ctx, uint32_t param_type, TEE_Param params[4],
+                                struct obj_handle **out)
+{
+    uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t obj_id_len;
+
+    if (TEE_PARAM_TYPE_GET(param_type, 0) == TEE_PARAM_TYPE_VALUE_INPUT) {
+        *out = lookup_handle(ctx, params[0].value.a);
+        if (!*out) {
+            EMSG("handle 0x%x is not opened\n\n", params[0].value.a);
+            return TEE_ERROR_ITEM_NOT_FOUND;
+        }
+        return journal_flush(*out);
+    }
+
+    if (TEE_PARAM_TYPE_GET(param_type, 0) != TEE_PARAM_TYPE_MEMREF_INPUT)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    obj_id_len = params[0].memref.size;
+    if (!obj_id_len || obj_id_len > sizeof(obj_id)) {
+        EMSG("object id length %u error\n\n", obj_id_len);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
+
+    return open_handle(ctx, obj_id, obj_id_len, out);
+}
+
+static uint8_t *get_io_buf(struct secure_storage_ctx *ctx)
+{
+    if (!ctx->io_buf) {
+        ctx->io_buf = TEE_Malloc(IO_CHUNK_SIZE, TEE_MALLOC_FILL_ZERO);
+        if (!ctx->io_buf)
+            EMSG("Out of memory\n\n");
+    }
+
+    return ctx->io_buf;
+}
+
+// 共享内存先拷贝到TA内存再写入, 避免CA在写入过程中修改数据
+static TEE_Result stream_write(struct secure_storage_ctx *ctx, TEE_ObjectHandle object,
+                                const uint8_t *src, uint32_t len)
+{
+    uint8_t *buf = get_io_buf(ctx);
+    TEE_Result res;
+
+    if (!buf)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    while (len) {
+        uint32_t n = MIN(len, (uint32_t)IO_CHUNK_SIZE);
+
+        TEE_MemMove(buf, src, n);
+        res = TEE_WriteObjectData(object, buf, n);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        src += n;
+        len -= n;
+    }
+
+    return TEE_SUCCESS;
+}
+
+// 读到对象末尾时提前结束, count 为实际读出的字节数
+static TEE_Result stream_read(struct secure_storage_ctx *ctx, TEE_ObjectHandle object,
+                                uint8_t *dst, uint32_t len, uint32_t *count)
+{
+    uint8_t *buf = get_io_buf(ctx);
+    uint32_t read_count;
+    TEE_Result res;
+
+    *count = 0;
+    if (!buf)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    while (len) {
+        uint32_t n = MIN(len, (uint32_t)IO_CHUNK_SIZE);
+
+        res = TEE_ReadObjectData(object, buf, n, &read_count);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        TEE_MemMove(dst, buf, read_count);
+        dst += read_count;
+        len -= read_count;
+        *count += read_count;
+
+        if (read_count < n)
+            break;
+    }
+
+    return TEE_SUCCESS;
+}
+
+// TEE_SeekObjectData 的偏移是 int32_t, 大于 INT32_MAX 的位置分两次移动
+static TEE_Result seek_to(TEE_ObjectHandle object, uint64_t offset)
+{
+    TEE_Result res;
+
+    if (offset > TEE_DATA_MAX_POSITION)
+        return TEE_ERROR_OVERFLOW;
+
+    res = TEE_SeekObjectData(object, (int32_t)MIN(offset, (uint64_t)INT32_MAX), TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS || offset <= INT32_MAX)
+        return res;
+
+    return TEE_SeekObjectData(object, (int32_t)(offset - INT32_MAX), TEE_DATA_SEEK_CUR);
+}
+
+/*
+ * 指定偏移读写一段数据(pread/pwrite), 完成后恢复对象原来的位置,
+ * SEEK/READ/WRITE 使用的位置不受影响
+ */
+static TEE_Result positional_io(struct secure_storage_ctx *ctx, TEE_ObjectHandle object, bool write,
+                                uint64_t offset, uint8_t *buf, uint32_t len, uint32_t *count)
+{
+    TEE_ObjectInfo info;
+    TEE_Result res;
+
+    if (offset + len > (uint64_t)TEE_DATA_MAX_POSITION + 1)
+        return TEE_ERROR_OVERFLOW;
+
+    res = TEE_GetObjectInfo1(object, &info);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = seek_to(object, offset);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (write) {
+        res = stream_write(ctx, object, buf, len);
+        *count = res == TEE_SUCCESS ? len : 0;
+    } else {
+        res = stream_read(ctx, object, buf, len, count);
+    }
+
+    seek_to(object, info.dataPosition);
+
+    return res;
+}
+
+/**********************************Read Cache**********************************/
+/*
+ * 经常被 GET_ALL 读取的小对象(配置等)缓存在TA内存中, 命中时不经过 tee-supplicant 和 REE 文件系统
+ * 缓存在所有会话间共享, 总大小有上限, 满了淘汰最久未使用的对象
+ * 所有修改对象内容/名字的操作(WRITE, WRITE_AT, RENAME, DELETE, BATCH)先使对应的缓存失效
+ */
+#define READ_CACHE_MAX_ENTRIES  32
+#define READ_CACHE_MAX_BYTES    (16 * 1024)     // 占用TA堆, 和 TA_DATA_SIZE 一起调整
+#define READ_CACHE_MAX_OBJECT   (4 * 1024)      // 更大的对象不缓存
+
+struct read_cache_entry {
+    uint32_t storage_id;
+    uint8_t *obj_id;        // 与数据在同一块内存中, obj_id | data
+    uint32_t obj_len;
+    uint8_t *data;
+    uint32_t size;
+    uint32_t last_use;
+};
+
+static struct {
+    struct read_cache_entry entries[READ_CACHE_MAX_ENTRIES];
+    uint32_t bytes;
+    uint32_t clock;
+    uint32_t hits;
+    uint32_t misses;
+} read_cache;
+
+static bool read_cache_match(struct read_cache_entry *e, const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    return e->obj_id && e->obj_len == obj_id_len && TEE_MemCompare(e->obj_id, obj_id, obj_id_len) == 0;
+}
+
+static struct read_cache_entry *read_cache_find(uint32_t storage_id, const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    for (uint32_t i = 0; i < READ_CACHE_MAX_ENTRIES; i++) {
+        struct read_cache_entry *e = &read_cache.entries[i];
+
+        if (e->storage_id == storage_id && read_cache_match(e, obj_id, obj_id_len))
+            return e;
+    }
+
+    return NULL;
+}
+
+static void read_cache_drop(struct read_cache_entry *e)
+{
+    read_cache.bytes -= e->size;
+    TEE_Free(e->obj_id);
+    TEE_MemFill(e, 0, sizeof(*e));
+}
+
+// TEE_STORAGE_PRIVATE 是其他存储的别名, 不区分存储, 同名的缓存全部失效
+static void read_cache_invalidate(const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    for (uint32_t i = 0; i < READ_CACHE_MAX_ENTRIES; i++) {
+        if (read_cache_match(&read_cache.entries[i], obj_id, obj_id_len))
+            read_cache_drop(&read_cache.entries[i]);
+    }
+}
+
+static void read_cache_release(void)
+{
+    for (uint32_t i = 0; i < READ_CACHE_MAX_ENTRIES; i++) {
+        if (read_cache.entries[i].obj_id)
+            read_cache_drop(&read_cache.entries[i]);
+    }
+}
+
+// 空出一个槽位和 size 字节, 返回空槽位
+static struct read_cache_entry *read_cache_evict(uint32_t size)
+{
+    struct read_cache_entry *free_entry, *lru;
+
+    while (true) {
+        free_entry = NULL;
+        lru = NULL;
+        for (uint32_t i = 0; i < READ_CACHE_MAX_ENTRIES; i++) {
+            struct read_cache_entry *e = &read_cache.entries[i];
+
+            if (!e->obj_id) {
+                if (!free_entry)
+                    free_entry = e;
+            } else if (!lru || e->last_use < lru->last_use) {
+                lru = e;
+            }
+        }
+
+        if (free_entry && read_cache.bytes + size <= READ_CACHE_MAX_BYTES)
+            return free_entry;
+
+        read_cache_drop(lru);
+    }
+}
+
+/*
+ * 为 GET_ALL 未命中的对象准备缓存项, 数据先读到TA内存再拷贝给CA,
+ * 不能从共享内存拷回缓存, 否则CA可以在两次拷贝之间改掉其他会话看到的内容
+ */
+static struct read_cache_entry *read_cache_alloc(uint32_t storage_id, const uint8_t *obj_id, uint32_t obj_id_len,
+                                                    uint32_t size)
+{
+    struct read_cache_entry *e;
+    uint8_t *buf;
+
+    if (size > READ_CACHE_MAX_OBJECT)
+        return NULL;
+
+    buf = TEE_Malloc(obj_id_len + size, TEE_MALLOC_FILL_ZERO);
+    if (!buf)
+        return NULL;
+
+    e = read_cache_evict(size);
+    TEE_MemMove(buf, obj_id, obj_id_len);
+    e->storage_id = storage_id;
+    e->obj_id = buf;
+    e->obj_len = obj_id_len;
+    e->data = buf + obj_id_len;
+    e->size = size;
+    e->last_use = ++read_cache.clock;
+    read_cache.bytes += size;
+
+    return e;
+}
+/**********************************Read Cache**********************************/
+
+/**********************************File Operation**********************************/
+static TEE_Result obj_exists(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    TEE_Result res;
+    
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, 
+                                             TEE_PARAM_TYPE_NONE,
+                                             TEE_PARAM_TYPE_NONE,
+                                             TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error for obj_exists\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t obj_id_len = params[0].memref.size;
+    uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
+    if (!obj_id) {
+        EMSG("out of memory in obj_exists\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
+
+    res = check_obj_id(obj_id, obj_id_len);
+    if (res == TEE_SUCCESS)
+        res = check_object_exists(ctx->storage_id, obj_id, obj_id_len);
+    TEE_Free(obj_id);
+
+    if (res == TEE_SUCCESS) 
+        return TEE_SUCCESS;
+    else if (res == TEE_ERROR_ITEM_NOT_FOUND) 
+        return TEE_ERROR_ITEM_NOT_FOUND;
+    else {
+        EMSG("Error checking object existence, res: 0x%x\n", res);
+        return res;
+    }
+}
+
+/*
+ * 初始数据在创建对象时一次写入, 对象已存在时原子地覆盖, 不会留下写了一半的内容
+ * out 不为空时对象留在句柄表中, 否则创建后关闭
+ */
+// 创建对象并写入初始数据, 同名对象被原子地替换
+static TEE_Result create_object(struct secure_storage_ctx *ctx, const uint8_t *obj_id, uint32_t obj_id_len,
+                                const void *data, uint32_t size, TEE_ObjectHandle *object)
+{
+    struct obj_handle *h;
+    TEE_Result res;
+
+    read_cache_invalidate(obj_id, obj_id_len);
+
+    // 本会话打开着的同名对象先关闭, 否则覆盖时访问冲突
+    h = find_handle(ctx, obj_id, obj_id_len);
+    if (h)
+        release_handle(h);
+
+    uint32_t access_flag = TEE_DATA_FLAG_ACCESS_READ |
+                          TEE_DATA_FLAG_ACCESS_WRITE |
+                          TEE_DATA_FLAG_ACCESS_WRITE_META |
+                          TEE_DATA_FLAG_OVERWRITE;
+
+    obj_dir_add(obj_id, obj_id_len);
+    res = TEE_CreatePersistentObject(ctx->storage_id, obj_id, obj_id_len, access_flag,
+                                     TEE_HANDLE_NULL, data, size, object);
+    if (res != TEE_SUCCESS)
+        EMSG("Failed to create object with data, res is 0x%x\n\n", res);
+
+    return res;
+}
+
+static TEE_Result create_with_data(struct secure_storage_ctx *ctx, const uint8_t *obj_id, uint32_t obj_id_len,
+                                    const void *data, uint32_t size, struct obj_handle **out)
+{
+    TEE_ObjectHandle object;
+    struct obj_handle *h;
+    TEE_Result res;
+
+    res = create_object(ctx, obj_id, obj_id_len, data, size, &object);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (!out) {
+        TEE_CloseObject(object);
+        return TEE_SUCCESS;
+    }
+
+    res = alloc_handle(ctx, &h);
+    if (res != TEE_SUCCESS) {
+        TEE_CloseObject(object);
+        return res;
+    }
+    h->object = object;
+    res = set_handle_id(h, obj_id, obj_id_len);
+    if (res != TEE_SUCCESS) {
+        release_handle(h);
+        return res;
+    }
+
+    touch_handle(ctx, h);
+    *out = h;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result obj_create(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+    struct obj_handle *h;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t handle_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+                                              TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type && param_type != handle_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    uint32_t obj_id_len = params[0].memref.size;
+    uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
+    if(!obj_id) {
+        EMSG("out of memory\n\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
+
+    uint32_t obj_size = params[1].value.a;
+
+    res = check_obj_id(obj_id, obj_id_len);
+    if (res != TEE_SUCCESS)
+        goto err_free_obj_id;
+
+    res = check_object_exists(ctx->storage_id, obj_id, obj_id_len);
+    if (res == TEE_SUCCESS) {
+        // 对象已存在时不改变其大小, 只把它打开放进句柄表
+        IMSG("object is already existed\n\n");
+        res = open_handle(ctx, obj_id, obj_id_len, &h);
+        if (res == TEE_SUCCESS && param_type == handle_param_type)
+            params[2].value.a = handle_value(ctx, h);
+        goto err_free_obj_id;
+    } else if (res != TEE_ERROR_ITEM_NOT_FOUND && res != TEE_ERROR_CORRUPT_OBJECT) {
+        goto err_free_obj_id;
+    }
+
+    res = alloc_handle(ctx, &h);
+    if (res != TEE_SUCCESS)
+        goto err_free_obj_id;
+
+    uint32_t access_flag = TEE_DATA_FLAG_ACCESS_READ |
+                          TEE_DATA_FLAG_ACCESS_WRITE |
+                          TEE_DATA_FLAG_ACCESS_WRITE_META;
+
+    // 先登记再创建, 保证目录是超集
+    obj_dir_add(obj_id, obj_id_len);
+
+    res = TEE_CreatePersistentObject(ctx->storage_id,
+                                    obj_id, obj_id_len,
+                                    access_flag,
+                                    TEE_HANDLE_NULL,
+                                    NULL, 0,
+                                    &h->object);
+    if(res != TEE_SUCCESS) {
+        EMSG("Failed to obj_create object, res is 0x%x\n\n", res);
+        h->object = TEE_HANDLE_NULL;
+        obj_dir_remove(obj_id, obj_id_len);
+        goto err_free_obj_id;
+    }
+
+    IMSG("Object created success\n\n");
+
+    res = TEE_TruncateObjectData(h->object, obj_size);
+    if(res != TEE_SUCCESS) {
+        EMSG("Failed to truncate object, res is 0x%x\n\n", res);
+        goto err_close;
+    }
+
+    IMSG("set object size success\n\n");
+
+    // 新建的对象留在句柄表中, 紧接着的 OPEN 不需要再打开一次
+    h->obj_id = obj_id;
+    h->obj_len = obj_id_len;
+    touch_handle(ctx, h);
+
+    if (param_type == handle_param_type)
+        params[2].value.a = handle_value(ctx, h);
+    
+    return TEE_SUCCESS;
+
+err_close:
+   release_handle(h);
+
+err_free_obj_id:
+    TEE_Free(obj_id);
+
+    return res;
+}
+
+static TEE_Result obj_create_with_data(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+    struct obj_handle *h;
+    TEE_Result res;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t handle_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                              TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type && param_type != handle_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    uint32_t obj_id_len = params[0].memref.size;
+    if (!obj_id_len || obj_id_len > sizeof(obj_id)) {
+        EMSG("object id length %u error\n\n", obj_id_len);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
+
+    res = check_obj_id(obj_id, obj_id_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    uint32_t size = params[1].memref.size;
+    if (size > SECURE_STORAGE_CREATE_DATA_MAX_SIZE) {
+        EMSG("initial data size %u is too large\n\n", size);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 共享内存先拷贝到会话的 io_buf, 避免CA在创建过程中修改数据
+    uint8_t *data = get_io_buf(ctx);
+    if (!data)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    TEE_MemMove(data, params[1].memref.buffer, size);
+
+    res = create_with_data(ctx, obj_id, obj_id_len, data, size,
+                           param_type == handle_param_type ? &h : NULL);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    if (param_type == handle_param_type)
+        params[2].value.a = handle_value(ctx, h);
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result obj_open(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t handle_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type && param_type != handle_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    uint32_t obj_id_len = params[0].memref.size;
+    uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
+    if(!obj_id) {
+        EMSG("out of memory\n\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
+
+    res = open_handle(ctx, obj_id, obj_id_len, &h);
+    if(res != TEE_SUCCESS) {
+        goto err_free_obj_id;
+    }
+
+    if (param_type == handle_param_type)
+        params[1].value.a = handle_value(ctx, h);
+
+    TEE_Free(obj_id);
+    return TEE_SUCCESS;
+
+err_free_obj_id:
+    TEE_Free(obj_id);
+
+    return res;
+}
+
+static TEE_Result obj_rename(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+    struct obj_handle *h;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    
+    uint32_t old_obj_id_len = params[0].memref.size;
+    uint8_t *old_obj_id = TEE_Malloc(old_obj_id_len, TEE_MALLOC_FILL_ZERO);
+    if(!old_obj_id) {
+        EMSG("out of memory\n\n");
+        return TEE_ERROR_OUT_OF_MEMORY;
+    }
+    TEE_MemMove(old_obj_id, params[0].memref.buffer, old_obj_id_len);
+
+    uint32_t new_obj_id_len = params[1].memref.size;
+    uint8_t *new_obj_id = TEE_Malloc(new_obj_id_len, TEE_MALLOC_FILL_ZERO);
+    if(!new_obj_id) {
+        EMSG("out of memory\n\n");
+        res = TEE_ERROR_OUT_OF_MEMORY;
+        goto err_free_old_obj_id;
+    }
+    TEE_MemMove(new_obj_id, params[1].memref.buffer, new_obj_id_len);
+
+    res = check_obj_id(new_obj_id, new_obj_id_len);
+    if(res != TEE_SUCCESS) {
+        goto err_free_new_obj_id;
+    }
+
+    res = open_handle(ctx, old_obj_id, old_obj_id_len, &h);
+    if(res != TEE_SUCCESS) {
+        goto err_free_new_obj_id;
+    }
+
+    read_cache_invalidate(old_obj_id, old_obj_id_len);
+    obj_dir_add(new_obj_id, new_obj_id_len);
+
+    res = TEE_RenamePersistentObject(h->object, new_obj_id, new_obj_id_len);
+    if(res == TEE_ERROR_ACCESS_CONFLICT) {
+        obj_dir_remove(new_obj_id, new_obj_id_len);
+        goto err_close;
+    }else if(res != TEE_SUCCESS) {
+        EMSG("Failed to obj_rename object, res is 0x%x\n\n", res);
+        obj_dir_remove(new_obj_id, new_obj_id_len);
+        goto err_close;
+    }
+
+    obj_dir_remove(old_obj_id, old_obj_id_len);
+
+    // 句柄仍然有效, 记录的名字换成新名字
+    TEE_Free(h->obj_id);
+    h->obj_id = new_obj_id;
+    h->obj_len = new_obj_id_len;
+
+    TEE_Free(old_obj_id);
+    return TEE_SUCCESS;
+
+err_close:
+   release_handle(h);
+
+err_free_new_obj_id:
+    TEE_Free(new_obj_id);
+
+err_free_old_obj_id:
+    TEE_Free(old_obj_id);
+
+    return res;
+}
+
+static TEE_Result obj_seek(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    // param[0] 为句柄或对象名, 只比较后三个参数
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_VALUE_INPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if ((param_type & ~0xF) != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    int32_t offset = params[1].value.a;
+    TEE_Whence whence = (TEE_Whence)params[1].value.b;
+    if(whence != TEE_DATA_SEEK_SET && whence != TEE_DATA_SEEK_CUR && whence != TEE_DATA_SEEK_END) {
+        EMSG("whence error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = param_handle(ctx, param_type, params, &h);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_SeekObjectData(h->object, offset, whence);
+    if(res != TEE_SUCCESS) {
+        EMSG("Failed to obj_seek object, res is 0x%x\n\n", res);
+        return res;
+    }
+    
+    return TEE_SUCCESS;
+}
+
+static TEE_Result obj_write(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if ((param_type & ~0xF) != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = param_handle(ctx, param_type, params, &h);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    read_cache_invalidate(h->obj_id, h->obj_len);
+
+    res = stream_write(ctx, h->object, params[1].memref.buffer, params[1].memref.size);
+    if(res != TEE_SUCCESS) {
+        EMSG("Failed to obj_write object, res is 0x%x\n\n", res);
+        return res;
+    }
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result obj_append(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                              TEE_PARAM_TYPE_VALUE_INOUT, TEE_PARAM_TYPE_NONE);
+    if ((param_type & ~0xF) != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 不能用 param_handle, 它会先写出缓冲区
+    if (TEE_PARAM_TYPE_GET(param_type, 0) == TEE_PARAM_TYPE_VALUE_INPUT) {
+        h = lookup_handle(ctx, params[0].value.a);
+        if (!h) {
+            EMSG("handle 0x%x is not opened\n\n", params[0].value.a);
+            return TEE_ERROR_ITEM_NOT_FOUND;
+        }
+    } else if (TEE_PARAM_TYPE_GET(param_type, 0) == TEE_PARAM_TYPE_MEMREF_INPUT) {
+        uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+        uint32_t obj_id_len = params[0].memref.size;
+
+        if (!obj_id_len || obj_id_len > sizeof(obj_id)) {
+            EMSG("object id length %u error\n\n", obj_id_len);
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+        TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
+
+        h = find_handle(ctx, obj_id, obj_id_len);
+        if (h) {
+            touch_handle(ctx, h);
+        } else {
+            res = open_handle(ctx, obj_id, obj_id_len, &h);
+            if (res != TEE_SUCCESS)
+                return res;
+        }
+    } else {
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (!h->journal) {
+        h->journal = TEE_Malloc(JOURNAL_SIZE, 0);
+        if (!h->journal) {
+            EMSG("out of memory\n\n");
+            return TEE_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    read_cache_invalidate(h->obj_id, h->obj_len);
+
+    const uint8_t *src = params[1].memref.buffer;
+    uint32_t len = params[1].memref.size;
+
+    // 放不下整条记录时先写出已有的, 记录只在大于缓冲区时才会被拆开
+    if (len > JOURNAL_SIZE - h->journal_len) {
+        res = journal_flush(h);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    while (len) {
+        if (h->journal_len == JOURNAL_SIZE) {
+            res = journal_flush(h);
+            if (res != TEE_SUCCESS)
+                return res;
+        }
+
+        if (!h->journal_len)
+            h->journal_since = journal_now_ms();
+
+        uint32_t n = MIN(len, JOURNAL_SIZE - h->journal_len);
+        TEE_MemMove(h->journal + h->journal_len, src, n);
+        h->journal_len += n;
+        src += n;
+        len -= n;
+    }
+
+    if ((params[2].value.a & SECURE_STORAGE_APPEND_SYNC) || h->journal_len == JOURNAL_SIZE ||
+        journal_now_ms() - h->journal_since >= JOURNAL_MAX_AGE_MS) {
+        res = journal_flush(h);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    params[2].value.b = h->journal_len;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result obj_flush(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if ((param_type & ~0xF) != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 取得句柄时已经写出了缓冲的记录
+    return param_handle(ctx, param_type, params, &h);
+}
+
+static TEE_Result obj_read(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    TEE_Result res;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if ((param_type & ~0xF) != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    uint32_t access_flag = TEE_DATA_FLAG_ACCESS_READ|
-                            TEE_DATA_FLAG_ACCESS_WRITE|
-                            TEE_DATA_FLAG_ACCESS_WRITE_META;
-    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, obj_id_len, access_flag, &ctx->persistant_object);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to obj_open object, res is 0x%x\n\n", res);
+    res = param_handle(ctx, param_type, params, &h);
+    if(res != TEE_SUCCESS)
         return res;
-    }
 
-    if (ctx->obj_len < obj_id_len) {
-        uint8_t *new_obj_id = TEE_Realloc(ctx->obj_id, obj_id_len);
-        if (!new_obj_id) {
-            EMSG("Out of memory\n\n");
-            close_persistent_object(ctx);
-            return TEE_ERROR_OUT_OF_MEMORY;
-        }
-        ctx->obj_id = new_obj_id;
+    uint32_t read_count;
+    res = stream_read(ctx, h->object, params[1].memref.buffer, params[1].memref.size, &read_count);
+    if(res != TEE_SUCCESS) {
+        EMSG("Failed to obj_read object, res is 0x%x\n\n", res);
+        return res;
     }
 
-    TEE_MemMove(ctx->obj_id, obj_id, obj_id_len);
-    ctx->obj_len = obj_id_len;
+    params[1].memref.size = read_count;
 
     return TEE_SUCCESS;
 }
 
-/**********************************File Operation**********************************/
-static TEE_Result obj_exists(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static TEE_Result obj_get_all(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
     struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    struct read_cache_entry *entry = NULL;
+    struct obj_handle *h;
     TEE_Result res;
-    
-    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, 
-                                             TEE_PARAM_TYPE_NONE,
-                                             TEE_PARAM_TYPE_NONE,
-                                             TEE_PARAM_TYPE_NONE);
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(
+        TEE_PARAM_TYPE_MEMREF_INPUT,
+        TEE_PARAM_TYPE_MEMREF_OUTPUT,
+        TEE_PARAM_TYPE_NONE,
+        TEE_PARAM_TYPE_NONE
+    );
+
     if (param_type != exp_param_type) {
-        EMSG("param type error for obj_exists\n");
+        EMSG("Parameter type error: obj_get_all\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
     uint32_t obj_id_len = params[0].memref.size;
     uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
     if (!obj_id) {
-        EMSG("out of memory in obj_exists\n");
+        EMSG("Memory allocation failed: obj_get_all\n");
         return TEE_ERROR_OUT_OF_MEMORY;
     }
 
     TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
 
-    res = TEE_AllocatePersistentObjectEnumerator(&ctx->enum_handle);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate enumerator in obj_exists, res: 0x%x\n", res);
+    // 命中缓存时不打开对象
+    entry = read_cache_find(ctx->storage_id, obj_id, obj_id_len);
+    if (entry) {
         TEE_Free(obj_id);
-        return res;
+        read_cache.hits++;
+        entry->last_use = ++read_cache.clock;
+
+        if (params[1].memref.size < entry->size) {
+            params[1].memref.size = entry->size;
+            return TEE_ERROR_SHORT_BUFFER;
+        }
+
+        TEE_MemMove(params[1].memref.buffer, entry->data, entry->size);
+        params[1].memref.size = entry->size;
+        return TEE_SUCCESS;
     }
+    read_cache.misses++;
 
-    res = check_object_exists(ctx, obj_id, obj_id_len);
+    // 已经通过 OPEN 打开的对象读完后保留在句柄表中
+    bool opened = find_handle(ctx, obj_id, obj_id_len) != NULL;
+    res = open_handle(ctx, obj_id, obj_id_len, &h);
     TEE_Free(obj_id);
-    free_enum_handle(ctx);
 
-    if (res == TEE_SUCCESS) 
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to open object: obj_get_all, res: 0x%x\n", res);
+        return res;
+    }
+
+    TEE_ObjectInfo obj_info;
+    res = TEE_GetObjectInfo1(h->object, &obj_info);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to get object info: obj_get_all, res: 0x%x\n", res);
+        if (!opened)
+            release_handle(h);
+        return res;
+    }
+
+    res = TEE_SeekObjectData(h->object, 0, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to seek object: obj_get_all, res: 0x%x\n", res);
+        if (!opened)
+            release_handle(h);
+        return res;
+    }
+
+    // 先检查输出缓冲区大小, 再分块读出
+    uint32_t data_size = obj_info.dataSize;
+    if (params[1].memref.size < data_size) {
+        EMSG("Output buffer too small: obj_get_all, expected: %u, provided: %u\n", data_size, params[1].memref.size);
+        params[1].memref.size = data_size;
+        res = TEE_ERROR_SHORT_BUFFER;
+        goto out;
+    }
+
+    // 小对象读到缓存项中, 再拷贝给CA
+    entry = read_cache_alloc(ctx->storage_id, h->obj_id, h->obj_len, data_size);
+
+    uint32_t read_bytes = 0;
+    res = stream_read(ctx, h->object, entry ? entry->data : params[1].memref.buffer, data_size, &read_bytes);
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to read object data: obj_get_all, res: 0x%x\n", res);
+        goto out;
+    }
+
+    if (read_bytes != data_size) {
+        EMSG("Mismatch in read bytes: obj_get_all, expected: %u, read: %u\n", data_size, read_bytes);
+        res = TEE_ERROR_GENERIC;
+        goto out;
+    }
+
+    if (entry)
+        TEE_MemMove(params[1].memref.buffer, entry->data, data_size);
+    params[1].memref.size = read_bytes;
+
+out:
+    if (res != TEE_SUCCESS && entry)
+        read_cache_drop(entry);
+
+    if (!opened)
+        release_handle(h);
+    else
+        TEE_SeekObjectData(h->object, obj_info.dataPosition, TEE_DATA_SEEK_SET);
+
+    return res;
+}
+
+static TEE_Result obj_close(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t handle_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_NONE,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type == exp_param_type) {
+        // 不带句柄时关闭会话中所有对象
+        release_all_handles(ctx);
         return TEE_SUCCESS;
-    else if (res == TEE_ERROR_ITEM_NOT_FOUND) 
+    } else if (param_type != handle_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    h = lookup_handle(ctx, params[0].value.a);
+    if (!h) {
+        EMSG("handle 0x%x is not opened\n\n", params[0].value.a);
         return TEE_ERROR_ITEM_NOT_FOUND;
-    else {
-        EMSG("Error checking object existence, res: 0x%x\n", res);
-        return res;
     }
+
+    // 写出失败时句柄保持打开, 缓冲的记录不丢, CA可以重试
+    TEE_Result res = journal_flush(h);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    release_handle(h);
+
+    return TEE_SUCCESS;
 }
 
-static TEE_Result obj_create(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static TEE_Result obj_delete(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
     TEE_Result res;
+    struct obj_handle *h;
 
     struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
 
-    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE,
                                               TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
     if (param_type != exp_param_type) {
         EMSG("param type error\n\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
+    
     uint32_t obj_id_len = params[0].memref.size;
     uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
     if(!obj_id) {
@@ -185,225 +1731,473 @@ static TEE_Result obj_create(void *sess_ctx, uint32_t param_type, TEE_Param para
     }
     TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
 
-    uint32_t obj_size = params[1].value.a;
-
-    free_enum_handle(ctx);
-    res = TEE_AllocatePersistentObjectEnumerator(&ctx->enum_handle);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to allocate enumerator, res is 0x%x\n\n", res);
-        goto err_free_obj_id;
-    }
-
-    res = check_object_exists(ctx, obj_id, obj_id_len);
-    if (res != TEE_ERROR_ITEM_NOT_FOUND && res != TEE_ERROR_CORRUPT_OBJECT) {
-        goto err_free_enum_handle;
-    }
-
-    uint32_t access_flag = TEE_DATA_FLAG_ACCESS_READ |
-                          TEE_DATA_FLAG_ACCESS_WRITE |
-                          TEE_DATA_FLAG_ACCESS_WRITE_META;
+    // 对象要被删除, 还没写出的记录直接丢弃
+    h = find_handle(ctx, obj_id, obj_id_len);
+    if (h)
+        h->journal_len = 0;
 
-    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
-                                    obj_id, obj_id_len,
-                                    access_flag,
-                                    TEE_HANDLE_NULL,
-                                    NULL, 0,
-                                    &ctx->persistant_object);
+    res = open_handle(ctx, obj_id, obj_id_len, &h);
     if(res != TEE_SUCCESS) {
-        EMSG("Failed to obj_create object, res is 0x%x\n\n", res);
-        goto err_free_enum_handle;
+        goto err_free_obj_id;
     }
 
-    IMSG("Object created success\n\n");
+    read_cache_invalidate(obj_id, obj_id_len);
 
-    res = TEE_TruncateObjectData(ctx->persistant_object, obj_size);
+    res = TEE_CloseAndDeletePersistentObject1(h->object);
     if(res != TEE_SUCCESS) {
-        EMSG("Failed to truncate object, res is 0x%x\n\n", res);
-        goto err_close;
+        EMSG("Failed to obj_delete object, res is 0x%x\n\n", res);
+        goto err_free_obj_id;
     }
+    h->object = TEE_HANDLE_NULL;
 
-    IMSG("set object size success\n\n");
+    obj_dir_remove(obj_id, obj_id_len);
 
-    free_enum_handle(ctx);
+    release_handle(h);
     TEE_Free(obj_id);
-    
     return TEE_SUCCESS;
 
-err_close:
-   close_persistent_object(ctx);
-
-err_free_enum_handle:
-    free_enum_handle(ctx);
-
 err_free_obj_id:
     TEE_Free(obj_id);
 
     return res;
 }
-
-static TEE_Result obj_open(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static TEE_Result obj_rw_at(void *sess_ctx, uint32_t param_type, TEE_Param params[4], bool write)
 {
     TEE_Result res;
 
     struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
 
-    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_NONE,
-                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
-    if (param_type != exp_param_type) {
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_VALUE_INPUT,
+                                              write ? TEE_PARAM_TYPE_MEMREF_INPUT : TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                              TEE_PARAM_TYPE_NONE);
+    if ((param_type & ~0xF) != exp_param_type) {
         EMSG("param type error\n\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
-    uint32_t obj_id_len = params[0].memref.size;
-    uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
-    if(!obj_id) {
-        EMSG("out of memory\n\n");
-        return TEE_ERROR_OUT_OF_MEMORY;
-    }
-    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
 
-    res = open_persistent_object(ctx, obj_id, obj_id_len);
+    res = param_handle(ctx, param_type, params, &h);
+    if(res != TEE_SUCCESS)
+        return res;
+
+    if (write)
+        read_cache_invalidate(h->obj_id, h->obj_len);
+
+    uint64_t offset = ((uint64_t)params[1].value.b << 32) | params[1].value.a;
+    uint32_t count;
+
+    res = positional_io(ctx, h->object, write, offset, params[2].memref.buffer, params[2].memref.size, &count);
     if(res != TEE_SUCCESS) {
-        goto err_free_obj_id;
+        EMSG("Failed to %s object at 0x%llx, res is 0x%x\n\n", write ? "write" : "read",
+            (unsigned long long)offset, res);
+        return res;
     }
 
-    TEE_Free(obj_id);
+    params[2].memref.size = count;
+
     return TEE_SUCCESS;
+}
 
-err_free_obj_id:
-    TEE_Free(obj_id);
+/*
+ * 一次调用读写多个区间, 各区间的数据在 param[2] 中依次紧密排列
+ */
+static TEE_Result obj_rw_at_batch(void *sess_ctx, uint32_t param_type, TEE_Param params[4], bool write)
+{
+    TEE_Result res;
+
+    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+
+    struct obj_handle *h;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_MEMREF_INPUT,
+                                              write ? TEE_PARAM_TYPE_MEMREF_INPUT : TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                              TEE_PARAM_TYPE_VALUE_OUTPUT);
+    if ((param_type & ~0xF) != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    if (params[1].memref.size % sizeof(struct secure_storage_extent) ||
+        params[1].memref.size > SECURE_STORAGE_MAX_EXTENTS * sizeof(struct secure_storage_extent)) {
+        EMSG("extent list size %u error\n\n", params[1].memref.size);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    res = param_handle(ctx, param_type, params, &h);
+    if(res != TEE_SUCCESS)
+        return res;
 
+    uint32_t extent_num = params[1].memref.size / sizeof(struct secure_storage_extent);
+    uint8_t *data = params[2].memref.buffer;
+    uint32_t data_size = params[2].memref.size;
+    uint32_t done = 0, data_off = 0;
+    struct secure_storage_extent *extents;
+    uint32_t count;
+
+    // 区间表在共享内存中, CA 可以随时修改, 只读取一次, 检查和读写都用TA内的副本
+    extents = TEE_Malloc(extent_num ? params[1].memref.size : 1, 0);
+    if (!extents)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    TEE_MemMove(extents, params[1].memref.buffer, params[1].memref.size);
+
+    // 先检查所有区间的总长度, 避免写到一半才发现数据不够
+    for (uint32_t i = 0; i < extent_num; i++) {
+        if (extents[i].len > data_size - data_off) {
+            EMSG("data size %u is too small for the extents\n\n", data_size);
+            res = TEE_ERROR_SHORT_BUFFER;
+            goto out;
+        }
+        data_off += extents[i].len;
+    }
+
+    if (write)
+        read_cache_invalidate(h->obj_id, h->obj_len);
+
+    data_off = 0;
+    for (uint32_t i = 0; i < extent_num; i++) {
+        res = positional_io(ctx, h->object, write, extents[i].offset, data + data_off, extents[i].len, &count);
+        if (res != TEE_SUCCESS) {
+            EMSG("Failed to %s extent %u, res is 0x%x\n\n", write ? "write" : "read", i, res);
+            goto out;
+        }
+
+        data_off += count;
+        if (count < extents[i].len)
+            break;
+        done++;
+    }
+
+    params[2].memref.size = data_off;
+    params[3].value.a = done;
+    res = TEE_SUCCESS;
+
+out:
+    TEE_Free(extents);
     return res;
 }
 
-static TEE_Result obj_rename(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static uint32_t list_entry_size(uint32_t id_len)
 {
+    return (sizeof(struct secure_storage_list_entry) + id_len + 3) & ~3U;
+}
+
+// 从枚举器取下一个客户端可见的对象, 跳过TA内部对象和损坏的对象
+static TEE_Result list_next(struct secure_storage_ctx *ctx)
+{
+    struct list_state *list = &ctx->list;
     TEE_Result res;
 
+    while (true) {
+        list->id_len = sizeof(list->id);
+        res = TEE_GetNextPersistentObject(ctx->enum_handle, &list->info, list->id, &list->id_len);
+        if (res == TEE_ERROR_CORRUPT_OBJECT || res == TEE_ERROR_CORRUPT_OBJECT_2) {
+            EMSG("there is a corrupt object\n\n");
+            continue;
+        }
+        if (res != TEE_SUCCESS)
+            return res;
+
+        if (list->id_len && list->id[0] != 0) {
+            list->pending = true;
+            return TEE_SUCCESS;
+        }
+    }
+}
+
+static TEE_Result obj_list(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
     struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    struct list_state *list = &ctx->list;
+    struct secure_storage_list_entry entry;
+    TEE_Result res;
 
-    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INOUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
                                               TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
     if (param_type != exp_param_type) {
         EMSG("param type error\n\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
-    
-    uint32_t old_obj_id_len = params[0].memref.size;
-    uint8_t *old_obj_id = TEE_Malloc(old_obj_id_len, TEE_MALLOC_FILL_ZERO);
-    if(!old_obj_id) {
-        EMSG("out of memory\n\n");
-        return TEE_ERROR_OUT_OF_MEMORY;
-    }
-    TEE_MemMove(old_obj_id, params[0].memref.buffer, old_obj_id_len);
 
-    uint32_t new_obj_id_len = params[1].memref.size;
-    uint8_t *new_obj_id = TEE_Malloc(new_obj_id_len, TEE_MALLOC_FILL_ZERO);
-    if(!new_obj_id) {
-        EMSG("out of memory\n\n");
-        res = TEE_ERROR_OUT_OF_MEMORY;
-        goto err_free_old_obj_id;
-    }
-    TEE_MemMove(new_obj_id, params[1].memref.buffer, new_obj_id_len);
+    uint32_t cursor = params[0].value.a;
+    uint8_t *out = params[1].memref.buffer;
+    uint32_t out_size = params[1].memref.size;
+    uint32_t out_len = 0, count = 0, size;
+
+    if (cursor == 0) {
+        // 从头开始, 枚举器在会话中复用
+        if (ctx->enum_handle == TEE_HANDLE_NULL) {
+            res = TEE_AllocatePersistentObjectEnumerator(&ctx->enum_handle);
+            if (res != TEE_SUCCESS) {
+                EMSG("Failed to allocate enumerator, res is 0x%x\n\n", res);
+                return res;
+            }
+        }
 
-    res = open_persistent_object(ctx, old_obj_id, old_obj_id_len);
-    if(res != TEE_SUCCESS) {
-        goto err_free_new_obj_id;
+        list->cursor = 0;
+        list->pending = false;
+        res = TEE_StartPersistentObjectEnumerator(ctx->enum_handle, ctx->storage_id);
+        if (res == TEE_ERROR_ITEM_NOT_FOUND)
+            goto end;
+        if (res != TEE_SUCCESS) {
+            EMSG("Failed to start enumerator, res is 0x%x\n\n", res);
+            return res;
+        }
+    } else if (ctx->enum_handle == TEE_HANDLE_NULL || cursor != list->cursor) {
+        EMSG("list cursor %u is stale\n\n", cursor);
+        return TEE_ERROR_BAD_STATE;
     }
 
-    res = TEE_RenamePersistentObject(ctx->persistant_object, new_obj_id, new_obj_id_len);
-    if(res == TEE_ERROR_ACCESS_CONFLICT) {
-        goto err_close;
-    }else if(res != TEE_SUCCESS) {
-        EMSG("Failed to obj_rename object, res is 0x%x\n\n", res);
-        goto err_close;
+    while (true) {
+        if (!list->pending) {
+            res = list_next(ctx);
+            if (res == TEE_ERROR_ITEM_NOT_FOUND)
+                goto end;
+            if (res != TEE_SUCCESS) {
+                EMSG("Failed to enumerate objects, res is 0x%x\n\n", res);
+                return res;
+            }
+        }
+
+        size = list_entry_size(list->id_len);
+        if (out_size - out_len < size) {
+            // 一项都放不下时返回需要的大小, 该对象留到下一次
+            if (!count) {
+                params[1].memref.size = size;
+                return TEE_ERROR_SHORT_BUFFER;
+            }
+            break;
+        }
+
+        entry.id_len = list->id_len;
+        entry.data_size = list->info.dataSize;
+        entry.flags = list->info.handleFlags;
+        TEE_MemFill(out + out_len, 0, size);
+        TEE_MemMove(out + out_len, &entry, sizeof(entry));
+        TEE_MemMove(out + out_len + sizeof(entry), list->id, list->id_len);
+        out_len += size;
+        count++;
+        list->pending = false;
     }
 
-    TEE_Free(new_obj_id);
-    TEE_Free(old_obj_id);
+    list->cursor += count;
+    params[0].value.a = list->cursor;
+    params[0].value.b = count;
+    params[1].memref.size = out_len;
+
     return TEE_SUCCESS;
 
-err_close:
-   close_persistent_object(ctx);
+end:
+    // 枚举结束, 释放枚举器
+    free_enum_handle(ctx);
+    list->pending = false;
+    params[0].value.a = SECURE_STORAGE_LIST_END;
+    params[0].value.b = count;
+    params[1].memref.size = out_len;
+
+    return TEE_SUCCESS;
+}
+
+static TEE_Result obj_cache_stats(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
+    (void)sess_ctx;
+
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    if (param_type != exp_param_type) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
 
-err_free_new_obj_id:
-    TEE_Free(new_obj_id);
+    uint32_t entries = 0;
+    for (uint32_t i = 0; i < READ_CACHE_MAX_ENTRIES; i++) {
+        if (read_cache.entries[i].obj_id)
+            entries++;
+    }
 
-err_free_old_obj_id:
-    TEE_Free(old_obj_id);
+    params[0].value.a = read_cache.hits;
+    params[0].value.b = read_cache.misses;
+    params[1].value.a = entries;
+    params[1].value.b = read_cache.bytes;
 
-    return res;
+    return TEE_SUCCESS;
 }
 
-static TEE_Result obj_seek(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static TEE_Result obj_dir_stats(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
-    TEE_Result res;
-
-    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    (void)sess_ctx;
 
-    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_VALUE_INPUT,
+    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_VALUE_OUTPUT,
                                               TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
     if (param_type != exp_param_type) {
         EMSG("param type error\n\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    int32_t offset = params[1].value.a;
-    TEE_Whence whence = (TEE_Whence)params[1].value.b;
-    if(whence != TEE_DATA_SEEK_SET && whence != TEE_DATA_SEEK_CUR && whence != TEE_DATA_SEEK_END) {
-        EMSG("whence error\n\n");
-        return TEE_ERROR_BAD_PARAMETERS;
-    }
+    // 还没有加载时先加载, 停用的目录不再加载
+    bool ready = obj_dir_load() == TEE_SUCCESS;
+
+    params[0].value.a = ready;
+    params[0].value.b = ready ? obj_dir.hdr.count : 0;
+    params[1].value.a = ready ? obj_dir.hdr.capacity : 0;
+    params[1].value.b = OBJ_DIR_MAX_SLOTS;
 
-    res = TEE_SeekObjectData(ctx->persistant_object, offset, whence);
-    if(res != TEE_SUCCESS) {
-        EMSG("Failed to obj_seek object, res is 0x%x\n\n", res);
-        return res;
-    }
-    
     return TEE_SUCCESS;
 }
+/**********************************File Operation**********************************/
 
-static TEE_Result obj_write(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+/**********************************Compression**********************************/
+/*
+ * 压缩对象 : struct compress_header | 块 | 块 | ...
+ * 原始数据按 COMPRESS_BLOCK_SIZE 分块, 每块单独压缩, 块为 struct compress_block | 数据,
+ * 压缩后没有变小的块不压缩(stored_len == raw_len), 读写都只需要一块大小的缓冲区
+ * 对象先以全零的头创建, 写完所有块后再写头, 写到一半掉电时对象没有合法的头, GET_COMPRESSED 返回
+ * TEE_ERROR_BAD_FORMAT, 不会返回不完整的数据, 这时旧对象已经被覆盖
+ */
+#define COMPRESS_MAGIC          0x5A535353  // "SSSZ"
+#define COMPRESS_BLOCK_SIZE     IO_CHUNK_SIZE
+
+struct compress_header {
+    uint32_t magic;
+    uint32_t block_size;
+    uint32_t raw_size;
+    uint32_t stored_size;   // 头之后的字节数, 含块头
+};
+
+struct compress_block {
+    uint16_t raw_len;
+    uint16_t stored_len;
+};
+
+static TEE_Result copy_obj_id(TEE_Param *param, uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN], uint32_t *obj_id_len)
 {
-    TEE_Result res;
+    *obj_id_len = param->memref.size;
+    if (!*obj_id_len || *obj_id_len > TEE_OBJECT_ID_MAX_LEN) {
+        EMSG("object id length %u error\n\n", *obj_id_len);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+    TEE_MemMove(obj_id, param->memref.buffer, *obj_id_len);
+
+    return check_obj_id(obj_id, *obj_id_len);
+}
 
+static TEE_Result obj_put_compressed(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+{
     struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    struct compress_header hdr = { 0 };
+    TEE_ObjectHandle object;
+    uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t obj_id_len;
+    TEE_Result res;
 
     uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_INPUT,
-                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+                                              TEE_PARAM_TYPE_VALUE_OUTPUT, TEE_PARAM_TYPE_NONE);
     if (param_type != exp_param_type) {
         EMSG("param type error\n\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    uint32_t data_len = params[1].memref.size;
-    uint8_t *data = TEE_Malloc(data_len, TEE_MALLOC_FILL_ZERO);
-    if(!data) {
-        EMSG("Out of memory\n\n");
+    res = copy_obj_id(&params[0], obj_id, &obj_id_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    uint32_t raw_size = params[1].memref.size;
+    if (raw_size > SECURE_STORAGE_COMPRESS_MAX_SIZE) {
+        EMSG("data size %u is too large to compress\n\n", raw_size);
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
+
+    // 原始块放在会话的 io_buf 中, 哈希表 | 块头 + 压缩输出 一次申请
+    uint8_t *raw = get_io_buf(ctx);
+    if (!raw)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    uint32_t table_size = LZ77_HASH_SIZE * sizeof(uint32_t);
+    uint8_t *work = TEE_Malloc(table_size + sizeof(struct compress_block) + COMPRESS_BLOCK_SIZE, 0);
+    if (!work) {
+        EMSG("out of memory\n\n");
         return TEE_ERROR_OUT_OF_MEMORY;
     }
-    TEE_MemMove(data, params[1].memref.buffer, data_len);
 
-    res = TEE_WriteObjectData(ctx->persistant_object, data, data_len);
-    if(res != TEE_SUCCESS) {
-        EMSG("Failed to obj_write object, res is 0x%x\n\n", res);
-        goto err_free_data;
+    uint32_t *table = (uint32_t *)work;
+    struct compress_block *blk = (struct compress_block *)(work + table_size);
+    uint8_t *out = (uint8_t *)(blk + 1);
+
+    res = create_object(ctx, obj_id, obj_id_len, &hdr, sizeof(hdr), &object);
+    if (res != TEE_SUCCESS)
+        goto err_free_work;
+
+    // 创建后读写位置在 0, 块写在头之后
+    res = TEE_SeekObjectData(object, sizeof(hdr), TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        goto err_delete;
+
+    const uint8_t *src = params[1].memref.buffer;
+    for (uint32_t done = 0; done < raw_size; done += blk->raw_len) {
+        blk->raw_len = MIN(raw_size - done, (uint32_t)COMPRESS_BLOCK_SIZE);
+
+        // 压缩时会反复读输入, 先拷贝到TA内存
+        TEE_MemMove(raw, src + done, blk->raw_len);
+
+        // 输出最多 raw_len - 1 字节, 放不下就说明没有变小
+        uint32_t n = lz77_compress(raw, blk->raw_len, out, blk->raw_len - 1, table);
+        if (n) {
+            blk->stored_len = n;
+        } else {
+            blk->stored_len = blk->raw_len;
+            TEE_MemMove(out, raw, blk->raw_len);
+        }
+
+        res = TEE_WriteObjectData(object, blk, sizeof(*blk) + blk->stored_len);
+        if (res != TEE_SUCCESS)
+            goto err_delete;
+        hdr.stored_size += sizeof(*blk) + blk->stored_len;
     }
 
-    TEE_Free(data);
+    // 所有块写完后才写头
+    hdr.magic = COMPRESS_MAGIC;
+    hdr.block_size = COMPRESS_BLOCK_SIZE;
+    hdr.raw_size = raw_size;
+
+    res = TEE_SeekObjectData(object, 0, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        goto err_delete;
+
+    res = TEE_WriteObjectData(object, &hdr, sizeof(hdr));
+    if (res != TEE_SUCCESS)
+        goto err_delete;
+
+    TEE_CloseObject(object);
+    TEE_Free(work);
+
+    params[2].value.a = raw_size;
+    params[2].value.b = sizeof(hdr) + hdr.stored_size;
+
     return TEE_SUCCESS;
 
-err_free_data:
-    TEE_Free(data);
+err_delete:
+    EMSG("Failed to write compressed object, res is 0x%x\n\n", res);
+    if (TEE_CloseAndDeletePersistentObject1(object) == TEE_SUCCESS)
+        obj_dir_remove(obj_id, obj_id_len);
+
+err_free_work:
+    TEE_Free(work);
 
     return res;
 }
 
-static TEE_Result obj_read(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static TEE_Result obj_get_compressed(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
-    TEE_Result res;
-
     struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    TEE_ObjectInfo obj_info = { 0 };
+    struct compress_header hdr;
+    struct compress_block blk;
+    uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+    uint32_t obj_id_len;
+    uint8_t *in = NULL;
+    struct obj_handle *h;
+    uint32_t count;
+    TEE_Result res;
 
     uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT, TEE_PARAM_TYPE_MEMREF_OUTPUT,
                                               TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
@@ -412,135 +2206,307 @@ static TEE_Result obj_read(void *sess_ctx, uint32_t param_type, TEE_Param params
         return TEE_ERROR_BAD_PARAMETERS;
     }
 
-    uint32_t data_len = params[1].memref.size;
-    uint8_t *data = TEE_Malloc(data_len, TEE_MALLOC_FILL_ZERO);
-    if(!data) {
-        EMSG("Out of memory\n\n");
+    res = copy_obj_id(&params[0], obj_id, &obj_id_len);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    // 解压输出放在会话的 io_buf 中
+    uint8_t *raw = get_io_buf(ctx);
+    if (!raw)
         return TEE_ERROR_OUT_OF_MEMORY;
+
+    // 已经通过 OPEN 打开的对象读完后保留在句柄表中, 并恢复读写位置
+    bool opened = find_handle(ctx, obj_id, obj_id_len) != NULL;
+    res = open_handle(ctx, obj_id, obj_id_len, &h);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_GetObjectInfo1(h->object, &obj_info);
+    if (res != TEE_SUCCESS)
+        goto out;
+
+    res = TEE_SeekObjectData(h->object, 0, TEE_DATA_SEEK_SET);
+    if (res != TEE_SUCCESS)
+        goto out;
+
+    res = TEE_ReadObjectData(h->object, &hdr, sizeof(hdr), &count);
+    if (res != TEE_SUCCESS)
+        goto out;
+
+    // 头中的大小都要和对象一致, 不是 PUT_COMPRESSED 写入的对象或没有写完的对象不解压
+    if (count != sizeof(hdr) || hdr.magic != COMPRESS_MAGIC ||
+        hdr.block_size != COMPRESS_BLOCK_SIZE ||
+        hdr.raw_size > SECURE_STORAGE_COMPRESS_MAX_SIZE ||
+        hdr.stored_size != obj_info.dataSize - sizeof(hdr)) {
+        EMSG("object is not compressed\n\n");
+        res = TEE_ERROR_BAD_FORMAT;
+        goto out;
     }
 
-    uint32_t read_count;
-    res = TEE_ReadObjectData(ctx->persistant_object, data, data_len, &read_count);
-    if(res != TEE_SUCCESS) {
-        EMSG("Failed to obj_read object, res is 0x%x\n\n", res);
-        goto err_free_data;
+    if (params[1].memref.size < hdr.raw_size) {
+        params[1].memref.size = hdr.raw_size;
+        res = TEE_ERROR_SHORT_BUFFER;
+        goto out;
     }
 
-    TEE_MemMove(params[1].memref.buffer, data, read_count);
-    params[1].memref.size = read_count;
+    in = TEE_Malloc(COMPRESS_BLOCK_SIZE, 0);
+    if (!in) {
+        EMSG("out of memory\n\n");
+        res = TEE_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
 
-    TEE_Free(data);
-    return TEE_SUCCESS;
+    // 逐块读入TA内存解压, 每块解压完成后再拷贝给CA
+    uint8_t *dst = params[1].memref.buffer;
+    uint32_t stored = 0;
+    for (uint32_t done = 0; done < hdr.raw_size; done += blk.raw_len) {
+        res = TEE_ReadObjectData(h->object, &blk, sizeof(blk), &count);
+        if (res != TEE_SUCCESS)
+            goto out;
+
+        if (count != sizeof(blk) ||
+            blk.raw_len != MIN(hdr.raw_size - done, (uint32_t)COMPRESS_BLOCK_SIZE) ||
+            !blk.stored_len || blk.stored_len > blk.raw_len) {
+            res = TEE_ERROR_CORRUPT_OBJECT;
+            goto out;
+        }
+
+        uint8_t *buf = blk.stored_len == blk.raw_len ? raw : in;
+        res = TEE_ReadObjectData(h->object, buf, blk.stored_len, &count);
+        if (res != TEE_SUCCESS)
+            goto out;
+        if (count != blk.stored_len) {
+            res = TEE_ERROR_CORRUPT_OBJECT;
+            goto out;
+        }
 
-err_free_data:
-    TEE_Free(data);
+        if (buf == in) {
+            res = lz77_decompress(in, blk.stored_len, raw, blk.raw_len);
+            if (res != TEE_SUCCESS) {
+                EMSG("Failed to decompress object, res is 0x%x\n\n", res);
+                goto out;
+            }
+        }
+
+        TEE_MemMove(dst + done, raw, blk.raw_len);
+        stored += sizeof(blk) + blk.stored_len;
+    }
+
+    if (stored != hdr.stored_size) {
+        res = TEE_ERROR_CORRUPT_OBJECT;
+        goto out;
+    }
+    params[1].memref.size = hdr.raw_size;
+
+out:
+    if (in)
+        TEE_Free(in);
+
+    if (!opened)
+        release_handle(h);
+    else
+        TEE_SeekObjectData(h->object, obj_info.dataPosition, TEE_DATA_SEEK_SET);
 
     return res;
 }
+/**********************************Compression**********************************/
+
+
+/**********************************Batch Transaction**********************************/
+/*
+ * 批量提交分三步:
+ * 1. 每个 put 的数据写入临时对象 TX_TEMP_ID(i)
+ * 2. 创建提交记录 TX_COMMIT_ID, 内容为所有操作(不含数据), 创建成功即为提交点
+ * 3. 依次执行: put 删除旧对象后把临时对象重命名为目标名, delete 删除目标对象, 最后删除提交记录
+ *
+ * 提交点之前掉电, 临时对象在下次加载TA时删除; 提交点之后掉电, 下次加载TA时按提交记录重做第3步,
+ * 临时对象已经不存在的 put 说明已经完成, 所以重做可以重复执行
+ */
+#define TX_RECORD_MAGIC         0x58545353  // "SSTX"
+#define TX_RECORD_MAX_SIZE      (2 * sizeof(uint32_t) + SECURE_STORAGE_BATCH_MAX_OPS * \
+                                 (sizeof(struct secure_storage_batch_op) + TEE_OBJECT_ID_MAX_LEN))
+#define TX_TEMP_ID_LEN          6
 
-static TEE_Result obj_get_all(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static const uint8_t tx_commit_id[] = "\0secure_storage.tx";
+#define TX_COMMIT_ID_LEN        (sizeof(tx_commit_id) - 1)
+
+static void tx_temp_id(uint32_t idx, uint8_t id[TX_TEMP_ID_LEN])
 {
-    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    id[0] = 0;
+    id[1] = 't';
+    id[2] = 'x';
+    id[3] = '.';
+    id[4] = '0' + idx / 10;
+    id[5] = '0' + idx % 10;
+}
+
+static TEE_Result delete_object(const uint8_t *obj_id, uint32_t obj_id_len)
+{
+    TEE_ObjectHandle object;
     TEE_Result res;
 
-    uint32_t exp_param_type = TEE_PARAM_TYPES(
-        TEE_PARAM_TYPE_MEMREF_INPUT,
-        TEE_PARAM_TYPE_MEMREF_OUTPUT,
-        TEE_PARAM_TYPE_NONE,
-        TEE_PARAM_TYPE_NONE
-    );
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, obj_id_len,
+                                    TEE_DATA_FLAG_ACCESS_WRITE_META, &object);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND)
+        return TEE_SUCCESS;
+    if (res != TEE_SUCCESS)
+        return res;
 
-    if (param_type != exp_param_type) {
-        EMSG("Parameter type error: obj_get_all\n");
-        return TEE_ERROR_BAD_PARAMETERS;
-    }
+    res = TEE_CloseAndDeletePersistentObject1(object);
+    if (res == TEE_SUCCESS)
+        obj_dir_remove(obj_id, obj_id_len);
 
-    uint32_t obj_id_len = params[0].memref.size;
-    uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
-    if (!obj_id) {
-        EMSG("Memory allocation failed: obj_get_all\n");
-        return TEE_ERROR_OUT_OF_MEMORY;
-    }
+    return res;
+}
 
-    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
-    res = open_persistent_object(ctx, obj_id, obj_id_len);
-    TEE_Free(obj_id);
+// 执行提交记录中的操作, 提交后和掉电恢复时共用
+static TEE_Result tx_apply(const uint8_t *rec, uint32_t rec_len)
+{
+    uint8_t temp_id[TX_TEMP_ID_LEN];
+    TEE_ObjectHandle temp, old;
+    uint32_t hdr[2];
+    uint64_t off = sizeof(hdr);
+    TEE_Result res;
 
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to open object: obj_get_all, res: 0x%x\n", res);
-        return res;
-    }
+    // 提交记录可能被截断或损坏, 每次读取前都用64位计算检查长度, 避免回绕
+    if (rec_len < sizeof(hdr))
+        return TEE_ERROR_CORRUPT_OBJECT;
+    TEE_MemMove(hdr, rec, sizeof(hdr));
 
-    TEE_ObjectInfo obj_info;
-    res = TEE_GetObjectInfo1(ctx->persistant_object, &obj_info);
-    if (res != TEE_SUCCESS) {
-        EMSG("Failed to get object info: obj_get_all, res: 0x%x\n", res);
-        close_persistent_object(ctx);
-        return res;
-    }
+    for (uint32_t i = 0; i < hdr[1]; i++) {
+        struct secure_storage_batch_op op;
+        const uint8_t *obj_id;
 
-    uint32_t data_size = obj_info.dataSize;
-    uint8_t *data_buffer = TEE_Malloc(data_size, TEE_MALLOC_FILL_ZERO);
-    if (!data_buffer) {
-        EMSG("Memory allocation failed for data_buffer: obj_get_all\n");
-        close_persistent_object(ctx);
-        return TEE_ERROR_OUT_OF_MEMORY;
+        if (off + sizeof(op) > rec_len)
+            return TEE_ERROR_CORRUPT_OBJECT;
+        TEE_MemMove(&op, rec + off, sizeof(op));
+        if (off + sizeof(op) + op.id_len > rec_len)
+            return TEE_ERROR_CORRUPT_OBJECT;
+        obj_id = rec + off + sizeof(op);
+        off += sizeof(op) + (uint64_t)op.id_len;
+
+        read_cache_invalidate(obj_id, op.id_len);
+
+        if (op.type == SECURE_STORAGE_BATCH_DELETE) {
+            res = delete_object(obj_id, op.id_len);
+            if (res != TEE_SUCCESS)
+                return res;
+            continue;
+        }
+
+        tx_temp_id(i, temp_id);
+        res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, temp_id, TX_TEMP_ID_LEN,
+                                        TEE_DATA_FLAG_ACCESS_WRITE_META, &temp);
+        if (res == TEE_ERROR_ITEM_NOT_FOUND)
+            continue;
+        if (res != TEE_SUCCESS)
+            return res;
+
+        // 目标已存在时删除, 目录中的条目保留给重命名后的对象
+        res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, op.id_len,
+                                        TEE_DATA_FLAG_ACCESS_WRITE_META, &old);
+        if (res == TEE_SUCCESS) {
+            res = TEE_CloseAndDeletePersistentObject1(old);
+        } else if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+            obj_dir_add(obj_id, op.id_len);
+            res = TEE_SUCCESS;
+        }
+
+        if (res == TEE_SUCCESS)
+            res = TEE_RenamePersistentObject(temp, obj_id, op.id_len);
+        TEE_CloseObject(temp);
+        if (res != TEE_SUCCESS)
+            return res;
+
+        obj_dir_remove(temp_id, TX_TEMP_ID_LEN);
     }
 
-    uint32_t read_bytes = 0;
-    res = TEE_ReadObjectData(ctx->persistant_object, data_buffer, data_size, &read_bytes);
+    return TEE_SUCCESS;
+}
+
+static TEE_Result tx_finish(const uint8_t *rec, uint32_t rec_len)
+{
+    TEE_Result res;
+
+    res = tx_apply(rec, rec_len);
     if (res != TEE_SUCCESS) {
-        EMSG("Failed to read object data: obj_get_all, res: 0x%x\n", res);
-        TEE_Free(data_buffer);
-        close_persistent_object(ctx);
+        EMSG("Failed to apply the batch, it is completed at next TA load, res is 0x%x\n\n", res);
         return res;
     }
 
-    if (read_bytes != data_size) {
-        EMSG("Mismatch in read bytes: obj_get_all, expected: %u, read: %u\n", data_size, read_bytes);
-        TEE_Free(data_buffer);
-        close_persistent_object(ctx);
-        return TEE_ERROR_GENERIC;
-    }
+    return delete_object(tx_commit_id, TX_COMMIT_ID_LEN);
+}
 
-    if (params[1].memref.size < data_size) {
-        EMSG("Output buffer too small: obj_get_all, expected: %u, provided: %u\n", data_size, params[1].memref.size);
-        TEE_Free(data_buffer);
-        close_persistent_object(ctx);
-        return TEE_ERROR_SHORT_BUFFER;
+// 提交记录还在说明上一次批量已提交但没有执行完, 重做并删除提交记录; 没有提交记录时直接返回成功
+static TEE_Result tx_redo(void)
+{
+    TEE_ObjectHandle object;
+    TEE_ObjectInfo info;
+    uint32_t read_count;
+    uint8_t *rec = NULL;
+    TEE_Result res;
+
+    if (check_object_exists(TEE_STORAGE_PRIVATE, tx_commit_id, TX_COMMIT_ID_LEN) != TEE_SUCCESS)
+        return TEE_SUCCESS;
+
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, tx_commit_id, TX_COMMIT_ID_LEN,
+                                    TEE_DATA_FLAG_ACCESS_READ, &object);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    res = TEE_GetObjectInfo1(object, &info);
+    if (res == TEE_SUCCESS && info.dataSize > TX_RECORD_MAX_SIZE)
+        res = TEE_ERROR_CORRUPT_OBJECT;
+    if (res == TEE_SUCCESS) {
+        rec = TEE_Malloc(info.dataSize, TEE_MALLOC_FILL_ZERO);
+        res = rec ? TEE_ReadObjectData(object, rec, info.dataSize, &read_count) : TEE_ERROR_OUT_OF_MEMORY;
     }
+    TEE_CloseObject(object);
+    if (res != TEE_SUCCESS)
+        goto out;
 
-    TEE_MemMove(params[1].memref.buffer, data_buffer, data_size);
-    params[1].memref.size = read_bytes;
+    IMSG("redo the committed batch\n\n");
+    res = TEE_ERROR_CORRUPT_OBJECT;
+    if (read_count >= 2 * sizeof(uint32_t) && *(uint32_t *)rec == TX_RECORD_MAGIC)
+        res = tx_finish(rec, read_count);
 
-    TEE_Free(data_buffer);
-    close_persistent_object(ctx);
+out:
+    if (rec)
+        TEE_Free(rec);
 
-    return TEE_SUCCESS;
+    return res;
 }
 
-
-static TEE_Result obj_close(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+// 加载TA时调用, 完成已提交的批量操作, 清理未提交的临时对象
+static void tx_recover(void)
 {
-    (void)params;
+    uint8_t temp_id[TX_TEMP_ID_LEN];
+    TEE_Result res;
 
-    struct secure_storage_ctx *ctx = (struct secure_storage_ctx *)sess_ctx;
+    res = tx_redo();
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to recover the batch, res is 0x%x\n\n", res);
+        return;
+    }
 
-    uint32_t exp_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE,
-                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
-    if (param_type != exp_param_type) {
-        EMSG("param type error\n\n");
-        return TEE_ERROR_BAD_PARAMETERS;
+    for (uint32_t i = 0; i < SECURE_STORAGE_BATCH_MAX_OPS; i++) {
+        tx_temp_id(i, temp_id);
+        if (check_object_exists(TEE_STORAGE_PRIVATE, temp_id, TX_TEMP_ID_LEN) == TEE_SUCCESS)
+            delete_object(temp_id, TX_TEMP_ID_LEN);
     }
-    
-    TEE_CloseObject(ctx->persistant_object);
-    ctx->persistant_object = TEE_HANDLE_NULL;
-    free_ctx_obj(ctx);
+}
 
-    return TEE_SUCCESS;
+static void tx_discard(uint32_t staged)
+{
+    uint8_t temp_id[TX_TEMP_ID_LEN];
+
+    for (uint32_t i = 0; i < staged; i++) {
+        tx_temp_id(i, temp_id);
+        delete_object(temp_id, TX_TEMP_ID_LEN);
+    }
 }
 
-static TEE_Result obj_delete(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
+static TEE_Result obj_batch(void *sess_ctx, uint32_t param_type, TEE_Param params[4])
 {
     TEE_Result res;
 
@@ -552,36 +2518,143 @@ static TEE_Result obj_delete(void *sess_ctx, uint32_t param_type, TEE_Param para
         EMSG("param type error\n\n");
         return TEE_ERROR_BAD_PARAMETERS;
     }
-    
-    uint32_t obj_id_len = params[0].memref.size;
-    uint8_t *obj_id = TEE_Malloc(obj_id_len, TEE_MALLOC_FILL_ZERO);
-    if(!obj_id) {
-        EMSG("out of memory\n\n");
+
+    // 提交记录和临时对象只在 TEE_STORAGE_PRIVATE 中, 掉电恢复时不知道会话选择的存储
+    if (ctx->storage_id != TEE_STORAGE_PRIVATE) {
+        EMSG("batch is only supported on TEE_STORAGE_PRIVATE\n\n");
+        return TEE_ERROR_NOT_SUPPORTED;
+    }
+
+    // 上一次批量的提交记录还在时, 它的临时对象仍是已提交的数据, 必须先完成它再暂存新的批量,
+    // 否则新的临时对象会覆盖它们. 完成不了时拒绝新的批量, 提交记录留给下一次调用或下次加载TA
+    res = tx_redo();
+    if (res != TEE_SUCCESS) {
+        EMSG("Failed to finish the pending batch, res is 0x%x\n\n", res);
+        return TEE_ERROR_BUSY;
+    }
+
+    // 提交记录: magic | 操作数 | (struct secure_storage_batch_op | name), ...
+    // 操作列表在共享内存中, 操作头和对象名只读一次, 复制到提交记录中, 校验和执行都使用这份数据,
+    // put 的数据不复制, 暂存时经过 io_buf 直接写入临时对象
+    uint8_t *rec = TEE_Malloc(TX_RECORD_MAX_SIZE, TEE_MALLOC_FILL_ZERO);
+    if (!rec) {
+        EMSG("Out of memory\n\n");
         return TEE_ERROR_OUT_OF_MEMORY;
     }
-    TEE_MemMove(obj_id, params[0].memref.buffer, obj_id_len);
 
-    res = open_persistent_object(ctx, obj_id, obj_id_len);
-    if(res != TEE_SUCCESS) {
-        goto err_free_obj_id;
+    const uint8_t *in = params[0].memref.buffer;
+    uint32_t in_len = params[0].memref.size;
+    struct secure_storage_batch_op op;
+    uint32_t data_off[SECURE_STORAGE_BATCH_MAX_OPS], data_len[SECURE_STORAGE_BATCH_MAX_OPS];
+    uint32_t off = 0, rec_len = 2 * sizeof(uint32_t), op_num = 0;
+
+    while (off < in_len) {
+        if (in_len - off < sizeof(op) || op_num == SECURE_STORAGE_BATCH_MAX_OPS) {
+            res = TEE_ERROR_BAD_PARAMETERS;
+            goto err_free_rec;
+        }
+        TEE_MemMove(&op, in + off, sizeof(op));
+        off += sizeof(op);
+
+        if ((op.type != SECURE_STORAGE_BATCH_PUT && op.type != SECURE_STORAGE_BATCH_DELETE) ||
+            (op.type == SECURE_STORAGE_BATCH_DELETE && op.data_len) ||
+            !op.id_len || op.id_len > TEE_OBJECT_ID_MAX_LEN ||
+            op.id_len > in_len - off || op.data_len > in_len - off - op.id_len) {
+            EMSG("batch operation %u error\n\n", op_num);
+            res = TEE_ERROR_BAD_PARAMETERS;
+            goto err_free_rec;
+        }
+
+        // 提交记录中不保存数据
+        data_off[op_num] = off + op.id_len;
+        data_len[op_num] = op.data_len;
+        op.data_len = 0;
+        TEE_MemMove(rec + rec_len, &op, sizeof(op));
+        TEE_MemMove(rec + rec_len + sizeof(op), in + off, op.id_len);
+
+        res = check_obj_id(rec + rec_len + sizeof(op), op.id_len);
+        if (res != TEE_SUCCESS)
+            goto err_free_rec;
+
+        rec_len += sizeof(op) + op.id_len;
+        off = data_off[op_num] + data_len[op_num];
+        op_num++;
     }
 
-    res = TEE_CloseAndDeletePersistentObject1(ctx->persistant_object);
-    if(res != TEE_SUCCESS) {
-        EMSG("Failed to obj_delete object, res is 0x%x\n\n", res);
-        goto err_free_obj_id;
+    uint32_t hdr[2] = { TX_RECORD_MAGIC, op_num };
+    TEE_MemMove(rec, hdr, sizeof(hdr));
+
+    // 暂存: 关闭本会话中的同名对象, 确认没有被其他会话打开, put 的数据写入临时对象
+    uint8_t temp_id[TX_TEMP_ID_LEN];
+    TEE_ObjectHandle object;
+    uint32_t staged = 0;
+
+    off = 2 * sizeof(uint32_t);
+    for (uint32_t i = 0; i < op_num; i++) {
+        struct obj_handle *h;
+        uint8_t *obj_id;
+
+        TEE_MemMove(&op, rec + off, sizeof(op));
+        obj_id = rec + off + sizeof(op);
+        off += sizeof(op) + op.id_len;
+
+        h = find_handle(ctx, obj_id, op.id_len);
+        if (h)
+            release_handle(h);
+
+        res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE, obj_id, op.id_len,
+                                        TEE_DATA_FLAG_ACCESS_WRITE_META, &object);
+        if (res == TEE_SUCCESS)
+            TEE_CloseObject(object);
+        else if (res != TEE_ERROR_ITEM_NOT_FOUND)
+            goto err_discard;
+
+        if (op.type != SECURE_STORAGE_BATCH_PUT)
+            continue;
+
+        tx_temp_id(i, temp_id);
+        obj_dir_add(temp_id, TX_TEMP_ID_LEN);
+        staged = i + 1;
+
+        res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, temp_id, TX_TEMP_ID_LEN,
+                                        TEE_DATA_FLAG_ACCESS_WRITE | TEE_DATA_FLAG_ACCESS_WRITE_META |
+                                        TEE_DATA_FLAG_OVERWRITE,
+                                        TEE_HANDLE_NULL, NULL, 0, &object);
+        if (res != TEE_SUCCESS)
+            goto err_discard;
+
+        res = stream_write(ctx, object, in + data_off[i], data_len[i]);
+        TEE_CloseObject(object);
+        if (res != TEE_SUCCESS)
+            goto err_discard;
     }
-    ctx->persistant_object = TEE_HANDLE_NULL;
 
-    free_ctx_obj(ctx);
-    return TEE_SUCCESS;
+    // 提交点, 带初始数据的创建是原子的. 创建失败时不删除目录中的条目, 这次调用不一定是它的添加者,
+    // 目录只需要是实际对象的超集, 多余的条目只多一次探测
+    obj_dir_add(tx_commit_id, TX_COMMIT_ID_LEN);
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE, tx_commit_id, TX_COMMIT_ID_LEN,
+                                    TEE_DATA_FLAG_ACCESS_READ, TEE_HANDLE_NULL,
+                                    rec, rec_len, &object);
+    if (res != TEE_SUCCESS)
+        goto err_discard;
+    TEE_CloseObject(object);
 
-err_free_obj_id:
-    TEE_Free(obj_id);
+    res = tx_finish(rec, rec_len);
+
+    TEE_Free(rec);
+
+    return res;
+
+err_discard:
+    EMSG("Failed to stage the batch, res is 0x%x\n\n", res);
+    tx_discard(staged);
+
+err_free_rec:
+    TEE_Free(rec);
 
     return res;
 }
-/**********************************File Operation**********************************/
+/**********************************Batch Transaction**********************************/
 
 /*******************************************************************************
  * Mandatory TA functions.
@@ -589,17 +2662,37 @@ err_free_obj_id:
 
 TEE_Result TA_CreateEntryPoint(void)
 {
+    tx_recover();
+
     return TEE_SUCCESS;
 }
 
 void TA_DestroyEntryPoint(void)
 {
+    obj_dir_release();
+    read_cache_release();
+    kv_release();
 }
 
 TEE_Result TA_OpenSessionEntryPoint(uint32_t param_type, TEE_Param params[4], void **sess_ctx)
 {
-    (void)param_type;
-    (void)params;
+    uint32_t storage_param_type = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT, TEE_PARAM_TYPE_NONE,
+                                                  TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE);
+    uint32_t storage_id = TEE_STORAGE_PRIVATE;
+
+    // 可选的 param[0] 选择存储, 见 include/secure_storage.h
+    if (param_type == storage_param_type) {
+        storage_id = params[0].value.a;
+        if (storage_id != TEE_STORAGE_PRIVATE && storage_id != TEE_STORAGE_PRIVATE_REE &&
+            storage_id != TEE_STORAGE_PRIVATE_RPMB) {
+            EMSG("storage 0x%x is not supported\n\n", storage_id);
+            return TEE_ERROR_BAD_PARAMETERS;
+        }
+    } else if (param_type != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE,
+                                              TEE_PARAM_TYPE_NONE, TEE_PARAM_TYPE_NONE)) {
+        EMSG("param type error\n\n");
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
 
     struct secure_storage_ctx *ctx = TEE_Malloc(sizeof(struct secure_storage_ctx), TEE_MALLOC_FILL_ZERO);
     if(!ctx) {
@@ -607,6 +2700,11 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_type, TEE_Param params[4], vo
         return TEE_ERROR_OUT_OF_MEMORY;
     }
 
+    ctx->storage_id = storage_id;
+
+    for(uint32_t i = 0; i < SECURE_STORAGE_MAX_HANDLES; i++)
+        ctx->handles[i].gen = 1;
+
     *sess_ctx = ctx;
 
     return TEE_SUCCESS;
@@ -616,9 +2714,9 @@ void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
     struct secure_storage_ctx *ctx = sess_ctx;
 
-    close_persistent_object(ctx);
+    release_all_handles(ctx);
     free_enum_handle(ctx);
-    free_ctx_obj(ctx);
+    TEE_Free(ctx->io_buf);
 
     TEE_Free(ctx);
 }
@@ -656,6 +2754,63 @@ TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx, uint32_t cmd, uint32_t par
         case SECURE_STORAGE_CMD_GET_ALL:
             return obj_get_all(sess_ctx, param_type, params);
 
+        case SECURE_STORAGE_CMD_READ_AT:
+            return obj_rw_at(sess_ctx, param_type, params, false);
+
+        case SECURE_STORAGE_CMD_WRITE_AT:
+            return obj_rw_at(sess_ctx, param_type, params, true);
+
+        case SECURE_STORAGE_CMD_READ_AT_BATCH:
+            return obj_rw_at_batch(sess_ctx, param_type, params, false);
+
+        case SECURE_STORAGE_CMD_WRITE_AT_BATCH:
+            return obj_rw_at_batch(sess_ctx, param_type, params, true);
+
+        case SECURE_STORAGE_CMD_BATCH:
+            return obj_batch(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_KV_PUT:
+            return kv_put(param_type, params);
+
+        case SECURE_STORAGE_CMD_KV_GET:
+            return kv_get(param_type, params);
+
+        case SECURE_STORAGE_CMD_KV_DELETE:
+            return kv_delete(param_type, params);
+
+        case SECURE_STORAGE_CMD_KV_SCAN:
+            return kv_scan(param_type, params);
+
+        case SECURE_STORAGE_CMD_KV_COMPACT:
+            return kv_compact(param_type, params);
+
+        case SECURE_STORAGE_CMD_KV_STATS:
+            return kv_stats(param_type, params);
+
+        case SECURE_STORAGE_CMD_CACHE_STATS:
+            return obj_cache_stats(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_LIST:
+            return obj_list(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_PUT_COMPRESSED:
+            return obj_put_compressed(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_GET_COMPRESSED:
+            return obj_get_compressed(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_APPEND:
+            return obj_append(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_FLUSH:
+            return obj_flush(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_CREATE_WITH_DATA:
+            return obj_create_with_data(sess_ctx, param_type, params);
+
+        case SECURE_STORAGE_CMD_DIR_STATS:
+            return obj_dir_stats(sess_ctx, param_type, params);
+
         default:
             return TEE_ERROR_BAD_PARAMETERS;
     }
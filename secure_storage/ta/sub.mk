@@ -1,5 +1,7 @@
 global-incdirs-y += include
 srcs-y += secure_storage.c
+srcs-y += kv_store.c
+srcs-y += lz77.c
 
 # To remove a certain compiler flag, add a line like this
 # cflags-template_ta.c-y += -Wno-strict-prototypes
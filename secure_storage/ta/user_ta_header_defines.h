@@ -13,6 +13,10 @@
 
 #define TA_STACK_SIZE		(2 * 1024)
 
-#define TA_DATA_SIZE		(32 * 1024)
+/*
+ * 堆的最坏情况: 对象目录 24KB(扩容时), 读缓存 16KB, KV 约 20KB, 压缩/批量的临时缓冲区 8KB,
+ * 共约 68KB; 每个会话另有 4KB 的 io_buf, 每个有 APPEND 缓冲的句柄 4KB(最多 8 个)
+ */
+#define TA_DATA_SIZE		(128 * 1024)
 
 #endif /* USER_TA_HEADER_DEFINES_H */